@@ -23,11 +23,27 @@ uniform sampler2D water_displ_tex;
 uniform float water_scrolling_t = 0;
 
 #ifdef _VERTEX
+#ifdef FACE_INSTANCES
+	// FaceInstance: cube faces only, pos and face packed into one uint
+	layout(location = 0) in uint	pos_face;
+	layout(location = 1) in float	texid;
+	layout(location = 2) in vec2	quad_size; // size of greedy merged faces along the 2 face axes
+#else
 	layout(location = 0) in vec3	voxel_pos; // pos of voxel instance in chunk
 	layout(location = 1) in uint	meshid;
 	layout(location = 2) in float	texid;
+	layout(location = 3) in vec2	quad_size; // size of greedy merged faces along the 2 face axes
+#endif
 	
-	uniform vec3 chunk_pos;
+	// per draw data of the multidraw (ChunkDrawCommands::DrawData)
+	struct ChunkDraw {
+		vec3	chunk_pos;
+		float	voxel_scale; // size of voxels in blocks, >1 for lod chunks
+	};
+	layout(std430, binding = 4) restrict readonly buffer ChunkDraws {
+		ChunkDraw chunk_draws[];
+	};
+	uniform uint draw_offset; // first draw of the current multidraw, gl_DrawID restarts at 0 for every multidraw
 	
 	uniform float damage;
 	uniform ivec3 damaged_block;
@@ -145,16 +161,40 @@ uniform float water_scrolling_t = 0;
 
 	//
 	void main () {
+		ChunkDraw draw = chunk_draws[draw_offset + uint(gl_DrawID)];
+		vec3 chunk_pos = draw.chunk_pos;
+		float voxel_scale = draw.voxel_scale;
+		
+	#ifdef FACE_INSTANCES
+		uint meshid = (pos_face >> 21u) & 7u;
+		vec3 pos_in_chunk = vec3(uvec3(pos_face, pos_face >> 7u, pos_face >> 14u) & 127u) - 1.0;
+	#else
+		vec3 pos_in_chunk = voxel_pos * FIXEDPOINT_FAC;
+	#endif
+		
 		BlockMeshVertex v = block_meshes.vertices[meshid][gl_VertexID];
 		vec3 mesh_pos_model		= v.pos.xyz;
 		//vec3 mesh_norm_model	= v.normal.xyz;
 		vec2 uv					= v.uv.xy;
 		
-		vec3 vox_pos_world = voxel_pos * FIXEDPOINT_FAC + chunk_pos;
-		vec3 vert_pos_world = mesh_pos_model + vox_pos_world;
+		bool merged = quad_size != vec2(1.0);
+		if (merged) {
+			// stretch face quad (meshid is the face) along its 2 axes and tile the texture along with it
+			uint axis = meshid / 2u;
+			vec3 size3 = axis == 0u ? vec3(1.0, quad_size) : axis == 1u ? vec3(quad_size.x, 1.0, quad_size.y) : vec3(quad_size, 1.0);
+			
+			mesh_pos_model *= size3;
+			uv *= vec2(dot(abs(v.tangent.xyz), size3), dot(abs(cross(v.normal.xyz, v.tangent.xyz)), size3));
+		}
+		
+		vec3 vox_pos_world = pos_in_chunk * voxel_scale + chunk_pos;
+		vec3 vert_pos_world = mesh_pos_model * voxel_scale + vox_pos_world;
 		
 		vs.dbg_col = vec3(0);
-		vertex_displacement(vox_pos_world, vert_pos_world, vs.dbg_col);
+		if (!merged)
+			vertex_displacement(vox_pos_world, vert_pos_world, vs.dbg_col);
+		else
+			vs.bid = read_voxel(ivec3(floor(vox_pos_world + vec3(0.5)))); // displacement is per voxel corner, which merged quads don't have
 
 		gl_Position =		view.world_to_clip * vec4(vert_pos_world, 1);
 		vs.uvi =			vec3(uv, texid);
@@ -8,7 +8,11 @@ layout(r8i, binding = 4) restrict uniform iimage3D df_img;
 
 #include "gpu_voxels.glsl"
 
-uniform ivec3 offsets[32];
+uniform ivec3 offsets[32]; // world voxel pos of the chunks
+
+// world voxel range of voxel_tex, voxels of neighbouring chunks outside of it count as air
+uniform ivec3 window_min;
+uniform ivec3 window_max;
 
 // Initialized my DF such that a cell gets the value:
 //   0 if a neighbouring voxel is solid (3x3 region)
@@ -33,14 +37,19 @@ void main () {
 	
 	ivec3 pos = wgroupid * CORE + ivec3(gl_LocalInvocationID)-1; // pos in chunk
 	bool in_chunk = all(lessThan(pos, ivec3(CHUNK_SIZE)));
+	// the 1 voxel border on both sides, which can be in the neighbouring chunks
+	bool in_border = all(lessThanEqual(pos, ivec3(CHUNK_SIZE)));
 	
 	pos += offsets[chunkid]; // to world coord
+	bool in_window = all(greaterThanEqual(pos, window_min)) && all(lessThan(pos, window_max));
+	
+	ivec3 tex_pos = pos & (textureSize(voxel_tex, 0) - 1); // wrapped like the uploads
 	
 	int x = int(gl_LocalInvocationID.x);
 	int y = int(gl_LocalInvocationID.y);
 	int z = int(gl_LocalInvocationID.z);
 	
-	uint bid = in_chunk ? texelFetch(voxel_tex, pos, 0).r : 0;
+	uint bid = in_border && in_window ? texelFetch(voxel_tex, tex_pos, 0).r : 0;
 	int8_t val = bid > B_AIR ? int8_t(1u) : int8_t(0u); // solid voxels get a 1, air gets a 0
 	
 	// Propagate 1s to X-neighbours
@@ -86,6 +95,6 @@ void main () {
 		if (val != 0)
 			df = bid > B_AIR ? -1 : 0;
 		
-		imageStore(df_img, pos, ivec4(df, 0,0,0));
+		imageStore(df_img, tex_pos, ivec4(df, 0,0,0));
 	}
 }
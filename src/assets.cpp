@@ -171,6 +171,37 @@ void BlockMeshes::load (json const& blocks_json) {
 	aiReleaseImport(scene);
 }
 
+void BlockFaceLUT::build (BlockTypes const& types, BlockMeshes const& meshes) {
+	ZoneScoped;
+
+	int count = (int)types.blocks.size();
+	shift = 0;
+	while ((1 << shift) < count)
+		shift++;
+
+	for (int border=0; border<2; ++border) {
+		auto& lut = pairs[border];
+		lut.assign((size_t)1 << (shift*2), 0);
+
+		for (int bid=0; bid<count; ++bid)
+		for (int nid=0; nid<count; ++nid) {
+			if (bid == nid) continue;
+			if (!border && (bid == B_NULL || nid == B_NULL)) continue;
+
+			auto& b  = types.blocks[bid];
+			auto& nb = types.blocks[nid];
+
+			uint8_t val = 0;
+			if (b.collision != CM_GAS && nb.transparency != TM_OPAQUE && meshes.block_meshes[bid] < 0)
+				val |= EMIT | (b.transparency == TM_TRANSPARENT ? EMIT_TRANSP : 0);
+			if (nb.collision != CM_GAS && b.transparency != TM_OPAQUE && meshes.block_meshes[nid] < 0 && nid != B_NULL)
+				val |= NEMIT | (nb.transparency == TM_TRANSPARENT ? NEMIT_TRANSP : 0);
+
+			lut[((size_t)bid << shift) | nid] = val;
+		}
+	}
+}
+
 void Assets::load_block_tiles (json const& blocks_json) {
 	ZoneScoped;
 
@@ -88,6 +88,7 @@ struct BlockMeshInstance {
 	int16_t		posx, posy, posz; // pos in chunk
 	uint16_t	meshid; // index for merge instancing, this is used to index block meshes
 	uint16_t	texid; // texture array id based on block id
+	uint8_t		size[2]; // size in blocks of greedy merged face quads along the 2 face axes (yz, xz or xy), 1,1 otherwise
 	
 	template <typename ATTRIBS>
 	static void attributes (ATTRIBS& a) {
@@ -96,6 +97,33 @@ struct BlockMeshInstance {
 		a.template addv<AttribMode::SINT2FLT, decltype(posx), 3>(loc++, "pos"   , offsetof(BlockMeshInstance, posx)); // fixed point
 		a.template add <AttribMode::UINT,     decltype(meshid) >(loc++, "meshid", offsetof(BlockMeshInstance, meshid));
 		a.template add <AttribMode::UINT2FLT, decltype(texid ) >(loc++, "texid" , offsetof(BlockMeshInstance, texid ));
+		a.template addv<AttribMode::UINT2FLT, uint8_t, 2      >(loc++, "size"  , offsetof(BlockMeshInstance, size  ));
+	}
+};
+// Compact vertex for axis aligned cube faces (meshid < 6), rendered via merge instancing like BlockMeshInstance
+// used for the opaque faces of chunk meshes, block meshes with jittered positions still use BlockMeshInstance
+struct FaceInstance {
+	uint32_t	pos_face; // x,y,z: voxel pos in chunk +1 (7 bits each, faces of the -1 neighbour voxels are included), BlockFace (3 bits), 8 bits unused
+	uint16_t	texid; // texture array id based on block id
+	uint8_t		size[2]; // see BlockMeshInstance::size
+
+	static uint32_t pack (int x, int y, int z, int face) {
+		return (uint32_t)(x+1) | ((uint32_t)(y+1) << 7) | ((uint32_t)(z+1) << 14) | ((uint32_t)face << 21);
+	}
+	int3 pos () const {
+		return int3(pos_face & 127, (pos_face >> 7) & 127, (pos_face >> 14) & 127) - 1;
+	}
+	int face () const {
+		return (pos_face >> 21) & 7;
+	}
+
+	template <typename ATTRIBS>
+	static void attributes (ATTRIBS& a) {
+		int loc = 0;
+		a.init(sizeof(FaceInstance), true);
+		a.template add <AttribMode::UINT,     decltype(pos_face)>(loc++, "pos_face", offsetof(FaceInstance, pos_face));
+		a.template add <AttribMode::UINT2FLT, decltype(texid   )>(loc++, "texid"   , offsetof(FaceInstance, texid   ));
+		a.template addv<AttribMode::UINT2FLT, uint8_t, 2        >(loc++, "size"    , offsetof(FaceInstance, size    ));
 	}
 };
 // Vertex for block meshes which are used when rendering chunks via merge instancing
@@ -144,6 +172,27 @@ struct BlockMeshes {
 	void load (json const& blocks_json);
 };
 
+// Which cube faces the mesher emits for every pair of neighbouring block types, precomputed so that meshing needs one load per pair
+// indexed with (bid << shift) | nid for voxel bid and its negative direction neighbour nid (see CallCtx::face)
+// equal block types never generate faces
+struct BlockFaceLUT {
+	enum : uint8_t {
+		EMIT		= 1, // face of bid that faces nid
+		EMIT_TRANSP	= 2, //  goes into the transparent mesh
+		NEMIT		= 4, // face of nid that faces bid
+		NEMIT_TRANSP= 8, //  goes into the transparent mesh
+	};
+
+	int shift; // log2 of the row stride, rows are padded to a power of two to avoid a multiply
+	std::vector<uint8_t> pairs[2]; // [mesh_world_border]
+
+	uint8_t const* get (bool mesh_world_border) const {
+		return pairs[mesh_world_border].data();
+	}
+
+	void build (BlockTypes const& types, BlockMeshes const& meshes);
+};
+
 struct PlayerAssets {
 	Animation<AnimPosRot, AIM_LINEAR> animation = {{
 		{  0 / 30.0f, float3(0.686f, 1.01f, -1.18f) / 2, AnimRotation::from_euler(deg(50), deg(-5), deg(15)) },
@@ -200,6 +249,7 @@ struct Assets {
 	std::vector<BlockTile>	block_tiles;
 
 	BlockTypes				block_types;
+	BlockFaceLUT			block_face_lut;
 
 	PlayerAssets			player;
 
@@ -219,6 +269,7 @@ struct Assets {
 		a.load_block_types(blocks_json);
 		a.block_meshes.load(blocks_json);
 		a.load_block_tiles(blocks_json);
+		a.block_face_lut.build(a.block_types, a.block_meshes);
 
 		a.stock_models = load_fbx("meshes/stock_models.fbx", "stock_models");
 
@@ -0,0 +1,620 @@
+#include "common.hpp"
+#include "brickmap.hpp"
+
+void Brickmap::init (int size_chunks) {
+	assert(size_chunks > 0 && (size_chunks & (size_chunks-1)) == 0);
+
+	this->size_chunks = size_chunks;
+	offset = 0;
+	placed = false;
+
+	grid.assign((size_t)size_chunks * size_chunks * size_chunks, SUBC_SPARSE_BIT | B_NULL);
+	nodes.clear();
+	unused_nodes.clear();
+	bricks.clear();
+	unused_bricks.clear();
+
+	clear_dirty();
+	for (uint32_t i=0; i<(uint32_t)grid.size(); ++i)
+		dirty_cells.push_back(i);
+}
+
+void Brickmap::clear () {
+	size_chunks = 0;
+	placed = false;
+
+	grid = {};
+	nodes = {};
+	unused_nodes = {};
+	bricks = {};
+	unused_bricks = {};
+
+	dirty_cells = {};
+	dirty_nodes = {};
+	dirty_bricks = {};
+}
+
+uint32_t Brickmap::alloc_node () {
+	if (!unused_nodes.empty()) {
+		uint32_t node = unused_nodes.back();
+		unused_nodes.pop_back();
+		return node;
+	}
+	uint32_t node = (uint32_t)(nodes.size() / NODE_SIZE);
+	nodes.resize(nodes.size() + NODE_SIZE);
+	return node;
+}
+void Brickmap::free_node (uint32_t node) {
+	uint32_t* entries = &nodes[(size_t)node * NODE_SIZE];
+	for (uint32_t i=0; i<NODE_SIZE; ++i) {
+		if ((entries[i] & SUBC_SPARSE_BIT) == 0)
+			free_brick(entries[i]);
+	}
+	unused_nodes.push_back(node);
+}
+
+uint32_t Brickmap::alloc_brick () {
+	if (!unused_bricks.empty()) {
+		uint32_t brick = unused_bricks.back();
+		unused_bricks.pop_back();
+		return brick;
+	}
+	bricks.emplace_back();
+	return (uint32_t)bricks.size() - 1;
+}
+void Brickmap::free_brick (uint32_t brick) {
+	unused_bricks.push_back(brick);
+}
+
+void Brickmap::reset_cell (uint32_t& cell, uint32_t value) {
+	assert(value & SUBC_SPARSE_BIT);
+	if ((cell & SUBC_SPARSE_BIT) == 0)
+		free_node(cell);
+	cell = value;
+}
+
+void Brickmap::move (int3 new_offset, std::vector<int3>& entered) {
+	ZoneScoped;
+
+	int3 old_offset = offset;
+	bool was_placed = placed;
+	offset = new_offset;
+	placed = true;
+
+	if (was_placed && new_offset == old_offset)
+		return;
+
+	for (int z=0; z<size_chunks; ++z)
+	for (int y=0; y<size_chunks; ++y)
+	for (int x=0; x<size_chunks; ++x) {
+		int3 pos = int3(x,y,z) + new_offset;
+		int3 old_rel = pos - old_offset;
+
+		bool was_inside = was_placed &&
+			(unsigned)old_rel.x < (unsigned)size_chunks &&
+			(unsigned)old_rel.y < (unsigned)size_chunks &&
+			(unsigned)old_rel.z < (unsigned)size_chunks;
+		if (was_inside)
+			continue;
+
+		// the cell still holds the chunk that wrapped around
+		uint32_t ci = cell_index(pos);
+		reset_cell(grid[ci], SUBC_SPARSE_BIT | B_NULL);
+		dirty_cells.push_back(ci);
+
+		entered.push_back(pos);
+	}
+}
+
+void Brickmap::set_chunk (int3 chunk_pos, chunk_id cid, int3 lo, int3 hi, ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks) {
+	if (!contains(chunk_pos))
+		return;
+
+	uint32_t ci = cell_index(chunk_pos);
+	uint32_t& cell = grid[ci];
+	dirty_cells.push_back(ci);
+
+	if (cid == U16_NULL) {
+		reset_cell(cell, SUBC_SPARSE_BIT | B_NULL);
+		return;
+	}
+
+	auto& vox = chunk_voxels[cid];
+
+	{ // chunks of a single block (sky, solid rock) don't need a node
+		uint32_t first = vox.subchunks[0];
+		bool uniform = (first & SUBC_SPARSE_BIT) != 0;
+		for (uint32_t i=1; i<NODE_SIZE && uniform; ++i)
+			uniform = vox.subchunks[i] == first;
+
+		if (uniform) {
+			reset_cell(cell, first);
+			return;
+		}
+	}
+
+	lo.x = max(lo.x, 0);
+	lo.y = max(lo.y, 0);
+	lo.z = max(lo.z, 0);
+	hi.x = min(hi.x, CHUNK_SIZE);
+	hi.y = min(hi.y, CHUNK_SIZE);
+	hi.z = min(hi.z, CHUNK_SIZE);
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z || (cell & SUBC_SPARSE_BIT)) {
+		// no dirty rect or the chunk did not have a node yet
+		lo = 0;
+		hi = CHUNK_SIZE;
+	}
+
+	if (cell & SUBC_SPARSE_BIT) {
+		uint32_t node = alloc_node();
+		std::fill_n(&nodes[(size_t)node * NODE_SIZE], NODE_SIZE, SUBC_SPARSE_BIT | B_NULL);
+		cell = node;
+	}
+	uint32_t* entries = &nodes[(size_t)cell * NODE_SIZE];
+
+	// subchunks overlapping the dirty rect
+	for (int sz=lo.z >> SUBCHUNK_SHIFT; sz <= (hi.z-1) >> SUBCHUNK_SHIFT; ++sz)
+	for (int sy=lo.y >> SUBCHUNK_SHIFT; sy <= (hi.y-1) >> SUBCHUNK_SHIFT; ++sy)
+	for (int sx=lo.x >> SUBCHUNK_SHIFT; sx <= (hi.x-1) >> SUBCHUNK_SHIFT; ++sx) {
+		uint32_t i = (uint32_t)(IDX3D(sx,sy,sz, SUBCHUNK_COUNT));
+		uint32_t subc = vox.subchunks[i];
+		uint32_t& e = entries[i];
+
+		if (subc & SUBC_SPARSE_BIT) {
+			if ((e & SUBC_SPARSE_BIT) == 0)
+				free_brick(e);
+			e = subc;
+		} else {
+			if (e & SUBC_SPARSE_BIT)
+				e = alloc_brick();
+			memcpy(&bricks[e], &subchunks[subc], sizeof(SubchunkVoxels));
+			dirty_bricks.push_back(e);
+		}
+	}
+
+	dirty_nodes.push_back(cell);
+}
+
+block_id Brickmap::lookup (int3 voxel, int& size) const {
+	int3 chunk_pos = int3(voxel.x >> CHUNK_SIZE_SHIFT, voxel.y >> CHUNK_SIZE_SHIFT, voxel.z >> CHUNK_SIZE_SHIFT);
+	if (!contains(chunk_pos)) {
+		size = CHUNK_SIZE;
+		return B_NULL;
+	}
+
+	uint32_t cell = grid[cell_index(chunk_pos)];
+	if (cell & SUBC_SPARSE_BIT) {
+		size = CHUNK_SIZE;
+		return (block_id)(cell & ~SUBC_SPARSE_BIT);
+	}
+
+	int3 p = voxel & CHUNK_SIZE_MASK;
+	uint32_t e = nodes[(size_t)cell * NODE_SIZE + SUBCHUNK_IDX(p.x, p.y, p.z)];
+	if (e & SUBC_SPARSE_BIT) {
+		size = SUBCHUNK_SIZE;
+		return (block_id)(e & ~SUBC_SPARSE_BIT);
+	}
+
+	size = 1;
+	return bricks[e].voxels[BLOCK_IDX(p.x, p.y, p.z)];
+}
+
+bool Brickmap::raycast (float3 const& pos, float3 const& dir, float max_dist, block_id air, Hit& hit, int* steps) const {
+	float p[3] = { pos.x, pos.y, pos.z };
+	float d[3] = { dir.x, dir.y, dir.z };
+	int   v[3] = { (int)floorf(p[0]), (int)floorf(p[1]), (int)floorf(p[2]) };
+
+	float t = 0;
+	int count = 0;
+
+	while (t <= max_dist) {
+		count++;
+
+		int size;
+		block_id bid = lookup(int3(v[0], v[1], v[2]), size);
+		if (bid > air) {
+			hit = { int3(v[0], v[1], v[2]), bid, t };
+			if (steps) *steps = count;
+			return true;
+		}
+
+		// leave the box of size around v through the nearest face
+		int lo[3];
+		float t_exit = INF;
+		int axis = 0;
+		for (int a=0; a<3; ++a) {
+			lo[a] = v[a] & ~(size-1);
+			if (d[a] == 0) continue;
+
+			int boundary = d[a] > 0 ? lo[a] + size : lo[a];
+			float ta = ((float)boundary - p[a]) / d[a];
+			if (ta < t_exit) {
+				t_exit = ta;
+				axis = a;
+			}
+		}
+
+		for (int a=0; a<3; ++a) {
+			if (a == axis)
+				v[a] = d[a] > 0 ? lo[a] + size : lo[a] - 1;
+			else if (size > 1) // clamp to the box, where the ray has not left it yet on these axes
+				v[a] = clamp((int)floorf(p[a] + d[a] * t_exit), lo[a], lo[a] + size-1);
+		}
+
+		t = max(t, t_exit);
+	}
+
+	if (steps) *steps = count;
+	return false;
+}
+
+size_t Brickmap::memory_bytes () const {
+	return grid.size() * sizeof(uint32_t)
+		+ (size_t)node_count() * NODE_SIZE * sizeof(uint32_t)
+		+ (size_t)brick_count() * sizeof(SubchunkVoxels);
+}
+size_t Brickmap::dense_bytes () const {
+	size_t size = (size_t)size_chunks * CHUNK_SIZE;
+	return size * size * size * sizeof(block_id);
+}
+
+int Brickmap::validate () const {
+	int errors = 0;
+
+	std::vector<uint8_t> node_refs (nodes.size() / NODE_SIZE, 0);
+	std::vector<uint8_t> brick_refs (bricks.size(), 0);
+
+	for (uint32_t cell : grid) {
+		if (cell & SUBC_SPARSE_BIT) continue;
+		if (cell >= node_refs.size()) { errors++; continue; }
+		node_refs[cell]++;
+
+		for (uint32_t i=0; i<NODE_SIZE; ++i) {
+			uint32_t e = nodes[(size_t)cell * NODE_SIZE + i];
+			if (e & SUBC_SPARSE_BIT) continue;
+			if (e >= brick_refs.size()) { errors++; continue; }
+			brick_refs[e]++;
+		}
+	}
+
+	for (uint32_t node : unused_nodes) {
+		if (node >= node_refs.size()) { errors++; continue; }
+		node_refs[node]++;
+	}
+	for (uint32_t brick : unused_bricks) {
+		if (brick >= brick_refs.size()) { errors++; continue; }
+		brick_refs[brick]++;
+	}
+
+	// every node and brick is either used once or in the free list
+	for (auto r : node_refs)
+		if (r != 1) errors++;
+	for (auto r : brick_refs)
+		if (r != 1) errors++;
+
+	return errors;
+}
+
+Brickmap::Bench Brickmap::check_synthetic () {
+	ZoneScoped;
+
+	Bench b;
+	b.failures = 0;
+
+	uint32_t rng = 0x2545f491u;
+	auto next = [&] (uint32_t n) {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng % n;
+	};
+	auto hash3 = [] (int x, int y, int z) {
+		uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u;
+		h ^= h >> 13;
+		h *= 0x5bd1e995u;
+		h ^= h >> 15;
+		return h;
+	};
+
+	constexpr block_id AIR = 1, STONE = 2, EARTH = 3, GRASS = 4, ORE = 5;
+
+	// hills with caves around z = 64..128, solid rock below and sky above
+	auto terrain = [&] (int x, int y, int z) -> block_id {
+		int height = 72 + (int)(hash3(x >> 3, y >> 3, 0) % 40);
+		if (z >= height) return AIR;
+		if (z >= height-1) return GRASS;
+		if (z >= height-4) return EARTH;
+		if (z > 8 && z < 64 && hash3(x >> 2, y >> 2, z >> 2) % 11 == 0) return AIR;
+		return hash3(x, y, z) % 61 == 0 ? ORE : STONE;
+	};
+
+	//// source chunks in the same sparse format as Chunks, one chunk wider than the window in x to test moving the window
+	constexpr int W = 4;
+	std::unordered_map<int3, chunk_id> chunks_map;
+	std::vector<ChunkVoxels> chunk_voxels;
+	std::vector<SubchunkVoxels> subchunks;
+
+	chunk_voxels.reserve((W+1) * W * W);
+	for (int cz=0; cz<W; ++cz)
+	for (int cy=0; cy<W; ++cy)
+	for (int cx=0; cx<W+1; ++cx) {
+		if (cz >= 2 && hash3(cx, cy, cz) % 3 == 0)
+			continue; // not loaded
+
+		chunk_id cid = (chunk_id)chunk_voxels.size();
+		chunk_voxels.emplace_back();
+		chunks_map.emplace(int3(cx,cy,cz), cid);
+
+		for (int sz=0; sz<SUBCHUNK_COUNT; ++sz)
+		for (int sy=0; sy<SUBCHUNK_COUNT; ++sy)
+		for (int sx=0; sx<SUBCHUNK_COUNT; ++sx) {
+			SubchunkVoxels sub;
+			bool uniform = true;
+			for (int z=0; z<SUBCHUNK_SIZE; ++z)
+			for (int y=0; y<SUBCHUNK_SIZE; ++y)
+			for (int x=0; x<SUBCHUNK_SIZE; ++x) {
+				int3 p = int3(cx,cy,cz) * CHUNK_SIZE + int3(sx,sy,sz) * SUBCHUNK_SIZE + int3(x,y,z);
+				auto bid = terrain(p.x, p.y, p.z);
+				sub.voxels[IDX3D(x,y,z, SUBCHUNK_SIZE)] = bid;
+				uniform = uniform && bid == sub.voxels[0];
+			}
+
+			uint32_t& subc = chunk_voxels[cid].subchunks[IDX3D(sx,sy,sz, SUBCHUNK_COUNT)];
+			if (uniform) {
+				subc = SUBC_SPARSE_BIT | sub.voxels[0];
+			} else {
+				subc = (uint32_t)subchunks.size();
+				subchunks.push_back(sub);
+			}
+		}
+	}
+
+	auto query = [&] (int3 pos) {
+		auto it = chunks_map.find(pos);
+		return it != chunks_map.end() ? it->second : U16_NULL;
+	};
+
+	Brickmap bm;
+
+	// reference lookup straight from the sparse source chunks
+	auto reference = [&] (int3 voxel) -> block_id {
+		int3 chunk_pos = int3(voxel.x >> CHUNK_SIZE_SHIFT, voxel.y >> CHUNK_SIZE_SHIFT, voxel.z >> CHUNK_SIZE_SHIFT);
+		if (!bm.contains(chunk_pos)) return B_NULL;
+		auto cid = query(chunk_pos);
+		if (cid == U16_NULL) return B_NULL;
+
+		int3 p = voxel & CHUNK_SIZE_MASK;
+		uint32_t subc = chunk_voxels[cid].subchunks[SUBCHUNK_IDX(p.x, p.y, p.z)];
+		if (subc & SUBC_SPARSE_BIT)
+			return (block_id)(subc & ~SUBC_SPARSE_BIT);
+		return subchunks[subc].voxels[BLOCK_IDX(p.x, p.y, p.z)];
+	};
+
+	auto check_all = [&] (Brickmap const& map) {
+		b.failures += map.validate();
+
+		for (int cz=0; cz<W; ++cz)
+		for (int cy=0; cy<W; ++cy)
+		for (int cx=0; cx<W; ++cx) {
+			int3 chunk_pos = map.offset + int3(cx,cy,cz);
+			auto cid = query(chunk_pos);
+
+			bool ok = true;
+			for (int z=0; z<CHUNK_SIZE && ok; ++z)
+			for (int y=0; y<CHUNK_SIZE && ok; ++y)
+			for (int x=0; x<CHUNK_SIZE && ok; ++x) {
+				block_id expect = B_NULL;
+				if (cid != U16_NULL) {
+					uint32_t subc = chunk_voxels[cid].subchunks[SUBCHUNK_IDX(x,y,z)];
+					expect = subc & SUBC_SPARSE_BIT ? (block_id)(subc & ~SUBC_SPARSE_BIT) : subchunks[subc].voxels[BLOCK_IDX(x,y,z)];
+				}
+				if (map.get(chunk_pos * CHUNK_SIZE + int3(x,y,z)) != expect)
+					ok = false;
+			}
+			if (!ok)
+				b.failures++;
+		}
+	};
+
+	auto build = [&] (Brickmap& map, int3 offset) {
+		std::vector<int3> entered;
+		map.move(offset, entered);
+		for (auto pos : entered)
+			map.set_chunk(pos, query(pos), 0, CHUNK_SIZE, chunk_voxels.data(), subchunks.data());
+		map.clear_dirty();
+	};
+
+	auto time_ms = [] (uint64_t t0) {
+		return (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq;
+	};
+
+	{ // full build
+		bm.init(W);
+		uint64_t t0 = get_timestamp();
+		build(bm, 0);
+		b.build_ms = time_ms(t0);
+
+		check_all(bm);
+		b.memory_mb = (float)bm.memory_bytes() / (1024*1024);
+		b.dense_mb = (float)bm.dense_bytes() / (1024*1024);
+	}
+
+	{ // edits like Chunks::set_block does them, followed by the incremental update
+		auto write = [&] (chunk_id cid, int x, int y, int z, block_id bid) {
+			uint32_t& subc = chunk_voxels[cid].subchunks[SUBCHUNK_IDX(x,y,z)];
+			if (subc & SUBC_SPARSE_BIT) {
+				block_id val = (block_id)(subc & ~SUBC_SPARSE_BIT);
+				if (val == bid) return;
+
+				subchunks.emplace_back();
+				std::fill_n(subchunks.back().voxels, SUBCHUNK_VOXEL_COUNT, val);
+				subc = (uint32_t)subchunks.size() - 1;
+			}
+			subchunks[subc].voxels[BLOCK_IDX(x,y,z)] = bid;
+		};
+		auto sparsify = [&] (chunk_id cid) {
+			for (auto& subc : chunk_voxels[cid].subchunks) {
+				if (subc & SUBC_SPARSE_BIT) continue;
+				auto& v = subchunks[subc].voxels;
+				if (std::all_of(v, v + SUBCHUNK_VOXEL_COUNT, [&] (block_id bid) { return bid == v[0]; }))
+					subc = SUBC_SPARSE_BIT | v[0];
+			}
+		};
+
+		block_id edit_blocks[] = { AIR, STONE, ORE+1 };
+
+		uint64_t edit_time = 0;
+		for (int i=0; i<300; ++i) {
+			int3 pos = int3((int)next(W), (int)next(W), (int)next(W));
+			auto cid = query(pos);
+			if (cid == U16_NULL) continue;
+
+			// mostly small edits, sometimes whole subchunks, which become sparse again
+			int3 lo = int3((int)next(CHUNK_SIZE), (int)next(CHUNK_SIZE), (int)next(CHUNK_SIZE));
+			int3 size = next(4) == 0 ? int3(1) : int3(1 + (int)next(12), 1 + (int)next(12), 1 + (int)next(12));
+			if (next(6) == 0) {
+				lo = lo & ~SUBCHUNK_MASK;
+				size = SUBCHUNK_SIZE * (1 + (int)next(3));
+			}
+			if (i % 100 == 49) { // the whole chunk, so that it no longer needs a node
+				lo = 0;
+				size = CHUNK_SIZE;
+			}
+			int3 hi = int3(min(lo.x + size.x, CHUNK_SIZE), min(lo.y + size.y, CHUNK_SIZE), min(lo.z + size.z, CHUNK_SIZE));
+			block_id bid = edit_blocks[next(ARRLEN(edit_blocks))];
+
+			for (int z=lo.z; z<hi.z; ++z)
+			for (int y=lo.y; y<hi.y; ++y)
+			for (int x=lo.x; x<hi.x; ++x)
+				write(cid, x,y,z, bid);
+			sparsify(cid);
+
+			uint64_t t0 = get_timestamp();
+			bm.set_chunk(pos, cid, lo, hi, chunk_voxels.data(), subchunks.data());
+			edit_time += get_timestamp() - t0;
+			b.edits++;
+
+			if (i % 100 == 99) { // unload a chunk
+				chunks_map.erase(pos);
+				bm.set_chunk(pos, U16_NULL, 0, CHUNK_SIZE, chunk_voxels.data(), subchunks.data());
+			}
+		}
+		b.edit_us = (float)edit_time * 1000000 / (float)timestamp_freq / (float)max(b.edits, 1);
+
+		check_all(bm);
+
+		// the incremental updates need exactly as much memory as a fresh build
+		Brickmap fresh;
+		fresh.init(W);
+		build(fresh, 0);
+		if (fresh.node_count() != bm.node_count() || fresh.brick_count() != bm.brick_count())
+			b.failures++;
+	}
+
+	{ // move the window by one chunk
+		std::vector<int3> entered;
+		bm.move(int3(1,0,0), entered);
+		if ((int)entered.size() != W*W)
+			b.failures++;
+		for (auto pos : entered)
+			bm.set_chunk(pos, query(pos), 0, CHUNK_SIZE, chunk_voxels.data(), subchunks.data());
+
+		check_all(bm);
+	}
+
+	{ // raycasts against a plain voxel by voxel dda on the reference
+		auto naive = [&] (float3 const& pos, float3 const& dir, float max_dist, Hit& hit, int& steps) {
+			float p[3] = { pos.x, pos.y, pos.z };
+			float d[3] = { dir.x, dir.y, dir.z };
+			int   v[3] = { (int)floorf(p[0]), (int)floorf(p[1]), (int)floorf(p[2]) };
+			float t = 0;
+			steps = 0;
+			while (t <= max_dist) {
+				steps++;
+				block_id bid = reference(int3(v[0], v[1], v[2]));
+				if (bid > AIR) {
+					hit = { int3(v[0], v[1], v[2]), bid, t };
+					return true;
+				}
+
+				float t_exit = INF;
+				int axis = 0;
+				for (int a=0; a<3; ++a) {
+					if (d[a] == 0) continue;
+					float ta = ((float)(d[a] > 0 ? v[a] + 1 : v[a]) - p[a]) / d[a];
+					if (ta < t_exit) {
+						t_exit = ta;
+						axis = a;
+					}
+				}
+				v[axis] += d[axis] > 0 ? 1 : -1;
+				t = max(t, t_exit);
+			}
+			return false;
+		};
+
+		constexpr int RAYS = 4096;
+		struct TestRay {
+			float3	pos, dir;
+		};
+		std::vector<TestRay> rays;
+		int3 lo = bm.offset * CHUNK_SIZE;
+		for (int i=0; i<RAYS; ++i) {
+			auto rnd = [&] (float a, float b) { return a + (b - a) * (float)next(1u << 20) / (float)(1u << 20); };
+			float3 pos = float3(rnd(0, W*CHUNK_SIZE), rnd(0, W*CHUNK_SIZE), rnd(64, W*CHUNK_SIZE)) + (float3)lo;
+			float3 dir = float3(rnd(-1,1), rnd(-1,1), rnd(-1,1));
+			if (i % 8 == 0) dir.x = 0; // axis aligned cases
+			if (i % 16 == 0) dir.y = 0;
+			float len = length(dir);
+			if (len < 0.001f) dir = float3(0,0,-1);
+			else dir = dir / len;
+			rays.push_back({ pos, dir });
+		}
+
+		constexpr float MAX_DIST = 400;
+		int steps_total = 0, naive_steps_total = 0;
+
+		for (auto& r : rays) {
+			Hit h, nh;
+			int steps, naive_steps;
+			bool res = bm.raycast(r.pos, r.dir, MAX_DIST, AIR, h, &steps);
+			bool naive_res = naive(r.pos, r.dir, MAX_DIST, nh, naive_steps);
+
+			// the box skipping may pick a different voxel only where the ray grazes an edge
+			if (res != naive_res)
+				b.failures++;
+			else if (res && (h.voxel != nh.voxel || h.bid != nh.bid) && fabsf(h.dist - nh.dist) > 0.001f)
+				b.failures++;
+
+			steps_total += steps;
+			naive_steps_total += naive_steps;
+		}
+		b.rays = RAYS;
+		b.steps = (float)steps_total / RAYS;
+		b.naive_steps = (float)naive_steps_total / RAYS;
+
+		Hit h;
+		int hits = 0, naive_hits = 0;
+		uint64_t t0 = get_timestamp();
+		for (auto& r : rays)
+			hits += bm.raycast(r.pos, r.dir, MAX_DIST, AIR, h) ? 1 : 0;
+		b.ray_ns = time_ms(t0) * 1000000 / RAYS;
+
+		int steps;
+		t0 = get_timestamp();
+		for (auto& r : rays)
+			naive_hits += naive(r.pos, r.dir, MAX_DIST, h, steps) ? 1 : 0;
+		b.naive_ray_ns = time_ms(t0) * 1000000 / RAYS;
+
+		b.hits = hits;
+		if (hits != naive_hits)
+			b.failures++;
+	}
+
+	return b;
+}
+
+void Brickmap::imgui () {
+	ImGui::Text("brickmap: %d^3 chunks  %6d nodes  %7d bricks  %8.2f MB (dense: %8.2f MB)",
+		size_chunks, node_count(), brick_count(), (float)memory_bytes() / (1024*1024), (float)dense_bytes() / (1024*1024));
+}
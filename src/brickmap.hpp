@@ -0,0 +1,110 @@
+#pragma once
+#include "common.hpp"
+#include "chunks.hpp"
+
+// Two level sparse brickmap of the voxels in a window of chunks around the player, as an alternative to the dense voxel texture of the raytracer
+// grid: one entry per chunk of the window, wrapped like the voxel texture, either a node or SUBC_SPARSE_BIT | block id for chunks that are a single block
+// nodes: CHUNK_SUBCHUNK_COUNT entries per chunk, either a brick or SUBC_SPARSE_BIT | block id, exactly like ChunkVoxels::subchunks
+// bricks: dense SUBCHUNK_SIZE^3 voxels (SubchunkVoxels), so sparse subchunks and single block chunks cost no brick memory
+// nodes and bricks live in pools with free lists so that a renderer could upload them as buffers, the dirty lists are the changes since clear_dirty()
+// updated incrementally from the dirty rects in Chunks::upload_voxels, only the touched subchunks are rewritten
+// Pure CPU code, including a reference traversal that skips empty chunks and subchunks
+struct Brickmap {
+	static constexpr uint32_t NODE_SIZE = CHUNK_SUBCHUNK_COUNT;
+
+	int						size_chunks = 0; // window size in chunks per axis, power of two
+	int3					offset = 0; // chunk pos of the lowest chunk in the window
+	bool					placed = false; // offset was set by move()
+
+	std::vector<uint32_t>	grid;
+	std::vector<uint32_t>	nodes; // NODE_SIZE entries per node
+	std::vector<uint32_t>	unused_nodes;
+	std::vector<SubchunkVoxels> bricks;
+	std::vector<uint32_t>	unused_bricks;
+
+	// changes since the last clear_dirty, may contain duplicates and freed entries
+	std::vector<uint32_t>	dirty_cells;
+	std::vector<uint32_t>	dirty_nodes;
+	std::vector<uint32_t>	dirty_bricks;
+
+	void init (int size_chunks);
+	// free all memory, size_chunks is 0 until the next init
+	void clear ();
+
+	bool contains (int3 chunk_pos) const {
+		int3 rel = chunk_pos - offset;
+		return (unsigned)rel.x < (unsigned)size_chunks &&
+		       (unsigned)rel.y < (unsigned)size_chunks &&
+		       (unsigned)rel.z < (unsigned)size_chunks;
+	}
+	uint32_t cell_index (int3 chunk_pos) const {
+		int3 wrap = chunk_pos & (size_chunks-1);
+		return (uint32_t)(IDX3D(wrap.x, wrap.y, wrap.z, size_chunks));
+	}
+
+	// move the window to offset, cells of chunks that left it are reset to B_NULL and the chunks that entered it are appended to entered
+	void move (int3 offset, std::vector<int3>& entered);
+
+	// rewrite the subchunks of the chunk in the dirty rect [lo,hi) (all of them if the rect is empty), cid U16_NULL resets the chunk to B_NULL
+	void set_chunk (int3 chunk_pos, chunk_id cid, int3 lo, int3 hi, ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks);
+
+	void clear_dirty () {
+		dirty_cells.clear();
+		dirty_nodes.clear();
+		dirty_bricks.clear();
+	}
+
+	// B_NULL outside of the window
+	block_id get (int3 voxel) const {
+		int size;
+		return lookup(voxel, size);
+	}
+	// block at voxel and the size of the uniform box (chunk, subchunk or voxel) it is in
+	block_id lookup (int3 voxel, int& size) const;
+
+	struct Hit {
+		int3		voxel;
+		block_id	bid;
+		float		dist; // where the ray enters voxel
+	};
+	// voxel dda that steps over whole chunks and subchunks of a single block <= air
+	// returns the first voxel with a block > air (like the raytracer), steps is the number of visited boxes
+	bool raycast (float3 const& pos, float3 const& dir, float max_dist, block_id air, Hit& hit, int* steps=nullptr) const;
+
+	uint32_t node_count () const { return (uint32_t)(nodes.size() / NODE_SIZE - unused_nodes.size()); }
+	uint32_t brick_count () const { return (uint32_t)(bricks.size() - unused_bricks.size()); }
+	// memory of the grid and the used nodes and bricks vs. the dense voxel texture of the same window
+	size_t memory_bytes () const;
+	size_t dense_bytes () const;
+
+	// check that every used node and brick is referenced exactly once, returns the number of errors
+	int validate () const;
+
+	struct Bench {
+		int		failures = 0;
+		int		edits = 0;
+		int		rays = 0;
+		int		hits = 0;
+		float	memory_mb = 0;
+		float	dense_mb = 0;
+		float	build_ms = 0;
+		float	edit_us = 0; // per set_chunk of an edit
+		float	steps = 0; // per ray
+		float	naive_steps = 0;
+		float	ray_ns = 0;
+		float	naive_ray_ns = 0;
+	};
+
+	// build from synthetic terrain, apply random edits and window moves and compare every voxel and random rays against a dense reference,
+	// runs without a gpu or loaded world
+	static Bench check_synthetic ();
+
+	void imgui ();
+
+private:
+	uint32_t alloc_node ();
+	void free_node (uint32_t node);
+	uint32_t alloc_brick ();
+	void free_brick (uint32_t brick);
+	void reset_cell (uint32_t& cell, uint32_t value);
+};
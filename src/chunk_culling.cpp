@@ -0,0 +1,274 @@
+#include "common.hpp"
+#include "chunk_culling.hpp"
+#include "immintrin.h"
+
+const bool ChunkCuller::has_avx2 = cpu_has_avx2();
+
+void ChunkCuller::add (chunk_id cid, int3 const& chunk_pos) {
+	int3 cell_pos = int3(chunk_pos.x >> CELL_SHIFT, chunk_pos.y >> CELL_SHIFT, chunk_pos.z >> CELL_SHIFT); // floor for negative coords
+
+	uint32_t celli;
+	auto it = cell_map.find(cell_pos);
+	if (it != cell_map.end()) {
+		celli = it->second;
+	} else {
+		celli = (uint32_t)cells.size();
+		cell_map.emplace(cell_pos, celli);
+
+		auto cell = std::make_unique<Cell>();
+		cell->pos = cell_pos;
+		cell->count = 0;
+		cells.emplace_back(std::move(cell));
+	}
+
+	auto& cell = *cells[celli];
+	assert(cell.count < CELL_CHUNKS);
+
+	int i = cell.count++;
+	cell.lo_x[i] = (float)(chunk_pos.x * CHUNK_SIZE);
+	cell.lo_y[i] = (float)(chunk_pos.y * CHUNK_SIZE);
+	cell.lo_z[i] = (float)(chunk_pos.z * CHUNK_SIZE);
+	cell.chunks[i] = cid;
+
+	if (cid >= chunk_slots.size())
+		chunk_slots.resize(cid + 1);
+	chunk_slots[cid] = celli << 8 | (uint32_t)i;
+}
+
+void ChunkCuller::remove (chunk_id cid) {
+	uint32_t celli = chunk_slots[cid] >> 8;
+	int i = (int)(chunk_slots[cid] & 0xff);
+
+	auto& cell = *cells[celli];
+	assert(cell.chunks[i] == cid);
+
+	// move last chunk of cell into the hole
+	int last = --cell.count;
+	if (i != last) {
+		cell.lo_x[i] = cell.lo_x[last];
+		cell.lo_y[i] = cell.lo_y[last];
+		cell.lo_z[i] = cell.lo_z[last];
+		cell.chunks[i] = cell.chunks[last];
+		chunk_slots[cell.chunks[i]] = celli << 8 | (uint32_t)i;
+	}
+
+	if (cell.count == 0) {
+		// move last cell into the hole
+		cell_map.erase(cell.pos);
+
+		uint32_t last_cell = (uint32_t)cells.size() - 1;
+		if (celli != last_cell) {
+			std::swap(cells[celli], cells[last_cell]);
+
+			auto& moved = *cells[celli];
+			cell_map[moved.pos] = celli;
+			for (int j=0; j<moved.count; ++j)
+				chunk_slots[moved.chunks[j]] = celli << 8 | (uint32_t)j;
+		}
+		cells.pop_back();
+	}
+}
+
+namespace {
+	// frustrum planes with outwards facing normals as n.x*x + n.y*y + n.z*z = d
+	struct CullPlanes {
+		static constexpr int COUNT = 6;
+		float3	n[COUNT];
+		float	d[COUNT];
+
+		CullPlanes (View_Frustrum const& frust) {
+			for (int i=0; i<COUNT; ++i) {
+				n[i] = frust.planes[i].normal;
+				d[i] = dot(frust.planes[i].normal, frust.planes[i].pos);
+			}
+		}
+
+		enum Result { OUTSIDE, INTERSECT, INSIDE };
+
+		Result classify (float3 const& lo, float3 const& hi) const {
+			Result res = INSIDE;
+			for (int i=0; i<COUNT; ++i) {
+				// corners of the aabb that are furthest inside and furthest outside of the plane
+				float3 near = float3(n[i].x > 0 ? lo.x : hi.x, n[i].y > 0 ? lo.y : hi.y, n[i].z > 0 ? lo.z : hi.z);
+				float3 far  = float3(n[i].x > 0 ? hi.x : lo.x, n[i].y > 0 ? hi.y : lo.y, n[i].z > 0 ? hi.z : lo.z);
+
+				if (dot(n[i], near) > d[i])
+					return OUTSIDE;
+				if (dot(n[i], far) > d[i])
+					res = INTERSECT;
+			}
+			return res;
+		}
+	};
+}
+
+void ChunkCuller::cull (View_Frustrum const& frust) {
+	if (has_avx2) cull_avx2(frust);
+	else          cull_scalar(frust);
+}
+
+void ChunkCuller::cull_avx2 (View_Frustrum const& frust) {
+	ZoneScoped;
+
+	visible.clear();
+
+	CullPlanes planes = frust;
+
+	// chunk aabbs are lo + [0, CHUNK_SIZE], so the corner furthest inside of each plane is lo + offs
+	// which makes the per chunk test a single dot product per plane
+	__m256 nx[CullPlanes::COUNT], ny[CullPlanes::COUNT], nz[CullPlanes::COUNT], thres[CullPlanes::COUNT];
+	for (int i=0; i<CullPlanes::COUNT; ++i) {
+		float3 n = planes.n[i];
+		float3 offs = float3(n.x > 0 ? 0.0f : (float)CHUNK_SIZE, n.y > 0 ? 0.0f : (float)CHUNK_SIZE, n.z > 0 ? 0.0f : (float)CHUNK_SIZE);
+
+		nx[i] = _mm256_set1_ps(n.x);
+		ny[i] = _mm256_set1_ps(n.y);
+		nz[i] = _mm256_set1_ps(n.z);
+		thres[i] = _mm256_set1_ps(planes.d[i] - dot(n, offs));
+	}
+
+	for (auto& cellp : cells) {
+		auto& cell = *cellp;
+
+		float3 lo = (float3)(cell.pos * (CELL_SIZE * CHUNK_SIZE));
+		float3 hi = lo + (float)(CELL_SIZE * CHUNK_SIZE);
+
+		auto res = planes.classify(lo, hi);
+		if (res == CullPlanes::OUTSIDE)
+			continue;
+
+		if (res == CullPlanes::INSIDE) {
+			visible.insert(visible.end(), cell.chunks, cell.chunks + cell.count);
+			continue;
+		}
+
+		for (int i=0; i<cell.count; i += 8) {
+			__m256 x = _mm256_load_ps(&cell.lo_x[i]);
+			__m256 y = _mm256_load_ps(&cell.lo_y[i]);
+			__m256 z = _mm256_load_ps(&cell.lo_z[i]);
+
+			__m256 outside = _mm256_setzero_ps();
+			for (int p=0; p<CullPlanes::COUNT; ++p) {
+				__m256 dist = _mm256_fmadd_ps(nx[p], x, _mm256_fmadd_ps(ny[p], y, _mm256_mul_ps(nz[p], z)));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, thres[p], _CMP_GT_OQ));
+			}
+
+			uint32_t mask = ~(uint32_t)_mm256_movemask_ps(outside) & 0xffu;
+			if (cell.count - i < 8)
+				mask &= (1u << (cell.count - i)) - 1; // lanes past count are garbage
+
+			while (mask) {
+				int lane = (int)_tzcnt_u32(mask);
+				visible.push_back(cell.chunks[i + lane]);
+				mask &= mask - 1;
+			}
+		}
+	}
+}
+
+void ChunkCuller::cull_scalar (View_Frustrum const& frust) {
+	ZoneScoped;
+
+	visible.clear();
+
+	for (auto& cellp : cells) {
+		auto& cell = *cellp;
+		for (int i=0; i<cell.count; ++i) {
+			float lx = cell.lo_x[i], ly = cell.lo_y[i], lz = cell.lo_z[i];
+			if (!frustrum_cull_aabb(frust, lx, ly, lz, lx + CHUNK_SIZE, ly + CHUNK_SIZE, lz + CHUNK_SIZE))
+				visible.push_back(cell.chunks[i]);
+		}
+	}
+}
+
+ChunkCuller::Bench ChunkCuller::benchmark (View_Frustrum const& frust, int3 center_chunk, int radius) {
+	ZoneScoped;
+
+	ChunkCuller culler;
+
+	chunk_id cid = 0;
+	for (int z=-radius; z<radius; ++z)
+	for (int y=-radius; y<radius; ++y)
+	for (int x=-radius; x<radius; ++x) {
+		if (cid == U16_NULL) break;
+		culler.add(cid++, center_chunk + int3(x,y,z));
+	}
+
+	Bench b;
+	b.chunks = (int)cid;
+
+	auto time_ms = [&] (auto func) {
+		float best = INF;
+		for (int i=0; i<16; ++i) {
+			uint64_t t0 = get_timestamp();
+			func();
+			best = min(best, (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq);
+		}
+		return best;
+	};
+
+	b.scalar_ms = time_ms([&] () { culler.cull_scalar(frust); });
+	auto reference = culler.visible;
+
+	b.cull_ms = time_ms([&] () { culler.cull(frust); });
+	b.visible = (int)culler.visible.size();
+
+	std::sort(reference.begin(), reference.end());
+	std::sort(culler.visible.begin(), culler.visible.end());
+	// chunks exactly touching a plane can differ due to float rounding between the two versions
+	for (size_t i=0, j=0; i < reference.size() || j < culler.visible.size(); ) {
+		if      (j == culler.visible.size() || (i < reference.size() && reference[i] < culler.visible[j])) { b.mismatches++; i++; }
+		else if (i == reference.size() || culler.visible[j] < reference[i]) { b.mismatches++; j++; }
+		else { i++; j++; }
+	}
+
+	return b;
+}
+
+ChunkCuller::Bench ChunkCuller::check_synthetic () {
+	ZoneScoped;
+
+	// odd angles and a camera position that is not a multiple of the chunk size, so no plane runs exactly along chunk faces
+	float3 const rots_deg[] = { float3(0, 0, 0), float3(37, -20, 0), float3(200, 65, 0), float3(-120, -80, 0), float3(95, 10, 0) };
+
+	Bench total;
+	total.failures = 0;
+
+	for (auto& rot : rots_deg) {
+		Camera cam (float3(13.37f, -41.9f, 27.3f), to_radians(rot));
+
+		float3x3 cam_to_world_rot;
+		float3x3 world_to_cam_rot = calc_aer_rotation(cam.rot_aer, &cam_to_world_rot);
+
+		Camera_View v;
+		v.world_to_cam = world_to_cam_rot * translate(-cam.pos);
+		v.cam_to_world = translate(cam.pos) * cam_to_world_rot;
+		v.cam_to_clip = cam.calc_cam_to_clip(int2(1920, 1080), &v.clip_to_cam, &v.frustrum, &v.frustrum_size);
+		v.clip_near = cam.clip_near;
+		v.clip_far = cam.clip_far;
+		v.calc_frustrum();
+
+		auto b = benchmark(v.frustrum, floori(cam.pos / CHUNK_SIZE));
+		total.chunks     += b.chunks;
+		total.visible    += b.visible;
+		total.mismatches += b.mismatches;
+		total.cull_ms    += b.cull_ms;
+		total.scalar_ms  += b.scalar_ms;
+	}
+
+	total.failures = total.mismatches;
+	return total;
+}
+
+void ChunkCuller::imgui () {
+	int chunks = 0;
+	for (auto& c : cells)
+		chunks += c->count;
+
+	ImGui::Text("culling: %6d / %6d chunks visible  %5d cells", (int)visible.size(), chunks, (int)cells.size());
+
+	if (bench.chunks > 0) {
+		ImGui::Text("cull bench: %6d chunks  %6d visible  cull%s: %7.3f ms  scalar: %7.3f ms  (%5.2fx)  %d mismatches",
+			bench.chunks, bench.visible, has_avx2 ? "" : " (no avx2)", bench.cull_ms, bench.scalar_ms, bench.scalar_ms / bench.cull_ms, bench.mismatches);
+	}
+}
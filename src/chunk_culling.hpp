@@ -0,0 +1,63 @@
+#pragma once
+#include "common.hpp"
+#include "chunks.hpp"
+#include "engine/camera.hpp"
+
+// Frustrum culling of chunks for the renderers
+// chunks are grouped into cells of 4^3 chunks that are culled first, so most of the chunks outside the view are rejected per cell
+// the chunks in cells intersecting the frustrum are stored as SoA and culled 8 at a time with AVX2, cpus without it fall back to cull_scalar
+// Pure CPU code, the renderers only consume the visible list
+struct ChunkCuller {
+	static constexpr int CELL_SHIFT = 2;
+	static constexpr int CELL_SIZE = 1 << CELL_SHIFT; // in chunks
+	static constexpr int CELL_CHUNKS = CELL_SIZE * CELL_SIZE * CELL_SIZE;
+
+	struct Cell {
+		int3		pos; // in cells
+		int			count;
+		// world space lo corner of the chunks, chunks are always CHUNK_SIZE cubes
+		alignas(32) float lo_x[CELL_CHUNKS];
+		alignas(32) float lo_y[CELL_CHUNKS];
+		alignas(32) float lo_z[CELL_CHUNKS];
+		chunk_id	chunks[CELL_CHUNKS];
+	};
+
+	std::vector<std::unique_ptr<Cell>>	cells;
+	chunk_pos_map<uint32_t>				cell_map; // cell pos -> index in cells
+
+	// per chunk_id: cell index << 8 | index in cell
+	std::vector<uint32_t>				chunk_slots;
+
+	// output of cull()
+	std::vector<chunk_id>				visible;
+
+	void add (chunk_id cid, int3 const& chunk_pos);
+	void remove (chunk_id cid);
+
+	// cpu_has_avx2(), checked once
+	static const bool has_avx2;
+
+	// fills visible with all chunks intersecting the frustrum (in no particular order)
+	void cull (View_Frustrum const& frust);
+	// cull with AVX2, only call if has_avx2
+	void cull_avx2 (View_Frustrum const& frust);
+	// reference version that tests every chunk on its own (like the renderers used to)
+	void cull_scalar (View_Frustrum const& frust);
+
+	struct Bench {
+		int		chunks = 0;
+		int		visible = 0;
+		int		mismatches = 0;
+		float	cull_ms = 0;
+		float	scalar_ms = 0;
+		int		failures = -1; // mismatches over the views of check_synthetic, -1 if not run yet
+	};
+	Bench bench;
+
+	// cull a synthetic grid of radius^3*8 chunks around center with cull and cull_scalar, and compare the results
+	static Bench benchmark (View_Frustrum const& frust, int3 center_chunk, int radius=16);
+	// benchmark a few synthetic views with the camera off the chunk grid, where cull has to agree exactly with cull_scalar, runs without a gpu or loaded world
+	static Bench check_synthetic ();
+
+	void imgui ();
+};
@@ -0,0 +1,175 @@
+#include "common.hpp"
+#include "chunk_draw_commands.hpp"
+
+void ChunkDrawCommands::begin (int page_count) {
+	this->page_count = page_count;
+
+	pending.clear();
+	ranges.assign(page_count * DRAW_TYPES, { 0, 0 });
+	instances = 0;
+}
+
+void ChunkDrawCommands::finish () {
+	ZoneScoped;
+
+	// counting sort by group, keeps the push order inside of each range
+	uint32_t offset = 0;
+	for (auto& r : ranges) {
+		r.offset = offset;
+		offset += r.count;
+		r.count = 0;
+	}
+
+	cmds.resize(offset);
+	draws.resize(offset);
+
+	for (auto& p : pending) {
+		auto& r = ranges[p.group];
+		uint32_t i = r.offset + r.count++;
+
+		cmds[i] = p.cmd;
+		draws[i] = p.data;
+		instances += p.cmd.instance_count;
+	}
+
+	pending.clear();
+}
+
+void ChunkDrawCommands::build (Chunks& chunks, std::vector<chunk_id> const& visible, float3 const& cam_pos) {
+	ZoneScoped;
+
+	begin(chunks.mesh_heap.page_count());
+
+	for (chunk_id cid : visible) {
+		auto& chunk = chunks[cid];
+		if (chunk.mesh_alloc == MeshAllocator::NULL_ALLOC) continue;
+
+		DrawData data = { (float3)(chunk.pos * CHUNK_SIZE), (float)(1 << chunk.drawn_lod) };
+
+		// the meshes are stored back to back in one allocation, see Chunk::mesh_alloc
+		uint32_t offset = chunks.mesh_heap.offset(chunk.mesh_alloc);
+		int page = (int)(offset / MESH_PAGE_UNITS);
+		uint32_t units = offset % MESH_PAGE_UNITS;
+
+		uint32_t faces_first = units * MESH_UNIT / (uint32_t)sizeof(FaceInstance);
+		units += instance_units(chunk.face_mesh_vertex_count, sizeof(FaceInstance));
+		uint32_t opaque_first = units * MESH_UNIT / (uint32_t)sizeof(BlockMeshInstance);
+		units += instance_units(chunk.opaque_mesh_vertex_count, sizeof(BlockMeshInstance));
+		uint32_t transp_first = units * MESH_UNIT / (uint32_t)sizeof(BlockMeshInstance);
+
+		float3 lo = (float3)(chunk.pos * CHUNK_SIZE);
+		float3 hi = (float3)((chunk.pos + 1) * CHUNK_SIZE);
+
+		uint32_t visible_buckets = chunks.face_bucket_culling ? visible_face_buckets(cam_pos, lo, hi) : ~0u;
+		visible_bucket_ranges(chunk.face_buckets, visible_buckets, [&] (uint32_t first, uint32_t count) {
+			push(DT_FACES, page, faces_first + first, count, data);
+		});
+		if (chunk.opaque_mesh_vertex_count > 0)
+			push(DT_OPAQUE, page, opaque_first, chunk.opaque_mesh_vertex_count, data);
+		if (chunk.transp_mesh_vertex_count > 0)
+			push(DT_TRANSPARENT, page, transp_first, chunk.transp_mesh_vertex_count, data);
+	}
+
+	finish();
+}
+
+ChunkDrawCommands::Bench ChunkDrawCommands::check_synthetic () {
+	ZoneScoped;
+
+	constexpr int PAGES = 5;
+	constexpr int COUNT = 30000;
+
+	struct Input {
+		DrawType	type;
+		int			page;
+		uint32_t	first, count;
+		DrawData	data;
+	};
+	std::vector<Input> input;
+	input.reserve(COUNT);
+
+	uint32_t rng = 0x9e3779b9u;
+	auto next = [&] (uint32_t n) {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng % n;
+	};
+
+	for (int i=0; i<COUNT; ++i) {
+		Input in;
+		in.type = (DrawType)next(DRAW_TYPES);
+		in.page = (int)next(PAGES);
+
+		uint32_t page_length = MESH_PAGE_UNITS * MESH_UNIT / (in.type == DT_FACES ? sizeof(FaceInstance) : sizeof(BlockMeshInstance));
+		in.first = next(page_length - 1);
+		in.count = 1 + next(min(page_length - in.first, 50000u));
+		in.data = { float3((float)next(1000), (float)next(1000), (float)next(1000)), (float)(1 << next(4)) };
+		input.push_back(in);
+	}
+
+	ChunkDrawCommands dc;
+
+	auto run = [&] () {
+		dc.begin(PAGES);
+		for (auto& in : input)
+			dc.push(in.type, in.page, in.first, in.count, in.data);
+		dc.finish();
+	};
+
+	Bench b;
+	b.failures = 0;
+	b.build_ms = INF;
+	for (int i=0; i<16; ++i) {
+		uint64_t t0 = get_timestamp();
+		run();
+		b.build_ms = min(b.build_ms, (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq);
+	}
+	b.draws = (int)dc.cmds.size();
+
+	// reference: the per page draw lists that used to be drawn one drawcall (and one chunk_pos uniform) at a time
+	std::vector<Input> lists[PAGES][DRAW_TYPES];
+	for (auto& in : input)
+		lists[in.page][in.type].push_back(in);
+
+	uint32_t offset = 0;
+	size_t instances = 0;
+	for (int p=0; p<PAGES; ++p)
+	for (int t=0; t<DRAW_TYPES; ++t) {
+		auto& list = lists[p][t];
+		auto& r = dc.range(p, (DrawType)t);
+
+		if (r.offset != offset || r.count != (uint32_t)list.size()) {
+			b.failures++;
+			continue;
+		}
+		offset += r.count;
+
+		for (uint32_t i=0; i<r.count; ++i) {
+			auto& in = list[i];
+			auto& cmd = dc.cmds[r.offset + i];
+			auto& data = dc.draws[r.offset + i];
+
+			bool ok = cmd.vertex_count == (uint32_t)BlockMeshes::MERGE_INSTANCE_FACTOR &&
+				cmd.instance_count == in.count &&
+				cmd.first_vertex == 0 &&
+				cmd.first_instance == in.first &&
+				memcmp(&data, &in.data, sizeof(DrawData)) == 0;
+			if (!ok) b.failures++;
+
+			instances += in.count;
+		}
+	}
+	if (offset != (uint32_t)dc.cmds.size() || instances != dc.instances)
+		b.failures++;
+
+	return b;
+}
+
+void ChunkDrawCommands::imgui () {
+	int multidraws = 0;
+	for (auto& r : ranges)
+		multidraws += r.count > 0 ? 1 : 0;
+
+	ImGui::Text("indirect draws: %6d in %2d multidraws", (int)cmds.size(), multidraws);
+}
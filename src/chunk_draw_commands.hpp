@@ -0,0 +1,87 @@
+#pragma once
+#include "common.hpp"
+#include "chunks.hpp"
+
+// Indirect draw commands for the chunk meshes
+// the culling pass emits one command per visible mesh (or face bucket range), packed into one array grouped by (mesh heap page, draw type),
+// so the renderers can draw each group with a single glMultiDrawArraysIndirect / vkCmdDrawIndirect instead of one drawcall per mesh
+// the per draw data (chunk pos and voxel scale) is a parallel array, the chunk shader reads draws[draw_offset + gl_DrawID]
+// Pure CPU code, the renderers only upload the arrays and submit the ranges
+struct ChunkDrawCommands {
+	enum DrawType { DT_FACES=0, DT_OPAQUE=1, DT_TRANSPARENT=2, DRAW_TYPES };
+
+	// same layout as DrawArraysIndirectCommand in GL and VkDrawIndirectCommand
+	struct DrawCmd {
+		uint32_t	vertex_count; // vertices of one block mesh instance
+		uint32_t	instance_count;
+		uint32_t	first_vertex;
+		uint32_t	first_instance; // instance in the page
+	};
+	static_assert(sizeof(DrawCmd) == 16, "");
+
+	// std430 compatible
+	struct DrawData {
+		float3		chunk_pos;
+		float		voxel_scale; // lod meshes have bigger voxels
+	};
+	static_assert(sizeof(DrawData) == 16, "");
+
+	// cmds[offset, offset+count) are drawn with the vertex buffer of one page
+	struct Range {
+		uint32_t	offset;
+		uint32_t	count;
+	};
+
+	int						page_count = 0;
+
+	std::vector<DrawCmd>	cmds;
+	std::vector<DrawData>	draws;
+	std::vector<Range>		ranges; // [page * DRAW_TYPES + type]
+
+	size_t					instances = 0; // sum of instance_count
+
+	Range const& range (int page, DrawType type) const {
+		return ranges[page * DRAW_TYPES + type];
+	}
+	int count (DrawType type) const {
+		int n = 0;
+		for (int p=0; p<page_count; ++p)
+			n += (int)range(p, type).count;
+		return n;
+	}
+
+	// clears the commands, the pages of the mesh heap determine the number of ranges
+	void begin (int page_count);
+	// emit the command for the instances [first, first+count) of a mesh heap page
+	void push (DrawType type, int page, uint32_t first, uint32_t count, DrawData const& data) {
+		assert(page < page_count);
+
+		uint32_t group = page * DRAW_TYPES + type;
+		pending.push_back({ group, { (uint32_t)BlockMeshes::MERGE_INSTANCE_FACTOR, count, 0, first }, data });
+		ranges[group].count++;
+	}
+	// sort the pushed commands into their ranges
+	void finish ();
+
+	// emit the commands for all meshes of the visible chunks, with face bucket culling if enabled
+	void build (Chunks& chunks, std::vector<chunk_id> const& visible, float3 const& cam_pos);
+
+	struct Bench {
+		int		failures = -1; // -1 if not run yet
+		int		draws = 0;
+		float	build_ms = 0;
+	};
+
+	// push a synthetic set of mesh ranges and check the packed output against the drawcall list the renderers used to emit, runs without a gpu
+	static Bench check_synthetic ();
+
+	void imgui ();
+
+private:
+	struct Pending {
+		uint32_t	group;
+		DrawCmd		cmd;
+		DrawData	data;
+	};
+	std::vector<Pending>	pending;
+};
@@ -3,6 +3,9 @@
 #include "world_generator.hpp"
 #include "assets.hpp"
 #include "player.hpp"
+#include "chunk_visibility.hpp"
+
+#include "immintrin.h"
 
 struct CallCtx {
 	RemeshChunkJob& j;
@@ -44,6 +47,8 @@ struct CallCtx {
 			v->posz = fixd_posz;
 			v->texid = texid;
 			v->meshid = meshid;
+			v->size[0] = 1;
+			v->size[1] = 1;
 		}
 	}
 
@@ -56,29 +61,30 @@ struct CallCtx {
 		v->posz = (int16_t)(z << BlockMeshInstance_FIXEDPOINT_SHIFT);
 		v->texid = j.block_tiles[bid].calc_tex_index(facei, 0);
 		v->meshid = facei;
+		v->size[0] = 1;
+		v->size[1] = 1;
 	}
 
 	template <int AXIS>
 	void face (block_id bid, block_id nid) const {
-		if (!j.mesh_world_border && (bid == B_NULL || nid == B_NULL))
+		// collision, transparency, block mesh and mesh_world_border checks are all baked into the lut
+		uint8_t f = j.face_lut[((uint32_t)bid << j.face_lut_shift) | nid];
+		if (f == 0)
 			return;
 
-		auto& b  = j.block_types[bid];
-		auto& nb = j.block_types[nid];
+		ChunkMeshData* meshes[2] = { &j.opaque_vertices, &j.transp_vertices };
 
 		// generate face of our voxel that faces negative direction neighbour
-		if (b.collision != CM_GAS && nb.transparency != TM_OPAQUE && j.block_meshes[bid] < 0) {
-			auto* mesh = b.transparency == TM_TRANSPARENT ? &j.transp_vertices : &j.opaque_vertices;
-			face(j, bid, x,y,z, mesh, (BlockFace)(BF_NEG_X + AXIS*2));
+		if (f & BlockFaceLUT::EMIT) {
+			face(j, bid, x,y,z, meshes[(f & BlockFaceLUT::EMIT_TRANSP) != 0], (BlockFace)(BF_NEG_X + AXIS*2));
 		}
 
 		// generate face of negative direction neighbour that faces this voxel
-		if (nb.collision != CM_GAS && b.transparency != TM_OPAQUE && j.block_meshes[nid] < 0 && nid != B_NULL) {
-			auto* mesh = nb.transparency == TM_TRANSPARENT ? &j.transp_vertices : &j.opaque_vertices;
+		if (f & BlockFaceLUT::NEMIT) {
 			int nx = AXIS == 0 ? x-1 : x;
 			int ny = AXIS == 1 ? y-1 : y;
 			int nz = AXIS == 2 ? z-1 : z;
-			face(j, nid, nx,ny,nz, mesh, (BlockFace)(BF_POS_X + AXIS*2));
+			face(j, nid, nx,ny,nz, meshes[(f & BlockFaceLUT::NEMIT_TRANSP) != 0], (BlockFace)(BF_POS_X + AXIS*2));
 		}
 	}
 	
@@ -130,7 +136,8 @@ struct CallCtx {
 	//  numbers: meshing can be as fast as 32us for mostly sparse chunks compared to 0.5ms-2ms for normal chunks
 	//    thats a 30x speedup for air and stone chunks! 
 	//    and even ragular chunks get some speedup due to empty regions, although currently the overhead makes me slightly slower than a dense 3d arary version was if I remember ~.5ms timings correctly
-
+	// WORLD_BORDER: mesh_world_border, without it whole sparse subchunk borders towards unloaded (B_NULL) space are skipped
+	template <bool WORLD_BORDER>
 	void mesh_chunk () {
 		ZoneScopedN("mesh_chunk");
 
@@ -148,6 +155,12 @@ struct CallCtx {
 			int subc_offs_cz = sz > 0 ? -SCZ : SCZ*(SUBCHUNK_COUNT-1);
 			_Chunk* subc_chunkz = sz > 0 ? &chunk : &chunkz;
 
+			if ((j.slabs & (1u << MESH_SLAB(sz))) == 0) { // slab unchanged, keep old segment
+				subchunk_i += SCZ;
+				end_slab(MESH_SLAB(sz));
+				continue;
+			}
+
 		for (int sy = 0; sy < CHUNK_SIZE; sy += SUBCHUNK_SIZE) {
 			int subc_offs_cy = sy > 0 ? -SCY : SCY*(SUBCHUNK_COUNT-1);
 			_Chunk* subc_chunky = sy > 0 ? &chunk : &chunky;
@@ -164,9 +177,14 @@ struct CallCtx {
 			if (sc.sparse) {
 				block_id bid = *sc.ptr;
 
+				// no faces between B_NULL and anything else without world border
+				bool null_sc = !WORLD_BORDER && bid == B_NULL;
+
 				// X faces
 				if (scx.sparse && *scx.ptr == bid) {
 					// both subchunks sparse and cannot generate any faces
+				} else if (null_sc || (!WORLD_BORDER && scx.sparse && *scx.ptr == B_NULL)) {
+					// subchunk border towards unloaded chunk
 				} else {
 					uint32_t block_i = 0;
 
@@ -185,6 +203,8 @@ struct CallCtx {
 				// Y faces
 				if (scy.sparse && *scy.ptr == bid) {
 					// both subchunks sparse and cannot generate any faces
+				} else if (null_sc || (!WORLD_BORDER && scy.sparse && *scy.ptr == B_NULL)) {
+					// subchunk border towards unloaded chunk
 				} else {
 					uint32_t block_i = 0;
 
@@ -204,6 +224,8 @@ struct CallCtx {
 				// Z faces
 				if (scz.sparse && *scz.ptr == bid) {
 					// both subchunks sparse and cannot generate any faces
+				} else if (null_sc || (!WORLD_BORDER && scz.sparse && *scz.ptr == B_NULL)) {
+					// subchunk border towards unloaded chunk
 				} else {
 					uint32_t block_i = 0;
 
@@ -527,15 +549,693 @@ struct CallCtx {
 			subchunk_i++;
 		}
 		}
+			end_slab(MESH_SLAB(sz));
 		}
 
 		ZoneValue(_dense_subchunks);
 	}
+
+	//// Binary mesher
+	// CHUNK_SIZE == 64, so a row of voxels along x fits into a uint64_t
+	// build per-row bitmasks of the properties face() looks at, then find visible faces of a whole row with a few word ops
+	//  and only touch voxels that actually generate faces (via tzcnt)
+	// generates the same faces as mesh_chunk, just in a different order
+	enum : uint8_t { BR_EMIT=1, BR_OPAQUE=2, BR_NULL=4, BR_BMESH=8 };
+
+	struct BinaryRow {
+		uint64_t	emit;   // not gas and no block mesh -> can generate cube faces
+		uint64_t	opaque; // TM_OPAQUE
+		uint64_t	null;   // B_NULL
+		uint64_t	bmesh;  // has block mesh
+	};
+	struct BinaryMasks {
+		BinaryRow	rows[CHUNK_SIZE+1][CHUNK_SIZE+1]; // [z+1][y+1] including the border rows of the -y and -z neighbour chunks
+		uint8_t		xborder[CHUNK_SIZE][CHUNK_SIZE]; // [z][y] flags of the -x neighbour chunk voxels
+	};
+
+	uint8_t const* flags;
+
+	void build_row (_Chunk& c, int y, int z, BinaryRow& row) {
+		row = {};
+		for (int sx=0; sx<CHUNK_SIZE; sx += SUBCHUNK_SIZE) {
+			auto sc = get_subchunk(SUBCHUNK_IDX(sx,y,z), c);
+			if (sc.sparse) {
+				uint8_t f = flags[*sc.ptr];
+				uint64_t bits = ((1ull << SUBCHUNK_SIZE) - 1) << sx;
+				if (f & BR_EMIT  ) row.emit   |= bits;
+				if (f & BR_OPAQUE) row.opaque |= bits;
+				if (f & BR_NULL  ) row.null   |= bits;
+				if (f & BR_BMESH ) row.bmesh  |= bits;
+			} else {
+				block_id* p = &sc.ptr[BLOCK_IDX(0,y,z)];
+				for (int bx=0; bx<SUBCHUNK_SIZE; ++bx) {
+					uint64_t f = flags[p[bx]];
+					int shift = sx + bx;
+					row.emit   |= ((f     ) & 1) << shift;
+					row.opaque |= ((f >> 1) & 1) << shift;
+					row.null   |= ((f >> 2) & 1) << shift;
+					row.bmesh  |= ((f >> 3) & 1) << shift;
+				}
+			}
+		}
+	}
+
+	// A: row of this chunk  B: row of the neighbours in -AXIS direction
+	template <int AXIS>
+	void row_faces (BinaryRow const& A, BinaryRow const& B, _Chunk& chunk, _Chunk& nchunk, int ry, int rz) {
+		uint64_t valid = j.mesh_world_border ? ~0ull : ~(A.null | B.null);
+
+		uint64_t negf = A.emit & ~B.opaque & valid; // faces of A facing B
+		uint64_t posf = B.emit & ~A.opaque & ~B.null & valid; // faces of B facing A
+		uint64_t cmp = ~A.opaque & ~B.opaque; // same block ids never generate faces, only possible if both are not opaque
+
+		uint64_t bits = negf | posf;
+		while (bits) {
+			int bx = (int)_tzcnt_u64(bits);
+			uint64_t bit = 1ull << bx;
+			bits &= bits - 1;
+
+			x = bx; y = ry; z = rz;
+			int nx = AXIS == 0 ? x-1 : x;
+			int ny = AXIS == 1 ? y-1 : y;
+			int nz = AXIS == 2 ? z-1 : z;
+
+			block_id bid = get_subchunk(SUBCHUNK_IDX(x,y,z), chunk).read(BLOCK_IDX(x,y,z));
+			block_id nid = get_subchunk(SUBCHUNK_IDX(nx & CHUNK_SIZE_MASK, ny & CHUNK_SIZE_MASK, nz & CHUNK_SIZE_MASK), nx < 0 || ny < 0 || nz < 0 ? nchunk : chunk)
+				.read(BLOCK_IDX(nx, ny, nz));
+
+			if ((cmp & bit) && bid == nid)
+				continue;
+
+			if (negf & bit) {
+				auto* mesh = j.block_types[bid].transparency == TM_TRANSPARENT ? &j.transp_vertices : &j.opaque_vertices;
+				face(j, bid, x,y,z, mesh, (BlockFace)(BF_NEG_X + AXIS*2));
+			}
+			if (posf & bit) {
+				auto* mesh = j.block_types[nid].transparency == TM_TRANSPARENT ? &j.transp_vertices : &j.opaque_vertices;
+				face(j, nid, nx,ny,nz, mesh, (BlockFace)(BF_POS_X + AXIS*2));
+			}
+		}
+	}
+
+	void mesh_chunk_binary () {
+		ZoneScopedN("mesh_chunk_binary");
+
+		std::vector<uint8_t> flags_lut(j.block_type_count);
+		for (int bid=0; bid<j.block_type_count; ++bid) {
+			auto& b = j.block_types[bid];
+			uint8_t f = 0;
+			if (b.collision != CM_GAS && j.block_meshes[bid] < 0) f |= BR_EMIT;
+			if (b.transparency == TM_OPAQUE)                      f |= BR_OPAQUE;
+			if (bid == B_NULL)                                    f |= BR_NULL;
+			if (j.block_meshes[bid] >= 0)                         f |= BR_BMESH;
+			flags_lut[bid] = f;
+		}
+		flags = flags_lut.data();
+
+		auto chunk  = get_chunk(j.chunk   );
+		auto chunkx = get_chunk(j.chunk_nx);
+		auto chunky = get_chunk(j.chunk_ny);
+		auto chunkz = get_chunk(j.chunk_nz);
+
+		// too big for the stack of the threadpool threads
+		std::unique_ptr<BinaryMasks> m (new BinaryMasks);
+
+		for (int slab=0; slab<MESH_SLABS; ++slab) {
+			int z0 = slab * SUBCHUNK_SIZE;
+			if ((j.slabs & (1u << slab)) == 0) { // slab unchanged, keep old segment
+				end_slab(slab);
+				continue;
+			}
+
+			{
+				ZoneScopedN("build masks");
+
+				for (int z=z0; z<z0+SUBCHUNK_SIZE; ++z) {
+					for (int y=0; y<CHUNK_SIZE; ++y)
+						build_row(chunk, y, z, m->rows[z+1][y+1]);
+
+					build_row(chunky, CHUNK_SIZE-1, z, m->rows[z+1][0]);
+
+					for (int y=0; y<CHUNK_SIZE; ++y) {
+						int x = CHUNK_SIZE-1;
+						m->xborder[z][y] = flags[ get_subchunk(SUBCHUNK_IDX(x,y,z), chunkx).read(BLOCK_IDX(x,y,z)) ];
+					}
+				}
+
+				// rows below the slab, unless they were already built for the previous slab
+				if (z0 == 0) {
+					for (int y=0; y<CHUNK_SIZE; ++y)
+						build_row(chunkz, y, CHUNK_SIZE-1, m->rows[0][y+1]);
+				} else if ((j.slabs & (1u << (slab-1))) == 0) {
+					for (int y=0; y<CHUNK_SIZE; ++y)
+						build_row(chunk, y, z0-1, m->rows[z0][y+1]);
+				}
+			}
+
+			for (int rz=z0; rz<z0+SUBCHUNK_SIZE; ++rz)
+			for (int ry=0; ry<CHUNK_SIZE; ++ry) {
+				auto& A = m->rows[rz+1][ry+1];
+
+				{ // X faces, -x neighbour is the same row shifted by one
+					uint64_t xb = m->xborder[rz][ry];
+					BinaryRow B;
+					B.emit   = (A.emit   << 1) | ((xb     ) & 1);
+					B.opaque = (A.opaque << 1) | ((xb >> 1) & 1);
+					B.null   = (A.null   << 1) | ((xb >> 2) & 1);
+					row_faces<0>(A, B, chunk, chunkx, ry, rz);
+				}
+				row_faces<1>(A, m->rows[rz+1][ry], chunk, chunky, ry, rz);
+				row_faces<2>(A, m->rows[rz][ry+1], chunk, chunkz, ry, rz);
+
+				// Block meshes
+				uint64_t bits = A.bmesh;
+				while (bits) {
+					x = (int)_tzcnt_u64(bits); y = ry; z = rz;
+					bits &= bits - 1;
+
+					block_id bid = get_subchunk(SUBCHUNK_IDX(x,y,z), chunk).read(BLOCK_IDX(x,y,z));
+					block_mesh(bid, j.block_meshes[bid]);
+				}
+			}
+
+			end_slab(slab);
+		}
+	}
+
+	// Simple dense mesher for lod chunks, which store (CHUNK_SIZE >> lod)^3 coarse voxels in the first subchunks
+	void mesh_lod_chunk () {
+		ZoneScopedN("mesh_lod_chunk");
+
+		auto chunk = get_chunk(j.chunk);
+
+		mesh_lod_grid(CHUNK_SIZE >> j.lod, [&] (int x, int y, int z) {
+			auto sc = get_subchunk(SUBCHUNK_IDX(x,y,z), chunk);
+			return sc.read(BLOCK_IDX(x,y,z));
+		});
+	}
+
+	// Mesh lod of full res chunks, voxels are downsampled by majority vote of each (1 << mesh_lod)^3 cell
+	// block meshes vote for air since they are not drawn at lod distances anyway
+	void mesh_downsampled_chunk () {
+		ZoneScopedN("mesh_downsampled_chunk");
+
+		int s = 1 << j.mesh_lod;
+		int n = CHUNK_SIZE >> j.mesh_lod;
+		static_assert(SUBCHUNK_SIZE >= 8, "cells need to be contained in single subchunks");
+
+		auto chunk = get_chunk(j.chunk);
+
+		std::vector<block_id> grid (n*n*n);
+
+		for (int cz=0; cz<n; ++cz)
+		for (int cy=0; cy<n; ++cy)
+		for (int cx=0; cx<n; ++cx) {
+			int x0 = cx*s, y0 = cy*s, z0 = cz*s;
+
+			grid[IDX3D(cx,cy,cz, n)] = downsample_cell(chunk, x0,y0,z0, s);
+		}
+
+		mesh_lod_grid(n, [&] (int x, int y, int z) {
+			return grid[IDX3D(x,y,z, n)];
+		});
+	}
+
+	// majority vote of the s^3 full res voxels of chunk at x0,y0,z0
+	block_id downsample_cell (_Chunk& chunk, int x0, int y0, int z0, int s) {
+		auto sc = get_subchunk(SUBCHUNK_IDX(x0,y0,z0), chunk);
+		if (sc.sparse) {
+			block_id bid = *sc.ptr;
+			return j.block_meshes[bid] >= 0 ? j.air_id : bid;
+		}
+
+		struct Vote { block_id bid; int count; };
+		Vote votes[32];
+		int vote_count = 0;
+
+		for (int z=z0; z<z0+s; ++z)
+		for (int y=y0; y<y0+s; ++y)
+		for (int x=x0; x<x0+s; ++x) {
+			block_id bid = sc.ptr[BLOCK_IDX(x,y,z)];
+			if (j.block_meshes[bid] >= 0) bid = j.air_id;
+
+			int i = 0;
+			while (i < vote_count && votes[i].bid != bid) i++;
+
+			if (i < vote_count)      votes[i].count++;
+			else if (i < (int)ARRLEN(votes)) votes[vote_count++] = { bid, 1 }; // more distinct block types in one cell are simply ignored
+		}
+
+		int best = 0;
+		for (int i=1; i<vote_count; ++i) {
+			if (votes[i].count > votes[best].count)
+				best = i;
+		}
+		return votes[best].bid;
+	}
+
+	// mesh a dense n^3 grid of coarse voxels (positions are in coarse voxels, the renderer scales them via voxel_scale)
+	// faces on the chunk border are always generated since neighbours can have a different lod, this avoids holes at the cost of some overdraw
+	// full res neighbours generate the faces of their voxels towards us from our coarse voxels (see lod_border_faces)
+	template <typename READ>
+	void mesh_lod_grid (int n, READ read) {
+		for (z=0; z<n; ++z)
+		for (y=0; y<n; ++y)
+		for (x=0; x<n; ++x) {
+			block_id bid = read(x,y,z);
+
+			auto& b = j.block_types[bid];
+			if (b.collision == CM_GAS || j.block_meshes[bid] >= 0)
+				continue; // block meshes are too small to be seen at lod distances
+
+			auto* mesh = b.transparency == TM_TRANSPARENT ? &j.transp_vertices : &j.opaque_vertices;
+
+			for (int facei=0; facei<6; ++facei) {
+				int3 np = int3(x,y,z) + NEIGHBOURS[facei];
+
+				if (np.x >= 0 && np.x < n && np.y >= 0 && np.y < n && np.z >= 0 && np.z < n) {
+					block_id nid = read(np.x, np.y, np.z);
+					if (nid == bid || j.block_types[nid].transparency == TM_OPAQUE)
+						continue;
+				}
+
+				face(j, bid, x,y,z, mesh, (BlockFace)facei);
+			}
+		}
+	}
+
+	// coarse voxel of each lod neighbour next to our border voxels, [v * CHUNK_SIZE + u] with the axes of lod_border_faces
+	std::vector<block_id> lod_borders[6];
+
+	void read_lod_borders () {
+		ZoneScopedN("read_lod_borders");
+
+		for (int facei=0; facei<6; ++facei) {
+			chunk_id nid = j.lod_neighbours[facei];
+			// with mesh_world_border our faces towards the (null) neg neighbours are generated anyway
+			if (nid == U16_NULL || (!(facei & 1) && j.mesh_world_border))
+				continue;
+
+			int a = facei >> 1;
+			int ua = a == 0 ? 1 : 0;
+			int va = a == 2 ? 1 : 2;
+			int s = 1 << j.lod_neighbour_lods[facei];
+
+			auto nchunk = get_chunk(nid);
+			auto& border = lod_borders[facei];
+			border.resize(CHUNK_SIZE * CHUNK_SIZE);
+
+			int3 c;
+			c[a] = facei & 1 ? 0 : (CHUNK_SIZE-1) / s; // coarse voxel of the neighbour touching our border
+			for (int cv=0; cv<CHUNK_SIZE/s; ++cv)
+			for (int cu=0; cu<CHUNK_SIZE/s; ++cu) {
+				c[ua] = cu; c[va] = cv;
+
+				block_id bid;
+				if (j.lod_neighbour_downsampled[facei]) {
+					bid = downsample_cell(nchunk, c.x*s, c.y*s, c.z*s, s);
+				} else {
+					bid = get_subchunk(SUBCHUNK_IDX(c.x,c.y,c.z), nchunk).read(BLOCK_IDX(c.x,c.y,c.z));
+					if (j.block_meshes[bid] >= 0) bid = j.air_id; // not drawn by mesh_lod_grid
+				}
+
+				for (int v=cv*s; v<cv*s+s; ++v)
+				for (int u=cu*s; u<cu*s+s; ++u)
+					border[v * CHUNK_SIZE + u] = bid;
+			}
+		}
+	}
+
+	// faces of our border voxels towards lod neighbours that lie in slab, neither mesher generates them otherwise
+	// since get_neighbour_blocks treats the neighbour as null and its lod mesh only has the faces of its own voxels
+	void lod_border_faces (int slab) {
+		ChunkMeshData* meshes[2] = { &j.opaque_vertices, &j.transp_vertices };
+		auto chunk = get_chunk(j.chunk);
+
+		for (int facei=0; facei<6; ++facei) {
+			auto& border = lod_borders[facei];
+			if (border.empty())
+				continue;
+
+			int a = facei >> 1;
+			int ua = a == 0 ? 1 : 0;
+			int va = a == 2 ? 1 : 2; // z is always v for X and Y faces
+
+			int3 p;
+			p[a] = facei & 1 ? CHUNK_SIZE-1 : 0;
+
+			int v0 = 0, v1 = CHUNK_SIZE;
+			if (a == 2) {
+				if (MESH_SLAB(p.z) != slab) continue;
+			} else {
+				v0 = slab * SUBCHUNK_SIZE;
+				v1 = v0 + SUBCHUNK_SIZE;
+			}
+
+			for (int v=v0; v<v1; ++v)
+			for (int u=0; u<CHUNK_SIZE; ++u) {
+				p[ua] = u; p[va] = v;
+
+				block_id bid = get_subchunk(SUBCHUNK_IDX(p.x,p.y,p.z), chunk).read(BLOCK_IDX(p.x,p.y,p.z));
+				uint8_t f = j.face_lut[((uint32_t)bid << j.face_lut_shift) | border[v * CHUNK_SIZE + u]];
+				if (f & BlockFaceLUT::EMIT)
+					face(j, bid, p.x,p.y,p.z, meshes[(f & BlockFaceLUT::EMIT_TRANSP) != 0], (BlockFace)facei);
+			}
+		}
+	}
+
+	// called by the full res meshers after each slab
+	void end_slab (int slab) {
+		if (j.slabs & (1u << slab))
+			lod_border_faces(slab);
+		j.end_slab(slab);
+	}
+
+	// Cave culling connectivity of the full res voxels of the chunk
+	FaceConnections face_connections () {
+		ZoneScopedN("face_connections");
+
+		auto chunk = get_chunk(j.chunk);
+
+		// too big for the stack of the threadpool threads
+		std::unique_ptr<OpenVoxels> open (new OpenVoxels);
+
+		for (int z=0; z<CHUNK_SIZE; ++z)
+		for (int y=0; y<CHUNK_SIZE; ++y) {
+			uint64_t row = 0;
+			for (int sx=0; sx<CHUNK_SIZE; sx += SUBCHUNK_SIZE) {
+				auto sc = get_subchunk(SUBCHUNK_IDX(sx,y,z), chunk);
+				if (sc.sparse) {
+					if (j.block_types[*sc.ptr].transparency != TM_OPAQUE)
+						row |= ((1ull << SUBCHUNK_SIZE) - 1) << sx;
+				} else {
+					block_id* p = &sc.ptr[BLOCK_IDX(0,y,z)];
+					for (int bx=0; bx<SUBCHUNK_SIZE; ++bx)
+						row |= (uint64_t)(j.block_types[p[bx]].transparency != TM_OPAQUE) << (sx + bx);
+				}
+			}
+			open->rows[z][y] = row;
+		}
+
+		return compute_face_connections(*open);
+	}
 };
 
+void greedy_merge_faces (std::vector<BlockMeshInstance>& instances) {
+	ZoneScoped;
+	static_assert(CHUNK_SIZE == 64, "key packing assumes 6 bits per coord");
+
+	struct Face {
+		uint32_t	key; // facei | depth+1 | v | u  -> sorting groups faces into planes in scan order
+		uint16_t	texid;
+	};
+	std::vector<Face> faces;
+	std::vector<BlockMeshInstance> others;
+
+	// face quads are the first 6 block mesh slices, stretched along these axes
+	auto axis_u = [] (int axis) { return axis == 0 ? 1 : 0; };
+	auto axis_v = [] (int axis) { return axis == 2 ? 1 : 2; };
+
+	{ // split instances into cube faces and block meshes
+		faces.reserve(instances.size());
+
+		for (auto& v : instances) {
+			if (v.meshid >= 6) {
+				others.push_back(v);
+				continue;
+			}
+
+			int axis = v.meshid / 2;
+			int p[3] = { v.posx >> BlockMeshInstance_FIXEDPOINT_SHIFT,
+			             v.posy >> BlockMeshInstance_FIXEDPOINT_SHIFT,
+			             v.posz >> BlockMeshInstance_FIXEDPOINT_SHIFT };
+
+			// depth can be -1 for faces of the neg neighbour chunk voxels, so it gets 7 bits
+			uint32_t key = ((uint32_t)v.meshid << 19) | ((uint32_t)(p[axis] + 1) << 12) | ((uint32_t)p[axis_v(axis)] << 6) | (uint32_t)p[axis_u(axis)];
+			faces.push_back({ key, v.texid });
+		}
+	}
+
+	std::sort(faces.begin(), faces.end(), [] (Face const& l, Face const& r) { return l.key < r.key; });
+
+	auto& out = instances;
+	out = std::move(others);
+
+	// texid+1 of faces in the current plane, 0 for no face
+	// merged rects are cleared while scanning, so it is all zeros again after each plane
+	uint16_t mask[CHUNK_SIZE][CHUNK_SIZE] = {};
+
+	for (size_t i=0; i<faces.size();) {
+		uint32_t plane = faces[i].key >> 12;
+
+		size_t end = i;
+		for (; end < faces.size() && (faces[end].key >> 12) == plane; ++end) {
+			auto& f = faces[end];
+			mask[(f.key >> 6) & 63][f.key & 63] = f.texid + 1;
+		}
+
+		int facei = (int)(plane >> 7);
+		int depth = (int)(plane & 127) - 1;
+		int axis  = facei / 2;
+
+		int v0 = (faces[i    ].key >> 6) & 63;
+		int v1 = (faces[end-1].key >> 6) & 63;
+
+		for (int v=v0; v<=v1; ++v)
+		for (int u=0; u<CHUNK_SIZE;) {
+			uint16_t t = mask[v][u];
+			if (t == 0) { ++u; continue; }
+
+			int w = 1;
+			while (u+w < CHUNK_SIZE && mask[v][u+w] == t)
+				w++;
+
+			int h = 1;
+			for (; v+h < CHUNK_SIZE; ++h) {
+				bool row = true;
+				for (int k=u; k<u+w; ++k)
+					row = row && mask[v+h][k] == t;
+				if (!row) break;
+			}
+
+			for (int dv=0; dv<h; ++dv)
+			for (int du=0; du<w; ++du)
+				mask[v+dv][u+du] = 0;
+
+			int p[3];
+			p[axis] = depth;
+			p[axis_u(axis)] = u;
+			p[axis_v(axis)] = v;
+
+			BlockMeshInstance inst;
+			inst.posx = (int16_t)(p[0] << BlockMeshInstance_FIXEDPOINT_SHIFT);
+			inst.posy = (int16_t)(p[1] << BlockMeshInstance_FIXEDPOINT_SHIFT);
+			inst.posz = (int16_t)(p[2] << BlockMeshInstance_FIXEDPOINT_SHIFT);
+			inst.meshid = (uint16_t)facei;
+			inst.texid = t - 1;
+			inst.size[0] = (uint8_t)w;
+			inst.size[1] = (uint8_t)h;
+			out.push_back(inst);
+
+			u += w;
+		}
+
+		i = end;
+	}
+}
+
+ChunkSliceData* SlicePool::alloc () {
+	auto& cache = thread_cache();
+
+	if (cache.count == 0) {
+		// refill half of the thread cache from the global cache
+		std::lock_guard<std::mutex> lock(mutex);
+
+		while (cache.count < THREAD_CACHE/2 && !global.empty()) {
+			cache.slices[cache.count++] = global.back();
+			global.pop_back();
+		}
+	}
+
+	if (cache.count > 0) {
+		reuses.fetch_add(1, std::memory_order_relaxed);
+		return cache.slices[--cache.count];
+	}
+
+	ZoneScopedNC("malloc slice", tracy::Color::Crimson);
+	mallocs.fetch_add(1, std::memory_order_relaxed);
+	return (ChunkSliceData*)malloc(sizeof(ChunkSliceData));
+}
+void SlicePool::free (ChunkSliceData* s) {
+	auto& cache = thread_cache();
+
+	if (cache.count == THREAD_CACHE) {
+		// move half of the thread cache to the global cache, free what does not fit
+		ChunkSliceData* overflow[THREAD_CACHE/2];
+		int overflow_count = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			while (cache.count > THREAD_CACHE/2) {
+				auto* slice = cache.slices[--cache.count];
+				if (global.size() < GLOBAL_CACHE)
+					global.push_back(slice);
+				else
+					overflow[overflow_count++] = slice;
+			}
+		}
+
+		if (overflow_count > 0) {
+			ZoneScopedNC("free slices", tracy::Color::Crimson);
+			frees.fetch_add(overflow_count, std::memory_order_relaxed);
+			for (int i=0; i<overflow_count; ++i)
+				::free(overflow[i]);
+		}
+	}
+
+	cache.slices[cache.count++] = s;
+}
+SlicePool::ThreadCache::~ThreadCache () {
+	// thread exit: the pool itself might be destroyed already, so simply free
+	for (int i=0; i<count; ++i)
+		::free(slices[i]);
+}
+
+void SlicePool::imgui () {
+	uint32_t cached;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cached = (uint32_t)global.size();
+	}
+	ImGui::Text("slice pool: %4d cached (%.1f MB)  %6d mallocs  %6d frees  %8d reuses",
+		cached, (float)(cached * sizeof(ChunkSliceData)) / (1024*1024),
+		mallocs.load(), frees.load(), reuses.load());
+}
+
+void RemeshChunkJob::end_slab (int slab) {
+	opaque_seg_end[slab] = opaque_vertices.vertex_count();
+	transp_seg_end[slab] = transp_vertices.vertex_count();
+}
+
+// copy instances [begin, end) of mesh
+static void copy_instances (ChunkMeshData& mesh, uint32_t begin, uint32_t end, std::vector<BlockMeshInstance>& out) {
+	out.clear();
+	out.reserve(end - begin);
+	for (uint32_t i=begin; i<end;) {
+		auto* slice = mesh.slices[i / CHUNK_SLICE_LENGTH];
+		uint32_t count = std::min(end - i, CHUNK_SLICE_LENGTH - i % CHUNK_SLICE_LENGTH);
+		out.insert(out.end(), &slice->verts[i % CHUNK_SLICE_LENGTH], &slice->verts[i % CHUNK_SLICE_LENGTH] + count);
+		i += count;
+	}
+}
+
+void RemeshChunkJob::assemble_segments () {
+	ZoneScoped;
+
+	// newly meshed slabs need to be split out, unless the mesh can be used as is
+	if (!greedy && !segments && slabs == ALL_MESH_SLABS)
+		return;
+
+	ChunkMeshData opaque, transp;
+
+	uint32_t opaque_begin = 0, transp_begin = 0;
+	for (int slab=0; slab<MESH_SLABS; ++slab) {
+		if (slabs & (1u << slab)) {
+			copy_instances(opaque_vertices, opaque_begin, opaque_seg_end[slab], new_opaque[slab]);
+			copy_instances(transp_vertices, transp_begin, transp_seg_end[slab], new_transp[slab]);
+
+			if (greedy)
+				greedy_merge_faces(new_opaque[slab]); // transparent faces (water) are left alone, since they are displaced per voxel in the shader
+		}
+		opaque_begin = opaque_seg_end[slab];
+		transp_begin = transp_seg_end[slab];
+
+		// splice old segments and new ones back together
+		auto& o = slabs & (1u << slab) ? new_opaque[slab] : segments->opaque[slab];
+		auto& t = slabs & (1u << slab) ? new_transp[slab] : segments->transp[slab];
+		for (auto& v : o) *opaque.push() = v;
+		for (auto& v : t) *transp.push() = v;
+	}
+
+	for (auto* s : opaque_vertices.slices) ChunkMeshData::free_slice(s);
+	for (auto* s : transp_vertices.slices) ChunkMeshData::free_slice(s);
+	opaque_vertices = std::move(opaque);
+	transp_vertices = std::move(transp);
+}
+
+void split_face_instances (ChunkMeshData& mesh, FaceMeshData& faces, uint32_t bucket_offsets[FACE_BUCKETS+1]) {
+	ZoneScoped;
+
+	uint32_t count = mesh.vertex_count();
+
+	uint32_t counts[FACE_BUCKETS] = {};
+	for (uint32_t i=0; i<count; ++i) {
+		uint16_t meshid = mesh[i].meshid;
+		if (meshid < FACE_BUCKETS) counts[meshid]++;
+	}
+
+	uint32_t offs = 0;
+	for (int b=0; b<FACE_BUCKETS; ++b) {
+		bucket_offsets[b] = offs;
+		offs += counts[b];
+	}
+	bucket_offsets[FACE_BUCKETS] = offs;
+
+	faces.alloc_instances(offs);
+
+	uint32_t write[FACE_BUCKETS];
+	memcpy(write, bucket_offsets, sizeof(write));
+
+	// compact block meshes in place, since they can only move backwards
+	uint32_t block_meshes = 0;
+
+	for (uint32_t i=0; i<count; ++i) {
+		auto& v = mesh[i];
+		if (v.meshid < FACE_BUCKETS) {
+			auto& f = faces[write[v.meshid]++];
+			// cube face positions are always whole voxels
+			f.pos_face = FaceInstance::pack(v.posx >> BlockMeshInstance_FIXEDPOINT_SHIFT, v.posy >> BlockMeshInstance_FIXEDPOINT_SHIFT,
+				v.posz >> BlockMeshInstance_FIXEDPOINT_SHIFT, v.meshid);
+			f.texid = v.texid;
+			f.size[0] = v.size[0];
+			f.size[1] = v.size[1];
+		} else {
+			mesh[block_meshes++] = v;
+		}
+	}
+
+	mesh.shrink(block_meshes);
+}
+
 void RemeshChunkJob::execute () {
+	uint64_t t0 = get_timestamp();
+
 	CallCtx ctx = { *this };
-	ctx.mesh_chunk();
+	if (mesh_lod > 0) {
+		if (lod > 0) ctx.mesh_lod_chunk();
+		else         ctx.mesh_downsampled_chunk();
+
+		for (int slab=0; slab<MESH_SLABS; ++slab)
+			end_slab(slab); // lod meshes are not split, everything ends up in slab 0
+	}
+	else {
+		ctx.read_lod_borders();
+
+		if (mesher == MESHER_BINARY)
+			ctx.mesh_chunk_binary();
+		else if (mesh_world_border)
+			ctx.mesh_chunk<true>();
+		else
+			ctx.mesh_chunk<false>();
+	}
+
+	assemble_segments();
+	split_face_instances(opaque_vertices, opaque_faces, face_buckets);
+
+	// lod chunks store coarse voxels, just treat them as fully connected
+	face_connections = lod > 0 ? ALL_FACE_CONNECTIONS : ctx.face_connections();
+
+	time_sec = (float)(get_timestamp() - t0) / (float)timestamp_freq;
 }
 
 chunk_id get_neighbour_blocks (Chunks& chunks, Chunk& chunk, int neighbour) {
@@ -544,17 +1244,44 @@ chunk_id get_neighbour_blocks (Chunks& chunks, Chunk& chunk, int neighbour) {
 
 	//auto nid = j.chunks->chunks_arr.checked_get(pos.x, pos.y, pos.z);
 	auto nid = chunks.query_chunk(pos);
-	if (nid != U16_NULL && chunks[nid].flags != 0) {
+	// neighbours with a different lod use different voxel coords, treat them like unloaded chunks
+	// full res neighbours that are drawn downsampled already have faces on their border, they are lod neighbours instead
+	if (nid != U16_NULL && chunks[nid].flags != 0 && chunks[nid].lod == chunk.lod && (chunk.lod > 0 || chunks[nid].drawn_lod == 0)) {
 		return nid;
 	}
 	return U16_NULL;
 }
 
-RemeshChunkJob::RemeshChunkJob (Chunks& chunks, chunk_id cid, WorldGenerator const& wg, bool mesh_world_border) {
+chunk_id get_lod_neighbour (Chunks& chunks, Chunk& chunk, int facei, int* nlod, bool* downsampled) {
+	if (max(chunk.lod, chunk.mesh_lod) > 0)
+		return U16_NULL; // lod meshes always generate all their border faces
+
+	auto nid = chunks.query_chunk(chunk.pos + NEIGHBOURS[facei]);
+	if (nid == U16_NULL || chunks[nid].flags == 0)
+		return U16_NULL;
+
+	auto& n = chunks[nid];
+	if (n.lod > 0) {
+		*nlod = n.lod;
+		*downsampled = false;
+	} else if (n.drawn_lod > 0) {
+		// the voxels of its current mesh, not of its pending mesh_lod, it gets remeshed once the new mesh is drawn
+		*nlod = n.drawn_lod;
+		*downsampled = true;
+	} else {
+		return U16_NULL;
+	}
+	return nid;
+}
+
+RemeshChunkJob::RemeshChunkJob (Chunks& chunks, chunk_id cid, WorldGenerator const& wg, bool mesh_world_border, bool greedy, MesherBackend mesher,
+		uint32_t slabs, ChunkMeshSegments* segments) {
 	block_types			= g_assets.block_types.blocks.data();
+	block_type_count	= g_assets.block_types.count();
 	block_meshes		= g_assets.block_meshes.block_meshes.data();
 	block_meshes_meshes	= g_assets.block_meshes.meshes.data();
 	block_tiles			= g_assets.block_tiles.data();
+	air_id				= g_assets.block_types.air_id;
 
 	this->chunk_voxels		= chunks.chunk_voxels.arr;
 	this->subchunks			= chunks.subchunks.arr;
@@ -562,10 +1289,23 @@ RemeshChunkJob::RemeshChunkJob (Chunks& chunks, chunk_id cid, WorldGenerator con
 	auto& chunk = chunks.chunks[cid];
 
 	this->chunk    = cid;
+	this->lod      = chunk.lod;
+	this->mesh_lod = max(chunk.lod, chunk.mesh_lod);
+	this->version  = 0; // set by update_chunk_meshing
 	this->chunk_nx = get_neighbour_blocks(chunks, chunk, 0);
 	this->chunk_ny = get_neighbour_blocks(chunks, chunk, 1);
 	this->chunk_nz = get_neighbour_blocks(chunks, chunk, 2);
+	for (int facei=0; facei<6; ++facei)
+		lod_neighbours[facei] = get_lod_neighbour(chunks, chunk, facei, &lod_neighbour_lods[facei], &lod_neighbour_downsampled[facei]);
 
 	this->mesh_world_border = mesh_world_border;
+	face_lut			= g_assets.block_face_lut.get(mesh_world_border);
+	face_lut_shift		= g_assets.block_face_lut.shift;
+	this->greedy = greedy || mesh_lod > 0; // lod meshes are always merged
+	this->mesher = mesher;
 	chunk_seed = wg.seed ^ hash(chunk.pos * CHUNK_SIZE);
+
+	assert(slabs == ALL_MESH_SLABS || (segments && mesh_lod == 0));
+	this->slabs = slabs;
+	this->segments = segments;
 }
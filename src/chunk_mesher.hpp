@@ -2,47 +2,114 @@
 #include "common.hpp"
 #include "chunks.hpp"
 #include "assets.hpp"
+#include <mutex>
+#include <atomic>
 
 struct WorldGenerator;
 struct Assets;
 
+// slice of BlockMeshInstance or FaceInstance depending on the mesh it belongs to
 struct ChunkSliceData {
-	BlockMeshInstance verts[CHUNK_SLICE_LENGTH];
+	union {
+		BlockMeshInstance	verts[CHUNK_SLICE_LENGTH];
+		FaceInstance		faces[FACE_SLICE_LENGTH];
+	};
+
+	template <typename T> T* instances ();
+};
+template <> inline BlockMeshInstance* ChunkSliceData::instances<BlockMeshInstance> () { return verts; }
+template <> inline FaceInstance*      ChunkSliceData::instances<FaceInstance>      () { return faces; }
+
+// Pool for ChunkSliceData to avoid a malloc per slice in the meshing threads and a free per slice in upload_remeshed
+// slices are allocated by the meshing threads and freed on the main thread (after upload),
+// so each thread keeps a small free list and moves batches of slices to and from a bounded global cache
+struct SlicePool {
+	static constexpr int THREAD_CACHE = 16; // slices kept per thread before moving half of them to the global cache
+	static constexpr int GLOBAL_CACHE = 256; // slices kept globally, anything beyond this is actually freed (256 * 192KB)
+
+	struct ThreadCache {
+		int count = 0;
+		ChunkSliceData* slices[THREAD_CACHE];
+
+		~ThreadCache ();
+	};
+	static ThreadCache& thread_cache () {
+		static thread_local ThreadCache cache;
+		return cache;
+	}
+
+	std::mutex						mutex;
+	std::vector<ChunkSliceData*>	global; // protected by mutex
+
+	// stats
+	std::atomic<uint32_t>			mallocs = 0; // slices that had to be malloc'd
+	std::atomic<uint32_t>			reuses = 0; // slices that came from a cache
+	std::atomic<uint32_t>			frees = 0; // slices that had to be freed because the global cache was full
+
+	ChunkSliceData* alloc ();
+	void free (ChunkSliceData* s);
+
+	void imgui ();
 };
+inline SlicePool g_slice_pool;
 
-struct ChunkMeshData {
-	BlockMeshInstance* next_ptr = nullptr;
-	BlockMeshInstance* alloc_end = nullptr;
+template <typename T>
+struct SliceMeshData {
+	static constexpr uint32_t SLICE_LENGTH = (uint32_t)(CHUNK_SLICE_SIZE / sizeof(T));
+
+	T* next_ptr = nullptr;
+	T* alloc_end = nullptr;
 
 	std::vector<ChunkSliceData*> slices;
 
-	ChunkMeshData () {
+	SliceMeshData () {
 		slices.reserve(32);
 	}
 
 	uint32_t vertex_count () {
-		return (uint32_t)slices.size() * CHUNK_SLICE_LENGTH - (uint32_t)(alloc_end - next_ptr);
+		return (uint32_t)slices.size() * SLICE_LENGTH - (uint32_t)(alloc_end - next_ptr);
 	}
 
 	void alloc_slice () {
-		ZoneScopedC(tracy::Color::Crimson);
-
-		auto* s = (ChunkSliceData*)malloc(sizeof(ChunkSliceData));
+		auto* s = g_slice_pool.alloc();
 
-		next_ptr  = s->verts;
-		alloc_end = s->verts + CHUNK_SLICE_LENGTH;
+		next_ptr  = s->instances<T>();
+		alloc_end = s->instances<T>() + SLICE_LENGTH;
 
 		slices.push_back(s);
 	}
-	static void free_slice (ChunkSliceData* s) {
-		if (s) {
-			ZoneScopedC(tracy::Color::Crimson);
-			::free(s);
+	// allocate enough slices for count instances, which are then written via operator[]
+	void alloc_instances (uint32_t count) {
+		while ((uint32_t)slices.size() * SLICE_LENGTH < count)
+			alloc_slice();
+		if (count > 0)
+			next_ptr = alloc_end - ((uint32_t)slices.size() * SLICE_LENGTH - count);
+	}
+	// drop instances past count, freeing slices that are no longer needed
+	void shrink (uint32_t count) {
+		uint32_t needed = (count + SLICE_LENGTH-1) / SLICE_LENGTH;
+		while ((uint32_t)slices.size() > needed) {
+			free_slice(slices.back());
+			slices.pop_back();
+		}
+
+		if (slices.empty()) {
+			next_ptr = alloc_end = nullptr;
+		} else {
+			alloc_end = slices.back()->instances<T>() + SLICE_LENGTH;
+			next_ptr = alloc_end - (needed * SLICE_LENGTH - count);
 		}
 	}
+	T& operator[] (uint32_t i) {
+		return slices[i / SLICE_LENGTH]->instances<T>()[i % SLICE_LENGTH];
+	}
+
+	static void free_slice (ChunkSliceData* s) {
+		if (s) g_slice_pool.free(s);
+	}
 
 	// forceinline because this is doing nothing but an if and a increment 99% of the time, compiler should keep alloc_slice not inlined instead
-	__forceinline BlockMeshInstance* push () {
+	__forceinline T* push () {
 		if (next_ptr != alloc_end) {
 			// likely case
 		} else {
@@ -52,37 +119,92 @@ struct ChunkMeshData {
 		return next_ptr++;
 	}
 };
+typedef SliceMeshData<BlockMeshInstance>	ChunkMeshData;
+typedef SliceMeshData<FaceInstance>			FaceMeshData;
 
 struct RemeshChunkJob { // Chunk remesh
 	//// input data
 	// LUTs
 	BlockTypes::Block const*	block_types;
+	int							block_type_count;
 	int const*					block_meshes;
 	BlockMeshes::Mesh const*	block_meshes_meshes;
 	BlockTile const*			block_tiles;
+	block_id					air_id;
+	uint8_t const*				face_lut; // BlockFaceLUT for mesh_world_border
+	int							face_lut_shift;
 
 	ChunkVoxels*				chunk_voxels;
 	SubchunkVoxels*				subchunks;
 
 	chunk_id					chunk;
+	int							lod; // see Chunk::lod
+	int							mesh_lod; // see Chunk::mesh_lod, >= lod
+	uint32_t					version; // Chunk::mesh_version when the job was started
 
 	// chunk neighbours (neg dir)
 	chunk_id					chunk_nx;
 	chunk_id					chunk_ny;
 	chunk_id					chunk_nz;
 
+	// neighbours with coarse voxels on all sides (BlockFace order) while this chunk is meshed at full res, null otherwise
+	// their lod meshes only cover their own voxels, so the faces of our border voxels towards them are generated here
+	chunk_id					lod_neighbours[6];
+	int							lod_neighbour_lods[6]; // coarse voxel size is 1 << lod
+	bool						lod_neighbour_downsampled[6]; // full res voxels drawn downsampled by majority vote (Chunk::drawn_lod)
+
 	bool						mesh_world_border;
+	bool						greedy; // run greedy_merge_faces on the opaque mesh
+	MesherBackend				mesher;
 	uint64_t					chunk_seed;
 
+	// incremental remeshing: only z slabs in this mask are meshed, the rest is taken from segments
+	uint32_t					slabs;
+	ChunkMeshSegments*			segments; // clean slabs to splice in (read only in job), null if not cached
+
 	//// output data
-	ChunkMeshData				opaque_vertices;
+	ChunkMeshData				opaque_vertices; // block meshes only after execute, cube faces are moved to opaque_faces
 	ChunkMeshData				transp_vertices;
+	FaceMeshData				opaque_faces;
+
+	// newly meshed slabs, moved into Chunks::mesh_segments on the main thread if segments != null
+	std::vector<BlockMeshInstance> new_opaque[MESH_SLABS];
+	std::vector<BlockMeshInstance> new_transp[MESH_SLABS];
+
+	// mesher output vertex count at the end of each slab
+	uint32_t					opaque_seg_end[MESH_SLABS];
+	uint32_t					transp_seg_end[MESH_SLABS];
 
-	RemeshChunkJob (Chunks& chunks, chunk_id cid, WorldGenerator const& wg, bool mesh_world_border);
+	uint32_t					face_buckets[FACE_BUCKETS+1]; // see Chunk::face_buckets
+	FaceConnections				face_connections; // see Chunk::face_connections
+
+	float						time_sec; // for MeshingPerfStats
+
+	RemeshChunkJob (Chunks& chunks, chunk_id cid, WorldGenerator const& wg, bool mesh_world_border, bool greedy, MesherBackend mesher,
+		uint32_t slabs, ChunkMeshSegments* segments);
+
+	void end_slab (int slab); // called by meshers after each slab
+	void assemble_segments ();
 
 	void execute ();
 };
 
+// neighbour of chunk in negative direction of axis as read by the mesher, null if not loaded, of a different lod or drawn downsampled
+chunk_id get_neighbour_blocks (Chunks& chunks, Chunk& chunk, int axis);
+// neighbour of a full res meshed chunk in BlockFace direction that is drawn with coarse voxels (lod chunk or drawn_lod > 0), null otherwise
+// writes the lod of its drawn voxels into nlod and if they are downsampled from full res voxels
+chunk_id get_lod_neighbour (Chunks& chunks, Chunk& chunk, int facei, int* nlod, bool* downsampled);
+
+// Greedy meshing as a post-process on mesher output
+// merges coplanar adjacent cube faces with the same texid into rectangles (BlockMeshInstance::size), block mesh instances are kept as is
+// Pure CPU code, instances are replaced by block meshes followed by merged faces
+void greedy_merge_faces (std::vector<BlockMeshInstance>& instances);
+
+// Moves the cube faces of mesh into faces as FaceInstance, sorted into face buckets by BlockFace (stable counting sort)
+// and writes the start of each bucket into bucket_offsets, block mesh instances stay in mesh in their original order
+// Pure CPU code
+void split_face_instances (ChunkMeshData& mesh, FaceMeshData& faces, uint32_t bucket_offsets[FACE_BUCKETS+1]);
+
 inline auto parallelism_threadpool = Threadpool<RemeshChunkJob>(parallelism_threads, TPRIO_PARALLELISM, ">> parallelism threadpool" ); // parallelism_threads - 1 to let main thread contribute work too
 
 //#include "assimp/cimport.h"
@@ -0,0 +1,215 @@
+#include "common.hpp"
+#include "chunk_visibility.hpp"
+
+// grow seeds along the runs of set bits in avail in both directions (kogge-stone fill)
+static uint64_t fill_runs (uint64_t seeds, uint64_t avail) {
+	uint64_t up = seeds, pu = avail;
+	up |= pu & (up <<  1);  pu &= pu <<  1;
+	up |= pu & (up <<  2);  pu &= pu <<  2;
+	up |= pu & (up <<  4);  pu &= pu <<  4;
+	up |= pu & (up <<  8);  pu &= pu <<  8;
+	up |= pu & (up << 16);  pu &= pu << 16;
+	up |= pu & (up << 32);
+
+	uint64_t dn = seeds, pd = avail;
+	dn |= pd & (dn >>  1);  pd &= pd >>  1;
+	dn |= pd & (dn >>  2);  pd &= pd >>  2;
+	dn |= pd & (dn >>  4);  pd &= pd >>  4;
+	dn |= pd & (dn >>  8);  pd &= pd >>  8;
+	dn |= pd & (dn >> 16);  pd &= pd >> 16;
+	dn |= pd & (dn >> 32);
+
+	return up | dn;
+}
+
+FaceConnections compute_face_connections (OpenVoxels const& open) {
+	ZoneScoped;
+
+	// too big for the stack of the threadpool threads
+	std::unique_ptr<OpenVoxels> visited (new OpenVoxels());
+
+	// scanline flood fill, spans are grown along x and then pushed to the 4 neighbouring rows
+	struct Span {
+		int			y, z;
+		uint64_t	bits;
+	};
+	std::vector<Span> stack;
+	stack.reserve(1024);
+
+	FaceConnections conn = 0;
+
+	auto fill = [&] (int y, int z, uint64_t seed) {
+		uint32_t faces = 0;
+
+		stack.push_back({ y, z, seed });
+		while (!stack.empty()) {
+			Span s = stack.back();
+			stack.pop_back();
+
+			uint64_t& vis = visited->rows[s.z][s.y];
+			uint64_t avail = open.rows[s.z][s.y] & ~vis;
+			uint64_t m = s.bits & avail;
+			if (!m) continue;
+
+			m = fill_runs(m, avail);
+			vis |= m;
+
+			if (m & 1)                       faces |= 1u << BF_NEG_X;
+			if (m >> (CHUNK_SIZE-1))         faces |= 1u << BF_POS_X;
+			if (s.y == 0)                    faces |= 1u << BF_NEG_Y;
+			if (s.y == CHUNK_SIZE-1)         faces |= 1u << BF_POS_Y;
+			if (s.z == 0)                    faces |= 1u << BF_NEG_Z;
+			if (s.z == CHUNK_SIZE-1)         faces |= 1u << BF_POS_Z;
+
+			if (s.y > 0)              stack.push_back({ s.y-1, s.z, m });
+			if (s.y < CHUNK_SIZE-1)   stack.push_back({ s.y+1, s.z, m });
+			if (s.z > 0)              stack.push_back({ s.y, s.z-1, m });
+			if (s.z < CHUNK_SIZE-1)   stack.push_back({ s.y, s.z+1, m });
+		}
+
+		// every face the region touches sees every other one
+		for (int a=0; a<6; ++a) {
+			if (faces & (1u << a))
+				conn |= (FaceConnections)faces << (a*6);
+		}
+	};
+
+	// only regions touching the border matter, so only seed from border voxels
+	for (int z=0; z<CHUNK_SIZE; ++z)
+	for (int y=0; y<CHUNK_SIZE; ++y) {
+		bool border_row = y == 0 || y == CHUNK_SIZE-1 || z == 0 || z == CHUNK_SIZE-1;
+		uint64_t seed_mask = border_row ? ~0ull : (1ull | (1ull << (CHUNK_SIZE-1)));
+
+		uint64_t seeds;
+		while ((seeds = open.rows[z][y] & seed_mask & ~visited->rows[z][y]) != 0) {
+			fill(y, z, seeds & (~seeds + 1)); // one region at a time
+		}
+
+		if (conn == ALL_FACE_CONNECTIONS)
+			return conn;
+	}
+
+	return conn;
+}
+
+void ChunkVisibility::update (Chunks& chunks, std::vector<chunk_id> const& frustrum_visible, float3 const& cam_pos) {
+	ZoneScoped;
+
+	visible.clear();
+	queue.clear();
+	frustrum_chunks = (int)frustrum_visible.size();
+
+	chunk_id start = chunks.query_chunk(floori(cam_pos / CHUNK_SIZE));
+	if (start == U16_NULL) {
+		visible = frustrum_visible;
+		return;
+	}
+
+	in_frustrum.assign(chunks.end(), 0);
+	entered.assign(chunks.end(), 0);
+
+	for (chunk_id cid : frustrum_visible)
+		in_frustrum[cid] = 1;
+
+	visible.push_back(start);
+	entered[start] = 1u << NO_FACE;
+	queue.push_back({ start, NO_FACE, 0 });
+
+	for (size_t i=0; i<queue.size(); ++i) {
+		Step step = queue[i];
+		auto& chunk = chunks[step.cid];
+
+		for (int f=0; f<6; ++f) {
+			if (step.dirs & (1u << (f^1)))
+				continue; // never walk back towards the camera
+			if (step.in_face != NO_FACE && !faces_connected(chunk.face_connections, step.in_face, f))
+				continue;
+
+			chunk_id nid = chunk.neighbours[f];
+			if (nid == U16_NULL || !in_frustrum[nid])
+				continue;
+
+			uint8_t in_face = (uint8_t)(f^1);
+			if (entered[nid] & (1u << in_face))
+				continue; // already walked through this face (with possibly different dirs, which we ignore like minecraft does)
+
+			if (entered[nid] == 0)
+				visible.push_back(nid);
+			entered[nid] |= 1u << in_face;
+
+			queue.push_back({ nid, in_face, (uint8_t)(step.dirs | (1u << f)) });
+		}
+	}
+}
+
+int ChunkVisibility::check_synthetic_layouts () {
+	ZoneScoped;
+
+	auto connect = [] (uint32_t faces) {
+		FaceConnections conn = 0;
+		for (int a=0; a<6; ++a) {
+			if (faces & (1u << a))
+				conn |= (FaceConnections)faces << (a*6);
+		}
+		return conn;
+	};
+	constexpr uint32_t NX = 1u<<BF_NEG_X, PX = 1u<<BF_POS_X, NY = 1u<<BF_NEG_Y, PY = 1u<<BF_POS_Y, NZ = 1u<<BF_NEG_Z, PZ = 1u<<BF_POS_Z;
+
+	std::unique_ptr<OpenVoxels> open (new OpenVoxels());
+	auto clear = [&] (uint64_t row) {
+		for (auto& r : open->rows)
+			for (auto& b : r)
+				b = row;
+	};
+
+	int failures = 0;
+	auto check = [&] (FaceConnections expect) {
+		if (compute_face_connections(*open) != expect)
+			failures++;
+	};
+
+	// solid stone
+	clear(0);
+	check(0);
+
+	// air
+	clear(~0ull);
+	check(ALL_FACE_CONNECTIONS);
+
+	// straight tunnel along x
+	clear(0);
+	open->rows[32][32] = ~0ull;
+	check(connect(NX|PX));
+
+	// tunnel entering at -x, turning up at x=20 and leaving at +z
+	clear(0);
+	open->rows[32][32] = (1ull << 21) - 1;
+	for (int z=32; z<CHUNK_SIZE; ++z)
+		open->rows[z][32] |= 1ull << 20;
+	check(connect(NX|PZ));
+
+	// tunnels along x and y that pass each other at different heights
+	clear(0);
+	open->rows[10][32] = ~0ull;
+	for (int y=0; y<CHUNK_SIZE; ++y)
+		open->rows[50][y] = 1ull << 32;
+	check(connect(NX|PX) | connect(NY|PY));
+
+	// solid wall at x=32 splitting the chunk in two halves of air
+	clear(~(1ull << 32));
+	check(connect(NX|NY|PY|NZ|PZ) | connect(PX|NY|PY|NZ|PZ));
+
+	// closed cave in the middle of the chunk is not connected to anything
+	clear(0);
+	for (int z=16; z<48; ++z)
+	for (int y=16; y<48; ++y)
+		open->rows[z][y] = 0x0000ffffffff0000ull;
+	check(0);
+
+	return failures;
+}
+
+void ChunkVisibility::imgui () {
+	ImGui::Text("cave culling: %6d / %6d frustrum chunks visible (%5.1f%% culled)",
+		(int)visible.size(), frustrum_chunks, frustrum_chunks > 0 ? 100.0f - (float)visible.size() / (float)frustrum_chunks * 100.0f : 0.0f);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "common.hpp"
+#include "chunks.hpp"
+
+// Cave culling
+// every chunk stores which of its faces can see each other through non-opaque voxels (Chunk::face_connections, computed by the mesher)
+// the renderers then only draw the chunks reachable from the camera chunk by walking through connected faces,
+// which skips most of the caves hidden in the rock below the surface
+
+// per-row bitmasks of the non-opaque voxels of a chunk, [z][y] with one bit per x
+struct OpenVoxels {
+	uint64_t rows[CHUNK_SIZE][CHUNK_SIZE];
+};
+static_assert(CHUNK_SIZE == 64, "OpenVoxels rows need to fit into a uint64_t");
+
+// Flood fill the non-opaque voxels from every voxel on the chunk border and connect all faces that each region touches
+// Pure CPU code
+FaceConnections compute_face_connections (OpenVoxels const& open);
+
+struct ChunkVisibility {
+	// per chunk_id, only valid during update
+	std::vector<uint8_t>	in_frustrum;
+	std::vector<uint8_t>	entered; // bitmask of the BlockFaces the walk entered the chunk through
+
+	struct Step {
+		chunk_id	cid;
+		uint8_t		in_face; // BlockFace the chunk was entered through, NO_FACE for the camera chunk
+		uint8_t		dirs; // bitmask of the BlockFace directions taken so far
+	};
+	static constexpr uint8_t NO_FACE = 6;
+	std::vector<Step>		queue;
+
+	// output of update(), subset of frustrum_visible
+	std::vector<chunk_id>	visible;
+
+	int						frustrum_chunks = 0; // for imgui
+
+	// BFS from the chunk containing cam_pos through connected faces, only entering chunks in frustrum_visible
+	// and never stepping opposite to a direction already taken (ie. the walk only ever moves away from the camera)
+	// falls back to all of frustrum_visible if the camera chunk is not loaded
+	void update (Chunks& chunks, std::vector<chunk_id> const& frustrum_visible, float3 const& cam_pos);
+
+	// run compute_face_connections on a few hand made voxel layouts, returns the number of wrong results
+	static int check_synthetic_layouts ();
+
+	void imgui ();
+};
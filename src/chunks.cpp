@@ -4,15 +4,51 @@
 #include "game.hpp"
 #include "world_generator.hpp"
 #include "voxel_light.hpp"
+#include "chunk_culling.hpp"
+#include "chunk_visibility.hpp"
+#include "occlusion_culling.hpp"
 #include "chunk_mesher.hpp"
+#include "mesh_upload_queue.hpp"
 
 //#pragma optimize("", off)
 
 //// Voxel system
 
+Chunks::Chunks () {
+	culler = std::make_unique<ChunkCuller>();
+	visibility = std::make_unique<ChunkVisibility>();
+	occlusion = std::make_unique<OcclusionCuller>();
+	upload_queue = std::make_unique<MeshUploadQueue>();
+
+	mesh_heap.init(MESH_PAGE_UNITS);
+}
+Chunks::~Chunks () {
+	destroy();
+}
+
+static void free_remesh_result (RemeshChunkJob& job) {
+	for (auto* s : job.opaque_vertices.slices) ChunkMeshData::free_slice(s);
+	for (auto* s : job.transp_vertices.slices) ChunkMeshData::free_slice(s);
+	for (auto* s : job.opaque_faces.slices) ChunkMeshData::free_slice(s);
+}
+
 void Chunks::destroy () {
 	// wait for all jobs to be completed to be able to safely recreate a new chunks with the same positions again later
 	background_threadpool.flush();
+	deferred_worldgen_results.clear();
+
+	// in-flight remesh jobs read the voxels, so they need to be completed too
+	while (remesh_jobs_in_flight > 0) {
+		std::unique_ptr<RemeshChunkJob> results[64];
+		size_t count = parallelism_threadpool.results.pop_n_wait(results, 1, ARRLEN(results));
+		for (size_t i=0; i<count; ++i)
+			free_remesh_result(*results[i]);
+		remesh_jobs_in_flight -= (uint32_t)count;
+	}
+	for (auto& res : remesh_results)
+		free_remesh_result(*res);
+	remesh_results.clear();
+	upload_queue->clear(*this);
 
 	for (chunk_id cid=0; cid < chunks.slots.alloc_end; ++cid) {
 		if (chunks[cid].flags != 0)
@@ -25,6 +61,10 @@ void Chunks::destroy () {
 
 	chunks_map.clear();
 	queued_chunks.clear();
+	pending_writes.clear();
+	mesh_segments.clear();
+	subchunk_hashes.clear();
+	subchunk_hashes.shrink_to_fit();
 }
 
 void Chunks::free_voxels (chunk_id cid, Chunk& chunk) {
@@ -54,7 +94,7 @@ block_id Chunks::read_block (int x, int y, int z) {
 
 	//chunk_id cid = chunks_arr.checked_get(cpos.x,cpos.y,cpos.z);
 	chunk_id cid = query_chunk(cpos);
-	if (cid == U16_NULL)
+	if (cid == U16_NULL || chunks[cid].lod != 0) // lod chunks use coarse coords
 		return B_NULL;
 
 	return read_block(bx,by,bz, cid);
@@ -91,7 +131,7 @@ void Chunks::write_block (int x, int y, int z, block_id data) {
 	chunk_id cid = query_chunk(cpos);
 	
 	//assert(chunk && (chunk->flags & Chunk::LOADED)); // out of bounds writes happen on digging in unloaded chunks
-	if (cid == U16_NULL)
+	if (cid == U16_NULL || chunks[cid].lod != 0)
 		return;
 
 	write_block(bx,by,bz, cid, data);
@@ -119,7 +159,13 @@ void Chunks::write_block (int x, int y, int z, chunk_id cid, block_id data) {
 }
 
 void Chunks::write_block_update_chunk_flags (int x, int y, int z, Chunk* c) {
-	c->flags |= Chunk::REMESH | Chunk::VOXELS_DIRTY;
+	c->flags |= Chunk::REMESH_SLABS | Chunk::VOXELS_DIRTY;
+
+	// faces towards z-1 are meshed with the slab of z, faces towards z+1 with the slab of z+1
+	// (z+1 in the +Z neighbour is handled by flag_touching_neighbours)
+	c->remesh_slabs |= 1u << MESH_SLAB(z);
+	if (z+1 < CHUNK_SIZE)
+		c->remesh_slabs |= 1u << MESH_SLAB(z+1);
 
 	c->dirty_rect_min.x = min(c->dirty_rect_min.x, x);
 	c->dirty_rect_min.y = min(c->dirty_rect_min.y, y);
@@ -134,11 +180,13 @@ void Chunks::densify_subchunk (ChunkVoxels& vox, uint32_t& subc) {
 	assert(subc & SUBC_SPARSE_BIT);
 	block_id bid = (block_id)(subc & ~SUBC_SPARSE_BIT);
 
-	subc = subchunks.alloc();
-	auto& subchunk = subchunks[subc];
+	uint32_t dense = subchunks.alloc();
+	auto& subchunk = subchunks[dense];
 
 	for (uint32_t i=0; i<SUBCHUNK_VOXEL_COUNT; ++i)
 		subchunk.voxels[i] = bid;
+
+	subc = dense; // only publish once filled, since remesh jobs might be reading this chunk
 }
 
 bool Chunks::checked_sparsify_subchunk (ChunkVoxels& vox, uint32_t& subc) {
@@ -159,6 +207,116 @@ bool Chunks::checked_sparsify_subchunk (ChunkVoxels& vox, uint32_t& subc) {
 	return true;
 }
 
+static inline uint64_t hash_mix (uint64_t h, uint64_t val) {
+	h ^= val * 0x9E3779B97F4A7C15ull;
+	h = (h << 31) | (h >> 33);
+	return h * 0xC2B2AE3D27D4EB4Full;
+}
+static uint64_t hash_subchunk (uint32_t subc, SubchunkVoxels const* subchunks) {
+	if (subc & SUBC_SPARSE_BIT)
+		return hash_mix(0, subc);
+
+	auto* words = (uint64_t const*)subchunks[subc].voxels;
+	uint64_t h = 1;
+	for (int i=0; i<(int)(sizeof(SubchunkVoxels) / sizeof(uint64_t)); ++i)
+		h = hash_mix(h, words[i]);
+	return h;
+}
+
+static_assert(SUBCHUNK_COUNT * SUBCHUNK_COUNT <= 64, "Chunk::hash_dirty_subchunks has one bit per subchunk of a z slab");
+static constexpr uint64_t ALL_SLAB_SUBCHUNKS = ~0ull >> (64 - SUBCHUNK_COUNT * SUBCHUNK_COUNT);
+
+// mark the subchunks overlapping the dirty rect [lo,hi), all if the rect is empty
+static void mark_hash_dirty_subchunks (uint64_t* dirty, int3 const& lo, int3 const& hi) {
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) {
+		for (int sz=0; sz<SUBCHUNK_COUNT; ++sz)
+			dirty[sz] = ALL_SLAB_SUBCHUNKS;
+		return;
+	}
+
+	uint64_t bits = 0;
+	for (int sy=lo.y >> SUBCHUNK_SHIFT; sy <= (hi.y-1) >> SUBCHUNK_SHIFT; ++sy)
+	for (int sx=lo.x >> SUBCHUNK_SHIFT; sx <= (hi.x-1) >> SUBCHUNK_SHIFT; ++sx)
+		bits |= 1ull << (sy * SUBCHUNK_COUNT + sx);
+
+	for (int sz=lo.z >> SUBCHUNK_SHIFT; sz <= (hi.z-1) >> SUBCHUNK_SHIFT; ++sz)
+		dirty[sz] |= bits;
+}
+
+void Chunks::update_voxel_hash (chunk_id cid) {
+	auto& chunk = chunks[cid];
+	if ((chunk.flags & Chunk::HASH_DIRTY) == 0)
+		return;
+	ZoneScoped;
+
+	auto& vox = chunk_voxels[cid];
+
+	if (subchunk_hashes.size() < subchunks.slots.alloc_end)
+		subchunk_hashes.resize(subchunks.slots.alloc_end);
+
+	chunk.voxel_hash = 0;
+	for (auto& h : chunk.border_hash)
+		h = 0;
+
+	// rehash only the changed dense subchunks, mixing the cached hashes back together is cheap
+	uint32_t subc_i = 0;
+	for (int sz=0; sz<SUBCHUNK_COUNT; ++sz)
+	for (int sy=0; sy<SUBCHUNK_COUNT; ++sy)
+	for (int sx=0; sx<SUBCHUNK_COUNT; ++sx) {
+		uint32_t subc = vox.subchunks[subc_i++];
+
+		uint64_t h;
+		if (subc & SUBC_SPARSE_BIT) {
+			h = hash_subchunk(subc, subchunks.arr);
+		} else {
+			if (chunk.hash_dirty_subchunks[sz] & (1ull << (sy * SUBCHUNK_COUNT + sx)))
+				subchunk_hashes[subc] = hash_subchunk(subc, subchunks.arr);
+			h = subchunk_hashes[subc];
+		}
+
+		chunk.voxel_hash = hash_mix(chunk.voxel_hash, h);
+		if (sx == SUBCHUNK_COUNT-1) chunk.border_hash[0] = hash_mix(chunk.border_hash[0], h);
+		if (sy == SUBCHUNK_COUNT-1) chunk.border_hash[1] = hash_mix(chunk.border_hash[1], h);
+		if (sz == SUBCHUNK_COUNT-1) chunk.border_hash[2] = hash_mix(chunk.border_hash[2], h);
+	}
+	for (auto& bits : chunk.hash_dirty_subchunks)
+		bits = 0;
+
+	chunk.flags &= ~Chunk::HASH_DIRTY;
+}
+
+uint64_t Chunks::mesh_input_hash (chunk_id cid) {
+	auto& chunk = chunks[cid];
+	update_voxel_hash(cid);
+
+	uint64_t h = hash_mix(chunk.voxel_hash, (uint64_t)chunk.lod | ((uint64_t)chunk.mesh_lod << 8) |
+		((uint64_t)mesh_world_border << 16) | ((uint64_t)greedy_meshing << 17));
+
+	// the mesher reads the border of the neighbours in negative directions
+	for (int axis=0; axis<3; ++axis) {
+		chunk_id nid = get_neighbour_blocks(*this, chunk, axis);
+		if (nid == U16_NULL) {
+			h = hash_mix(h, 0);
+		} else {
+			update_voxel_hash(nid);
+			h = hash_mix(h, chunks[nid].border_hash[axis]);
+		}
+	}
+	// and the coarse voxels of lod neighbours on all sides
+	for (int facei=0; facei<6; ++facei) {
+		int nlod;
+		bool downsampled;
+		chunk_id nid = get_lod_neighbour(*this, chunk, facei, &nlod, &downsampled);
+		if (nid == U16_NULL) {
+			h = hash_mix(h, 0);
+		} else {
+			update_voxel_hash(nid);
+			h = hash_mix(h, hash_mix(chunks[nid].voxel_hash, (uint64_t)nlod | ((uint64_t)downsampled << 8)));
+		}
+	}
+	return h != 0 ? h : 1; // 0 is reserved for Chunk::mesh_hash
+}
+
 void Chunks::checked_sparsify_chunk (chunk_id cid) {
 	ZoneScoped;
 	auto& vox = chunk_voxels[cid];
@@ -259,6 +417,34 @@ void Chunks::sparse_chunk_from_worldgen (chunk_id cid, block_id* raw_voxels) {
 	subchunks.free(temp_subc);
 }
 
+void Chunks::sparse_lod_chunk_from_worldgen (chunk_id cid, block_id* raw_voxels, int lod) {
+	ZoneScoped;
+
+	auto& vox = chunk_voxels[cid];
+
+	int n = CHUNK_SIZE >> lod; // raw_voxels is n^3
+	assert(n >= SUBCHUNK_SIZE);
+
+	for (uint32_t i=0; i<CHUNK_SUBCHUNK_COUNT; ++i)
+		vox.subchunks[i] = (uint32_t)B_NULL | SUBC_SPARSE_BIT;
+
+	for (int sz=0; sz<n; sz += SUBCHUNK_SIZE)
+	for (int sy=0; sy<n; sy += SUBCHUNK_SIZE)
+	for (int sx=0; sx<n; sx += SUBCHUNK_SIZE) {
+		auto& subc = vox.subchunks[SUBCHUNK_IDX(sx,sy,sz)];
+		subc = subchunks.alloc();
+		auto& subchunk = subchunks[subc];
+
+		for (int z=0; z<SUBCHUNK_SIZE; ++z)
+		for (int y=0; y<SUBCHUNK_SIZE; ++y)
+		for (int x=0; x<SUBCHUNK_SIZE; ++x) {
+			subchunk.voxels[BLOCK_IDX(x,y,z)] = raw_voxels[IDX3D(sx+x, sy+y, sz+z, n)];
+		}
+
+		checked_sparsify_subchunk(vox, subc);
+	}
+}
+
 //// Chunk system
 
 chunk_id Chunks::alloc_chunk (int3 pos) {
@@ -273,19 +459,36 @@ chunk_id Chunks::alloc_chunk (int3 pos) {
 	{ // init
 		chunk.flags = Chunk::ALLOCATED;
 		chunk.pos = pos;
+		chunk.lod = 0;
+		chunk.mesh_lod = 0;
+		chunk.drawn_lod = 0;
 		//chunk.refcount = 0;
 		chunk.clear_dirty_rect();
 		chunk.init_meshes();
+		chunk.face_connections = ALL_FACE_CONNECTIONS;
+		chunk.remesh_slabs = 0;
+		chunk.mesh_version = 0;
+		chunk.queued_mesh_version = 0;
+		chunk.drawn_mesh_version = 0;
+		chunk.mesh_pins = 0;
+		chunk.mesh_hash = 0;
+		chunk.flags |= Chunk::HASH_DIRTY;
+		for (auto& bits : chunk.hash_dirty_subchunks)
+			bits = ALL_SLAB_SUBCHUNKS;
 	}
 
+	culler->add(cid, pos);
+
 	return cid;
 }
 void Chunks::free_chunk (chunk_id cid) {
 	ZoneScoped;
 	auto& chunk = chunks[cid];
 
-	free_slices(chunk.opaque_mesh_slices);
-	free_slices(chunk.transp_mesh_slices);
+	if (chunk.mesh_alloc != MeshAllocator::NULL_ALLOC)
+		mesh_heap.free(chunk.mesh_alloc);
+	mesh_segments.remove(chunk.pos);
+	culler->remove(cid);
 
 	{ // link neigbour ptrs
 		for (int i=0; i<6; ++i) {
@@ -314,20 +517,27 @@ void Chunks::update_chunk_loading (Game& game) {
 	load_radius = clamp(load_radius, 0.0f, 20000.0f);
 	unload_hyster = clamp(unload_hyster, 0.0f, 20000.0f);
 
+	lod_radius = clamp(lod_radius, 0.0f, 20000.0f);
+
 	float unload_dist = load_radius + unload_hyster;
-	float load_dist_sqr = load_radius * load_radius;
 	float unload_dist_sqr = unload_dist * unload_dist;
 
+	// lod chunks are loaded up to lod_radius
+	float far_radius = lod_chunks ? max(load_radius, lod_radius) : load_radius;
+	float far_unload_dist = far_radius + unload_hyster;
+	float far_load_dist_sqr = far_radius * far_radius;
+	float far_unload_dist_sqr = far_unload_dist * far_unload_dist;
+
 	static constexpr float BUCKET_FAC = (0.5f) / (CHUNK_SIZE*CHUNK_SIZE);
 	{
-		float radius = load_radius;
+		float radius = far_radius;
 
 		chunks_to_generate.clear(); // clear all inner vectors
 		chunks_to_generate.shrink_to_fit(); // delete all inner vectors to avoid constant memory alloc when loading idle
 		chunks_to_generate.resize((int)(radius*radius * BUCKET_FAC) + 1);
 	}
 	auto add_chunk_to_generate = [&] (int3 const& chunk_pos, float dist_sqr, int phase) {
-		assert(query_chunk(chunk_pos) == U16_NULL);
+		assert(query_chunk(chunk_pos) == U16_NULL || chunks[query_chunk(chunk_pos)].lod > 0); // null or lod chunk to be replaced
 
 		int bucketi = (int)(dist_sqr * BUCKET_FAC);
 		//assert(bucketi >= 0 && bucketi < chunks_to_generate.size());
@@ -345,6 +555,8 @@ void Chunks::update_chunk_loading (Game& game) {
 		if (visualize_chunks) {
 			if (visualize_radius) {
 				g_debugdraw.wire_sphere(loading_center, load_radius, DBG_RADIUS_COL);
+				if (lod_chunks)
+					g_debugdraw.wire_sphere(loading_center, lod_radius, DBG_RADIUS_COL);
 
 				//auto sz = (float)(chunks_arr.size * CHUNK_SIZE);
 				//g_debugdraw.wire_cube((float3)chunks_arr.pos * CHUNK_SIZE + sz/2, sz, DBG_CHUNK_ARRAY_COL);
@@ -436,7 +648,13 @@ void Chunks::update_chunk_loading (Game& game) {
 
 			float dist_sqr = chunk_dist_sqr(chunk.pos);
 
-			if (dist_sqr <= unload_dist_sqr) {
+			// full chunks outside of the unload radius get unloaded (and regenerated as lod chunks), lod chunks outside of the lod radius
+			if (dist_sqr <= (chunk.lod == 0 ? unload_dist_sqr : far_unload_dist_sqr)) {
+				// lod chunk closer than its lod allows, queue replacement with higher resolution chunk
+				if (chunk.lod > 0 && far_chunk_lod(sqrtf(dist_sqr)) < chunk.lod &&
+						queued_chunks.find(chunk.pos) == queued_chunks.end())
+					add_chunk_to_generate(chunk.pos, dist_sqr, 1);
+
 				// check flags to see if any of the neighbours are still null, which is faster than checking the array
 				if (chunk.flags & Chunk::NEIGHBOUR_NULL_MASK) {
 					for (int i=0; i<6; ++i) {
@@ -446,13 +664,13 @@ void Chunks::update_chunk_loading (Game& game) {
 							auto npos = chunk.pos + NEIGHBOURS[i];
 							float ndist_sqr = chunk_dist_sqr(npos);
 							
-							if (	ndist_sqr <= load_dist_sqr &&
+							if (	ndist_sqr <= far_load_dist_sqr &&
 									queued_chunks.find(npos) == queued_chunks.end()) // chunk not yet queued for worldgen
 								add_chunk_to_generate(npos, ndist_sqr, 1); // note: this creates duplicates because we arrive at the same chunk through two ways
 						}
 					}
 				}
-			} else {
+			} else if (chunk.mesh_pins == 0 && !(chunk.flags & Chunk::MESHING)) { // remesh jobs still using the chunk delay the unload
 				// chunk outside unload radius
 				unload_chunks.push_back(chunk.pos);
 
@@ -460,6 +678,26 @@ void Chunks::update_chunk_loading (Game& game) {
 				free_chunk(cid);
 			}
 		}
+
+		// drop feature writes into chunks that left the unload radius before they could be generated,
+		// but only once none of the chunks that could have written them is loaded anymore, since those don't run their object pass again
+		// and the writes would be missing (cut off trees) when the target gets generated later
+		auto source_loaded = [&] (int3 const& target) {
+			for (int z=-1; z<=1; ++z)
+			for (int y=-1; y<=1; ++y)
+			for (int x=-1; x<=1; ++x) {
+				chunk_id nid = query_chunk(target + int3(x,y,z));
+				if (nid != U16_NULL && chunks[nid].lod == 0 && (chunks[nid].flags & Chunk::LOADED_PHASE2))
+					return true;
+			}
+			return false;
+		};
+		for (auto it = pending_writes.begin(); it != pending_writes.end();) {
+			if (chunk_dist_sqr(it->first) > unload_dist_sqr && !source_loaded(it->first))
+				it = pending_writes.erase(it);
+			else
+				++it;
+		}
 	}
 
 	{
@@ -469,21 +707,26 @@ void Chunks::update_chunk_loading (Game& game) {
 			auto& chunk = chunks[cid];
 			if (chunk.flags & Chunk::LOADED_PHASE2) return;
 
+			auto full_res = [&] (chunk_id nid) {
+				return nid != U16_NULL && chunks[nid].lod == 0;
+			};
+
+			// only need the chunks above and below, since the surface checks read across the z border
+			// writes into all other neighbours go through pending_writes in worldgen::object_pass()
+			if (!full_res(chunk.neighbours[4]) || !full_res(chunk.neighbours[5]))
+				return; // neighbours not ready yet
+
 			worldgen::Neighbours n;
 
-			// check if neighbours are ready yet and build 3x3x3 LUT for faster lookups in worldgen::object_pass() at the same time
+			// build 3x3x3 LUT for faster lookups in worldgen::object_pass(), can contain nulls (lod chunks count as null)
 			for (int z=-1; z<=1; ++z)
 			for (int y=-1; y<=1; ++y)
 			for (int x=-1; x<=1; ++x) {
 				chunk_id nid = query_chunk(chunk.pos + int3(x,y,z));
-
-				if (nid == U16_NULL)
-					return; // neighbours not read yet
-
-				n.neighbours[z+1][y+1][x+1] = nid;
+				n.neighbours[z+1][y+1][x+1] = full_res(nid) ? nid : U16_NULL;
 			}
 
-			worldgen::object_pass(*this, cid, n, &game._threads_world_gen);
+			worldgen::object_pass(*this, cid, n, &game._threads_world_gen, game.column_cache);
 
 			chunk.flags |= Chunk::LOADED_PHASE2 | Chunk::REMESH;
 		};
@@ -515,32 +758,68 @@ void Chunks::update_chunk_loading (Game& game) {
 			std::unique_ptr<WorldgenJob> jobs[64];
 
 			int count = (int)background_threadpool.results.pop_n(jobs, std::min((size_t)parallelism_threads * MAX_REMESH_PER_THREAD_FRAME, ARRLEN(jobs)));
-			for (int jobi=0; jobi<count; ++jobi) {
-				auto job = std::move(jobs[jobi]);
+
+			auto results = std::move(deferred_worldgen_results);
+			deferred_worldgen_results.clear();
+			for (int jobi=0; jobi<count; ++jobi)
+				results.emplace_back(std::move(jobs[jobi]));
+
+			for (auto& job : results) {
 				auto& chunk_pos = job->noise_pass.chunk_pos;
+				int lod = job->noise_pass.lod;
+
+				{ // lod chunk to be replaced is still in use by remesh jobs
+					chunk_id old_cid = query_chunk(chunk_pos);
+					if (old_cid != U16_NULL && (chunks[old_cid].mesh_pins > 0 || (chunks[old_cid].flags & Chunk::MESHING))) {
+						deferred_worldgen_results.emplace_back(std::move(job));
+						continue;
+					}
+				}
 
 				queued_chunks.erase(job->noise_pass.chunk_pos);
 
+				game.world_gen.perf.push(job->noise_pass.specialized, job->time_sec);
+
+				{ // replace lod chunk
+					chunk_id old_cid = query_chunk(chunk_pos);
+					if (old_cid != U16_NULL) {
+						assert(chunks[old_cid].lod > 0);
+						chunks_map.erase(chunk_pos);
+						free_chunk(old_cid);
+					}
+				}
+
 				auto cid = alloc_chunk(chunk_pos);
 				auto& chunk = chunks[cid];
 				chunks_map.emplace(chunk.pos, cid);
 
-				sparse_chunk_from_worldgen(cid, &job->noise_pass.voxels[0][0][0]);
+				chunk.lod = lod;
+
+				if (lod == 0) {
+					sparse_chunk_from_worldgen(cid, &job->noise_pass.voxels[0][0][0]);
 
-				chunk.dirty_rect_min = 0;
-				chunk.dirty_rect_max = CHUNK_SIZE;
-				chunk.flags |= Chunk::REMESH | Chunk::VOXELS_DIRTY;
+					chunk.dirty_rect_min = 0;
+					chunk.dirty_rect_max = CHUNK_SIZE;
+					chunk.flags |= Chunk::REMESH | Chunk::VOXELS_DIRTY;
+				} else {
+					sparse_lod_chunk_from_worldgen(cid, &job->noise_pass.voxels[0][0][0], lod);
+
+					// lod chunks skip phase 2 (pending writes stay queued for the full chunk) and are not uploaded as voxels
+					chunk.flags |= Chunk::REMESH | Chunk::LOADED_PHASE2;
+				}
 
 				link_neighbours_and_flag_remesh(chunk_pos, cid);
 
-				// run phase2 generation where required
-				// TODO: this could possibly be accelerated by keeping a counter of how many neighbours have are ready,
-				// but don't bother because this should be fast enough and will be less bugprone (and not require storing a counter)
-				for (auto& offs : FULL_NEIGHBOURS) {
-					chunk_id nid = query_chunk(chunk_pos + offs);
-					if (nid != U16_NULL)
-						update_chunk_phase2_generation(nid);
+				if (lod == 0) {
+					// features of already generated neighbours that reached into this chunk
+					worldgen::apply_pending_writes(*this, cid, &game._threads_world_gen);
 				}
+
+				// run phase2 generation where required
+				// only this chunk and the ones above and below can have become ready
+				update_chunk_phase2_generation(cid);
+				if (chunk.neighbours[4] != U16_NULL) update_chunk_phase2_generation(chunk.neighbours[4]);
+				if (chunk.neighbours[5] != U16_NULL) update_chunk_phase2_generation(chunk.neighbours[5]);
 			}
 		}
 
@@ -569,19 +848,47 @@ void Chunks::update_chunk_loading (Game& game) {
 
 					//if (queued_chunks.find(genchunk.pos) != queued_chunks.end()) continue; // remove duplicates generated by code above
 
+					float dist = length(((float3)genchunk + 0.5f) * CHUNK_SIZE - loading_center);
+					int lod = far_chunk_lod(dist);
+
 					chunk_id cid = U16_NULL;
-					if (load_from_disk)
+					if (load_from_disk && lod == 0) {
+						// a lod chunk might be resident, the saved chunk still has to replace it, or its edits would be lost
+						chunk_id lod_cid = query_chunk(genchunk);
+						if (lod_cid != U16_NULL) {
+							assert(chunks[lod_cid].lod > 0);
+							if (chunks[lod_cid].mesh_pins > 0 || (chunks[lod_cid].flags & Chunk::MESHING))
+								continue; // still in use by remesh jobs, try again next frame
+							chunks_map.erase(genchunk);
+						}
+
 						cid = try_load_chunk_from_disk(*this, genchunk, game.world_gen.savefile.c_str());
+
+						if (lod_cid != U16_NULL) {
+							if (cid != U16_NULL)
+								free_chunk(lod_cid); // replace lod chunk like the worldgen results do
+							else
+								chunks_map.emplace(genchunk, lod_cid); // not saved, keep it until the worldgen result replaces it
+						}
+					}
 					
 					if (cid != U16_NULL) {
 						// finished chunk was loaded from disk
 						link_neighbours_and_flag_remesh(genchunk, cid);
 						file_loaded_count++;
+
+						// the saved chunk contains the features of its neighbours at the time it was saved,
+						// but neighbours generated since then still queued theirs
+						worldgen::apply_pending_writes(*this, cid, &game._threads_world_gen);
+
+						auto& chunk = chunks[cid];
+						if (chunk.neighbours[4] != U16_NULL) update_chunk_phase2_generation(chunk.neighbours[4]);
+						if (chunk.neighbours[5] != U16_NULL) update_chunk_phase2_generation(chunk.neighbours[5]);
 					} else {
 						// chunk could not be loaded from disk, generate chunk
 						ZoneScopedN("phase 1 job");
 
-						auto job = std::make_unique<WorldgenJob>(genchunk, &game._threads_world_gen);
+						auto job = std::make_unique<WorldgenJob>(genchunk, lod, &game._threads_world_gen);
 						
 						jobs[queued_count++] = std::move(job);
 
@@ -606,12 +913,13 @@ void Chunks::update_chunk_loading (Game& game) {
 
 void Chunks::flag_touching_neighbours (Chunk* c) {
 	// Set remesh flags for neighbours where needed
-	auto flag_neighbour = [&] (int x, int y, int z, Chunk::Flags flag) {
+	auto flag_neighbour = [&] (int x, int y, int z, Chunk::Flags flag, uint32_t slabs=0) {
 		//auto nid = chunks_arr.checked_get(x,y,z);
 		auto nid = query_chunk(int3(x,y,z));
 		if (nid != U16_NULL) {
 			assert(chunks[nid].flags != 0);
 			chunks[nid].flags |= flag;
+			chunks[nid].remesh_slabs |= slabs;
 		}
 	};
 
@@ -619,10 +927,15 @@ void Chunks::flag_touching_neighbours (Chunk* c) {
 	int3 const& x1 = c->dirty_rect_max;
 	int sz = CHUNK_SIZE;
 
-	Chunk::Flags face = Chunk::DIRTY_FACE | Chunk::REMESH;
+	Chunk::Flags face = Chunk::DIRTY_FACE | Chunk::REMESH_SLABS;
 	Chunk::Flags edge = Chunk::DIRTY_FACE;
 	Chunk::Flags corner = Chunk::DIRTY_FACE;
 
+	// slabs of the X and Y face neighbours next to the dirty rect
+	uint32_t xy_slabs = 0;
+	for (int slab = MESH_SLAB(x0.z); slab <= MESH_SLAB(x1.z-1); ++slab)
+		xy_slabs |= 1u << slab;
+
 	if (x0.x == 0) {
 		if (x0.y == 0) {
 			if (x0.z ==  0) flag_neighbour(c->pos.x -1, c->pos.y -1, c->pos.z -1, corner);
@@ -631,7 +944,7 @@ void Chunks::flag_touching_neighbours (Chunk* c) {
 		}
 		{
 			if (x0.z ==  0) flag_neighbour(c->pos.x -1, c->pos.y   , c->pos.z -1, edge);
-			                flag_neighbour(c->pos.x -1, c->pos.y   , c->pos.z   , face); // -X face
+			                flag_neighbour(c->pos.x -1, c->pos.y   , c->pos.z   , face, xy_slabs); // -X face
 			if (x1.z == sz) flag_neighbour(c->pos.x -1, c->pos.y   , c->pos.z +1, edge);
 		}
 		if (x1.y == sz) {
@@ -643,17 +956,17 @@ void Chunks::flag_touching_neighbours (Chunk* c) {
 	{
 		if (x0.y == 0) {
 			if (x0.z ==  0) flag_neighbour(c->pos.x   , c->pos.y -1, c->pos.z -1, edge);
-			                flag_neighbour(c->pos.x   , c->pos.y -1, c->pos.z   , face); // -Y face
+			                flag_neighbour(c->pos.x   , c->pos.y -1, c->pos.z   , face, xy_slabs); // -Y face
 			if (x1.z == sz) flag_neighbour(c->pos.x   , c->pos.y -1, c->pos.z +1, edge);
 		}
 		{
-			if (x0.z ==  0) flag_neighbour(c->pos.x   , c->pos.y   , c->pos.z -1, face); // -Z face
+			if (x0.z ==  0) flag_neighbour(c->pos.x   , c->pos.y   , c->pos.z -1, face, 1u << (MESH_SLABS-1)); // -Z face
 			// -------------/\/\/\/\/\/\/\---------------------------------------
-			if (x1.z == sz) flag_neighbour(c->pos.x   , c->pos.y   , c->pos.z +1, face); // +Z face
+			if (x1.z == sz) flag_neighbour(c->pos.x   , c->pos.y   , c->pos.z +1, face, 1u << 0); // +Z face
 		}
 		if (x1.y == sz) {
 			if (x0.z ==  0) flag_neighbour(c->pos.x   , c->pos.y +1, c->pos.z -1, edge);
-			                flag_neighbour(c->pos.x   , c->pos.y +1, c->pos.z   , face); // +Y face
+			                flag_neighbour(c->pos.x   , c->pos.y +1, c->pos.z   , face, xy_slabs); // +Y face
 			if (x1.z == sz) flag_neighbour(c->pos.x   , c->pos.y +1, c->pos.z +1, edge);
 		}
 	}
@@ -665,7 +978,7 @@ void Chunks::flag_touching_neighbours (Chunk* c) {
 		}
 		{
 			if (x0.z ==  0) flag_neighbour(c->pos.x +1, c->pos.y   , c->pos.z -1, edge);
-			                flag_neighbour(c->pos.x +1, c->pos.y   , c->pos.z   , face); // +X face
+			                flag_neighbour(c->pos.x +1, c->pos.y   , c->pos.z   , face, xy_slabs); // +X face
 			if (x1.z == sz) flag_neighbour(c->pos.x +1, c->pos.y   , c->pos.z +1, edge);
 		}
 		if (x1.y == sz) {
@@ -683,11 +996,45 @@ void Chunks::update_chunk_meshing (Game& game) {
 
 	upload_slices.clear();
 	upload_slices.shrink_to_fit();
+	mesh_moves.clear();
 
 	upload_voxels.clear();
 	upload_voxels.shrink_to_fit();
 
-	std::vector<std::unique_ptr<RemeshChunkJob>> remesh_jobs;
+	// voxels of the meshed chunk, its neg neighbours and its lod neighbours are read by the job
+	auto pin_voxels = [&] (RemeshChunkJob& job, int delta) {
+		for (chunk_id cid : { job.chunk, job.chunk_nx, job.chunk_ny, job.chunk_nz }) {
+			if (cid != U16_NULL)
+				chunks[cid].mesh_pins += delta;
+		}
+		for (chunk_id cid : job.lod_neighbours) {
+			if (cid != U16_NULL)
+				chunks[cid].mesh_pins += delta;
+		}
+	};
+
+	{ // collect finished jobs without blocking, jobs are processed further below
+		ZoneScopedN("remesh pop results");
+
+		std::unique_ptr<RemeshChunkJob> results[64];
+		size_t count;
+		while ((count = parallelism_threadpool.results.pop_n(results, ARRLEN(results))) > 0) {
+			for (size_t i=0; i<count; ++i) {
+				auto& res = results[i];
+				// unpin now, so that pinned voxels get freed as soon as possible, results still waiting on the budget don't need them
+				pin_voxels(*res, -1);
+				remesh_results.emplace_back(std::move(res));
+			}
+			remesh_jobs_in_flight -= (uint32_t)count;
+		}
+	}
+
+	struct RemeshCandidate {
+		float		priority; // lower is more important
+		chunk_id	cid;
+		uint64_t	hash; // mesh_input_hash
+	};
+	std::vector<RemeshCandidate> candidates;
 
 	{
 		ZoneScopedN("remesh iterate chunks");
@@ -697,85 +1044,331 @@ void Chunks::update_chunk_meshing (Game& game) {
 			chunk._validate_flags();
 			
 			if (chunk.flags & Chunk::VOXELS_DIRTY) {
+				upload_voxels.push_back({ cid, chunk.dirty_rect_min, chunk.dirty_rect_max });
+
+				mark_hash_dirty_subchunks(chunk.hash_dirty_subchunks, chunk.dirty_rect_min, chunk.dirty_rect_max);
+
 				flag_touching_neighbours(&chunk);
 
+				chunk.flags |= Chunk::SPARSIFY | Chunk::HASH_DIRTY;
+			}
+			if ((chunk.flags & Chunk::SPARSIFY) && chunk.mesh_pins == 0) {
 				checked_sparsify_chunk(cid);
-
-				upload_voxels.push_back(cid);
+				chunk.flags &= ~Chunk::SPARSIFY;
 			}
 		}
+
+		float3 lod_center = game.lod_center();
+		auto& frustrum = game.view.frustrum;
+
 		for (chunk_id cid = 0; cid<end(); ++cid) {
 			auto& chunk = chunks[cid];
-			
-			if (chunk.flags & Chunk::REMESH) {
-				auto job = std::make_unique<RemeshChunkJob>(*this, cid, game.world_gen, mesh_world_border);
-				remesh_jobs.emplace_back(std::move(job));
+			if (chunk.flags == 0) continue;
+
+			float3 lo = (float3)(chunk.pos * CHUNK_SIZE);
+			float3 hi = lo + (float3)CHUNK_SIZE;
+			float dist = length((lo + hi) * 0.5f - lod_center);
+
+			{ // mesh lod with hysteresis
+				int lod = chunk.lod;
+				if (chunk.lod == 0 && mesh_lods) {
+					lod = chunk.mesh_lod;
+					int farther = chunk_mesh_lod(max(dist - mesh_lod_hyster, 1.0f)); // lod if the chunk was a bit closer
+					int nearer  = chunk_mesh_lod(dist + mesh_lod_hyster);            // lod if the chunk was a bit further away
+					if      (farther > lod) lod = farther;
+					else if (nearer  < lod) lod = nearer;
+				}
+				if (lod != chunk.mesh_lod) {
+					chunk.mesh_lod = lod;
+					chunk.flags |= Chunk::REMESH;
+				}
+			}
+
+			// a chunk that is still being meshed can simply be remeshed again (the in-flight result will be dropped as stale)
+			// unless it has segments, since the in-flight job reads them and its result is needed to keep them up to date
+			bool can_remesh = !(chunk.flags & Chunk::MESHING) || mesh_segments.map.find(chunk.pos) == mesh_segments.map.end();
+
+			if (chunk.flags & (Chunk::REMESH | Chunk::REMESH_SLABS)) {
+				// neighbours loading on the +X/+Y/+Z side, phase 2 without writes into this chunk etc. don't change anything the mesher reads
+				uint64_t hash = mesh_input_hash(cid);
+				if (hash == chunk.mesh_hash) {
+					// keep the existing mesh (or the result of the in-flight job, which is still the newest version)
+					chunk.flags &= ~(Chunk::REMESH | Chunk::REMESH_SLABS);
+					chunk.remesh_slabs = 0;
+					skipped_remeshes++;
+				}
+				else if (can_remesh) {
+					float priority = dist * dist;
+					if (frustrum_cull_aabb(frustrum, lo.x, lo.y, lo.z, hi.x, hi.y, hi.z))
+						priority *= 4; // chunks outside of the view count as twice as far away
+
+					candidates.push_back({ priority, cid, hash });
+				}
 			}
 
 			chunk.flags &= ~(Chunk::VOXELS_DIRTY | Chunk::DIRTY_FACE | Chunk::DIRTY_EDGE | Chunk::DIRTY_CORNER);
 		}
 	}
 
-	// remesh all chunks in parallel
-	parallelism_threadpool.jobs.push_n(remesh_jobs.data(), remesh_jobs.size());
+	{
+		ZoneScopedN("remesh push jobs");
+
+		int job_count = clamp(remesh_queue_limit - (int)remesh_jobs_in_flight, 0, (int)candidates.size());
+
+		std::partial_sort(candidates.begin(), candidates.begin() + job_count, candidates.end(),
+			[] (RemeshCandidate const& l, RemeshCandidate const& r) { return l.priority < r.priority; });
+
+		std::vector<std::unique_ptr<RemeshChunkJob>> remesh_jobs;
+		remesh_jobs.reserve(job_count);
+
+		partial_remeshes = 0;
+
+		float3 lod_center = game.lod_center();
+
+		for (int i=0; i<job_count; ++i) {
+			chunk_id cid = candidates[i].cid;
+			auto& chunk = chunks[cid];
+
+			bool partial = (chunk.flags & Chunk::REMESH) == 0;
+
+			ChunkMeshSegments* segments = nullptr;
+			uint32_t slabs = ALL_MESH_SLABS;
+
+			if (chunk.mesh_lod == 0) {
+				segments = mesh_segments.find(chunk.pos);
+				if (segments && partial) {
+					slabs = chunk.remesh_slabs;
+					partial_remeshes++;
+				} else if (!segments) {
+					// start keeping segments for chunks that are likely to be edited
+					float3 center = ((float3)chunk.pos + 0.5f) * CHUNK_SIZE;
+					if (partial || length_sqr(center - lod_center) <= mesh_segment_radius * mesh_segment_radius)
+						segments = mesh_segments.insert(chunk.pos);
+				}
+			}
+
+			auto job = std::make_unique<RemeshChunkJob>(*this, cid, game.world_gen, mesh_world_border, greedy_meshing, mesher, slabs, segments);
+			// globally unique, so that results for reused chunk ids are also detected as stale
+			job->version = chunk.mesh_version = ++mesh_version_counter;
+			chunk.mesh_hash = candidates[i].hash;
+
+			pin_voxels(*job, +1);
+			if (segments)
+				segments->pins++;
+
+			// writes while the job is in flight set the flags again and cause another remesh after this one
+			chunk.flags |= Chunk::MESHING;
+			chunk.flags &= ~(Chunk::REMESH | Chunk::REMESH_SLABS);
+			chunk.remesh_slabs = 0;
+
+			remesh_jobs.emplace_back(std::move(job));
+		}
+
+		parallelism_threadpool.jobs.push_n(remesh_jobs.data(), remesh_jobs.size());
+		remesh_jobs_in_flight += (uint32_t)remesh_jobs.size();
+	}
 
 	{
-		ZoneScopedN("remesh process slices");
+		ZoneScopedN("remesh process results");
 		
-		// upload remeshed slices and register them in chunk mesh
-		auto process_slices = [&] (ChunkMeshData& remeshed, uint32_t* pvertex_count, slice_id* pslices) {
+		// queue the slices of a remeshed mesh for upload at offset (in bytes relative to the allocation) and advance offset past it
+		// remeshed is a ChunkMeshData or FaceMeshData
+		auto process_slices = [&] (auto& remeshed, uint32_t* pvertex_count, uint64_t& offset, MeshUploadQueue::Entry& e) {
 			ZoneScopedN("process_slices");
 
 			*pvertex_count = remeshed.vertex_count();
 			uint32_t remain_vertices = *pvertex_count;
 
-			slice_id* prev_next = pslices;
-			slice_id sliceid = *prev_next;
+			for (int i=0; remain_vertices > 0; ++i) {
+				uint32_t count = std::min(remain_vertices, remeshed.SLICE_LENGTH);
+				uint32_t size = count * (uint32_t)sizeof(*remeshed.next_ptr);
+
+				// data stays valid (malloc'd) until it is processed by the renderer or the entry is superseded
+				e.slices.push_back({ offset + (uint64_t)i * CHUNK_SLICE_SIZE, size, remeshed.slices[i] });
+				e.bytes += size;
+
+				remain_vertices -= count;
+			}
 
-			int i = 0;
-			while (remain_vertices > 0) {
-				if (sliceid == U16_NULL) {
-					sliceid = (slice_id)slices.alloc();
-					slices[sliceid].next = U16_NULL;
-					*prev_next = sliceid;
+			offset += (uint64_t)instance_units(*pvertex_count, sizeof(*remeshed.next_ptr)) * MESH_UNIT;
+		};
+
+		uint64_t t0 = get_timestamp();
+		uint64_t budget = (uint64_t)(remesh_budget_ms * 0.001f * (float)timestamp_freq);
+
+		size_t resi = 0;
+		for (; resi < remesh_results.size(); ++resi) {
+			if (resi > 0 && get_timestamp() - t0 >= budget)
+				break;
+
+			auto res = std::move(remesh_results[resi]);
+			auto& chunk = chunks[res->chunk];
+
+			if (res->segments)
+				res->segments->pins--;
+
+			if (res->version != chunk.mesh_version) {
+				// chunk was remeshed again while this job was in flight, or it was unloaded and the id reused
+				assert(res->segments == nullptr);
+				stale_remeshes++;
+				free_remesh_result(*res);
+				continue;
+			}
+
+			assert(chunk.flags & Chunk::MESHING);
+			chunk.flags &= ~Chunk::MESHING;
+
+			if (res->mesh_lod == 0)
+				meshing_perf.push(MeshingPerfStats::mode(res->mesher, res->greedy), res->time_sec,
+					res->opaque_vertices.vertex_count() + res->transp_vertices.vertex_count() + res->opaque_faces.vertex_count());
+
+			g_ChunkMeshExporter.export_(chunk, res->opaque_vertices, false);
+			g_ChunkMeshExporter.export_(chunk, res->transp_vertices, true);
+
+			// meshes change size on every remesh, so always allocate a new one, the old mesh is freed once the new one replaces it
+			uint32_t units = instance_units(res->opaque_faces.vertex_count(), sizeof(FaceInstance)) +
+				instance_units(res->opaque_vertices.vertex_count(), sizeof(BlockMeshInstance)) +
+				instance_units(res->transp_vertices.vertex_count(), sizeof(BlockMeshInstance));
+
+			MeshUploadQueue::Entry e;
+			e.cid = res->chunk;
+			e.version = res->version;
+			e.mesh_alloc = units > 0 ? mesh_heap.alloc(units) : MeshAllocator::NULL_ALLOC;
+			e.bytes = 0;
+			e.queued_time = get_timestamp();
+
+			uint64_t offset = 0;
+			process_slices(res->opaque_faces, &e.face_mesh_vertex_count, offset, e);
+			process_slices(res->opaque_vertices, &e.opaque_mesh_vertex_count, offset, e);
+			process_slices(res->transp_vertices, &e.transp_mesh_vertex_count, offset, e);
+			memcpy(e.face_buckets, res->face_buckets, sizeof(e.face_buckets));
+			e.face_connections = res->face_connections;
+			e.drawn_lod = res->mesh_lod;
+
+			// supersedes any older mesh of this chunk that is still queued
+			chunk.queued_mesh_version = res->version;
+			upload_queue->push(std::move(e));
+
+			if (res->segments) {
+				// keep newly meshed segments for the next partial remesh
+				for (int slab=0; slab<MESH_SLABS; ++slab) {
+					if (res->slabs & (1u << slab)) {
+						res->segments->opaque[slab] = std::move(res->new_opaque[slab]);
+						res->segments->transp[slab] = std::move(res->new_transp[slab]);
+					}
 				}
+			}
+		}
 
-				uint32_t count = std::min(remain_vertices, (uint32_t)CHUNK_SLICE_LENGTH);
+		remesh_results.erase(remesh_results.begin(), remesh_results.begin() + resi);
+	}
 
-				// queue data to be uploaded for sliceid, data stays valid (malloc'd) until it is processed by the renderer
-				upload_slices.push_back({ sliceid, remeshed.slices[i++] });
+	upload_queue->update(*this, game.lod_center(), game.view.frustrum, upload_budget_mb);
 
-				remain_vertices -= count;
+	if (mesh_defrag) {
+		// after all of this frame's allocs, so the uploads happen before the moves and moved meshes never get overwritten by stale uploads
+		uint32_t max_units = (uint32_t)(mesh_defrag_mb * (1024*1024) / MESH_UNIT);
+		mesh_heap.defrag(max_units, mesh_defrag_max_usage, mesh_moves);
+	}
+}
+
+ChunkMeshSegments* MeshSegmentCache::insert (int3 const& pos) {
+	uint32_t idx;
+	if (entries.size() < CAPACITY) {
+		idx = (uint32_t)entries.size();
+		entries.emplace_back(std::make_unique<Entry>());
+	} else {
+		// evict least recently used, entries in use by in-flight jobs can't be evicted
+		idx = (uint32_t)-1;
+		for (uint32_t i=0; i<(uint32_t)entries.size(); ++i) {
+			if (entries[i]->segments.pins == 0 && (idx == (uint32_t)-1 || entries[i]->last_used < entries[idx]->last_used))
+				idx = i;
+		}
+		if (idx == (uint32_t)-1)
+			return nullptr; // all entries pinned
+
+		map.erase(entries[idx]->pos);
+		entries[idx]->segments = {};
+	}
+
+	auto& e = *entries[idx];
+	e.pos = pos;
+	e.last_used = ++counter;
+	map.emplace(pos, idx);
+	return &e.segments;
+}
+void MeshSegmentCache::remove (int3 const& pos) {
+	auto it = map.find(pos);
+	if (it == map.end()) return;
+
+	uint32_t idx = it->second;
+	map.erase(it);
+
+	// move last entry into the hole
+	uint32_t last = (uint32_t)entries.size() - 1;
+	if (idx != last) {
+		std::swap(entries[idx], entries[last]);
+		map[entries[idx]->pos] = idx;
+	}
+	entries.pop_back();
+}
+
+void Chunks::benchmark_meshers (WorldGenerator const& wg) {
+	ZoneScoped;
 
-				prev_next = &slices[sliceid].next;
-				sliceid = *prev_next;
+	meshing_bench = {};
+	meshing_bench_mismatches = 0;
+
+	// instances of both meshes in a canonical order, meshers emit faces in different orders
+	auto sorted_instances = [] (RemeshChunkJob& job) {
+		std::vector<BlockMeshInstance> res;
+		for (auto* mesh : { &job.opaque_vertices, &job.transp_vertices }) {
+			uint32_t remain_vertices = mesh->vertex_count();
+			for (int i=0; remain_vertices > 0; ++i) {
+				uint32_t count = std::min(remain_vertices, (uint32_t)CHUNK_SLICE_LENGTH);
+				res.insert(res.end(), mesh->slices[i]->verts, mesh->slices[i]->verts + count);
+				remain_vertices -= count;
 			}
+		}
+		for (uint32_t i=0; i<job.opaque_faces.vertex_count(); ++i) {
+			auto& f = job.opaque_faces[i];
+			int3 pos = f.pos();
+			res.push_back({ (int16_t)(pos.x << BlockMeshInstance_FIXEDPOINT_SHIFT), (int16_t)(pos.y << BlockMeshInstance_FIXEDPOINT_SHIFT),
+				(int16_t)(pos.z << BlockMeshInstance_FIXEDPOINT_SHIFT), (uint16_t)f.face(), f.texid, { f.size[0], f.size[1] } });
+		}
+		std::sort(res.begin(), res.end(), [] (BlockMeshInstance const& l, BlockMeshInstance const& r) {
+			return memcmp(&l, &r, sizeof(BlockMeshInstance)) < 0;
+		});
+		return res;
+	};
 
-			// free potentially remaining slices no longer needed
-			free_slices(sliceid);
+	for (chunk_id cid=0; cid < end(); ++cid) {
+		auto& chunk = chunks[cid];
+		if (chunk.flags == 0 || chunk.lod != 0) continue;
 
-			// end linked list before the part that we freed
-			*prev_next = U16_NULL;
-		};
+		std::vector<BlockMeshInstance> reference;
 
-		for (size_t resi=0; resi < remesh_jobs.size();) {
-			std::unique_ptr<RemeshChunkJob> results[64];
-			size_t count = parallelism_threadpool.results.pop_n_wait(results, 1, ARRLEN(results));
+		for (int mode=0; mode < MeshingPerfStats::MODES; ++mode) {
+			bool greedy = mode & 1;
+			auto mesher = (MesherBackend)(mode >> 1);
 
-			for (size_t i=0; i<count; ++i) {
-				auto res = std::move(results[i]);
-				auto& chunk = chunks[res->chunk];
+			RemeshChunkJob job (*this, cid, wg, mesh_world_border, greedy, mesher, ALL_MESH_SLABS, nullptr);
+			job.mesh_lod = 0; // always compare full res meshing
+			job.greedy = greedy;
+			job.execute();
 
-				g_ChunkMeshExporter.export_(chunk, res->opaque_vertices, false);
-				g_ChunkMeshExporter.export_(chunk, res->transp_vertices, true);
+			meshing_bench.push(mode, job.time_sec, job.opaque_vertices.vertex_count() + job.transp_vertices.vertex_count() + job.opaque_faces.vertex_count());
 
-				process_slices(res->opaque_vertices, &chunk.opaque_mesh_vertex_count, &chunk.opaque_mesh_slices);
-				process_slices(res->transp_vertices, &chunk.transp_mesh_vertex_count, &chunk.transp_mesh_slices);
-				
-				chunk.flags &= ~Chunk::REMESH;
+			if (!greedy) {
+				auto instances = sorted_instances(job);
+				if (mesher == MESHER_SCALAR)
+					reference = std::move(instances);
+				else if (instances.size() != reference.size() ||
+						memcmp(instances.data(), reference.data(), instances.size() * sizeof(BlockMeshInstance)) != 0)
+					meshing_bench_mismatches++;
 			}
 
-			resi += count;
+			free_remesh_result(job);
 		}
 	}
 }
@@ -801,14 +1394,71 @@ void Chunks::imgui (Renderer* renderer) {
 	//}
 
 	ImGui::Checkbox("debug_frustrum_culling", &debug_frustrum_culling);
+	ImGui::Checkbox("face_bucket_culling", &face_bucket_culling);
+	culler->imgui();
+	ImGui::Checkbox("cave_culling", &cave_culling);
+	visibility->imgui();
+	ImGui::Checkbox("occlusion_culling", &occlusion_culling);
+	occlusion->imgui();
 
 	ImGui::Spacing();
-	ImGui::Checkbox("mesh_world_border", &mesh_world_border);
+	bool mesher_changed = ImGui::Checkbox("mesh_world_border", &mesh_world_border);
+	ImGui::SameLine();
+	mesher_changed |= ImGui::Checkbox("greedy_meshing", &greedy_meshing);
+	mesher_changed |= ImGui::Combo("mesher", (int*)&mesher, "SCALAR\0BINARY");
+	if (mesher_changed)
+		mesher_switch();
+
+	ImGui::Checkbox("mesh_lods", &mesh_lods);
+	ImGui::SameLine();
+	ImGui::DragFloat("mesh_lod_hyster", &mesh_lod_hyster, 0.5f, 0, CHUNK_SIZE);
+	ImGui::SliderFloat("mesh_lod0_radius", &mesh_lod0_radius, 0.1f, 1);
+	{
+		int lod_count[4] = {};
+		uint64_t lod_instances[4] = {};
+		uint64_t lod_bytes[4] = {};
+		for (chunk_id cid=0; cid < end(); ++cid) {
+			auto& chunk = chunks[cid];
+			if (chunk.flags == 0) continue;
+			lod_count[chunk.drawn_lod]++;
+			lod_instances[chunk.drawn_lod] += chunk.mesh_vertex_count();
+			lod_bytes[chunk.drawn_lod] += chunk.mesh_bytes();
+		}
+		for (int lod=0; lod<4; ++lod)
+			ImGui::Text("mesh lod %d: %5d chunks  %9llu instances (%6.1f MB)", lod, lod_count[lod],
+				(unsigned long long)lod_instances[lod], (float)lod_bytes[lod] / (1024*1024));
+	}
+	ImGui::DragFloat("mesh_segment_radius", &mesh_segment_radius, 1, 0);
+	ImGui::Text("mesh segment cache: %3d / %3d chunks  %3d partial remeshes this frame",
+		(int)mesh_segments.entries.size(), MeshSegmentCache::CAPACITY, partial_remeshes);
+	g_slice_pool.imgui();
+	ImGui::SliderInt("remesh_queue_limit", &remesh_queue_limit, 1, 512);
+	ImGui::DragFloat("remesh_budget_ms", &remesh_budget_ms, 0.05f, 0, 100);
+
+	ImGui::DragFloat("upload_budget_mb", &upload_budget_mb, 0.1f, 0, 1024);
+	upload_queue->imgui();
+
+	ImGui::Checkbox("mesh_defrag", &mesh_defrag);
+	ImGui::SameLine();
+	ImGui::DragFloat("mesh_defrag_mb", &mesh_defrag_mb, 0.1f, 0, 256);
+	ImGui::SliderFloat("mesh_defrag_max_usage", &mesh_defrag_max_usage, 0, 1);
+	mesh_heap.imgui("mesh heap", MESH_UNIT);
+	ImGui::Text("mesh heap: %3d moves this frame", (int)mesh_moves.size());
+	ImGui::Text("remesh: %3d jobs in flight  %3d results waiting  %6d stale results dropped  %6d skipped (unchanged hash)",
+		remesh_jobs_in_flight, (int)remesh_results.size(), stale_remeshes, skipped_remeshes);
+	meshing_perf.imgui("live");
+	meshing_bench.imgui("bench");
+	if (meshing_bench.count[0] > 0)
+		ImGui::Text("bench binary vs scalar mismatches: %d chunks", meshing_bench_mismatches);
 
 	ImGui::Spacing();
 	ImGui::DragFloat("load_radius", &load_radius, 1, 0);
 	ImGui::DragFloat("unload_hyster", &unload_hyster, 1, 0);
 
+	ImGui::Checkbox("lod_chunks", &lod_chunks);
+	ImGui::SameLine();
+	ImGui::DragFloat("lod_radius", &lod_radius, 1, 0);
+
 	////
 	ImGui::Separator();
 
@@ -828,6 +1478,11 @@ void Chunks::imgui (Renderer* renderer) {
 			ImGui::SameLine();
 			ImGui::Text("  %s", str.c_str());
 		}
+
+		size_t pending_write_count = 0;
+		for (auto& kv : pending_writes)
+			pending_write_count += kv.second.size();
+		ImGui::Text("pending feature writes: %5d chunks %7d voxels", (int)pending_writes.size(), (int)pending_write_count);
 	}
 	
 	////
@@ -878,8 +1533,9 @@ void Chunks::imgui (Renderer* renderer) {
 			if ((chunks[id].flags & Chunk::ALLOCATED) == 0)
 				ImGui::Text("[%5d] <not allocated>", id);
 			else
-				ImGui::Text("[%5d] %+4d,%+4d,%+4d - %2d, %2d slices", id, chunks[id].pos.x,chunks[id].pos.y,chunks[id].pos.z,
-					_slices_count(chunks[id].opaque_mesh_vertex_count), _slices_count(chunks[id].transp_mesh_vertex_count));
+				ImGui::Text("[%5d] %+4d,%+4d,%+4d - %6d, %6d, %6d instances  %7d units", id, chunks[id].pos.x,chunks[id].pos.y,chunks[id].pos.z,
+					chunks[id].face_mesh_vertex_count, chunks[id].opaque_mesh_vertex_count, chunks[id].transp_mesh_vertex_count,
+					chunks[id].mesh_units());
 		}
 		ImGui::TreePop();
 	}
@@ -1007,6 +1663,8 @@ void save_chunk_to_disk (Chunks& chunks, chunk_id cid, char const* dirname) {
 	auto& chunk = chunks.chunks[cid];
 	if ((chunk.flags & (Chunk::ALLOCATED|Chunk::LOADED_PHASE2)) == 0)
 		return; // only save completely loaded chunks
+	if (chunk.lod != 0)
+		return; // lod chunks are regenerated
 
 	ZoneScoped;
 
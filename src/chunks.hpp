@@ -3,6 +3,7 @@
 #include "blocks.hpp"
 #include "assets.hpp"
 #include "player.hpp"
+#include "mesh_allocator.hpp"
 
 #if 1
 #define CHUNK_SIZE			64 // size of chunk in blocks per axis
@@ -62,14 +63,38 @@ static_assert(SUBCHUNK_MASK == SUBCHUNK_SIZE-1, "");
 
 #define U16_NULL			((uint16_t)-1)
 
-typedef uint16_t			slice_id;
 typedef uint16_t			chunk_id;
 
 #define MAX_CHUNKS			((1<<16)-1) // one less than POT to allow i<N loop condition and leave -1u as null value
-#define MAX_SLICES			((1<<16)-1) // one less than POT to allow i<N loop condition and leave -1u as null value
 
+// the mesher outputs meshes in pooled slices of CHUNK_SLICE_SIZE bytes
 static constexpr uint16_t CHUNK_SLICE_LENGTH = 16 * 1024;
 static constexpr size_t CHUNK_SLICE_SIZE = CHUNK_SLICE_LENGTH * sizeof(BlockMeshInstance);
+static constexpr uint16_t FACE_SLICE_LENGTH = (uint16_t)(CHUNK_SLICE_SIZE / sizeof(FaceInstance)); // slices of face meshes hold FaceInstance instead
+static_assert(CHUNK_SLICE_SIZE % sizeof(FaceInstance) == 0, "");
+
+// the gpu meshes are allocated in Chunks::mesh_heap in units of MESH_UNIT bytes, so that both instance types start on a unit
+static constexpr uint32_t MESH_UNIT = 24;
+static_assert(MESH_UNIT % sizeof(BlockMeshInstance) == 0 && MESH_UNIT % sizeof(FaceInstance) == 0, "");
+// size of the mesh heap pages (vram buffers of the renderers) in units, 48MB
+static constexpr uint32_t MESH_PAGE_UNITS = 1u << 21;
+
+inline uint32_t instance_units (uint32_t count, size_t stride) {
+	return (uint32_t)(((uint64_t)count * stride + MESH_UNIT-1) / MESH_UNIT);
+}
+
+// Opaque cube faces of chunk meshes are sorted into buckets by face direction (BlockFace)
+// so that the renderer can skip the face directions that can't be visible from the camera
+#define FACE_BUCKETS		6
+
+// 6x6 bit matrix of which faces (BlockFace) of a chunk are connected through non-opaque voxels, bit a*6+b for faces a and b
+// used for cave culling (see chunk_visibility.hpp)
+typedef uint64_t FaceConnections;
+static constexpr FaceConnections ALL_FACE_CONNECTIONS = (1ull << 36) - 1;
+
+inline bool faces_connected (FaceConnections conn, int a, int b) {
+	return (conn >> (a*6 + b)) & 1;
+}
 
 static constexpr int3 NEIGHBOURS[6] = {
 	int3(-1,0,0), int3(+1,0,0),
@@ -117,14 +142,14 @@ struct Chunks;
 class Renderer;
 struct ChunkSliceData;
 struct WorldgenJob;
+struct ChunkCuller;
+struct ChunkVisibility;
+struct OcclusionCuller;
+struct MeshUploadQueue;
+struct RemeshChunkJob;
 
 inline constexpr block_id g_null_chunk[CHUNK_VOXEL_COUNT] = {}; // chunk data filled with B_NULL to optimize meshing with non-loaded neighbours
 
-// linked list in Chunks::slices
-struct SliceNode {
-	slice_id next;
-};
-
 static constexpr uint32_t SUBC_SPARSE_BIT = 0x80000000u;
 
 struct DenseChunkVoxels {
@@ -150,12 +175,18 @@ struct Chunk {
 		VOXELS_DIRTY	= 1u<<1, // voxels were changed, run checked_sparsify
 		REMESH			= 1u<<2, // need remesh due to voxel change, neighbour chunk change, etc.
 
-		LOADED_PHASE2	= 1u<<3, // not set: phase 1
-
 		DIRTY_FACE		= 1u<<3,
 		DIRTY_EDGE		= 1u<<4,
 		DIRTY_CORNER	= 1u<<5,
 
+		LOADED_PHASE2	= 1u<<6, // not set: phase 1 (was aliased with DIRTY_FACE, which got cleared every remesh)
+
+		REMESH_SLABS	= 1u<<7, // only the slabs in remesh_slabs need to be remeshed (ignored if REMESH is set)
+
+		MESHING			= 1u<<8, // a RemeshChunkJob for this chunk is in flight, no second one is started until its result was processed
+		SPARSIFY		= 1u<<9, // checked_sparsify_chunk was deferred because the voxels were pinned by remesh jobs
+		HASH_DIRTY		= 1u<<10, // voxel_hash and border_hash need to be recomputed from the subchunks in hash_dirty_subchunks
+
 		// Flags for if neighbours[i] contains null to skip neighbour loop in iterate chunk loading for performance
 		NEIGHBOUR0_NULL = 1u<<26,
 		NEIGHBOUR1_NULL = 1u<<27,
@@ -169,6 +200,17 @@ struct Chunk {
 	Flags flags;
 	int3 pos;
 
+	// 0: normal chunk
+	// 1-3: downsampled far-field chunk, (CHUNK_SIZE >> lod)^3 voxels that are (1 << lod) blocks wide
+	//      stored at their coarse coords in the normal subchunk layout, remaining subchunks are sparse B_NULL
+	//      these are never edited, get no phase 2 and are not uploaded to the raytracer
+	int lod;
+
+	// lod the chunk is meshed at, full res chunks get meshed from downsampled voxels based on distance (see Chunks::mesh_lods)
+	int mesh_lod;
+	// lod of the current mesh, which lags behind mesh_lod until the remesh is done and uploaded, determines voxel_scale in the renderer
+	int drawn_lod;
+
 	int3 dirty_rect_min;
 	int3 dirty_rect_max;
 
@@ -180,22 +222,70 @@ struct Chunk {
 	chunk_id neighbours[6];
 	// make sure there are still at 4 bytes following this so that 16-byte sse loads of neighbours can never segfault
 
-	slice_id opaque_mesh_slices;
-	slice_id transp_mesh_slices;
+	// handle in Chunks::mesh_heap, holds the face mesh (opaque cube faces as FaceInstance), then the opaque and transparent block meshes,
+	// each starting on a MESH_UNIT, MeshAllocator::NULL_ALLOC if all meshes are empty
+	uint32_t mesh_alloc;
 
 	uint32_t opaque_mesh_vertex_count;
 	uint32_t transp_mesh_vertex_count;
+	uint32_t face_mesh_vertex_count;
+
+	// start of each face bucket in the face mesh, [FACE_BUCKETS] == face_mesh_vertex_count
+	uint32_t face_buckets[FACE_BUCKETS+1];
+
+	// computed by the mesher, ALL_FACE_CONNECTIONS until the first mesh and for lod chunks
+	FaceConnections face_connections;
+
+	// bitmask of MESH_SLAB()s that need remeshing due to block writes, see REMESH_SLABS
+	uint32_t remesh_slabs;
+
+	// incremented for every started remesh job, results with an older version are dropped
+	uint32_t mesh_version;
+	// version of the newest result queued in Chunks::upload_queue, older queued meshes are superseded, 0 if none was queued
+	uint32_t queued_mesh_version;
+	// version of the mesh the renderer currently draws, 0 if none was uploaded yet
+	uint32_t drawn_mesh_version;
+	// number of in-flight remesh jobs reading the voxels of this chunk (as the meshed chunk or as a neighbour)
+	// pinned chunks are not freed or sparsified, since the jobs read the voxels without locking
+	uint32_t mesh_pins;
+
+	// content hash of the voxels (see Chunks::update_voxel_hash) and of the subchunk layers on the +X, +Y and +Z border,
+	// which are read by the mesher of the respective neighbour
+	uint64_t voxel_hash;
+	uint64_t border_hash[3];
+	// dense subchunks that need to be rehashed into Chunks::subchunk_hashes, one word per z slab with one bit per subchunk of the slab
+	uint64_t hash_dirty_subchunks[SUBCHUNK_COUNT];
+	// Chunks::mesh_input_hash of the last started remesh, 0 if the current mesh is not known to match any voxel content
+	uint64_t mesh_hash;
+
+	// the drawn mesh matches the current voxels, no remesh is pending, in flight or waiting for its upload
+	bool mesh_current () const {
+		return (flags & (REMESH | REMESH_SLABS | MESHING)) == 0 && mesh_version != 0 && drawn_mesh_version == mesh_version;
+	}
+
+	uint32_t mesh_vertex_count () const {
+		return opaque_mesh_vertex_count + transp_mesh_vertex_count + face_mesh_vertex_count;
+	}
+	size_t mesh_bytes () const {
+		return (opaque_mesh_vertex_count + transp_mesh_vertex_count) * sizeof(BlockMeshInstance) + face_mesh_vertex_count * sizeof(FaceInstance);
+	}
+	uint32_t mesh_units () const {
+		return instance_units(face_mesh_vertex_count, sizeof(FaceInstance)) +
+			instance_units(opaque_mesh_vertex_count, sizeof(BlockMeshInstance)) + instance_units(transp_mesh_vertex_count, sizeof(BlockMeshInstance));
+	}
 
 	void init_meshes () {
-		opaque_mesh_slices = U16_NULL;
-		transp_mesh_slices = U16_NULL;
+		mesh_alloc = MeshAllocator::NULL_ALLOC;
 		opaque_mesh_vertex_count = 0;
 		transp_mesh_vertex_count = 0;
+		face_mesh_vertex_count = 0;
+		for (auto& offs : face_buckets)
+			offs = 0;
 	}
 
 	void _validate_flags () {
 		if ((flags & ALLOCATED) == 0) assert(flags == (Flags)0);
-		if (flags & VOXELS_DIRTY) assert(flags & REMESH);
+		if (flags & VOXELS_DIRTY) assert(flags & (REMESH | REMESH_SLABS));
 
 		for (int i=0; i<6; ++i) {
 			assert((neighbours[i] == U16_NULL) == ((flags & (NEIGHBOUR0_NULL << i)) != 0));
@@ -204,8 +294,43 @@ struct Chunk {
 };
 ENUM_BITFLAG_OPERATORS_TYPE(Chunk::Flags, uint32_t)
 
-inline int _slices_count (uint32_t vertex_count) { // just for imgui
-	return (vertex_count + CHUNK_SLICE_LENGTH-1) / CHUNK_SLICE_LENGTH;
+// Chunk meshes are split into segments by z slabs (one layer of subchunks) to allow remeshing only the slabs that changed
+// a segment contains all faces generated while meshing the voxels of the slab (which includes the faces towards the slab below)
+#define MESH_SLABS			SUBCHUNK_COUNT
+#define MESH_SLAB(z)		((z) >> SUBCHUNK_SHIFT)
+#define ALL_MESH_SLABS		((uint32_t)((1ull << MESH_SLABS) - 1))
+static_assert(MESH_SLABS <= 32, "");
+
+// bitmask of face buckets that can be front facing for a camera at cam_pos, for a chunk with the world space bounds lo - hi
+// faces of a direction are all back facing once the camera is behind all of their planes
+inline uint32_t visible_face_buckets (float3 const& cam_pos, float3 const& lo, float3 const& hi) {
+	uint32_t mask = 0;
+	for (int axis=0; axis<3; ++axis) {
+		if (cam_pos[axis] < hi[axis]) mask |= 1u << (BF_NEG_X + axis*2);
+		if (cam_pos[axis] > lo[axis]) mask |= 1u << (BF_POS_X + axis*2);
+	}
+	return mask;
+}
+
+// call func(first, count) for each range of instances of a bucketed mesh that are in visible buckets, adjacent buckets are merged
+template <typename FUNC>
+inline void visible_bucket_ranges (uint32_t const* bucket_offsets, uint32_t visible, FUNC func) {
+	int bucket = 0;
+	while (bucket < FACE_BUCKETS) {
+		if (!(visible & (1u << bucket))) { bucket++; continue; }
+
+		uint32_t first = bucket_offsets[bucket];
+		while (bucket < FACE_BUCKETS && (visible & (1u << bucket)))
+			bucket++;
+		uint32_t end = bucket_offsets[bucket];
+
+		if (end > first)
+			func(first, end - first);
+	}
+}
+
+inline int _slices_count (uint32_t vertex_count, uint32_t slice_length=CHUNK_SLICE_LENGTH) { // just for imgui
+	return (vertex_count + slice_length-1) / slice_length;
 }
 
 inline constexpr size_t _chunk_sz = sizeof(Chunk); // only for checking value in intellisense
@@ -235,6 +360,49 @@ using chunk_pos_map = std::unordered_map<int3, T, ChunkKey_Hasher, ChunkKey_Comp
 
 typedef std::unordered_set<int3, ChunkKey_Hasher, ChunkKey_Comparer> chunk_pos_set;
 
+struct ChunkMeshSegments {
+	std::vector<BlockMeshInstance> opaque[MESH_SLABS];
+	std::vector<BlockMeshInstance> transp[MESH_SLABS];
+
+	uint32_t pins = 0; // in-flight remesh jobs reading these segments, can't be evicted while pinned
+};
+
+// LRU cache of per-slab mesh segments, keyed by chunk pos
+// only kept for chunks near the player and chunks that got edited, since it duplicates the mesh data in cpu memory
+// entries are read by in-flight RemeshChunkJobs while pinned, and only written by update_chunk_meshing when the job result is processed
+struct MeshSegmentCache {
+	static constexpr uint32_t CAPACITY = 64;
+
+	struct Entry {
+		int3				pos;
+		uint64_t			last_used;
+		ChunkMeshSegments	segments;
+	};
+	std::vector<std::unique_ptr<Entry>>	entries;
+	chunk_pos_map<uint32_t>				map; // chunk pos -> index into entries
+
+	uint64_t	counter = 0;
+
+	// returns null if not cached
+	ChunkMeshSegments* find (int3 const& pos) {
+		auto it = map.find(pos);
+		if (it == map.end()) return nullptr;
+		auto& e = *entries[it->second];
+		e.last_used = ++counter;
+		return &e.segments;
+	}
+	// returns null if the cache is full of pinned entries
+	ChunkMeshSegments* insert (int3 const& pos);
+
+	void remove (int3 const& pos);
+
+	void clear () {
+		entries.clear();
+		entries.shrink_to_fit();
+		map.clear();
+	}
+};
+
 // TODO: Maybe a 128x128x16 Texture might have less artefacting than a 64^3 texture because trees are mainly horizontally placed
 struct BlueNoiseTexture {
 	float* data;
@@ -294,6 +462,14 @@ struct BlueNoiseTexture {
 	}
 };
 
+// Voxel write by a worldgen feature (tree, stalactite etc.) into a chunk that is not loaded yet
+// Collected per target chunk and applied once that chunk arrives, so that object_pass does not need all 26 neighbours
+struct PendingVoxelWrite {
+	uint8_t		x, y, z; // block pos in target chunk
+	bool		replace; // only write if block is still air (or leaves for tree logs) when applied, see worldgen::can_replace
+	block_id	bid;
+};
+
 struct ChunkFileData {
 	ChunkVoxels voxels;
 	SubchunkVoxels subchunks[CHUNK_SUBCHUNK_COUNT];
@@ -354,43 +530,90 @@ struct VoxelEdits {
 	void update (Input& I, Game& game);
 };
 
+enum MesherBackend : int {
+	MESHER_SCALAR=0, // CallCtx::mesh_chunk, compares neighbouring voxels one by one
+	MESHER_BINARY,   // CallCtx::mesh_chunk_binary, bitmask rows
+};
+
+// compare mesher modes, toggle mode and reload world (or use Chunks::benchmark_meshers) to get numbers for the same chunks
+struct MeshingPerfStats {
+	static constexpr int MODES = 4; // mesher * 2 + greedy
+
+	float		total_sec[MODES] = {};
+	uint64_t	instances[MODES] = {};
+	int			count[MODES] = {};
+
+	static int mode (MesherBackend mesher, bool greedy) { return (int)mesher * 2 + (int)greedy; }
+
+	void push (int mode, float sec, uint32_t instance_count) {
+		total_sec[mode] += sec;
+		instances[mode] += instance_count;
+		count[mode]++;
+	}
+
+	void imgui (char const* label) {
+		static constexpr char const* NAMES[MODES] = { "scalar", "scalar+greedy", "binary", "binary+greedy" };
+		ImGui::PushID(label);
+		for (int i=0; i<MODES; ++i) {
+			if (count[i] == 0) continue;
+			float ms = total_sec[i] / (float)count[i] * 1000;
+			float inst = (float)instances[i] / (float)count[i];
+			ImGui::Text("%s %-13s: %6d chunks  %7.3f ms/chunk  %8.1f instances/chunk", label, NAMES[i], count[i], ms, inst);
+		}
+		if (ImGui::Button("reset"))
+			*this = {};
+		ImGui::PopID();
+	}
+};
+
 struct Chunks {
-	SERIALIZE(Chunks, load_radius, load_from_disk, unload_hyster, mesh_world_border,
-		visualize_chunks, visualize_subchunks, visualize_radius, debug_frustrum_culling,
+	SERIALIZE(Chunks, load_radius, load_from_disk, unload_hyster, lod_chunks, lod_radius, mesh_world_border, greedy_meshing, mesher,
+		mesh_lods, mesh_lod0_radius, mesh_lod_hyster,
+		remesh_queue_limit, remesh_budget_ms, upload_budget_mb, mesh_defrag, mesh_defrag_mb, mesh_defrag_max_usage,
+		visualize_chunks, visualize_subchunks, visualize_radius, debug_frustrum_culling, face_bucket_culling, cave_culling, occlusion_culling,
 		edits)
 
 	BlockAllocator<Chunk>			chunks			= { MAX_CHUNKS };
 	BlockAllocator<ChunkVoxels>		chunk_voxels	= { MAX_CHUNKS }; // TODO: get rid of alloc bitset here;  always same id as chunk, ie. this is just a SOA array together with chunks
 	BlockAllocator<SubchunkVoxels>	subchunks		= { MAX_SUBCHUNKS };
 
-	BlockAllocator<SliceNode>		slices			= { MAX_SLICES };
+	// gpu memory of the chunk meshes (Chunk::mesh_alloc), the renderers mirror its pages with vram buffers
+	MeshAllocator					mesh_heap;
 
 	chunk_pos_map<chunk_id>			chunks_map;
 
 	chunk_pos_set					queued_chunks; // queued for async worldgen
 
+	chunk_pos_map<std::vector<PendingVoxelWrite>> pending_writes; // worldgen feature writes keyed by target chunk pos, waiting for that chunk to be generated
+
+	// content hash of each dense subchunk by its id in subchunks, only valid while the subchunk is not in its chunk's hash_dirty_subchunks
+	// sparse subchunks are hashed from their block id, so chunks without dense subchunks don't use this
+	std::vector<uint64_t>			subchunk_hashes;
+
 	BlueNoiseTexture				blue_noise_tex;
 
 	VoxelEdits                      edits;
 
+	// all allocated chunks grouped into cells for frustrum culling, renderers draw culler->visible
+	std::unique_ptr<ChunkCuller>	culler;
+	// walks the culler->visible chunks from the camera through Chunk::face_connections, renderers draw visibility->visible if cave_culling
+	std::unique_ptr<ChunkVisibility> visibility;
+	// software occlusion culling of the remaining chunks, renderers draw occlusion->visible if occlusion_culling
+	std::unique_ptr<OcclusionCuller> occlusion;
+	// remeshed meshes waiting for the upload budget, chunks keep drawing their old mesh until then
+	std::unique_ptr<MeshUploadQueue> upload_queue;
+
 	chunk_id query_chunk (int3 const& pos) {
 		//ZoneScoped;
 		auto it = chunks_map.find(pos);
 		return it != chunks_map.end() ? it->second : U16_NULL;
 	}
 
-	void destroy ();
-	~Chunks () {
-		destroy();
-	}
+	// out of line because of the unique_ptrs to incomplete job, culling and upload types
+	Chunks ();
+	~Chunks ();
 
-	void free_slices (slice_id sid) {
-		while (sid != U16_NULL) {
-			auto next = slices[sid].next;
-			slices.free(sid);
-			sid = next;
-		}
-	}
+	void destroy ();
 
 	void free_voxels (chunk_id cid, Chunk& chunk);
 
@@ -400,9 +623,13 @@ struct Chunks {
 	bool checked_sparsify_subchunk (ChunkVoxels& vox, uint32_t& subc);
 
 	void sparse_chunk_from_worldgen (chunk_id cid, block_id* raw_voxels);
+	void sparse_lod_chunk_from_worldgen (chunk_id cid, block_id* raw_voxels, int lod);
 
 	void flag_touching_neighbours (Chunk* c);
 
+	void update_voxel_hash (chunk_id cid);
+	uint64_t mesh_input_hash (chunk_id cid);
+
 	Chunk& operator[] (chunk_id id) {
 		return chunks[id];
 	}
@@ -422,6 +649,18 @@ struct Chunks {
 			auto& chunk = chunks[cid];
 			if (chunk.flags == 0) continue;
 			chunks[cid].flags |= Chunk::REMESH; // remesh chunk to make sure new renderer gets all meshes uploaded again
+			chunks[cid].mesh_hash = 0; // slice data is freed after upload, so the mesh can't be reused
+		}
+	}
+
+	// for mesh_world_border, greedy_meshing and mesher changes
+	void mesher_switch () {
+		for (chunk_id cid=0; cid<end(); ++cid) {
+			auto& chunk = chunks[cid];
+			if (chunk.flags == 0) continue;
+			// full remesh, so that partial remeshes don't splice in mesh segments generated with the old settings
+			chunks[cid].flags |= Chunk::REMESH;
+			chunks[cid].mesh_hash = 0; // the mesher backend is not part of mesh_input_hash
 		}
 	}
 
@@ -433,17 +672,78 @@ struct Chunks {
 	// This way walking back and forth small distances does not cause load on the system
 	float unload_hyster = 40;
 
+	// generate downsampled chunks between load_radius and lod_radius, which get replaced by full chunks when they enter load_radius
+	bool lod_chunks = true;
+	float lod_radius = 1400.0f;
+
+	// lod of newly generated chunks based on distance to player, doubles voxel size with every doubling of distance past load_radius
+	int far_chunk_lod (float dist) {
+		if (!lod_chunks || dist <= load_radius) return 0;
+		return clamp(1 + floori(log2f(dist / load_radius)), 1,3);
+	}
+
 	bool mesh_world_border = false;
+	// merge opaque faces into rectangles after meshing
+	bool greedy_meshing = true;
+
+	// mesh full res chunks at chunk_mesh_lod() of their distance, only switching lod once the distance is mesh_lod_hyster past the threshold
+	bool mesh_lods = true;
+	// fraction of load_radius that is always meshed at full res, lods double with every doubling of distance past it
+	float mesh_lod0_radius = 0.5f;
+	float mesh_lod_hyster = 16;
+	MesherBackend mesher = MESHER_BINARY;
+
+	MeshingPerfStats meshing_perf;
+
+	// segments of chunks within this radius are kept to allow for partial remeshing on block edits
+	float mesh_segment_radius = 100;
+	MeshSegmentCache mesh_segments;
+	uint32_t partial_remeshes = 0; // for imgui
+	uint32_t skipped_remeshes = 0; // for imgui, remeshes skipped since mesh_input_hash did not change
+
+	// remeshing is asynchronous, jobs are started for the most important dirty chunks (near and visible first)
+	// and their results are processed over the following frames within a time budget, the main thread never waits on them
+	int remesh_queue_limit = 64; // max remesh jobs in flight
+	float remesh_budget_ms = 2.0f; // time per frame for processing remesh results (at least one is always processed)
+	float upload_budget_mb = 8.0f; // mesh data uploaded per frame (the most important mesh is always uploaded)
+
+	// compact mesh_heap by copying meshes on the gpu, so that unused pages can be released after unloading lots of chunks
+	bool mesh_defrag = true;
+	float mesh_defrag_mb = 4.0f; // max data moved per frame
+	float mesh_defrag_max_usage = 0.5f; // only evacuate pages that are at most this full
+
+	uint32_t remesh_jobs_in_flight = 0;
+	uint32_t mesh_version_counter = 0; // source of Chunk::mesh_version
+	std::vector<std::unique_ptr<RemeshChunkJob>> remesh_results; // finished jobs not yet processed due to the time budget
+	uint32_t stale_remeshes = 0; // for imgui
+
+	// worldgen results that replace lod chunks still pinned by remesh jobs, retried next frame
+	std::vector<std::unique_ptr<WorldgenJob>> deferred_worldgen_results;
+
+	MeshingPerfStats meshing_bench;
+	int meshing_bench_mismatches = 0; // chunks where the binary mesher output differs from the scalar one
+
+	// remesh all loaded chunks on the calling thread with every mesher mode and compare outputs
+	void benchmark_meshers (WorldGenerator const& wg);
 
 	bool visualize_chunks = false;
 	bool visualize_subchunks = false;
 	bool visualize_radius = true;
 	bool debug_frustrum_culling = false;
+	bool face_bucket_culling = true; // skip drawing face buckets that are back facing for the whole chunk
+	bool cave_culling = true; // skip chunks not reachable from the camera through face_connections
+	bool occlusion_culling = false; // skip chunks hidden behind opaque subchunks near the camera
 
 	// distance of chunk to player
 	int chunk_lod (float dist) {
 		return clamp(floori(log2f(dist / load_radius * 16)), 0,3);
 	}
+	// mesh lod of a full res chunk, 0 up to load_radius * mesh_lod0_radius, so the near field is never downsampled
+	int chunk_mesh_lod (float dist) {
+		float lod0_dist = load_radius * mesh_lod0_radius;
+		if (dist <= lod0_dist) return 0;
+		return clamp(1 + floori(log2f(dist / lod0_dist)), 1,3);
+	}
 
 	void imgui (Renderer* renderer);
 
@@ -476,12 +776,20 @@ struct Chunks {
 	void update_chunk_loading (Game& game);
 	
 	struct UploadSlice {
-		slice_id		sliceid;
+		uint64_t		offset; // in bytes in mesh_heap, page = offset / (MESH_PAGE_UNITS * MESH_UNIT)
+		uint32_t		size; // in bytes, only the used part of the tail slice needs to be uploaded
 		ChunkSliceData*	data;
 	};
 	std::vector<UploadSlice> upload_slices;
+	// mesh_heap defrag of this frame in units, renderers have to copy these after the upload_slices
+	std::vector<MeshAllocator::Move> mesh_moves;
 
-	std::vector<chunk_id> upload_voxels; // VOXELS_DIRTY of this frame
+	struct UploadVoxels {
+		chunk_id	cid;
+		int3		dirty_rect_min; // Chunk dirty rect, captured before flag_touching_neighbours clears it
+		int3		dirty_rect_max;
+	};
+	std::vector<UploadVoxels> upload_voxels; // VOXELS_DIRTY of this frame
 
 	std::vector<int3> unload_chunks; // Consumed by renderer, cleared beginning of next frame
 
@@ -1,3 +1,24 @@
 
 // Precompiled header
 #include "common.hpp"
+#include "intrin.h"
+
+bool cpu_has_avx2 () {
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+	bool fma     = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx     = (info[2] & (1 << 28)) != 0;
+	// the os also has to save the ymm registers on context switches
+	if (!fma || !osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	bool bmi1 = (info[1] & (1 << 3)) != 0; // tzcnt
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	return bmi1 && avx2;
+}
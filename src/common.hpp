@@ -59,6 +59,10 @@ static constexpr const char* APPNAME = "Voxel Game";
 	#define PROFILE_NOINLINE
 #endif
 
+// AVX2, FMA and BMI1 are available and enabled by the os
+// the project is not compiled with /arch:AVX2, so AVX2 code paths check this once via cpuid and keep a scalar fallback
+bool cpu_has_avx2 ();
+
 //
 #include "kisslib/kissmath.hpp"
 #include "kisslib/kissmath_colors.hpp"
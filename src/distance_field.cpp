@@ -0,0 +1,519 @@
+#include "common.hpp"
+#include "distance_field.hpp"
+
+void DistanceFieldBatch::clear (int3 window_offset, int window_size, block_id air) {
+	entries.clear();
+	entry_map.clear();
+	this->window_offset = window_offset;
+	this->window_size = window_size;
+	this->air = air;
+	edits = 0;
+	uniform_chunks = 0;
+}
+
+void DistanceFieldBatch::add (int3 chunk_pos, int3 lo, int3 hi) {
+	lo.x = max(lo.x, 0);
+	lo.y = max(lo.y, 0);
+	lo.z = max(lo.z, 0);
+	hi.x = min(hi.x, CHUNK_SIZE);
+	hi.y = min(hi.y, CHUNK_SIZE);
+	hi.z = min(hi.z, CHUNK_SIZE);
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) {
+		lo = 0;
+		hi = CHUNK_SIZE;
+	}
+	edits++;
+
+	// the init of a neighbour reads the 1 voxel layer of this chunk that touches it
+	for (int z=-1; z<=1; ++z)
+	for (int y=-1; y<=1; ++y)
+	for (int x=-1; x<=1; ++x) {
+		if ((x < 0 && lo.x > 0) || (x > 0 && hi.x < CHUNK_SIZE)) continue;
+		if ((y < 0 && lo.y > 0) || (y > 0 && hi.y < CHUNK_SIZE)) continue;
+		if ((z < 0 && lo.z > 0) || (z > 0 && hi.z < CHUNK_SIZE)) continue;
+
+		add_chunk(chunk_pos + int3(x,y,z));
+	}
+}
+
+void DistanceFieldBatch::add_chunk (int3 chunk_pos) {
+	if (!contains(chunk_pos) || entry_map.find(chunk_pos) != entry_map.end())
+		return;
+
+	entry_map.emplace(chunk_pos, (uint32_t)entries.size());
+	entries.push_back({ chunk_pos });
+}
+
+void DistanceFieldBatch::compute (ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, int8_t* dst, bool threaded) {
+	ZoneScoped;
+
+	uint64_t t0 = get_timestamp();
+
+	uint32_t count = (uint32_t)entries.size();
+	uint32_t parts = threaded ? (uint32_t)parallelism_threads + 1 : 1;
+
+	parallel_for(count, parts, [&] (uint32_t first, uint32_t end) {
+		compute_entries(chunk_voxels, subchunks, dst, first, end);
+	});
+
+	uniform_chunks = 0;
+	for (auto& e : entries)
+		uniform_chunks += e.uniform ? 1 : 0;
+
+	compute_ms = (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq;
+}
+
+void DistanceFieldBatch::compute_entries (ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, int8_t* dst, uint32_t first, uint32_t end) {
+	ZoneScoped;
+
+	std::unique_ptr<uint8_t[]> solid (new uint8_t[PADDED*PADDED*PADDED]);
+	std::unique_ptr<uint8_t[]> tmp   (new uint8_t[PADDED*PADDED*PADDED]);
+
+	for (uint32_t i=first; i<end; ++i) {
+		auto& e = entries[i];
+		int8_t* df = dst + (size_t)i * CHUNK_VOXEL_COUNT;
+
+		if (!gather_solid(e.neighbours, chunk_voxels, subchunks, air, solid.get())) {
+			// nothing solid in reach (sky or unloaded)
+			memset(df, MAX, CHUNK_VOXEL_COUNT);
+			e.uniform = true;
+			e.value = MAX;
+			continue;
+		}
+
+		compute_chunk(solid.get(), tmp.get(), df);
+
+		e.value = df[0];
+		e.uniform = std::all_of(df, df + CHUNK_VOXEL_COUNT, [&] (int8_t v) { return v == e.value; });
+	}
+}
+
+bool DistanceFieldBatch::gather_solid (chunk_id const neighbours[27], ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, block_id air, uint8_t* solid) {
+	ZoneScoped;
+
+	auto get_subc = [&] (chunk_id cid, int x, int y, int z) -> uint32_t {
+		if (cid == U16_NULL) return SUBC_SPARSE_BIT | B_NULL;
+		return chunk_voxels[cid].subchunks[SUBCHUNK_IDX(x,y,z)];
+	};
+	auto is_solid = [&] (chunk_id cid, int x, int y, int z) -> uint8_t {
+		uint32_t subc = get_subc(cid, x,y,z);
+		block_id bid = subc & SUBC_SPARSE_BIT ? (block_id)(subc & ~SUBC_SPARSE_BIT) : subchunks[subc].voxels[BLOCK_IDX(x,y,z)];
+		return bid > air ? 1 : 0;
+	};
+
+	uint8_t any = 0;
+
+	for (int z=-1; z<=CHUNK_SIZE; ++z)
+	for (int y=-1; y<=CHUNK_SIZE; ++y) {
+		// which of the 3x3x3 chunks and the position in it
+		int cz = z < 0 ? 0 : z < CHUNK_SIZE ? 1 : 2;
+		int cy = y < 0 ? 0 : y < CHUNK_SIZE ? 1 : 2;
+		int lz = z & CHUNK_SIZE_MASK;
+		int ly = y & CHUNK_SIZE_MASK;
+
+		uint8_t* row = solid + IDX3D(0, y+1, z+1, PADDED);
+
+		row[0] = is_solid(neighbours[IDX3D(0, cy, cz, 3)], CHUNK_SIZE-1, ly, lz);
+
+		chunk_id cid = neighbours[IDX3D(1, cy, cz, 3)];
+		for (int sx=0; sx<CHUNK_SIZE; sx+=SUBCHUNK_SIZE) {
+			uint32_t subc = get_subc(cid, sx, ly, lz);
+			if (subc & SUBC_SPARSE_BIT) {
+				memset(row + 1 + sx, (block_id)(subc & ~SUBC_SPARSE_BIT) > air ? 1 : 0, SUBCHUNK_SIZE);
+			} else {
+				auto* data = &subchunks[subc].voxels[BLOCK_IDX(0, ly, lz)];
+				for (int x=0; x<SUBCHUNK_SIZE; ++x)
+					row[1 + sx + x] = data[x] > air ? 1 : 0;
+			}
+		}
+
+		row[PADDED-1] = is_solid(neighbours[IDX3D(2, cy, cz, 3)], 0, ly, lz);
+
+		for (int x=0; x<PADDED; ++x)
+			any |= row[x];
+	}
+
+	return any != 0;
+}
+
+void DistanceFieldBatch::compute_chunk (uint8_t const* solid, uint8_t* tmp, int8_t* df) {
+	ZoneScoped;
+
+	//// init, the 3x3x3 OR of rt_df_init done separably like the shader does
+	// x, only the columns of the chunk are needed
+	for (int z=0; z<PADDED; ++z)
+	for (int y=0; y<PADDED; ++y) {
+		uint8_t const* in = solid + IDX3D(0, y, z, PADDED);
+		uint8_t* out      = tmp   + IDX3D(0, y, z, PADDED);
+		for (int x=1; x<PADDED-1; ++x)
+			out[x] = in[x-1] | in[x] | in[x+1];
+	}
+	// y in place, prev keeps the value before it was overwritten
+	for (int z=0; z<PADDED; ++z) {
+		uint8_t prev[PADDED];
+		memcpy(prev, tmp + IDX3D(0, 0, z, PADDED), PADDED);
+		for (int y=1; y<PADDED-1; ++y) {
+			uint8_t* cur        = tmp + IDX3D(0, y  , z, PADDED);
+			uint8_t const* next = tmp + IDX3D(0, y+1, z, PADDED);
+			for (int x=1; x<PADDED-1; ++x) {
+				uint8_t c = cur[x];
+				cur[x] = prev[x] | c | next[x];
+				prev[x] = c;
+			}
+		}
+	}
+	// z, directly into the df
+	for (int z=0; z<CHUNK_SIZE; ++z)
+	for (int y=0; y<CHUNK_SIZE; ++y) {
+		uint8_t const* below = tmp   + IDX3D(1, y+1, z  , PADDED);
+		uint8_t const* cur   = tmp   + IDX3D(1, y+1, z+1, PADDED);
+		uint8_t const* above = tmp   + IDX3D(1, y+1, z+2, PADDED);
+		uint8_t const* self  = solid + IDX3D(1, y+1, z+1, PADDED);
+		int8_t* out = df + IDX3D(0, y, z, CHUNK_SIZE);
+
+		for (int x=0; x<CHUNK_SIZE; ++x) {
+			int8_t val = MAX;
+			if (below[x] | cur[x] | above[x])
+				val = self[x] ? -1 : 0;
+			out[x] = val;
+		}
+	}
+
+	//// gen, rt_df_gen: prev+1 < cur ? prev+1 : cur  is just  min(prev+1, cur)
+	// x
+	for (int z=0; z<CHUNK_SIZE; ++z)
+	for (int y=0; y<CHUNK_SIZE; ++y) {
+		int8_t* row = df + IDX3D(0, y, z, CHUNK_SIZE);
+
+		int prev = MAX;
+		for (int x=0; x<CHUNK_SIZE; ++x)
+			row[x] = (int8_t)(prev = min(prev + 1, (int)row[x]));
+		prev = MAX;
+		for (int x=CHUNK_SIZE-1; x>=0; --x)
+			row[x] = (int8_t)(prev = min(prev + 1, (int)row[x]));
+	}
+	// y and z scan whole rows at once
+	auto scan = [&] (int8_t* base, int stride) {
+		int prev[CHUNK_SIZE];
+
+		std::fill_n(prev, CHUNK_SIZE, MAX);
+		for (int i=0; i<CHUNK_SIZE; ++i) {
+			int8_t* row = base + (size_t)i * stride;
+			for (int x=0; x<CHUNK_SIZE; ++x)
+				row[x] = (int8_t)(prev[x] = min(prev[x] + 1, (int)row[x]));
+		}
+		std::fill_n(prev, CHUNK_SIZE, MAX);
+		for (int i=CHUNK_SIZE-1; i>=0; --i) {
+			int8_t* row = base + (size_t)i * stride;
+			for (int x=0; x<CHUNK_SIZE; ++x)
+				row[x] = (int8_t)(prev[x] = min(prev[x] + 1, (int)row[x]));
+		}
+	};
+	for (int z=0; z<CHUNK_SIZE; ++z)
+		scan(df + IDX3D(0, 0, z, CHUNK_SIZE), CHUNK_SIZE);
+	for (int y=0; y<CHUNK_SIZE; ++y)
+		scan(df + IDX3D(0, y, 0, CHUNK_SIZE), CHUNK_SIZE*CHUNK_SIZE);
+}
+
+DistanceFieldBatch::Bench DistanceFieldBatch::check_synthetic () {
+	ZoneScoped;
+
+	Bench b;
+	b.failures = 0;
+
+	uint32_t rng = 0x2545f491u;
+	auto next = [&] (uint32_t n) {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng % n;
+	};
+	auto hash3 = [] (int x, int y, int z) {
+		uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u;
+		h ^= h >> 13;
+		h *= 0x5bd1e995u;
+		h ^= h >> 15;
+		return h;
+	};
+
+	constexpr block_id AIR = 1, STONE = 2, EARTH = 3, GRASS = 4, ORE = 5;
+
+	// hills with caves around z = 64..128, solid rock below and sky above
+	auto terrain = [&] (int x, int y, int z) -> block_id {
+		int height = 72 + (int)(hash3(x >> 3, y >> 3, 0) % 40);
+		if (z >= height) return AIR;
+		if (z >= height-1) return GRASS;
+		if (z >= height-4) return EARTH;
+		if (z > 8 && z < 64 && hash3(x >> 2, y >> 2, z >> 2) % 11 == 0) return AIR;
+		return hash3(x, y, z) % 61 == 0 ? ORE : STONE;
+	};
+
+	//// source chunks in the same sparse format as Chunks, plus a dense solid mask of the window for the reference
+	constexpr int W = 4;
+	constexpr int WV = W * CHUNK_SIZE;
+	std::unordered_map<int3, chunk_id> chunks_map;
+	std::vector<ChunkVoxels> chunk_voxels;
+	std::vector<SubchunkVoxels> subchunks;
+	std::vector<uint8_t> world_solid ((size_t)WV*WV*WV, 0);
+
+	chunk_voxels.reserve(W * W * W);
+	for (int cz=0; cz<W; ++cz)
+	for (int cy=0; cy<W; ++cy)
+	for (int cx=0; cx<W; ++cx) {
+		if (cz >= 2 && hash3(cx, cy, cz) % 3 == 0)
+			continue; // not loaded
+
+		chunk_id cid = (chunk_id)chunk_voxels.size();
+		chunk_voxels.emplace_back();
+		chunks_map.emplace(int3(cx,cy,cz), cid);
+
+		for (int sz=0; sz<SUBCHUNK_COUNT; ++sz)
+		for (int sy=0; sy<SUBCHUNK_COUNT; ++sy)
+		for (int sx=0; sx<SUBCHUNK_COUNT; ++sx) {
+			SubchunkVoxels sub;
+			bool uniform = true;
+			for (int z=0; z<SUBCHUNK_SIZE; ++z)
+			for (int y=0; y<SUBCHUNK_SIZE; ++y)
+			for (int x=0; x<SUBCHUNK_SIZE; ++x) {
+				int3 p = int3(cx,cy,cz) * CHUNK_SIZE + int3(sx,sy,sz) * SUBCHUNK_SIZE + int3(x,y,z);
+				auto bid = terrain(p.x, p.y, p.z);
+				sub.voxels[IDX3D(x,y,z, SUBCHUNK_SIZE)] = bid;
+				uniform = uniform && bid == sub.voxels[0];
+				world_solid[IDX3D(p.x, p.y, p.z, WV)] = bid > AIR ? 1 : 0;
+			}
+
+			uint32_t& subc = chunk_voxels[cid].subchunks[IDX3D(sx,sy,sz, SUBCHUNK_COUNT)];
+			if (uniform) {
+				subc = SUBC_SPARSE_BIT | sub.voxels[0];
+			} else {
+				subc = (uint32_t)subchunks.size();
+				subchunks.push_back(sub);
+			}
+		}
+	}
+
+	auto query = [&] (int3 pos) {
+		auto it = chunks_map.find(pos);
+		return it != chunks_map.end() ? it->second : U16_NULL;
+	};
+
+	auto time_ms = [] (uint64_t t0) {
+		return (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq;
+	};
+
+	// the df of the whole window, chunk by chunk
+	auto chunk_df = [&] (std::vector<int8_t>& field, int3 chunk_pos) {
+		return field.data() + (IDX3D(chunk_pos.x, chunk_pos.y, chunk_pos.z, W)) * CHUNK_VOXEL_COUNT;
+	};
+
+	// reference: 27 lookups per voxel for the init and a 6-neighbour bfs inside the chunk from all voxels <= 0, which is the manhattan distance the scans compute
+	auto reference_chunk = [&] (int3 chunk_pos, int8_t* out) {
+		auto solid = [&] (int3 p) -> bool {
+			if ((unsigned)p.x >= WV || (unsigned)p.y >= WV || (unsigned)p.z >= WV) return false;
+			return world_solid[IDX3D(p.x, p.y, p.z, WV)] != 0;
+		};
+
+		std::vector<uint32_t> queue;
+		queue.reserve(CHUNK_VOXEL_COUNT);
+
+		for (int z=0; z<CHUNK_SIZE; ++z)
+		for (int y=0; y<CHUNK_SIZE; ++y)
+		for (int x=0; x<CHUNK_SIZE; ++x) {
+			int3 p = chunk_pos * CHUNK_SIZE + int3(x,y,z);
+			bool near = false;
+			for (int dz=-1; dz<=1; ++dz)
+			for (int dy=-1; dy<=1; ++dy)
+			for (int dx=-1; dx<=1; ++dx)
+				near = near || solid(p + int3(dx,dy,dz));
+
+			uint32_t i = (uint32_t)(IDX3D(x,y,z, CHUNK_SIZE));
+			out[i] = MAX;
+			if (near) {
+				out[i] = solid(p) ? -1 : 0;
+				queue.push_back(i);
+			}
+		}
+
+		for (size_t q=0; q<queue.size(); ++q) {
+			uint32_t i = queue[q];
+			int x = i & CHUNK_SIZE_MASK, y = (i >> CHUNK_SIZE_SHIFT) & CHUNK_SIZE_MASK, z = i >> (CHUNK_SIZE_SHIFT*2);
+			int d = max((int)out[i], 0) + 1;
+			if (d >= MAX) continue;
+
+			int3 neighbours[] = { {x-1,y,z}, {x+1,y,z}, {x,y-1,z}, {x,y+1,z}, {x,y,z-1}, {x,y,z+1} };
+			for (auto n : neighbours) {
+				if ((unsigned)n.x >= CHUNK_SIZE || (unsigned)n.y >= CHUNK_SIZE || (unsigned)n.z >= CHUNK_SIZE) continue;
+				uint32_t j = (uint32_t)(IDX3D(n.x, n.y, n.z, CHUNK_SIZE));
+				if (out[j] > d) {
+					out[j] = (int8_t)d;
+					queue.push_back(j);
+				}
+			}
+		}
+	};
+
+	auto check_all = [&] (std::vector<int8_t>& field) {
+		std::vector<int8_t> ref (CHUNK_VOXEL_COUNT);
+		for (int cz=0; cz<W; ++cz)
+		for (int cy=0; cy<W; ++cy)
+		for (int cx=0; cx<W; ++cx) {
+			reference_chunk(int3(cx,cy,cz), ref.data());
+			if (memcmp(ref.data(), chunk_df(field, int3(cx,cy,cz)), CHUNK_VOXEL_COUNT) != 0)
+				b.failures++;
+		}
+	};
+
+	DistanceFieldBatch batch;
+	std::vector<int8_t> field ((size_t)W*W*W * CHUNK_VOXEL_COUNT);
+
+	auto build = [&] (std::vector<int8_t>& field, bool threaded) {
+		batch.clear(0, W, AIR);
+		for (int cz=0; cz<W; ++cz)
+		for (int cy=0; cy<W; ++cy)
+		for (int cx=0; cx<W; ++cx)
+			batch.add(int3(cx,cy,cz), 0, CHUNK_SIZE);
+		batch.prepare(query);
+
+		std::vector<int8_t> out (batch.entries.size() * CHUNK_VOXEL_COUNT);
+		batch.compute(chunk_voxels.data(), subchunks.data(), out.data(), threaded);
+
+		for (size_t i=0; i<batch.entries.size(); ++i)
+			memcpy(chunk_df(field, batch.entries[i].chunk_pos), out.data() + i * CHUNK_VOXEL_COUNT, CHUNK_VOXEL_COUNT);
+	};
+
+	{ // full builds of the window
+		uint64_t t0 = get_timestamp();
+		build(field, false);
+		b.full_ms = time_ms(t0);
+
+		std::vector<int8_t> threaded (field.size());
+		t0 = get_timestamp();
+		build(threaded, true);
+		b.full_threaded_ms = time_ms(t0);
+
+		if (threaded != field)
+			b.failures++;
+		check_all(field);
+	}
+
+	{ // edits like Chunks::set_block does them, followed by the incremental update of the affected chunks only
+		auto write = [&] (chunk_id cid, int3 chunk_pos, int x, int y, int z, block_id bid) {
+			int3 p = chunk_pos * CHUNK_SIZE + int3(x,y,z);
+			world_solid[IDX3D(p.x, p.y, p.z, WV)] = bid > AIR ? 1 : 0;
+
+			uint32_t& subc = chunk_voxels[cid].subchunks[SUBCHUNK_IDX(x,y,z)];
+			if (subc & SUBC_SPARSE_BIT) {
+				block_id val = (block_id)(subc & ~SUBC_SPARSE_BIT);
+				if (val == bid) return;
+
+				subchunks.emplace_back();
+				std::fill_n(subchunks.back().voxels, SUBCHUNK_VOXEL_COUNT, val);
+				subc = (uint32_t)subchunks.size() - 1;
+			}
+			subchunks[subc].voxels[BLOCK_IDX(x,y,z)] = bid;
+		};
+
+		block_id edit_blocks[] = { AIR, STONE, ORE };
+
+		uint64_t edit_time = 0;
+		size_t recomputed = 0, changed = 0;
+		std::vector<int8_t> out;
+
+		for (int i=0; i<200; ++i) {
+			int3 pos = int3((int)next(W), (int)next(W), (int)next(W));
+			auto cid = query(pos);
+			if (cid == U16_NULL) continue;
+
+			// mostly single blocks (digging and placing), sometimes small boxes, often at the chunk border
+			int3 lo = int3((int)next(CHUNK_SIZE), (int)next(CHUNK_SIZE), (int)next(CHUNK_SIZE));
+			int3 size = next(3) == 0 ? int3(1 + (int)next(8), 1 + (int)next(8), 1 + (int)next(8)) : int3(1);
+			if (next(3) == 0) {
+				int3 border = int3(next(2) == 0 ? 0 : CHUNK_SIZE - size.x,
+				                   next(2) == 0 ? 0 : CHUNK_SIZE - size.y,
+				                   next(2) == 0 ? 0 : CHUNK_SIZE - size.z);
+				switch (next(3)) {
+					case 0: lo.x = border.x; break;
+					case 1: lo.y = border.y; break;
+					case 2: lo.z = border.z; break;
+				}
+			}
+			int3 hi = int3(min(lo.x + size.x, CHUNK_SIZE), min(lo.y + size.y, CHUNK_SIZE), min(lo.z + size.z, CHUNK_SIZE));
+			block_id bid = edit_blocks[next(ARRLEN(edit_blocks))];
+
+			for (int z=lo.z; z<hi.z; ++z)
+			for (int y=lo.y; y<hi.y; ++y)
+			for (int x=lo.x; x<hi.x; ++x)
+				write(cid, pos, x,y,z, bid);
+
+			uint64_t t0 = get_timestamp();
+
+			batch.clear(0, W, AIR);
+			batch.add(pos, lo, hi);
+			if (i % 100 == 99) { // unload a chunk, its voxels are air now
+				int3 unload = int3((int)next(W), (int)next(W), (int)next(W));
+				if (chunks_map.erase(unload)) {
+					for (int z=0; z<CHUNK_SIZE; ++z)
+					for (int y=0; y<CHUNK_SIZE; ++y) {
+						int3 p = unload * CHUNK_SIZE + int3(0,y,z);
+						memset(&world_solid[IDX3D(p.x, p.y, p.z, WV)], 0, CHUNK_SIZE);
+					}
+					batch.add(unload, 0, CHUNK_SIZE);
+				}
+			}
+			batch.prepare(query);
+
+			out.resize(batch.entries.size() * CHUNK_VOXEL_COUNT);
+			batch.compute(chunk_voxels.data(), subchunks.data(), out.data(), true);
+
+			edit_time += get_timestamp() - t0;
+			b.edits++;
+
+			// how much of the recomputed volume actually changed, and how far from the edit
+			for (size_t j=0; j<batch.entries.size(); ++j) {
+				int3 chunk_pos = batch.entries[j].chunk_pos;
+				int8_t* dst = chunk_df(field, chunk_pos);
+				int8_t const* src = out.data() + j * CHUNK_VOXEL_COUNT;
+
+				for (int z=0; z<CHUNK_SIZE; ++z)
+				for (int y=0; y<CHUNK_SIZE; ++y)
+				for (int x=0; x<CHUNK_SIZE; ++x) {
+					size_t idx = IDX3D(x,y,z, CHUNK_SIZE);
+					if (dst[idx] == src[idx]) continue;
+					changed++;
+
+					int3 p = (chunk_pos - pos) * CHUNK_SIZE + int3(x,y,z);
+					int3 d = int3(max(max(lo.x - p.x, p.x - (hi.x-1)), 0),
+					              max(max(lo.y - p.y, p.y - (hi.y-1)), 0),
+					              max(max(lo.z - p.z, p.z - (hi.z-1)), 0));
+					if (i % 100 != 99) // the unloads change a whole chunk
+						b.max_radius = max(b.max_radius, max(max(d.x, d.y), d.z));
+				}
+
+				memcpy(dst, src, CHUNK_VOXEL_COUNT);
+				recomputed += CHUNK_VOXEL_COUNT;
+			}
+		}
+
+		int edits = max(b.edits, 1);
+		b.edit_ms = (float)edit_time * 1000 / (float)timestamp_freq / (float)edits;
+		b.chunks = (float)recomputed / CHUNK_VOXEL_COUNT / (float)edits;
+		b.recomputed_pct = (float)recomputed / (float)field.size() / (float)edits * 100;
+		b.changed_voxels = (float)changed / (float)edits;
+		b.changed_pct = (float)changed / (float)max(recomputed, (size_t)1) * 100;
+
+		check_all(field);
+
+		// incremental updates give the same result as a fresh build
+		std::vector<int8_t> fresh (field.size());
+		build(fresh, true);
+		if (fresh != field)
+			b.failures++;
+	}
+
+	return b;
+}
+
+void DistanceFieldBatch::imgui () {
+	ImGui::Text("df: %4d chunks (%4d uniform) for %4d edits  %6.3f ms",
+		(int)entries.size(), uniform_chunks, edits, compute_ms);
+}
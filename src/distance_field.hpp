@@ -0,0 +1,97 @@
+#pragma once
+#include "common.hpp"
+#include "chunks.hpp"
+
+// CPU version of the raytracer distance field, computed per chunk exactly like rt_df_init + the three rt_df_gen passes
+// init: -1 for solid voxels (bid > air like the B_AIR of the shaders), 0 for voxels with a solid voxel in their 3x3x3 neighbourhood, MAX otherwise
+//  the neighbourhood reaches 1 voxel into the neighbouring chunks, unloaded chunks and voxels outside of the window count as air
+// gen: a forward and a backward +1 scan along x, y and z inside the chunk, which is the manhattan distance to the nearest voxel <= 0 of the chunk, capped to MAX
+// since the scans never leave the chunk, an edit can only change its own chunk and the neighbours within 1 voxel of the dirty rect
+// DistanceFieldBatch collects exactly these chunks and computes them split across parallel_for_threadpool,
+// either as the voxels to upload instead of running the gpu passes, or as a reference to compare the gpu result against
+// Pure CPU code
+struct DistanceFieldBatch {
+	// r8i texture, so the 255 of a r8ui field does not fit, the gpu passes use the same cap
+	static constexpr int MAX = 127;
+	// solid mask of a chunk with the 1 voxel border of the init
+	static constexpr int PADDED = CHUNK_SIZE + 2;
+
+	struct Entry {
+		int3		chunk_pos;
+		chunk_id	neighbours[27]; // the 3x3x3 chunks around chunk_pos (IDX3D(x+1,y+1,z+1, 3)), U16_NULL for unloaded or outside the window
+
+		bool		uniform; // all voxels of the result are value (sky or solid rock), set by compute
+		int8_t		value;
+	};
+	std::vector<Entry>	entries; // result of entry i is CHUNK_VOXEL_COUNT values at i * CHUNK_VOXEL_COUNT, x fastest
+
+	// chunks outside of the window are not added, and their voxels count as air
+	int3				window_offset = 0;
+	int					window_size = 0; // in chunks per axis
+	block_id			air = B_NULL; // blocks > air are solid
+
+	// stats of the last batch
+	int		edits = 0;
+	int		uniform_chunks = 0;
+	float	compute_ms = 0;
+
+	void clear (int3 window_offset, int window_size, block_id air);
+
+	bool contains (int3 chunk_pos) const {
+		int3 rel = chunk_pos - window_offset;
+		return (unsigned)rel.x < (unsigned)window_size &&
+		       (unsigned)rel.y < (unsigned)window_size &&
+		       (unsigned)rel.z < (unsigned)window_size;
+	}
+
+	// voxels in the dirty rect [lo,hi) of the chunk changed (the whole chunk if the rect is empty),
+	// adds the chunk and the neighbours whose border overlaps the rect
+	void add (int3 chunk_pos, int3 lo, int3 hi);
+	// add only the chunk itself, if it is in the window and not added yet
+	void add_chunk (int3 chunk_pos);
+
+	// look up the neighbourhood of every entry, query(chunk_pos) returns the chunk at a position or U16_NULL
+	template <typename QUERY>
+	void prepare (QUERY query) {
+		ZoneScoped;
+		for (auto& e : entries) {
+			for (int z=-1; z<=1; ++z)
+			for (int y=-1; y<=1; ++y)
+			for (int x=-1; x<=1; ++x) {
+				int3 pos = e.chunk_pos + int3(x,y,z);
+				e.neighbours[IDX3D(x+1, y+1, z+1, 3)] = contains(pos) ? query(pos) : U16_NULL;
+			}
+		}
+	}
+
+	// compute all entries into dst (entries.size() * CHUNK_VOXEL_COUNT), split across parallel_for_threadpool if threaded
+	void compute (ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, int8_t* dst, bool threaded);
+	void compute_entries (ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, int8_t* dst, uint32_t first, uint32_t end);
+
+	// solid mask of the chunk with its border (PADDED^3, x fastest), returns false if nothing is solid
+	static bool gather_solid (chunk_id const neighbours[27], ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, block_id air, uint8_t* solid);
+	// init + gen of one chunk, tmp is PADDED^3 bytes
+	static void compute_chunk (uint8_t const* solid, uint8_t* tmp, int8_t* df);
+
+	struct Bench {
+		int		failures = -1; // -1 if not run yet
+		int		edits = 0;
+		float	full_ms = 0; // all chunks of the window
+		float	full_threaded_ms = 0;
+		float	edit_ms = 0; // per edit
+		// per edit
+		float	chunks = 0; // recomputed chunks
+		float	recomputed_pct = 0; // of the window volume
+		float	changed_voxels = 0; // voxels whose value actually changed
+		float	changed_pct = 0; // of the recomputed voxels
+		int		max_radius = 0; // furthest changed voxel from the dirty rect
+	};
+
+	// compare full builds and incremental updates after random edits against a bfs reference on synthetic chunks, runs without a gpu or loaded world
+	static Bench check_synthetic ();
+
+	void imgui ();
+
+private:
+	std::unordered_map<int3, uint32_t> entry_map; // chunk_pos -> entry
+};
@@ -0,0 +1,117 @@
+#include "common.hpp"
+#include "ring_allocator.hpp"
+
+uint64_t RingAllocator::alloc (uint64_t bytes, uint64_t align) {
+	assert(bytes > 0 && bytes <= size);
+	assert(align > 0 && (align & (align - 1)) == 0 && size % align == 0);
+
+	uint64_t pos = (head + align - 1) & ~(align - 1);
+
+	uint64_t offs = pos % size;
+	if (offs + bytes > size) {
+		pos += size - offs; // skip to the start of the buffer
+		offs = 0;
+	}
+
+	if (pos + bytes - tail > size)
+		return FAILED;
+
+	head = pos + bytes;
+	return offs;
+}
+
+void RingAllocator::submit (uint64_t fence) {
+	if (open_empty()) return;
+
+	regions.push_back({ head, fence });
+	open_begin = head;
+}
+
+RingAllocator::Bench RingAllocator::check_synthetic () {
+	ZoneScoped;
+
+	constexpr uint64_t SIZE = 1024 * 1024;
+	constexpr int FRAMES = 2000;
+	constexpr uint64_t GPU_LATENCY = 3; // frames until the gpu is done with a frame
+
+	RingAllocator ring;
+	ring.init(SIZE);
+
+	uint32_t rng = 0x2545f491u;
+	auto next = [&] (uint32_t n) {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng % n;
+	};
+
+	struct Live {
+		uint64_t	offs, bytes;
+		uint64_t	fence;
+	};
+	std::vector<Live> live; // allocations the simulated gpu may still read
+
+	Bench b;
+	b.failures = 0;
+
+	// every submit gets a new fence, the simulated gpu signals the fences of a frame GPU_LATENCY frames later
+	uint64_t next_fence = 1;
+	std::vector<uint64_t> frame_fence (FRAMES+1, 0); // last fence submitted in each frame
+	uint64_t gpu_done = 0; // all fences <= gpu_done have signaled
+
+	auto signaled = [&] (uint64_t fence) { return fence <= gpu_done; };
+	auto gpu_progress = [&] (uint64_t done) {
+		gpu_done = max(gpu_done, done);
+		ring.retire(signaled);
+		live.erase(std::remove_if(live.begin(), live.end(), [&] (Live& l) { return l.fence <= gpu_done; }), live.end());
+	};
+
+	auto overlaps = [] (uint64_t a, uint64_t an, uint64_t b, uint64_t bn) {
+		return a < b + bn && b < a + an;
+	};
+
+	for (int frame=1; frame<=FRAMES; ++frame) {
+		if (frame > (int)GPU_LATENCY)
+			gpu_progress(frame_fence[frame - GPU_LATENCY]);
+
+		// mostly small uploads with the occasional burst, like after a load wave
+		int count = next(16) == 0 ? 200 : (int)next(20);
+		for (int i=0; i<count; ++i) {
+			uint64_t bytes = 1 + next(next(4) == 0 ? 64*1024 : 4*1024);
+			uint64_t align = 1ull << next(5);
+
+			uint64_t offs = ring.alloc(bytes, align);
+			if (offs == FAILED) {
+				// what the backends do: submit the open region and wait for the gpu to finish the oldest one
+				b.stalls++;
+				if (!ring.open_empty())
+					ring.submit(next_fence++);
+				while (offs == FAILED && !ring.regions.empty()) {
+					gpu_progress(ring.regions.front().fence);
+					offs = ring.alloc(bytes, align);
+				}
+				if (offs == FAILED) {
+					b.failures++;
+					continue;
+				}
+			}
+
+			if (offs + bytes > SIZE || (offs & (align - 1)) != 0)
+				b.failures++;
+			for (auto& l : live) {
+				if (overlaps(offs, bytes, l.offs, l.bytes))
+					b.failures++;
+			}
+
+			live.push_back({ offs, bytes, next_fence }); // read until the fence of the region it ends up in
+			b.allocs++;
+			b.max_usage = max(b.max_usage, (float)ring.used() / (float)SIZE);
+		}
+
+		if (!ring.open_empty())
+			ring.submit(next_fence++);
+		frame_fence[frame] = next_fence - 1;
+	}
+
+	return b;
+}
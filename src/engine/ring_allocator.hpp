@@ -0,0 +1,64 @@
+#pragma once
+#include "common.hpp"
+
+// Allocator for a ring buffer of upload memory (persistently mapped staging memory that the gpu copies from asynchronously)
+// allocations are grouped into regions, a region is closed with submit(fence) after the copies out of it were recorded
+// and freed once the backend saw that fence signal, regions are retired strictly in order
+// only tracks offsets, the backends own the buffer memory and the fences (GLsync or frame numbers)
+// Pure CPU code, shared by gl::ChunkRenderer and vk::StagingBuffers
+struct RingAllocator {
+	static constexpr uint64_t FAILED = (uint64_t)-1;
+
+	struct Region {
+		uint64_t	end; // head at the time of submit
+		uint64_t	fence;
+	};
+
+	uint64_t	size = 0;
+
+	// monotonic positions, the offset in the buffer is pos % size
+	uint64_t	head = 0; // end of the newest allocation
+	uint64_t	tail = 0; // start of the oldest allocation that may still be read by the gpu
+	uint64_t	open_begin = 0; // start of the region that was not submitted yet
+
+	std::vector<Region>	regions; // submitted and not retired yet, oldest first
+
+	void init (uint64_t size) {
+		this->size = size;
+		head = 0;
+		tail = 0;
+		open_begin = 0;
+		regions.clear();
+	}
+
+	uint64_t used () const { return head - tail; }
+	bool open_empty () const { return head == open_begin; }
+
+	// returns the offset in the buffer or FAILED if the free space can't fit bytes right now
+	// allocations never wrap around the end of the buffer, the skipped bytes at the end count as used until their region is retired
+	uint64_t alloc (uint64_t bytes, uint64_t align=16);
+
+	// close the open region, fence has to signal once the gpu is done reading the allocations made since the last submit
+	void submit (uint64_t fence);
+
+	// retire the oldest regions as long as is_signaled(fence) returns true
+	template <typename FUNC>
+	int retire (FUNC is_signaled) {
+		size_t i = 0;
+		while (i < regions.size() && is_signaled(regions[i].fence)) {
+			tail = regions[i].end;
+			i++;
+		}
+		regions.erase(regions.begin(), regions.begin() + i);
+		return (int)i;
+	}
+
+	struct Bench {
+		int		failures = -1; // -1 if not run yet
+		int		allocs = 0;
+		int		stalls = 0; // allocs that had to wait for the simulated gpu
+		float	max_usage = 0;
+	};
+	// simulate a gpu that finishes frames with a delay and check that no allocation overlaps memory that may still be read
+	static Bench check_synthetic ();
+};
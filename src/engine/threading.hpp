@@ -17,3 +17,61 @@ inline const int parallelism_threads = clamp(roundi((float)logical_cores * 0.84f
 #else
 inline const int parallelism_threads = 1;
 #endif
+
+// A range of a parallel_for loop
+struct ParallelForJob {
+	void		(*fn) (void const* ctx, uint32_t first, uint32_t end);
+	void const*	ctx;
+	uint32_t	first, end;
+
+	void execute () {
+		fn(ctx, first, end);
+	}
+};
+// shared by all parallel_for loops, which wait for their results right away (unlike the remesh jobs on parallelism_threadpool, which are collected in a later frame)
+inline auto parallel_for_threadpool = Threadpool<ParallelForJob>(parallelism_threads, TPRIO_PARALLELISM, ">> parallel for threadpool");
+
+// run func(first, end) for the ranges [bounds[i], bounds[i+1]) with i < ranges and return once all are done
+// ranges after the first are split across parallel_for_threadpool, the main thread does the first one instead of idling
+// only call from the main thread, since all loops share the results queue
+template <typename FUNC>
+inline void parallel_for_ranges (uint32_t const* bounds, uint32_t ranges, FUNC const& func) {
+	if (ranges == 0)
+		return;
+	if (ranges == 1) {
+		func(bounds[0], bounds[1]);
+		return;
+	}
+
+	auto call = [] (void const* ctx, uint32_t first, uint32_t end) {
+		(*(FUNC const*)ctx)(first, end);
+	};
+
+	std::vector<std::unique_ptr<ParallelForJob>> jobs;
+	jobs.reserve(ranges-1);
+	for (uint32_t i=1; i<ranges; ++i)
+		jobs.emplace_back(new ParallelForJob{ call, &func, bounds[i], bounds[i+1] });
+	parallel_for_threadpool.jobs.push_n(jobs.data(), jobs.size());
+
+	func(bounds[0], bounds[1]);
+
+	size_t done = 0;
+	while (done < ranges-1) {
+		std::unique_ptr<ParallelForJob> results[64];
+		done += parallel_for_threadpool.results.pop_n_wait(results, 1, 64);
+	}
+}
+
+// run func(first, end) over [0,count) split into up to parts ranges of equal size
+template <typename FUNC>
+inline void parallel_for (uint32_t count, uint32_t parts, FUNC const& func) {
+	parts = max(min(parts, count), 1u);
+	uint32_t per_part = (count + parts-1) / parts;
+
+	std::vector<uint32_t> bounds;
+	for (uint32_t first=0; first<count; first+=per_part)
+		bounds.push_back(first);
+	bounds.push_back(count);
+
+	parallel_for_ranges(bounds.data(), (uint32_t)bounds.size()-1, func);
+}
@@ -294,6 +294,16 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLin
 	#endif
 #endif
 {
+	// run the cpu side selftests headless and exit, non-zero if any failed
+	for (int i=1; i<__argc; ++i) {
+		if (strcmp(__argv[i], "--selftest") == 0) {
+			Selftest selftest;
+			selftest.run();
+			selftest.print();
+			return selftest.failures() == 0 ? 0 : 1;
+		}
+	}
+
 	if (!app_init())
 		return 1;
 
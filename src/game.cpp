@@ -1,5 +1,6 @@
 #include "common.hpp"
 #include "game.hpp"
+#include "chunk_culling.hpp"
 #include "engine/window.hpp"
 #include "kisslib/threadpool.hpp"
 
@@ -24,7 +25,7 @@ Game::Game () {
 	set_thread_description(">> gameloop");
 
 	_threads_world_gen = world_gen; // apply changes loaded by load("debug.json")
-	_threads_world_gen.seed = get_seed(_threads_world_gen.seed_str);
+	_threads_world_gen.init_seed();
 }
 Game::~Game () {
 	ZoneScoped;
@@ -106,7 +107,8 @@ void Game::imgui (Window& window, Input& I, Renderer* renderer) {
 			if (ImGui::Button("Recreate")) {
 				chunks.destroy();
 				_threads_world_gen = world_gen; // make copy that can safely be used in threads while main version is edited by imgui
-				_threads_world_gen.seed = get_seed(_threads_world_gen.seed_str);
+				_threads_world_gen.init_seed();
+				column_cache.clear();
 			}
 
 			ImGui::InputText("savefile", &world_gen.savefile);
@@ -117,10 +119,17 @@ void Game::imgui (Window& window, Input& I, Renderer* renderer) {
 				chunks.save_chunks_to_disk(world_gen.savefile.c_str());
 
 			world_gen.imgui();
+			column_cache.imgui();
 		}
 
 		if (imgui_header("Chunks", &imopen.chunks)) {
 			chunks.edits.imgui(I);
+			if (ImGui::Button("Benchmark meshers"))
+				chunks.benchmark_meshers(world_gen);
+			ImGui::SameLine();
+			if (ImGui::Button("Benchmark culling"))
+				chunks.culler->bench = ChunkCuller::benchmark(view.frustrum, floori(lod_center() / CHUNK_SIZE));
+			selftest.imgui();
 			chunks.imgui(renderer);
 			block_update.imgui();
 		}
@@ -5,6 +5,7 @@
 #include "block_update.hpp"
 #include "player.hpp"
 #include "assets.hpp"
+#include "selftest.hpp"
 
 struct Game {
 #define SERIALIZE_NORMAL     world_gen, chunks, flycam, player, activate_flycam, imopen, lod_follow_flycam
@@ -23,6 +24,7 @@ struct Game {
 
 	WorldGenerator world_gen; // modified by imgui etc.
 	WorldGenerator _threads_world_gen; // used in threads, do not modify
+	worldgen::ColumnFieldCache column_cache; // 2D fields of _threads_world_gen, cleared when it changes
 
 	Chunks chunks;
 
@@ -31,6 +33,8 @@ struct Game {
 
 	BlockUpdate block_update;
 
+	Selftest selftest;
+
 	bool activate_flycam = false;
 	bool flycam_control_player = false;
 	bool player_controls_active () { return !activate_flycam || flycam_control_player; }
@@ -0,0 +1,598 @@
+#include "common.hpp"
+#include "mesh_allocator.hpp"
+#include "chunks.hpp"
+
+// bin of a block size, sizes below SL_COUNT get exact bins, above that each power of two is split into SL_COUNT linear bins
+static void mapping (uint32_t size, int& fl, int& sl) {
+	if (size < MeshAllocator::SL_COUNT) {
+		fl = 0;
+		sl = (int)size;
+	} else {
+		int l = 31 - (int)_lzcnt_u32(size);
+		fl = l - MeshAllocator::SL_BITS + 1;
+		sl = (int)((size >> (l - MeshAllocator::SL_BITS)) ^ MeshAllocator::SL_COUNT);
+	}
+}
+
+void MeshAllocator::init (uint32_t page_size) {
+	assert(page_size > 0);
+	this->page_size = page_size;
+
+	blocks.clear();
+	unused_blocks.clear();
+	handles.clear();
+	unused_handles.clear();
+	page_first.clear();
+	page_used.clear();
+
+	fl_bitmap = 0;
+	for (int fl=0; fl<FL_COUNT; ++fl) {
+		sl_bitmap[fl] = 0;
+		for (int sl=0; sl<SL_COUNT; ++sl)
+			bins[fl][sl] = NULL_ALLOC;
+	}
+
+	used_units = 0;
+	alloc_count = 0;
+}
+
+uint32_t MeshAllocator::new_block () {
+	if (!unused_blocks.empty()) {
+		uint32_t b = unused_blocks.back();
+		unused_blocks.pop_back();
+		return b;
+	}
+	blocks.emplace_back();
+	return (uint32_t)blocks.size() - 1;
+}
+
+void MeshAllocator::insert_free (uint32_t b) {
+	int fl, sl;
+	mapping(blocks[b].size, fl, sl);
+
+	uint32_t head = bins[fl][sl];
+	blocks[b].handle = NULL_ALLOC;
+	blocks[b].prev_free = NULL_ALLOC;
+	blocks[b].next_free = head;
+	if (head != NULL_ALLOC)
+		blocks[head].prev_free = b;
+	bins[fl][sl] = b;
+
+	fl_bitmap |= 1u << fl;
+	sl_bitmap[fl] |= 1u << sl;
+}
+void MeshAllocator::remove_free (uint32_t b) {
+	auto& blk = blocks[b];
+
+	if (blk.prev_free != NULL_ALLOC) blocks[blk.prev_free].next_free = blk.next_free;
+	if (blk.next_free != NULL_ALLOC) blocks[blk.next_free].prev_free = blk.prev_free;
+
+	int fl, sl;
+	mapping(blk.size, fl, sl);
+	if (bins[fl][sl] == b) {
+		bins[fl][sl] = blk.next_free;
+		if (blk.next_free == NULL_ALLOC) {
+			sl_bitmap[fl] &= ~(1u << sl);
+			if (sl_bitmap[fl] == 0)
+				fl_bitmap &= ~(1u << fl);
+		}
+	}
+	blk.prev_free = NULL_ALLOC;
+	blk.next_free = NULL_ALLOC;
+}
+
+uint32_t MeshAllocator::find_free (uint32_t size) {
+	// round up to the next bin boundary, so that any block in the found bin fits
+	uint32_t rounded = size;
+	if (size >= SL_COUNT) {
+		int l = 31 - (int)_lzcnt_u32(size);
+		rounded += (1u << (l - SL_BITS)) - 1;
+	}
+
+	int fl, sl;
+	mapping(rounded, fl, sl);
+	if (fl >= FL_COUNT) return NULL_ALLOC;
+
+	uint32_t sl_map = sl_bitmap[fl] & (~0u << sl);
+	if (sl_map == 0) {
+		uint32_t fl_map = fl+1 < FL_COUNT ? fl_bitmap & (~0u << (fl+1)) : 0;
+		if (fl_map == 0) return NULL_ALLOC;
+
+		fl = (int)_tzcnt_u32(fl_map);
+		sl_map = sl_bitmap[fl];
+	}
+	sl = (int)_tzcnt_u32(sl_map);
+
+	uint32_t b = bins[fl][sl];
+	assert(b != NULL_ALLOC && blocks[b].size >= size);
+	return b;
+}
+
+void MeshAllocator::add_page () {
+	ZoneScoped;
+
+	uint32_t b = new_block();
+	auto& blk = blocks[b];
+	blk.offset = (uint32_t)page_first.size() * page_size;
+	blk.size = page_size;
+	blk.prev_phys = NULL_ALLOC;
+	blk.next_phys = NULL_ALLOC;
+	insert_free(b);
+
+	page_first.push_back(b);
+	page_used.push_back(0);
+}
+void MeshAllocator::release_last_pages () {
+	// keep one page around to not recreate the buffer every time the last mesh is freed
+	while (page_first.size() > 1 && page_used.back() == 0) {
+		uint32_t b = page_first.back();
+		assert(blocks[b].size == page_size && blocks[b].handle == NULL_ALLOC);
+
+		remove_free(b);
+		unused_blocks.push_back(b);
+
+		page_first.pop_back();
+		page_used.pop_back();
+	}
+}
+
+uint32_t MeshAllocator::alloc_from (uint32_t b, uint32_t size) {
+	remove_free(b);
+
+	if (blocks[b].size > size) {
+		// split off the remainder as a new free block
+		uint32_t r = new_block();
+		auto& blk = blocks[b];
+		auto& rest = blocks[r];
+
+		rest.offset = blk.offset + size;
+		rest.size = blk.size - size;
+		rest.prev_phys = b;
+		rest.next_phys = blk.next_phys;
+		if (blk.next_phys != NULL_ALLOC)
+			blocks[blk.next_phys].prev_phys = r;
+		blk.next_phys = r;
+		blk.size = size;
+
+		insert_free(r);
+	}
+
+	uint32_t h;
+	if (!unused_handles.empty()) {
+		h = unused_handles.back();
+		unused_handles.pop_back();
+	} else {
+		handles.push_back(NULL_ALLOC);
+		h = (uint32_t)handles.size() - 1;
+	}
+	handles[h] = b;
+	blocks[b].handle = h;
+
+	page_used[blocks[b].offset / page_size] += size;
+	used_units += size;
+	alloc_count++;
+	return h;
+}
+
+uint32_t MeshAllocator::alloc (uint32_t size) {
+	ZoneScoped;
+	assert(size > 0 && size <= page_size);
+
+	uint32_t b = find_free(size);
+	if (b == NULL_ALLOC) {
+		add_page();
+		b = find_free(size);
+		assert(b != NULL_ALLOC);
+	}
+
+	return alloc_from(b, size);
+}
+
+uint32_t MeshAllocator::merge_free (uint32_t b) {
+	// absorb the free neighbour n into the block before it
+	auto absorb = [&] (uint32_t into, uint32_t n) {
+		blocks[into].size += blocks[n].size;
+		blocks[into].next_phys = blocks[n].next_phys;
+		if (blocks[n].next_phys != NULL_ALLOC)
+			blocks[blocks[n].next_phys].prev_phys = into;
+		unused_blocks.push_back(n);
+	};
+
+	uint32_t prev = blocks[b].prev_phys;
+	if (prev != NULL_ALLOC && blocks[prev].handle == NULL_ALLOC) {
+		remove_free(prev);
+		absorb(prev, b);
+		b = prev;
+	}
+	uint32_t next = blocks[b].next_phys;
+	if (next != NULL_ALLOC && blocks[next].handle == NULL_ALLOC) {
+		remove_free(next);
+		absorb(b, next);
+	}
+	return b;
+}
+
+void MeshAllocator::free (uint32_t handle) {
+	ZoneScoped;
+
+	uint32_t b = handles[handle];
+	assert(b != NULL_ALLOC && blocks[b].handle == handle);
+
+	page_used[blocks[b].offset / page_size] -= blocks[b].size;
+	used_units -= blocks[b].size;
+	alloc_count--;
+
+	handles[handle] = NULL_ALLOC;
+	unused_handles.push_back(handle);
+	blocks[b].handle = NULL_ALLOC;
+
+	insert_free(merge_free(b));
+
+	release_last_pages();
+}
+
+uint32_t MeshAllocator::largest_free () const {
+	if (fl_bitmap == 0) return 0;
+
+	// every block in the highest non-empty bin is larger than the ones in lower bins, but the bin is not sorted
+	int fl = 31 - (int)_lzcnt_u32(fl_bitmap);
+	int sl = 31 - (int)_lzcnt_u32(sl_bitmap[fl]);
+
+	uint32_t largest = 0;
+	for (uint32_t b = bins[fl][sl]; b != NULL_ALLOC; b = blocks[b].next_free)
+		largest = max(largest, blocks[b].size);
+	return largest;
+}
+float MeshAllocator::fragmentation () const {
+	uint64_t free_units = committed_units() - used_units;
+	if (free_units == 0) return 0;
+	return 1.0f - (float)largest_free() / (float)free_units;
+}
+
+uint32_t MeshAllocator::evacuate (int page, uint32_t max_units, std::vector<Move>& moves) {
+	ZoneScoped;
+
+	// detach the free blocks of this and all later pages from the bins, so the allocations can only move to earlier pages
+	for (int p=page; p<page_count(); ++p) {
+		for (uint32_t b = page_first[p]; b != NULL_ALLOC; b = blocks[b].next_phys) {
+			if (blocks[b].handle == NULL_ALLOC)
+				remove_free(b);
+		}
+	}
+
+	uint32_t moved = 0;
+	for (uint32_t b = page_first[page]; b != NULL_ALLOC; b = blocks[b].next_phys) {
+		uint32_t h = blocks[b].handle;
+		if (h == NULL_ALLOC) continue;
+
+		uint32_t size = blocks[b].size;
+		if (moved > 0 && moved + size > max_units) break;
+
+		uint32_t dst = find_free(size);
+		if (dst == NULL_ALLOC) continue; // no free block fits this one, but smaller ones might
+
+		uint32_t nh = alloc_from(dst, size);
+		dst = handles[nh];
+
+		moves.push_back({ blocks[b].offset, blocks[dst].offset, size });
+		moved += size;
+
+		// the new block takes over the handle, the old one stays detached until the page is rebuilt below
+		handles[h] = dst;
+		blocks[dst].handle = h;
+		handles[nh] = NULL_ALLOC;
+		unused_handles.push_back(nh);
+
+		blocks[b].handle = NULL_ALLOC;
+		page_used[page] -= size;
+		used_units -= size;
+		alloc_count--;
+	}
+
+	// merge the free runs of the evacuated page and put all detached blocks back into the bins
+	for (int p=page; p<page_count(); ++p) {
+		for (uint32_t b = page_first[p]; b != NULL_ALLOC; b = blocks[b].next_phys) {
+			if (blocks[b].handle != NULL_ALLOC) continue;
+
+			uint32_t n;
+			while ((n = blocks[b].next_phys) != NULL_ALLOC && blocks[n].handle == NULL_ALLOC) {
+				blocks[b].size += blocks[n].size;
+				blocks[b].next_phys = blocks[n].next_phys;
+				if (blocks[n].next_phys != NULL_ALLOC)
+					blocks[blocks[n].next_phys].prev_phys = b;
+				unused_blocks.push_back(n);
+			}
+			insert_free(b);
+		}
+	}
+
+	return moved;
+}
+
+uint32_t MeshAllocator::defrag (uint32_t max_units, float max_usage, std::vector<Move>& moves) {
+	ZoneScoped;
+
+	// compact towards the first pages, since only trailing empty pages can be released
+	// take the last page that is empty enough to be worth it, and fall back to earlier ones if none of its allocations fit into the free blocks before it
+	uint64_t free_before = 0; // free units in the pages before p
+	for (int p=0; p<page_count(); ++p)
+		free_before += page_size - page_used[p];
+
+	uint32_t moved = 0;
+	for (int p=page_count()-1; p>0 && moved == 0; --p) {
+		free_before -= page_size - page_used[p];
+
+		if (page_used[p] == 0 || (float)page_used[p] > max_usage * (float)page_size) continue;
+		if (free_before < page_used[p]) continue;
+
+		moved = evacuate(p, max_units, moves);
+	}
+
+	release_last_pages();
+	return moved;
+}
+
+int MeshAllocator::validate () const {
+	int errors = 0;
+	auto check = [&] (bool cond) {
+		if (!cond) errors++;
+	};
+
+	uint64_t used = 0;
+	uint32_t allocs = 0;
+	size_t free_blocks = 0;
+
+	for (int p=0; p<page_count(); ++p) {
+		uint32_t offset = (uint32_t)p * page_size;
+		uint32_t page_alloced = 0;
+		uint32_t prev = NULL_ALLOC;
+
+		for (uint32_t b = page_first[p]; b != NULL_ALLOC; b = blocks[b].next_phys) {
+			auto& blk = blocks[b];
+			check(blk.offset == offset && blk.size > 0);
+			check(blk.prev_phys == prev);
+
+			if (blk.handle == NULL_ALLOC) {
+				// free blocks never touch, they would have been merged
+				check(prev == NULL_ALLOC || blocks[prev].handle != NULL_ALLOC);
+				free_blocks++;
+			} else {
+				check(blk.handle < handles.size() && handles[blk.handle] == b);
+				page_alloced += blk.size;
+				allocs++;
+			}
+
+			offset += blk.size;
+			prev = b;
+		}
+
+		check(offset == (uint32_t)(p+1) * page_size);
+		check(page_used[p] == page_alloced);
+		used += page_alloced;
+	}
+	check(used == used_units && allocs == alloc_count);
+
+	size_t binned = 0;
+	for (int fl=0; fl<FL_COUNT; ++fl) {
+		check(((fl_bitmap >> fl) & 1) == (sl_bitmap[fl] != 0 ? 1u : 0u));
+
+		for (int sl=0; sl<SL_COUNT; ++sl) {
+			check(((sl_bitmap[fl] >> sl) & 1) == (bins[fl][sl] != NULL_ALLOC ? 1u : 0u));
+
+			uint32_t prev = NULL_ALLOC;
+			for (uint32_t b = bins[fl][sl]; b != NULL_ALLOC; b = blocks[b].next_free) {
+				int bfl, bsl;
+				mapping(blocks[b].size, bfl, bsl);
+				check(bfl == fl && bsl == sl);
+				check(blocks[b].handle == NULL_ALLOC && blocks[b].prev_free == prev);
+
+				prev = b;
+				if (++binned > blocks.size()) return errors + 1; // cycle
+			}
+		}
+	}
+	check(binned == free_blocks);
+
+	return errors;
+}
+
+MeshAllocator::Bench MeshAllocator::check_synthetic () {
+	ZoneScoped;
+
+	uint32_t rng = 0x68e31da4u;
+	auto next = [&] (uint32_t n) {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng % n;
+	};
+
+	Bench b;
+	b.failures = 0;
+
+	{ // random churn, the simulated heap memory holds the id of the allocation at each unit to check the moves
+		constexpr uint32_t PAGE = 4096;
+		constexpr int ROUNDS = 400;
+
+		MeshAllocator a;
+		a.init(PAGE);
+
+		struct Live {
+			uint32_t	handle;
+			uint32_t	id;
+		};
+		std::vector<Live> live;
+		std::vector<uint32_t> heap;
+		std::vector<Move> moves;
+		uint32_t next_id = 1;
+
+		for (int round=0; round<ROUNDS; ++round) {
+			// phases of growth and shrinking to exercise adding and releasing pages
+			bool grow = (round / 50) % 2 == 0;
+
+			for (int i=0; i<64; ++i) {
+				if (live.empty() || next(4) < (grow ? 3u : 1u)) {
+					uint32_t size = next(4) == 0 ? 1 + next(PAGE) : 1 + next(64);
+					uint32_t h = a.alloc(size);
+
+					heap.resize(a.committed_units());
+					uint32_t offs = a.offset(h);
+					if (a.size(h) != size || offs / PAGE != (offs + size - 1) / PAGE)
+						b.failures++;
+					for (uint32_t u=0; u<size; ++u)
+						heap[offs + u] = next_id;
+
+					live.push_back({ h, next_id++ });
+					b.allocs++;
+				} else {
+					uint32_t i = next((uint32_t)live.size());
+					a.free(live[i].handle);
+					live[i] = live.back();
+					live.pop_back();
+				}
+			}
+
+			if (round % 4 == 0) {
+				moves.clear();
+				heap.resize(max(heap.size(), (size_t)a.committed_units()));
+				a.defrag(PAGE / 2, 0.5f, moves);
+
+				for (auto& m : moves) {
+					for (auto& n : moves) {
+						if (m.dst < n.src + n.size && n.src < m.dst + m.size)
+							b.failures++;
+					}
+					for (uint32_t u=0; u<m.size; ++u)
+						heap[m.dst + u] = heap[m.src + u];
+				}
+				b.moves += (int)moves.size();
+			}
+			heap.resize(a.committed_units());
+
+			b.failures += a.validate();
+			for (auto& l : live) {
+				uint32_t offs = a.offset(l.handle);
+				for (uint32_t u=0; u<a.size(l.handle); ++u) {
+					if (offs + u >= heap.size() || heap[offs + u] != l.id) {
+						b.failures++;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	{ // chunk meshes being loaded, remeshed and unloaded while walking around, compared to the fixed size slices
+		constexpr int CHUNKS = 3000;
+		constexpr int FRAMES = 2000;
+
+		auto mesh_units = [&] (uint32_t& slices) {
+			// mostly small meshes, some surface chunks with lots of faces
+			uint32_t faces  = next(8) == 0 ? next(60000) : next(3000);
+			uint32_t opaque = next(2) == 0 ? next(800) : 0;
+			uint32_t transp = next(6) == 0 ? next(4000) : 0;
+
+			slices = _slices_count(faces, FACE_SLICE_LENGTH) + _slices_count(opaque) + _slices_count(transp);
+			return instance_units(faces, sizeof(FaceInstance)) + instance_units(opaque, sizeof(BlockMeshInstance))
+				+ instance_units(transp, sizeof(BlockMeshInstance));
+		};
+
+		MeshAllocator plain, defragged;
+		plain.init(MESH_PAGE_UNITS);
+		defragged.init(MESH_PAGE_UNITS);
+
+		struct Mesh {
+			uint32_t	plain = NULL_ALLOC, defragged = NULL_ALLOC;
+			uint32_t	slices = 0;
+		};
+		std::vector<Mesh> meshes (CHUNKS);
+		std::vector<Move> moves;
+
+		uint64_t alloc_ticks = 0;
+		int timed = 0;
+
+		auto remesh = [&] (Mesh& m, bool unload) {
+			if (m.plain != NULL_ALLOC) {
+				uint64_t t0 = get_timestamp();
+				plain.free(m.plain);
+				alloc_ticks += get_timestamp() - t0;
+
+				defragged.free(m.defragged);
+				m.plain = m.defragged = NULL_ALLOC;
+				m.slices = 0;
+			}
+			if (unload) return;
+
+			uint32_t units = mesh_units(m.slices);
+			if (units == 0) return;
+
+			uint64_t t0 = get_timestamp();
+			m.plain = plain.alloc(units);
+			alloc_ticks += get_timestamp() - t0;
+			timed++;
+
+			m.defragged = defragged.alloc(units);
+		};
+
+		for (auto& m : meshes)
+			remesh(m, false);
+
+		for (int frame=0; frame<FRAMES; ++frame) {
+			// edits and lod changes remesh chunks, walking around unloads chunks and loads new ones in their ids
+			for (int i=0; i<8; ++i)
+				remesh(meshes[next(CHUNKS)], false);
+
+			for (int i=0; i<4; ++i)
+				remesh(meshes[next(CHUNKS)], next(2) == 0);
+
+			moves.clear();
+			defragged.defrag(MESH_PAGE_UNITS / 8, 0.5f, moves);
+			b.moves += (int)moves.size();
+		}
+
+		// teleport: unload most chunks and only keep the defrag running
+		for (auto& m : meshes)
+			remesh(m, next(3) != 0);
+		for (int frame=0; frame<100; ++frame) {
+			moves.clear();
+			defragged.defrag(MESH_PAGE_UNITS / 8, 0.5f, moves);
+			b.moves += (int)moves.size();
+		}
+		b.failures += plain.validate() + defragged.validate();
+
+		uint64_t slices = 0;
+		for (auto& m : meshes)
+			slices += m.slices;
+
+		float unit_mb = (float)MESH_UNIT / (1024*1024);
+		b.slices_mb = (float)(slices * CHUNK_SLICE_SIZE) / (1024*1024);
+		b.used_mb = (float)plain.used_units * unit_mb;
+		b.committed_mb = (float)plain.committed_units() * unit_mb;
+		b.committed_defrag_mb = (float)defragged.committed_units() * unit_mb;
+		b.fragmentation = plain.fragmentation();
+		b.fragmentation_defrag = defragged.fragmentation();
+		b.alloc_ns = (float)alloc_ticks * 1e9f / (float)timestamp_freq / (float)max(timed, 1);
+	}
+
+	return b;
+}
+
+void MeshAllocator::imgui (char const* name, uint64_t unit_size) {
+	float unit_mb = (float)unit_size / (1024*1024);
+	float used = (float)used_units * unit_mb;
+	float committed = (float)committed_units() * unit_mb;
+
+	ImGui::Text("%s: %6d allocs  used: %7.1f / %7.1f MB in %2d pages (%5.1f%%)  fragmentation: %5.1f%%", name,
+		alloc_count, used, committed, page_count(), used / max(committed, 1e-6f) * 100, fragmentation() * 100);
+
+	if (ImGui::TreeNode("pages")) {
+		for (int p=0; p<page_count(); ++p) {
+			int free_blocks = 0;
+			for (uint32_t b = page_first[p]; b != NULL_ALLOC; b = blocks[b].next_phys)
+				free_blocks += blocks[b].handle == NULL_ALLOC ? 1 : 0;
+
+			ImGui::Text("[%2d] %5.1f%% used  %5d free blocks", p, (float)page_used[p] / (float)page_size * 100, free_blocks);
+		}
+		ImGui::TreePop();
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "common.hpp"
+
+// TLSF style suballocator for variable sized chunk meshes in gpu memory
+// the heap is split into pages of page_size units (one vbo / VkBuffer per page in the renderers) and allocations never cross a page border
+// free blocks are kept in segregated free lists with a two level bitmap, which gives O(1) good fit allocation,
+// and are merged with their free neighbours in the same page on free
+// defrag() compacts the allocations towards the first pages, so that the trailing pages become empty and can be released
+// only tracks offsets, the data is moved by the renderers based on the returned Moves
+// Pure CPU code, shared by gl::ChunkRenderer and vk::ChunkRenderer
+struct MeshAllocator {
+	static constexpr uint32_t NULL_ALLOC = (uint32_t)-1;
+
+	static constexpr int SL_BITS = 4;
+	static constexpr int SL_COUNT = 1 << SL_BITS; // second level bins per power of two
+	static constexpr int FL_COUNT = 32;
+
+	struct Block {
+		uint32_t	offset;
+		uint32_t	size;
+		uint32_t	prev_phys, next_phys; // neighbours in the same page, NULL_ALLOC at the page borders
+		uint32_t	prev_free, next_free; // free list of the bin, only for free blocks
+		uint32_t	handle; // NULL_ALLOC for free blocks
+	};
+
+	// data of size units has to be copied from src to dst (offsets in units), sources and destinations of one defrag() never overlap
+	struct Move {
+		uint32_t	src;
+		uint32_t	dst;
+		uint32_t	size;
+	};
+
+	uint32_t				page_size = 0; // in units
+
+	std::vector<Block>		blocks;
+	std::vector<uint32_t>	unused_blocks;
+	std::vector<uint32_t>	handles; // handle -> block, handles stay valid when defrag moves the allocation
+	std::vector<uint32_t>	unused_handles;
+
+	std::vector<uint32_t>	page_first; // first block of each page
+	std::vector<uint32_t>	page_used; // allocated units in each page
+
+	uint32_t				fl_bitmap = 0;
+	uint32_t				sl_bitmap[FL_COUNT];
+	uint32_t				bins[FL_COUNT][SL_COUNT]; // first free block in each bin
+
+	uint64_t				used_units = 0;
+	uint32_t				alloc_count = 0;
+
+	void init (uint32_t page_size);
+
+	// returns a handle, adds a page if no free block fits, 0 < size <= page_size
+	uint32_t alloc (uint32_t size);
+	void free (uint32_t handle);
+
+	uint32_t offset (uint32_t handle) const { return blocks[handles[handle]].offset; }
+	uint32_t size (uint32_t handle) const { return blocks[handles[handle]].size; }
+
+	int page_count () const { return (int)page_first.size(); }
+	uint64_t committed_units () const { return (uint64_t)page_first.size() * page_size; }
+
+	uint32_t largest_free () const;
+	// 0 if all free space is one block, approaching 1 if it is split into many small blocks
+	float fragmentation () const;
+
+	// move up to max_units of allocations out of the last page that is at most max_usage full into the pages before it,
+	// appends the moves the renderers have to do to moves and returns the number of moved units
+	uint32_t defrag (uint32_t max_units, float max_usage, std::vector<Move>& moves);
+
+	// check all invariants of the block lists and bins, returns the number of errors
+	int validate () const;
+
+	struct Bench {
+		int		failures = -1; // -1 if not run yet
+		int		allocs = 0;
+		float	alloc_ns = 0; // per alloc + free
+		// chunk mesh churn: committed memory of the fixed slices vs. this allocator
+		float	slices_mb = 0;
+		float	used_mb = 0;
+		float	committed_mb = 0;
+		float	committed_defrag_mb = 0; // with defrag after every frame
+		float	fragmentation = 0;
+		float	fragmentation_defrag = 0;
+		int		moves = 0;
+	};
+
+	// random alloc/free with validation and a simulated data copy for defrag, then a chunk load/unload churn benchmark
+	static Bench check_synthetic ();
+
+	void imgui (char const* name, uint64_t unit_size);
+
+private:
+	uint32_t new_block ();
+	void insert_free (uint32_t b);
+	void remove_free (uint32_t b);
+	uint32_t find_free (uint32_t size);
+	// allocate size units from the front of the free block b, returns the new handle
+	uint32_t alloc_from (uint32_t b, uint32_t size);
+	// merge the free block b with its free neighbours, returns the merged block
+	uint32_t merge_free (uint32_t b);
+	// move allocations out of page into earlier pages
+	uint32_t evacuate (int page, uint32_t max_units, std::vector<Move>& moves);
+	void add_page ();
+	void release_last_pages ();
+};
@@ -0,0 +1,144 @@
+#include "common.hpp"
+#include "mesh_upload_queue.hpp"
+#include "chunk_mesher.hpp"
+
+void MeshUploadQueue::discard (Chunks& chunks, Entry& e) {
+	if (e.mesh_alloc != MeshAllocator::NULL_ALLOC)
+		chunks.mesh_heap.free(e.mesh_alloc);
+	for (auto& s : e.slices)
+		ChunkMeshData::free_slice(s.data);
+	e.slices.clear();
+}
+
+void MeshUploadQueue::apply (Chunks& chunks, Entry& e, uint64_t now) {
+	auto& chunk = chunks[e.cid];
+
+	if (chunk.mesh_alloc != MeshAllocator::NULL_ALLOC)
+		chunks.mesh_heap.free(chunk.mesh_alloc);
+
+	chunk.mesh_alloc = e.mesh_alloc;
+	chunk.face_mesh_vertex_count = e.face_mesh_vertex_count;
+	chunk.opaque_mesh_vertex_count = e.opaque_mesh_vertex_count;
+	chunk.transp_mesh_vertex_count = e.transp_mesh_vertex_count;
+	memcpy(chunk.face_buckets, e.face_buckets, sizeof(chunk.face_buckets));
+	chunk.face_connections = e.face_connections;
+
+	// full res neighbours mesh their border differently towards chunks drawn downsampled (see get_lod_neighbour)
+	if (e.drawn_lod != chunk.drawn_lod) {
+		for (chunk_id nid : chunk.neighbours) {
+			if (nid != U16_NULL)
+				chunks[nid].flags |= Chunk::REMESH;
+		}
+	}
+	chunk.drawn_lod = e.drawn_lod;
+	chunk.drawn_mesh_version = e.version;
+
+	// the allocation might have been moved by the defrag while queued
+	if (e.mesh_alloc != MeshAllocator::NULL_ALLOC) {
+		uint64_t base = (uint64_t)chunks.mesh_heap.offset(e.mesh_alloc) * MESH_UNIT;
+		for (auto& s : e.slices)
+			chunks.upload_slices.push_back({ base + s.offset, s.size, s.data });
+	}
+	e.slices.clear();
+
+	float latency_ms = (float)(now - e.queued_time) * 1000 / (float)timestamp_freq;
+	latency_total_ms += latency_ms;
+	latency_max_ms = max(latency_max_ms, latency_ms);
+	latency_count++;
+
+	uploaded_meshes++;
+	uploaded_bytes += e.bytes;
+}
+
+void MeshUploadQueue::update (Chunks& chunks, float3 const& center, View_Frustrum const& frustrum, float budget_mb) {
+	ZoneScoped;
+
+	uploaded_meshes = 0;
+	uploaded_bytes = 0;
+	queued_bytes = 0;
+
+	struct Item {
+		float		priority; // lower is more important
+		uint32_t	idx;
+	};
+	std::vector<Item> order;
+	order.reserve(entries.size());
+
+	std::vector<bool> done (entries.size(), false);
+
+	for (uint32_t i=0; i<(uint32_t)entries.size(); ++i) {
+		auto& e = entries[i];
+		auto& chunk = chunks[e.cid];
+
+		// chunk was unloaded (and the id maybe reused) or a newer result was queued
+		if (chunk.flags == 0 || chunk.queued_mesh_version != e.version) {
+			discard(chunks, e);
+			done[i] = true;
+			superseded++;
+			continue;
+		}
+
+		// same as the remesh priority
+		float3 lo = (float3)(chunk.pos * CHUNK_SIZE);
+		float3 hi = lo + (float3)CHUNK_SIZE;
+		float dist = length((lo + hi) * 0.5f - center);
+
+		float priority = dist * dist;
+		if (frustrum_cull_aabb(frustrum, lo.x, lo.y, lo.z, hi.x, hi.y, hi.z))
+			priority *= 4; // chunks outside of the view count as twice as far away
+
+		order.push_back({ priority, i });
+	}
+
+	std::sort(order.begin(), order.end(), [] (Item const& l, Item const& r) { return l.priority < r.priority; });
+
+	uint64_t budget = (uint64_t)(budget_mb * (1024*1024));
+	uint64_t now = get_timestamp();
+
+	for (auto& item : order) {
+		auto& e = entries[item.idx];
+
+		// meshes that don't fit wait for the next frame, where the most important one is always uploaded, smaller ones can still fill up the budget
+		if (uploaded_meshes > 0 && (uint64_t)uploaded_bytes + e.bytes > budget) {
+			queued_bytes += e.bytes;
+			continue;
+		}
+
+		apply(chunks, e, now);
+		done[item.idx] = true;
+	}
+
+	// remove done entries, keeping the queue order
+	size_t out = 0;
+	for (size_t i=0; i<entries.size(); ++i) {
+		if (done[i]) continue;
+		if (out != i)
+			entries[out] = std::move(entries[i]);
+		out++;
+	}
+	entries.resize(out);
+}
+
+void MeshUploadQueue::clear (Chunks& chunks) {
+	for (auto& e : entries)
+		discard(chunks, e);
+	entries.clear();
+	queued_bytes = 0;
+}
+
+void MeshUploadQueue::imgui () {
+	ImGui::Text("mesh uploads: %5d queued (%7.3f MB)  %4d uploaded (%7.3f MB) this frame  %6d superseded",
+		(int)entries.size(), (float)queued_bytes / (1024*1024), uploaded_meshes, (float)uploaded_bytes / (1024*1024), superseded);
+	ImGui::Text("mesh upload latency: avg %7.2f ms  max %7.2f ms (%d meshes)",
+		latency_count > 0 ? latency_total_ms / (float)latency_count : 0.0f, latency_max_ms, latency_count);
+
+	ImGui::PushID("upload_queue");
+	ImGui::SameLine();
+	if (ImGui::Button("reset")) {
+		superseded = 0;
+		latency_count = 0;
+		latency_total_ms = 0;
+		latency_max_ms = 0;
+	}
+	ImGui::PopID();
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "common.hpp"
+#include "chunks.hpp"
+
+// Remeshed chunk meshes waiting for their upload, limited to a budget of bytes per frame
+// so that load waves or renderer switches don't upload hundreds of MB in a single frame
+// the nearest meshes (and the ones in view) go first, a chunk keeps drawing its previous mesh until the new one is uploaded
+// a newer remesh result for the same chunk supersedes the queued one, which is then dropped without being uploaded
+// Pure CPU code, the renderers only see the Chunks::upload_slices of the meshes that made it into the budget
+struct MeshUploadQueue {
+	struct Entry {
+		chunk_id		cid;
+		uint32_t		version; // RemeshChunkJob::version, superseded if it no longer matches Chunk::queued_mesh_version
+
+		// become the Chunk mesh fields once uploaded
+		uint32_t		mesh_alloc; // owned by the entry until then
+		uint32_t		face_mesh_vertex_count;
+		uint32_t		opaque_mesh_vertex_count;
+		uint32_t		transp_mesh_vertex_count;
+		uint32_t		face_buckets[FACE_BUCKETS+1];
+		FaceConnections	face_connections;
+		int				drawn_lod;
+
+		std::vector<Chunks::UploadSlice> slices; // offsets relative to the start of mesh_alloc
+		uint32_t		bytes; // sum of the slice sizes
+
+		uint64_t		queued_time; // get_timestamp()
+	};
+	std::vector<Entry>	entries;
+
+	// stats of the last update
+	uint32_t	queued_bytes = 0;
+	int			uploaded_meshes = 0;
+	uint32_t	uploaded_bytes = 0;
+	// since the last reset
+	int			superseded = 0;
+	int			latency_count = 0;
+	float		latency_total_ms = 0;
+	float		latency_max_ms = 0;
+
+	void push (Entry&& e) {
+		entries.emplace_back(std::move(e));
+	}
+
+	// drop superseded entries and upload the most important ones within budget_mb (at least one),
+	// which replaces the chunk meshes and appends their data to chunks.upload_slices
+	void update (Chunks& chunks, float3 const& center, View_Frustrum const& frustrum, float budget_mb);
+
+	// drop all entries, freeing their allocations and slice data
+	void clear (Chunks& chunks);
+
+	void imgui ();
+
+private:
+	void discard (Chunks& chunks, Entry& e);
+	void apply (Chunks& chunks, Entry& e, uint64_t now);
+};
@@ -0,0 +1,510 @@
+#include "common.hpp"
+#include "occlusion_culling.hpp"
+#include "immintrin.h"
+
+void OcclusionBuffer::begin (Camera_View const& view) {
+	world_to_cam = view.world_to_cam;
+	cam_to_clip = view.cam_to_clip;
+	cam_pos = view.cam_to_world * float3(0);
+	clip_near = view.clip_near;
+
+	quads.clear();
+	for (auto& bin : bins)
+		bin.clear();
+}
+
+namespace {
+	struct Projected {
+		float2	px; // in pixels, y up
+		float	inv_depth;
+	};
+
+	bool project (OcclusionBuffer const& b, float3 const& pos, Projected* out) {
+		float3 cam = b.world_to_cam * pos;
+		float depth = -cam.z;
+		if (depth <= b.clip_near)
+			return false;
+
+		float4 clip = b.cam_to_clip * float4(cam, 1);
+		float2 ndc = (float2)clip / clip.w;
+
+		out->px = (ndc * 0.5f + 0.5f) * float2((float)OcclusionBuffer::WIDTH, (float)OcclusionBuffer::HEIGHT);
+		out->inv_depth = 1.0f / depth;
+		return true;
+	}
+
+	float cross2 (float2 a, float2 b) {
+		return a.x * b.y - a.y * b.x;
+	}
+}
+
+void OcclusionBuffer::add_box_occluder (float3 const& lo, float3 const& hi) {
+	for (int axis=0; axis<3; ++axis) {
+		float plane;
+		if      (cam_pos[axis] < lo[axis]) plane = lo[axis];
+		else if (cam_pos[axis] > hi[axis]) plane = hi[axis];
+		else continue; // faces on this axis are back facing
+
+		int a = (axis + 1) % 3;
+		int b = (axis + 2) % 3;
+
+		float3 corners[4];
+		for (int i=0; i<4; ++i) {
+			corners[i][axis] = plane;
+			corners[i][a] = (i == 1 || i == 2) ? hi[a] : lo[a];
+			corners[i][b] = (i >= 2)           ? hi[b] : lo[b];
+		}
+		add_quad(corners);
+	}
+}
+
+void OcclusionBuffer::add_quad (float3 const corners[4]) {
+	// clip to slightly in front of the near plane in camera space, so that the quads of the ground right below the camera still occlude
+	float near_z = clip_near * 1.01f;
+
+	float3 cam[4];
+	int behind = 0;
+	for (int i=0; i<4; ++i) {
+		cam[i] = world_to_cam * corners[i];
+		behind += -cam[i].z < near_z ? 1 : 0;
+	}
+	if (behind == 4)
+		return;
+
+	float3 poly[MAX_EDGES];
+	int n = 0;
+	for (int i=0; i<4; ++i) {
+		float3 a = cam[i];
+		float3 b = cam[(i+1) % 4];
+		float da = -a.z - near_z;
+		float db = -b.z - near_z;
+
+		if (da >= 0)
+			poly[n++] = a;
+		if ((da >= 0) != (db >= 0))
+			poly[n++] = a + (b - a) * (da / (da - db));
+	}
+	assert(n >= 3 && n <= MAX_EDGES);
+
+	Projected v[MAX_EDGES];
+	for (int i=0; i<n; ++i) {
+		float4 clip = cam_to_clip * float4(poly[i], 1);
+		float2 ndc = (float2)clip / clip.w;
+
+		v[i].px = (ndc * 0.5f + 0.5f) * float2((float)WIDTH, (float)HEIGHT);
+		v[i].inv_depth = 1.0f / max(-poly[i].z, near_z);
+	}
+
+	float area = 0;
+	for (int i=0; i<n; ++i)
+		area += cross2(v[i].px, v[(i+1) % n].px);
+	area *= 0.5f;
+
+	if (abs(area) < 1.0f)
+		return; // can't fully cover any pixel
+	if (area < 0)
+		std::reverse(v, v + n); // make winding counter clockwise
+
+	Quad q;
+
+	for (int i=0; i<MAX_EDGES; ++i) {
+		int e = i < n ? i : 0; // repeat the first edge
+		float2 a = v[e].px;
+		float2 b = v[(e+1) % n].px;
+
+		// E(p) = cross(b - a, p - a), positive inside
+		float A = a.y - b.y;
+		float B = b.x - a.x;
+		float C = -(A * a.x + B * a.y);
+
+		q.edges[i][0] = A;
+		q.edges[i][1] = B;
+		q.edges[i][2] = C - 0.5f * (abs(A) + abs(B)); // pixel center needs to be this far inside for the whole pixel to be covered
+	}
+
+	{ // 1/depth is linear in screen space for planar polygons, take the plane from the biggest triangle of the fan
+		int i1 = 1, i2 = 2;
+		float best = 0;
+		for (int i=1; i+1<n; ++i) {
+			float tri = abs(cross2(v[i].px - v[0].px, v[i+1].px - v[0].px));
+			if (tri > best) {
+				best = tri;
+				i1 = i; i2 = i+1;
+			}
+		}
+
+		float2 d1 = v[i1].px - v[0].px;
+		float2 d2 = v[i2].px - v[0].px;
+		float z1 = v[i1].inv_depth - v[0].inv_depth;
+		float z2 = v[i2].inv_depth - v[0].inv_depth;
+
+		float det = cross2(d1, d2);
+		if (abs(det) < 0.01f)
+			return;
+
+		float za = (z1 * d2.y - d1.y * z2) / det;
+		float zb = (d1.x * z2 - z1 * d2.x) / det;
+		float zc = v[0].inv_depth - za * v[0].px.x - zb * v[0].px.y;
+
+		q.zplane[0] = za;
+		q.zplane[1] = zb;
+		q.zplane[2] = zc - 0.5f * (abs(za) + abs(zb)); // min over the pixel
+	}
+
+	float2 mn = v[0].px, mx = v[0].px;
+	for (int i=1; i<n; ++i) {
+		mn = min(mn, v[i].px);
+		mx = max(mx, v[i].px);
+	}
+	// clamp as floats first, vertices close to the near plane can project very far off screen
+	q.x0 = (int)clamp(floorf(mn.x), 0.0f, (float)WIDTH);
+	q.y0 = (int)clamp(floorf(mn.y), 0.0f, (float)HEIGHT);
+	q.x1 = (int)clamp(ceilf (mx.x), 0.0f, (float)WIDTH);
+	q.y1 = (int)clamp(ceilf (mx.y), 0.0f, (float)HEIGHT);
+	if (q.x0 >= q.x1 || q.y0 >= q.y1)
+		return;
+
+	uint32_t idx = (uint32_t)quads.size();
+	quads.push_back(q);
+
+	for (int band = q.y0 / BAND_HEIGHT; band <= (q.y1-1) / BAND_HEIGHT; ++band)
+		bins[band].push_back(idx);
+}
+
+void OcclusionBuffer::rasterize (bool threaded) {
+	ZoneScoped;
+
+	if (!threaded) {
+		for (int band=0; band<BANDS; ++band)
+			rasterize_band(band);
+		return;
+	}
+
+	parallel_for(BANDS, BANDS, [this] (uint32_t first, uint32_t end) {
+		for (uint32_t band=first; band<end; ++band)
+			rasterize_band((int)band);
+	});
+}
+
+void OcclusionBuffer::rasterize_band (int band) {
+	ZoneScoped;
+
+	int by0 = band * BAND_HEIGHT;
+	int by1 = by0 + BAND_HEIGHT;
+
+	memset(&inv_depth[by0][0], 0, sizeof(inv_depth[0]) * BAND_HEIGHT);
+
+	__m256 lane_centers = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	__m256 zero = _mm256_setzero_ps();
+
+	for (uint32_t qi : bins[band]) {
+		auto& q = quads[qi];
+
+		int y0 = max(q.y0, by0);
+		int y1 = min(q.y1, by1);
+		int x0 = q.x0 & ~(TILE-1);
+
+		__m256 A0 = _mm256_set1_ps(q.edges[0][0]);
+		__m256 A1 = _mm256_set1_ps(q.edges[1][0]);
+		__m256 A2 = _mm256_set1_ps(q.edges[2][0]);
+		__m256 A3 = _mm256_set1_ps(q.edges[3][0]);
+		__m256 A4 = _mm256_set1_ps(q.edges[4][0]);
+		__m256 zA = _mm256_set1_ps(q.zplane[0]);
+
+		for (int y=y0; y<y1; ++y) {
+			float yc = (float)y + 0.5f;
+
+			__m256 C0 = _mm256_set1_ps(q.edges[0][1] * yc + q.edges[0][2]);
+			__m256 C1 = _mm256_set1_ps(q.edges[1][1] * yc + q.edges[1][2]);
+			__m256 C2 = _mm256_set1_ps(q.edges[2][1] * yc + q.edges[2][2]);
+			__m256 C3 = _mm256_set1_ps(q.edges[3][1] * yc + q.edges[3][2]);
+			__m256 C4 = _mm256_set1_ps(q.edges[4][1] * yc + q.edges[4][2]);
+			__m256 zC = _mm256_set1_ps(q.zplane[1] * yc + q.zplane[2]);
+
+			for (int x=x0; x<q.x1; x += 8) {
+				__m256 xs = _mm256_add_ps(_mm256_set1_ps((float)x), lane_centers);
+
+				__m256 inside =                     _mm256_cmp_ps(_mm256_fmadd_ps(A0, xs, C0), zero, _CMP_GE_OQ);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(A1, xs, C1), zero, _CMP_GE_OQ));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(A2, xs, C2), zero, _CMP_GE_OQ));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(A3, xs, C3), zero, _CMP_GE_OQ));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(A4, xs, C4), zero, _CMP_GE_OQ));
+				if (_mm256_movemask_ps(inside) == 0)
+					continue;
+
+				// pixels outside the quad become 0, which never wins the max
+				__m256 z = _mm256_and_ps(_mm256_fmadd_ps(zA, xs, zC), inside);
+
+				float* p = &inv_depth[y][x];
+				_mm256_store_ps(p, _mm256_max_ps(_mm256_load_ps(p), z));
+			}
+		}
+	}
+
+	// tile mins for the hierarchical test
+	for (int ty = by0 / TILE; ty < by1 / TILE; ++ty)
+	for (int tx = 0; tx < TILES_X; ++tx) {
+		__m256 m = _mm256_load_ps(&inv_depth[ty*TILE][tx*TILE]);
+		for (int r=1; r<TILE; ++r)
+			m = _mm256_min_ps(m, _mm256_load_ps(&inv_depth[ty*TILE + r][tx*TILE]));
+
+		alignas(32) float lanes[8];
+		_mm256_store_ps(lanes, m);
+
+		float mn = lanes[0];
+		for (int i=1; i<8; ++i)
+			mn = min(mn, lanes[i]);
+		tile_min[ty][tx] = mn;
+	}
+}
+
+bool OcclusionBuffer::test_box (float3 const& lo, float3 const& hi) const {
+	float2 mn = INF, mx = -INF;
+	float nearest = 0; // max 1/depth of the box, always at a corner
+
+	for (int i=0; i<8; ++i) {
+		float3 pos = float3(i & 1 ? hi.x : lo.x, i & 2 ? hi.y : lo.y, i & 4 ? hi.z : lo.z);
+
+		Projected v;
+		if (!project(*this, pos, &v))
+			return true; // crosses the near plane
+
+		mn = min(mn, v.px);
+		mx = max(mx, v.px);
+		nearest = max(nearest, v.inv_depth);
+	}
+
+	int x0 = (int)clamp(floorf(mn.x), 0.0f, (float)WIDTH);
+	int y0 = (int)clamp(floorf(mn.y), 0.0f, (float)HEIGHT);
+	int x1 = (int)clamp(ceilf (mx.x), 0.0f, (float)WIDTH);
+	int y1 = (int)clamp(ceilf (mx.y), 0.0f, (float)HEIGHT);
+	if (x0 >= x1 || y0 >= y1)
+		return true; // off screen, leave that to frustrum culling
+
+	__m256 box = _mm256_set1_ps(nearest);
+	__m256 lane_idx = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256 fx0 = _mm256_set1_ps((float)x0);
+	__m256 fx1 = _mm256_set1_ps((float)x1);
+
+	for (int ty = y0 / TILE; ty <= (y1-1) / TILE; ++ty)
+	for (int tx = x0 / TILE; tx <= (x1-1) / TILE; ++tx) {
+		if (nearest <= tile_min[ty][tx])
+			continue; // whole tile is covered by occluders in front of the box
+
+		__m256 xs = _mm256_add_ps(_mm256_set1_ps((float)(tx*TILE)), lane_idx);
+		__m256 xmask = _mm256_and_ps(_mm256_cmp_ps(xs, fx0, _CMP_GE_OQ), _mm256_cmp_ps(xs, fx1, _CMP_LT_OQ));
+
+		int ry0 = max(y0, ty*TILE);
+		int ry1 = min(y1, ty*TILE + TILE);
+		for (int y=ry0; y<ry1; ++y) {
+			__m256 d = _mm256_load_ps(&inv_depth[y][tx*TILE]);
+			if (_mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(d, box, _CMP_LT_OQ), xmask)))
+				return true;
+		}
+	}
+	return false;
+}
+
+void OcclusionCuller::add_chunk_occluders (Chunks& chunks, chunk_id cid) {
+	auto& chunk = chunks[cid];
+	auto& vox = chunks.chunk_voxels[cid];
+	float3 chunk_lo = (float3)(chunk.pos * CHUNK_SIZE);
+
+	static_assert(SUBCHUNK_COUNT <= 8, "");
+
+	// bit per sx of the sparse subchunks of opaque blocks
+	uint8_t rows[SUBCHUNK_COUNT][SUBCHUNK_COUNT];
+	bool full = true;
+
+	for (int sz=0; sz<SUBCHUNK_COUNT; ++sz)
+	for (int sy=0; sy<SUBCHUNK_COUNT; ++sy) {
+		uint8_t m = 0;
+		for (int sx=0; sx<SUBCHUNK_COUNT; ++sx) {
+			uint32_t subc = vox.subchunks[IDX3D(sx,sy,sz, SUBCHUNK_COUNT)];
+			if ((subc & SUBC_SPARSE_BIT) && opaque_lut[(block_id)subc])
+				m |= (uint8_t)(1u << sx);
+		}
+		rows[sz][sy] = m;
+		full = full && m == (uint8_t)((1u << SUBCHUNK_COUNT) - 1);
+	}
+
+	if (full) {
+		buf->add_box_occluder(chunk_lo, chunk_lo + (float)CHUNK_SIZE);
+		return;
+	}
+
+	// merge runs along x into one box
+	for (int sz=0; sz<SUBCHUNK_COUNT; ++sz)
+	for (int sy=0; sy<SUBCHUNK_COUNT; ++sy) {
+		uint32_t m = rows[sz][sy];
+		while (m) {
+			int x0 = (int)_tzcnt_u32(m);
+			int x1 = x0;
+			while (x1 < SUBCHUNK_COUNT && (m & (1u << x1)))
+				x1++;
+			m &= ~((1u << x1) - (1u << x0));
+
+			buf->add_box_occluder(
+				chunk_lo + (float3)int3(x0, sy  , sz  ) * SUBCHUNK_SIZE,
+				chunk_lo + (float3)int3(x1, sy+1, sz+1) * SUBCHUNK_SIZE);
+		}
+	}
+}
+
+void OcclusionCuller::update (Chunks& chunks, Camera_View const& view, std::vector<chunk_id> const& chunks_to_test) {
+	ZoneScoped;
+
+	uint64_t t0 = get_timestamp();
+
+	auto& b = *buf;
+	b.begin(view);
+
+	opaque_lut.resize(g_assets.block_types.count());
+	for (int bid=0; bid<(int)opaque_lut.size(); ++bid)
+		opaque_lut[bid] = bid != B_NULL && g_assets.block_types.blocks[bid].transparency == TM_OPAQUE;
+
+	// occluders from the chunks near the camera, nearest first so that max_quads keeps the most useful ones
+	occluder_candidates.clear();
+	for (chunk_id cid : chunks_to_test) {
+		auto& chunk = chunks[cid];
+		if (chunk.lod != 0)
+			continue; // coarse voxels
+		if (!chunk.mesh_current() || chunk.drawn_lod != 0)
+			continue; // the drawn mesh lags behind the voxels (or is downsampled), occluders from the voxels could hide chunks through holes that are still drawn
+
+		float3 lo = (float3)(chunk.pos * CHUNK_SIZE);
+		float dist = length(clamp(b.cam_pos, lo, lo + (float)CHUNK_SIZE) - b.cam_pos);
+		if (dist <= occluder_radius)
+			occluder_candidates.push_back({ dist, cid });
+	}
+	std::sort(occluder_candidates.begin(), occluder_candidates.end());
+
+	occluder_chunks = 0;
+	for (auto& c : occluder_candidates) {
+		if ((int)b.quads.size() >= max_quads)
+			break;
+		add_chunk_occluders(chunks, c.second);
+		occluder_chunks++;
+	}
+
+	b.rasterize(threaded);
+
+	uint64_t t1 = get_timestamp();
+
+	visible.clear();
+	for (chunk_id cid : chunks_to_test) {
+		float3 lo = (float3)(chunks[cid].pos * CHUNK_SIZE);
+		if (b.test_box(lo, lo + (float)CHUNK_SIZE))
+			visible.push_back(cid);
+	}
+	tested = (int)chunks_to_test.size();
+
+	uint64_t t2 = get_timestamp();
+	raster_ms = (float)(t1 - t0) * 1000 / (float)timestamp_freq;
+	test_ms   = (float)(t2 - t1) * 1000 / (float)timestamp_freq;
+}
+
+// camera at pos looking towards +y, with the aspect ratio of the buffer
+static Camera_View synthetic_view (float3 const& pos) {
+	Camera cam (pos, float3(0));
+
+	float3x3 cam_to_world_rot;
+	float3x3 world_to_cam_rot = calc_aer_rotation(cam.rot_aer, &cam_to_world_rot);
+
+	Camera_View v;
+	v.world_to_cam = world_to_cam_rot * translate(-cam.pos);
+	v.cam_to_world = translate(cam.pos) * cam_to_world_rot;
+	v.cam_to_clip = cam.calc_cam_to_clip(int2(OcclusionBuffer::WIDTH, OcclusionBuffer::HEIGHT), &v.clip_to_cam, &v.frustrum, &v.frustrum_size);
+	v.clip_near = cam.clip_near;
+	v.clip_far = cam.clip_far;
+	v.calc_frustrum();
+	return v;
+}
+
+OcclusionCuller::Bench OcclusionCuller::check_synthetic_scenes () {
+	ZoneScoped;
+
+	Bench bench;
+	bench.failures = 0;
+
+	std::unique_ptr<OcclusionBuffer> b (new OcclusionBuffer);
+
+	auto expect = [&] (float3 lo, float3 hi, bool visible) {
+		if (b->test_box(lo, hi) != visible)
+			bench.failures++;
+	};
+
+	{
+		auto view = synthetic_view(0);
+
+		// nothing to occlude
+		b->begin(view);
+		b->rasterize(false);
+		expect(float3(-16,64,-16), float3(16,128,16), true);
+
+		// wall in front of the camera
+		b->begin(view);
+		b->add_box_occluder(float3(-8,16,-24), float3(8,20,24));
+		b->rasterize(false);
+		expect(float3(-8,64,-8), float3(8,128,8), false); // right behind the wall
+		expect(float3(-4,4,-4), float3(4,12,4), true); // in front of the wall
+		expect(float3(32,64,-8), float3(96,128,8), true); // partially behind the wall
+		expect(float3(-16,-16,-16), float3(16,16,16), true); // contains the camera
+
+		// camera standing on flat ground
+		b->begin(view);
+		b->add_box_occluder(float3(-256,1,-64), float3(256,512,-2));
+		b->rasterize(true);
+		expect(float3(-32,100,-80), float3(32,164,-20), false); // buried
+		expect(float3(-32,100,0), float3(32,164,64), true); // above the ground
+	}
+
+	{ // hilly terrain made of 8x8 columns for timing
+		auto view = synthetic_view(float3(0,0,40));
+		b->begin(view);
+
+		for (int gy=0; gy<64; ++gy)
+		for (int gx=-32; gx<32; ++gx) {
+			float height = (float)(hash(int3(gx,gy,0)) % 48);
+			b->add_box_occluder(float3((float)gx*8, (float)gy*8, -64), float3((float)gx*8 + 8, (float)gy*8 + 8, height));
+		}
+		bench.quads = (int)b->quads.size();
+
+		auto time_ms = [&] (auto func) {
+			float best = INF;
+			for (int i=0; i<16; ++i) {
+				uint64_t t0 = get_timestamp();
+				func();
+				best = min(best, (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq);
+			}
+			return best;
+		};
+
+		bench.raster_ms          = time_ms([&] () { b->rasterize(false); });
+		bench.raster_threaded_ms = time_ms([&] () { b->rasterize(true); });
+
+		bench.test_ms = time_ms([&] () {
+			bench.boxes = 0;
+			bench.hidden = 0;
+			for (int z=-2; z<1; ++z)
+			for (int y=0; y<16; ++y)
+			for (int x=-8; x<8; ++x) {
+				float3 lo = (float3)(int3(x,y,z) * CHUNK_SIZE);
+				bench.boxes++;
+				if (!b->test_box(lo, lo + (float)CHUNK_SIZE))
+					bench.hidden++;
+			}
+		});
+	}
+
+	return bench;
+}
+
+void OcclusionCuller::imgui () {
+	ImGui::Text("occlusion: %6d / %6d chunks visible  %5d quads from %4d chunks  raster: %6.3f ms  test: %6.3f ms",
+		(int)visible.size(), tested, (int)buf->quads.size(), occluder_chunks, raster_ms, test_ms);
+
+	ImGui::Checkbox("occlusion threaded", &threaded);
+	ImGui::DragFloat("occluder_radius", &occluder_radius, 1, 0, 2048);
+	ImGui::DragInt("occluder max_quads", &max_quads, 16, 0, 1 << 20);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "common.hpp"
+#include "chunks.hpp"
+#include "engine/camera.hpp"
+
+// Software occlusion culling
+// conservative occluders (the camera facing box faces of fully opaque subchunks near the camera) are rasterized into a small depth buffer on the cpu,
+//  only chunks whose drawn mesh is up to date with their voxels contribute occluders, so meshes lagging behind during load waves or edits can't cause holes
+// chunk aabbs are then tested against it to skip the chunks that are completely hidden behind terrain
+// the buffer stores 1/depth (0 is infinitely far away), occluders write the max and a box is hidden if its nearest point is <= every pixel it covers
+// occluders only cover pixels they fully contain and write the smallest 1/depth over the pixel, so the test never hides anything visible
+// assumes a perspective projection
+// Pure CPU code, the renderers only consume the visible list
+struct OcclusionBuffer {
+	static constexpr int WIDTH = 256;
+	static constexpr int HEIGHT = 128;
+	static constexpr int TILE = 8; // tiles of 8x8 pixels for the hierarchical test, a row of a tile is one AVX register
+	static constexpr int TILES_X = WIDTH / TILE;
+	static constexpr int TILES_Y = HEIGHT / TILE;
+	static constexpr int BAND_HEIGHT = 16; // rows rasterized by one job
+	static constexpr int BANDS = HEIGHT / BAND_HEIGHT;
+	static_assert(WIDTH % TILE == 0 && BAND_HEIGHT % TILE == 0 && HEIGHT % BAND_HEIGHT == 0, "");
+
+	// a quad, or the pentagon left of it after clipping it to the near plane
+	static constexpr int MAX_EDGES = 5;
+
+	struct Quad {
+		float	edges[MAX_EDGES][3]; // inside if A*x + B*y + C >= 0 at the pixel center for all edges, C already includes the margin for full pixel coverage, unused edges repeat the first
+		float	zplane[3]; // 1/depth = a*x + b*y + c, c already lowered to the minimum over the pixel
+		int		x0, y0, x1, y1; // pixel bounds [x0,x1) [y0,y1)
+	};
+
+	alignas(32) float	inv_depth[HEIGHT][WIDTH];
+	float				tile_min[TILES_Y][TILES_X]; // min of inv_depth in each tile
+
+	float3x4			world_to_cam;
+	float4x4			cam_to_clip;
+	float3				cam_pos;
+	float				clip_near;
+
+	std::vector<Quad>		quads;
+	std::vector<uint32_t>	bins[BANDS]; // quads overlapping each band
+
+	void begin (Camera_View const& view);
+
+	// faces of the box that face the camera
+	void add_box_occluder (float3 const& lo, float3 const& hi);
+	// convex planar quad, clipped to the near plane
+	void add_quad (float3 const corners[4]);
+
+	// clears the buffer and rasterizes all quads, the bands are split across parallel_for_threadpool if threaded
+	void rasterize (bool threaded);
+	void rasterize_band (int band);
+
+	// false if the box is hidden behind the rasterized occluders
+	bool test_box (float3 const& lo, float3 const& hi) const;
+};
+
+struct OcclusionCuller {
+	std::unique_ptr<OcclusionBuffer> buf = std::unique_ptr<OcclusionBuffer>(new OcclusionBuffer);
+
+	float	occluder_radius = 192; // only chunks within this distance of the camera contribute occluders
+	int		max_quads = 8192;
+	bool	threaded = true;
+
+	// output of update(), subset of chunks passed in
+	std::vector<chunk_id>	visible;
+
+	// stats for imgui
+	int		occluder_chunks = 0;
+	int		tested = 0;
+	float	raster_ms = 0;
+	float	test_ms = 0;
+
+	// rasterize occluders from the chunks near the camera and test all chunks against them
+	void update (Chunks& chunks, Camera_View const& view, std::vector<chunk_id> const& chunks_to_test);
+
+	struct Bench {
+		int		failures = -1; // wrong results in the synthetic scenes, -1 if not run yet
+		int		quads = 0;
+		int		boxes = 0;
+		int		hidden = 0;
+		float	raster_ms = 0;
+		float	raster_threaded_ms = 0;
+		float	test_ms = 0;
+	};
+
+	// check a few hand made scenes with known results and time a synthetic hilly terrain, runs without a gpu or loaded world
+	static Bench check_synthetic_scenes ();
+
+	void imgui ();
+
+private:
+	std::vector<uint8_t> opaque_lut; // bid -> fully opaque block
+	std::vector<std::pair<float, chunk_id>> occluder_candidates;
+
+	void add_chunk_occluders (Chunks& chunks, chunk_id cid);
+};
@@ -63,4 +63,275 @@ namespace OSN {
 		3,-1,-1,-1,   1,-3,-1,-1,   1,-1,-3,-1,   1,-1,-1,-3,
 		-3,-1,-1,-1,  -1,-3,-1,-1,  -1,-1,-3,-1,  -1,-1,-1,-3
 	};
+
+	namespace {
+		// lattice offset of a contribution relative to (xsb,ysb,zsb) per lane
+		struct Vertex8 {
+			__m256i	x, y, z;
+			__m256	squish; // squish offset subtracted from the position (0, 1, 2 or 3 times SQUISH_CONSTANT)
+			__m256i	ysplit; // y offset 2 that eval subtracts as 1 before and 1 after the squish offset
+		};
+
+		inline __m256i mask_lt (__m256 a, __m256 b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+		inline __m256i mask_le (__m256 a, __m256 b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+		inline __m256i mask_gt (__m256 a, __m256 b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+		inline __m256i mask_ge (__m256 a, __m256 b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GE_OQ)); }
+		inline __m256i mask_bit (__m256i c, int bit) { return _mm256_cmpeq_epi32(_mm256_and_si256(c, _mm256_set1_epi32(bit)), _mm256_set1_epi32(bit)); }
+		inline __m256i mask_not (__m256i m) { return _mm256_xor_si256(m, _mm256_set1_epi32(-1)); }
+
+		// mask ? b : a
+		inline __m256i select (__m256i a, __m256i b, __m256i mask) { return _mm256_blendv_epi8(a, b, mask); }
+		inline __m256  select (__m256 a, __m256 b, __m256i mask) { return _mm256_blendv_ps(a, b, _mm256_castsi256_ps(mask)); }
+		inline __m256i select (int a, int b, __m256i mask) { return select(_mm256_set1_epi32(a), _mm256_set1_epi32(b), mask); }
+		inline Vertex8 select (Vertex8 const& a, Vertex8 const& b, __m256i mask) {
+			return { select(a.x, b.x, mask), select(a.y, b.y, mask), select(a.z, b.z, mask),
+			         select(a.squish, b.squish, mask), select(a.ysplit, b.ysplit, mask) };
+		}
+
+		inline Vertex8 vertex8 (int x, int y, int z, __m256 squish) {
+			return { _mm256_set1_epi32(x), _mm256_set1_epi32(y), _mm256_set1_epi32(z), squish, _mm256_setzero_si256() };
+		}
+		inline Vertex8 vertex8 (__m256i x, __m256i y, __m256i z, __m256 squish, __m256i ysplit = _mm256_setzero_si256()) {
+			return { x, y, z, squish, ysplit };
+		}
+	}
+
+	// Follows eval<float> line by line, see the comments there for what the regions and extra vertices are.
+	// The intrinsics are usable without /arch:AVX2, which the project is not compiled with.
+	__m256 Noise<3>::eval8 (__m256 x, __m256 y, __m256 z) const {
+		const float STRETCH_CONSTANT = (float)(-1.0 / 6.0);
+		const float SQUISH_CONSTANT  = (float)(1.0 / 3.0);
+		const float NORM_CONSTANT    = (float)(1.0 / 103.0);
+
+		// the 3 gradient values at each index packed as signed bytes, so one gather fetches all of them instead of 3
+		static const struct PackedGradients {
+			int packed [72] = {};
+
+			PackedGradients () {
+				for (int i = 0; i < 72; i += 3)
+					packed[i] = (gradients[i] & 0xFF) | ((gradients[i + 1] & 0xFF) << 8) | ((gradients[i + 2] & 0xFF) << 16);
+			}
+		} packed_gradients;
+
+		const __m256 zero  = _mm256_setzero_ps();
+		const __m256 one   = _mm256_set1_ps(1.0f);
+		const __m256 two   = _mm256_set1_ps(2.0f);
+		const __m256 three = _mm256_set1_ps(3.0f);
+		const __m256 sq1   = _mm256_set1_ps(SQUISH_CONSTANT);
+		const __m256 sq2   = _mm256_set1_ps(SQUISH_CONSTANT * 2.0f);
+		const __m256 sq3   = _mm256_set1_ps(SQUISH_CONSTANT * 3.0f);
+
+		// Place input coordinates on simplectic lattice.
+		__m256 stretchOffset = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(x, y), z), _mm256_set1_ps(STRETCH_CONSTANT));
+		__m256 xs = _mm256_add_ps(x, stretchOffset);
+		__m256 ys = _mm256_add_ps(y, stretchOffset);
+		__m256 zs = _mm256_add_ps(z, stretchOffset);
+
+		// fastFloori: truncate, then subtract 1 for negative values (the compare mask is -1)
+		__m256i xsb = _mm256_add_epi32(_mm256_cvttps_epi32(xs), mask_lt(xs, zero));
+		__m256i ysb = _mm256_add_epi32(_mm256_cvttps_epi32(ys), mask_lt(ys, zero));
+		__m256i zsb = _mm256_add_epi32(_mm256_cvttps_epi32(zs), mask_lt(zs, zero));
+		__m256 xsbd = _mm256_cvtepi32_ps(xsb);
+		__m256 ysbd = _mm256_cvtepi32_ps(ysb);
+		__m256 zsbd = _mm256_cvtepi32_ps(zsb);
+
+		// Skew out to get actual coordinates of rhombohedron origin, positions relative to origin point.
+		__m256 squishOffset = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(xsbd, ysbd), zsbd), sq1);
+		__m256 dx0 = _mm256_sub_ps(x, _mm256_add_ps(xsbd, squishOffset));
+		__m256 dy0 = _mm256_sub_ps(y, _mm256_add_ps(ysbd, squishOffset));
+		__m256 dz0 = _mm256_sub_ps(z, _mm256_add_ps(zsbd, squishOffset));
+
+		// Compute simplectic lattice coordinates relative to rhombohedral origin.
+		__m256 xins = _mm256_sub_ps(xs, xsbd);
+		__m256 yins = _mm256_sub_ps(ys, ysbd);
+		__m256 zins = _mm256_sub_ps(zs, zsbd);
+
+		__m256 inSum = _mm256_add_ps(_mm256_add_ps(xins, yins), zins);
+
+		__m256i middle = _mm256_and_si256(mask_gt(inSum, one), mask_lt(inSum, two));
+		__m256i lower  = mask_le(inSum, one);
+		__m256i upper  = mask_not(_mm256_or_si256(middle, lower));
+
+		// The two extra vertices for each region, blended together at the end.
+		Vertex8 mid_ext0, mid_ext1;
+		{ // inside the octahedron (rectified 3-Simplex) inbetween
+			__m256 p1 = _mm256_add_ps(xins, yins);
+			__m256i p1le = mask_le(p1, one);
+			__m256  aScore = select(_mm256_sub_ps(p1, one), _mm256_sub_ps(one, p1), p1le);
+			__m256i aPoint = select(3, 4, p1le);
+			__m256i aIsFurtherSide = mask_not(p1le);
+
+			__m256 p2 = _mm256_add_ps(xins, zins);
+			__m256i p2le = mask_le(p2, one);
+			__m256  bScore = select(_mm256_sub_ps(p2, one), _mm256_sub_ps(one, p2), p2le);
+			__m256i bPoint = select(5, 2, p2le);
+			__m256i bIsFurtherSide = mask_not(p2le);
+
+			__m256 p3 = _mm256_add_ps(yins, zins);
+			__m256i p3gt = mask_gt(p3, one);
+			__m256  score = select(_mm256_sub_ps(one, p3), _mm256_sub_ps(p3, one), p3gt);
+			__m256i point = select(1, 6, p3gt);
+
+			__m256i replaceB = _mm256_and_si256(mask_gt(aScore, bScore), mask_lt(bScore, score));
+			__m256i replaceA = _mm256_and_si256(mask_le(aScore, bScore), mask_lt(aScore, score));
+			bPoint         = select(bPoint, point, replaceB);
+			bIsFurtherSide = select(bIsFurtherSide, p3gt, replaceB);
+			aPoint         = select(aPoint, point, replaceA);
+			aIsFurtherSide = select(aIsFurtherSide, p3gt, replaceA);
+
+			__m256i bothFurther = _mm256_and_si256(aIsFurtherSide, bIsFurtherSide);
+			__m256i bothCloser  = mask_not(_mm256_or_si256(aIsFurtherSide, bIsFurtherSide));
+			__m256i differ      = _mm256_xor_si256(aIsFurtherSide, bIsFurtherSide);
+
+			// permutation of (1,1,-1) based on the omitted axis, permutation of (0,0,2) based on the shared axis
+			__m256i c1 = select(bPoint, aPoint, aIsFurtherSide);
+			__m256i c2 = select(aPoint, bPoint, aIsFurtherSide);
+			__m256i omitted = select(_mm256_or_si256(aPoint, bPoint), c1, differ);
+			__m256i shared  = select(_mm256_and_si256(aPoint, bPoint), c2, differ);
+
+			__m256i o1 = mask_bit(omitted, 0x01), o2 = mask_bit(omitted, 0x02);
+			Vertex8 ext_omitted = vertex8(
+				select(-1, 1, o1),
+				select(1, -1, _mm256_andnot_si256(o2, o1)),
+				select(1, -1, _mm256_and_si256(o1, o2)), sq1);
+
+			__m256i s1 = mask_bit(shared, 0x01), s2 = mask_bit(shared, 0x02);
+			Vertex8 ext_shared = vertex8(
+				_mm256_and_si256(s1, _mm256_set1_epi32(2)),
+				_mm256_and_si256(_mm256_andnot_si256(s1, s2), _mm256_set1_epi32(2)),
+				_mm256_andnot_si256(_mm256_or_si256(s1, s2), _mm256_set1_epi32(2)), sq2);
+
+			mid_ext0 = select(select(ext_omitted, vertex8(0,0,0, zero), bothCloser), vertex8(1,1,1, sq3), bothFurther);
+			mid_ext1 = select(ext_shared, ext_omitted, bothCloser);
+		}
+
+		Vertex8 low_ext0, low_ext1;
+		{ // inside the tetrahedron (3-Simplex) at (0,0,0)
+			__m256  aScore = xins;
+			__m256i aPoint = _mm256_set1_epi32(1);
+			__m256  bScore = yins;
+			__m256i bPoint = _mm256_set1_epi32(2);
+
+			__m256i replaceA = _mm256_and_si256(mask_lt(aScore, bScore), mask_gt(zins, aScore));
+			__m256i replaceB = _mm256_and_si256(mask_ge(aScore, bScore), mask_gt(zins, bScore));
+			aScore = select(aScore, zins, replaceA);
+			aPoint = select(aPoint, _mm256_set1_epi32(4), replaceA);
+			bScore = select(bScore, zins, replaceB);
+			bPoint = select(bPoint, _mm256_set1_epi32(4), replaceB);
+
+			__m256 wins = _mm256_sub_ps(one, inSum);
+			__m256i originClosest = _mm256_or_si256(mask_gt(wins, aScore), mask_gt(wins, bScore));
+
+			// (0,0,0) is one of the closest two tetrahedral vertices
+			__m256i c = select(aPoint, bPoint, mask_gt(bScore, aScore));
+			__m256i c1 = _mm256_cmpeq_epi32(c, _mm256_set1_epi32(1));
+			__m256i c2 = _mm256_cmpeq_epi32(c, _mm256_set1_epi32(2));
+			__m256i c4 = _mm256_cmpeq_epi32(c, _mm256_set1_epi32(4));
+			Vertex8 origin0 = vertex8(
+				select(-1, 1, c1),
+				select(select(0, -1, c1), _mm256_set1_epi32(1), c2),
+				select(0, 1, c4), zero);
+			Vertex8 origin1 = vertex8(
+				select(0, 1, c1),
+				select(select(-1, 0, c1), _mm256_set1_epi32(1), c2),
+				select(-1, 1, c4), zero);
+
+			// the two extra vertices are determined by the closest two
+			__m256i cc = _mm256_or_si256(aPoint, bPoint);
+			__m256i b1 = mask_bit(cc, 0x01), b2 = mask_bit(cc, 0x02), b4 = mask_bit(cc, 0x04);
+			Vertex8 closest0 = vertex8(select(0, 1, b1), select(0, 1, b2), select(0, 1, b4), sq2);
+			Vertex8 closest1 = vertex8(select(-1, 1, b1), select(-1, 1, b2), select(-1, 1, b4), sq1);
+
+			low_ext0 = select(closest0, origin0, originClosest);
+			low_ext1 = select(closest1, origin1, originClosest);
+		}
+
+		Vertex8 high_ext0, high_ext1;
+		{ // inside the tetrahedron (3-Simplex) at (1,1,1)
+			__m256  aScore = xins;
+			__m256i aPoint = _mm256_set1_epi32(6);
+			__m256  bScore = yins;
+			__m256i bPoint = _mm256_set1_epi32(5);
+
+			__m256i replaceB = _mm256_and_si256(mask_le(aScore, bScore), mask_lt(zins, bScore));
+			__m256i replaceA = _mm256_and_si256(mask_gt(aScore, bScore), mask_lt(zins, aScore));
+			bScore = select(bScore, zins, replaceB);
+			bPoint = select(bPoint, _mm256_set1_epi32(3), replaceB);
+			aScore = select(aScore, zins, replaceA);
+			aPoint = select(aPoint, _mm256_set1_epi32(3), replaceA);
+
+			__m256 wins = _mm256_sub_ps(three, inSum);
+			__m256i cornerClosest = _mm256_or_si256(mask_lt(wins, aScore), mask_lt(wins, bScore));
+
+			// (1,1,1) is one of the closest two tetrahedral vertices
+			__m256i c = select(aPoint, bPoint, mask_lt(bScore, aScore));
+			__m256i c1 = mask_bit(c, 0x01), c2 = mask_bit(c, 0x02), c4 = mask_bit(c, 0x04);
+			Vertex8 corner0 = vertex8(
+				select(0, 2, c1),
+				_mm256_and_si256(c2, select(2, 1, c1)),
+				select(0, 1, c4), sq3, _mm256_andnot_si256(c1, c2));
+			Vertex8 corner1 = vertex8(
+				select(0, 1, c1),
+				_mm256_and_si256(c2, select(1, 2, c1)),
+				select(0, 2, c4), sq3, _mm256_and_si256(c1, c2));
+
+			// the two extra vertices are determined by the closest two
+			__m256i cc = _mm256_and_si256(aPoint, bPoint);
+			__m256i b1 = mask_bit(cc, 0x01), b2 = mask_bit(cc, 0x02), b4 = mask_bit(cc, 0x04);
+			Vertex8 closest0 = vertex8(select(0, 1, b1), select(0, 1, b2), select(0, 1, b4), sq1);
+			Vertex8 closest1 = vertex8(select(0, 2, b1), select(0, 2, b2), select(0, 2, b4), sq2);
+
+			high_ext0 = select(closest0, corner0, cornerClosest);
+			high_ext1 = select(closest1, corner1, cornerClosest);
+		}
+
+		auto contribution = [&] (Vertex8 const& v) {
+			__m256 ysplit = _mm256_and_ps(_mm256_castsi256_ps(v.ysplit), one);
+			__m256 dx = _mm256_sub_ps(_mm256_sub_ps(dx0, _mm256_cvtepi32_ps(v.x)), v.squish);
+			__m256 dy = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(dy0, _mm256_sub_ps(_mm256_cvtepi32_ps(v.y), ysplit)), v.squish), ysplit);
+			__m256 dz = _mm256_sub_ps(_mm256_sub_ps(dz0, _mm256_cvtepi32_ps(v.z)), v.squish);
+
+			__m256 m = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+			// extrapolate
+			const __m256i byte = _mm256_set1_epi32(0xFF);
+			__m256i i = _mm256_i32gather_epi32(perm, _mm256_and_si256(_mm256_add_epi32(xsb, v.x), byte), 4);
+			i = _mm256_i32gather_epi32(perm, _mm256_and_si256(_mm256_add_epi32(i, _mm256_add_epi32(ysb, v.y)), byte), 4);
+			i = _mm256_i32gather_epi32(permGradIndex, _mm256_and_si256(_mm256_add_epi32(i, _mm256_add_epi32(zsb, v.z)), byte), 4);
+			__m256i g = _mm256_i32gather_epi32(packed_gradients.packed, i, 4);
+			__m256 gx = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(g, 24), 24));
+			__m256 gy = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(g, 16), 24));
+			__m256 gz = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(g,  8), 24));
+			__m256 ext = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, dx), _mm256_mul_ps(gy, dy)), _mm256_mul_ps(gz, dz));
+
+			__m256 attn = _mm256_max_ps(_mm256_sub_ps(two, m), zero);
+			attn = _mm256_mul_ps(attn, attn);
+			return _mm256_mul_ps(_mm256_mul_ps(attn, attn), ext);
+		};
+		// contributions that eval sets to 0 add +0 there, masking them out gives the same sum
+		auto masked = [] (__m256 val, __m256i mask) {
+			return _mm256_and_ps(val, _mm256_castsi256_ps(mask));
+		};
+
+		// contributions in the order eval sums them
+		// lower and middle region: (0,0,0) (1,0,0) (0,1,0) (0,0,1)
+		// upper region:            (1,1,1) (0,1,1) (1,0,1) (1,1,0)
+		__m256 value = _mm256_add_ps(zero, masked(contribution(select(vertex8(0,0,0, zero), vertex8(1,1,1, sq3), upper)), mask_not(middle)));
+		value = _mm256_add_ps(value, contribution(select(vertex8(1,0,0, sq1), vertex8(0,1,1, sq2), upper)));
+		value = _mm256_add_ps(value, contribution(select(vertex8(0,1,0, sq1), vertex8(1,0,1, sq2), upper)));
+		value = _mm256_add_ps(value, contribution(select(vertex8(0,0,1, sq1), vertex8(1,1,0, sq2), upper)));
+
+		// middle region only: (1,1,0) (1,0,1) (0,1,1)
+		if (!_mm256_testz_si256(middle, middle)) {
+			value = _mm256_add_ps(value, masked(contribution(vertex8(1,1,0, sq2)), middle));
+			value = _mm256_add_ps(value, masked(contribution(vertex8(1,0,1, sq2)), middle));
+			value = _mm256_add_ps(value, masked(contribution(vertex8(0,1,1, sq2)), middle));
+		}
+
+		// extra vertices
+		value = _mm256_add_ps(value, contribution(select(select(high_ext0, mid_ext0, middle), low_ext0, lower)));
+		value = _mm256_add_ps(value, contribution(select(select(high_ext1, mid_ext1, middle), low_ext1, lower)));
+
+		return _mm256_mul_ps(value, _mm256_set1_ps(NORM_CONSTANT));
+	}
 }
@@ -2,36 +2,105 @@
 #include "gl_chunk_renderer.hpp"
 #include "chunks.hpp"
 #include "chunk_mesher.hpp"
+#include "chunk_culling.hpp"
+#include "chunk_visibility.hpp"
+#include "occlusion_culling.hpp"
 #include "opengl_renderer.hpp"
 
 #include "engine/window.hpp" // for frame_counter hack
 
 namespace gl {
 	
+// fences of the upload ring are GLsync
+static bool poll_fence (uint64_t fence) {
+	GLsync sync = (GLsync)(uintptr_t)fence;
+	GLenum res = glClientWaitSync(sync, 0, 0);
+	if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+		return false;
+	glDeleteSync(sync);
+	return true;
+}
+static void wait_fence (uint64_t fence) {
+	glClientWaitSync((GLsync)(uintptr_t)fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+}
+
 void ChunkRenderer::upload_remeshed (Chunks& chunks) {
 	ZoneScoped;
 	OGL_TRACE("chunks upload remeshed");
 
-	for (auto& slice : chunks.upload_slices) {
-		uint32_t alloci = slice.sliceid / (uint32_t)SLICES_PER_ALLOC;
-		uint32_t slicei = slice.sliceid % (uint32_t)SLICES_PER_ALLOC;
+	upload_ring.retire(poll_fence);
+
+	uploaded_bytes = 0;
+	moved_bytes = 0;
+
+	{ // uploads and moves can still reference a page that the defrag released at the end of this frame
+		size_t pages = (size_t)chunks.mesh_heap.page_count();
+		for (auto& slice : chunks.upload_slices)
+			pages = max(pages, (size_t)(slice.offset / ALLOC_SIZE) + 1);
+		for (auto& m : chunks.mesh_moves)
+			pages = max(pages, (size_t)(m.src / MESH_PAGE_UNITS) + 1);
 
-		while (alloci >= (uint32_t)allocs.size())
+		while (allocs.size() < pages)
 			allocs.emplace_back();
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, upload_buf);
+
+	for (auto& slice : chunks.upload_slices) {
+		uint32_t alloci = (uint32_t)(slice.offset / ALLOC_SIZE);
+		size_t offset = (size_t)(slice.offset % ALLOC_SIZE);
+
+		if (slice.size > 0) {
+			ZoneScopedN("upload slice");
+
+			uint64_t offs = upload_ring.alloc(slice.size);
+			if (offs == RingAllocator::FAILED) {
+				ZoneScopedN("upload ring stall");
+				upload_stalls++;
+
+				if (!upload_ring.open_empty())
+					upload_ring.submit((uint64_t)(uintptr_t)glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+				while (offs == RingAllocator::FAILED) {
+					wait_fence(upload_ring.regions.front().fence);
+					upload_ring.retire(poll_fence);
+					offs = upload_ring.alloc(slice.size);
+				}
+			}
 
-		ZoneScopedN("upload slice");
-		OGL_TRACE("upload slice");
+			memcpy(upload_ptr + offs, slice.data, slice.size);
 
-		size_t unpadded_size = CHUNK_SLICE_LENGTH * sizeof(BlockMeshInstance); // size of slice data without padding
+			glBindBuffer(GL_COPY_WRITE_BUFFER, allocs[alloci].vbo);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offs, offset, slice.size);
 
-		glBindBuffer(GL_ARRAY_BUFFER, allocs[alloci].vbo);
-		glBufferSubData(GL_ARRAY_BUFFER, slicei * unpadded_size, unpadded_size, slice.data->verts);
+			uploaded_bytes += slice.size;
+		}
 
 		ChunkMeshData::free_slice(slice.data);
 	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	if (!upload_ring.open_empty())
+		upload_ring.submit((uint64_t)(uintptr_t)glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+	// defrag moves after the uploads, since they can move meshes that were uploaded this frame
+	for (auto& m : chunks.mesh_moves) {
+		ZoneScopedN("move mesh");
+
+		glBindBuffer(GL_COPY_READ_BUFFER, allocs[m.src / MESH_PAGE_UNITS].vbo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, allocs[m.dst / MESH_PAGE_UNITS].vbo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+			(size_t)(m.src % MESH_PAGE_UNITS) * MESH_UNIT, (size_t)(m.dst % MESH_PAGE_UNITS) * MESH_UNIT, (size_t)m.size * MESH_UNIT);
+
+		moved_bytes += (size_t)m.size * MESH_UNIT;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
 	
-	// free allocation blocks
-	while ((int)chunks.slices.slots.alloc_end < ((int)allocs.size()-1) * (int)SLICES_PER_ALLOC) {
+	// free allocation blocks of released pages, gl keeps the buffers alive until the copies out of them are done
+	while ((int)allocs.size() > chunks.mesh_heap.page_count()) {
 		allocs.pop_back();
 	}
 }
@@ -47,26 +116,7 @@ void ChunkRenderer::draw_chunks (OpenglRenderer& r, Game& game) {
 	{
 		ZoneScopedN("chunk culling pass");
 
-		for (auto& a : allocs) {
-			a.draw_lists[0].count = 0;
-			a.draw_lists[1].count = 0;
-		}
-
-		auto push_draw_slices = [&] (chunk_id cid, uint32_t remain_count, slice_id slices, DrawType type) {
-			slice_id sliceid = slices;
-			while (sliceid != U16_NULL) {
-				uint16_t alloci = sliceid / (uint32_t)SLICES_PER_ALLOC;
-				uint16_t slicei = sliceid % (uint32_t)SLICES_PER_ALLOC;
-
-				auto& draw_list = allocs[alloci].draw_lists[type];
-
-				auto draw_vertex_count = (uint16_t)std::min(remain_count, (uint32_t)CHUNK_SLICE_LENGTH);
-				draw_list.slices[draw_list.count++] = { draw_vertex_count, slicei, cid };
-
-				remain_count -= draw_vertex_count;
-				sliceid = chunks.slices[sliceid].next;
-			}
-		};
+		float3 cam_pos = cull_view.cam_to_world * float3(0);
 
 		lrgba cols[] = {
 			srgba(0, 0, 255, 255),
@@ -77,29 +127,54 @@ void ChunkRenderer::draw_chunks (OpenglRenderer& r, Game& game) {
 		if (chunks.debug_frustrum_culling)
 			g_debugdraw.wire_frustrum(cull_view, srgba(141,41,234));
 
-		for (chunk_id cid=0; cid < chunks.end(); ++cid) {
-			auto& chunk = chunks[cid];
-			if (chunk.flags == 0) continue;
+		chunks.culler->cull(cull_view.frustrum);
 
-			bool empty = chunk.opaque_mesh_vertex_count == 0 && chunk.transp_mesh_vertex_count == 0;
-			
-			float3 lo = (float3)(chunk.pos * CHUNK_SIZE);
-			float3 hi = (float3)((chunk.pos + 1) * CHUNK_SIZE);
+		auto* visible_chunks = &chunks.culler->visible;
+		if (chunks.cave_culling) {
+			chunks.visibility->update(chunks, chunks.culler->visible, cam_pos);
+			visible_chunks = &chunks.visibility->visible;
+		}
+		if (chunks.occlusion_culling) {
+			chunks.occlusion->update(chunks, cull_view, *visible_chunks);
+			visible_chunks = &chunks.occlusion->visible;
+		}
 
-			bool culled = empty || frustrum_cull_aabb(cull_view.frustrum, lo.x, lo.y, lo.z, hi.x, hi.y, hi.z);
+		if (chunks.debug_frustrum_culling || chunks.visualize_chunks) {
+			std::vector<bool> visible(chunks.end(), false);
+			for (chunk_id cid : *visible_chunks)
+				visible[cid] = true;
 
-			chunks.visualize_chunk(cid, chunk, empty, culled);
+			for (chunk_id cid=0; cid < chunks.end(); ++cid) {
+				auto& chunk = chunks[cid];
+				if (chunk.flags == 0) continue;
 
-			if (!culled) {
-				push_draw_slices(cid, chunk.opaque_mesh_vertex_count, chunk.opaque_mesh_slices, DT_OPAQUE);
-				push_draw_slices(cid, chunk.transp_mesh_vertex_count, chunk.transp_mesh_slices, DT_TRANSPARENT);
+				bool empty = chunk.mesh_vertex_count() == 0;
+				chunks.visualize_chunk(cid, chunk, empty, empty || !visible[cid]);
 			}
 		}
+
+		draw_cmds.build(chunks, *visible_chunks, cam_pos);
 	}
 
-	draw_instances = 0;
+	{
+		ZoneScopedN("upload draw commands");
+		OGL_TRACE("upload draw commands");
+
+		// orphan and refill every frame, like the debug draw streams
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buf);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, draw_cmds.cmds.size() * sizeof(ChunkDrawCommands::DrawCmd), draw_cmds.cmds.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
-	auto draw_slices = [&] (Shader* shader, PipelineState& state, DrawType type, int& drawcount) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, draws_ssbo);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, draw_cmds.draws.size() * sizeof(ChunkDrawCommands::DrawData), draw_cmds.draws.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, draws_ssbo);
+	}
+
+	draw_instances = draw_cmds.instances;
+
+	auto draw_slices = [&] (Shader* shader, PipelineState& state, ChunkDrawCommands::DrawType type, int& drawcount) {
 		if (!shader) return;
 		
 		glUseProgram(shader->prog);
@@ -131,46 +206,49 @@ void ChunkRenderer::draw_chunks (OpenglRenderer& r, Game& game) {
 			shader->set_uniform("water_z", (float)game.world_gen.water_level);
 		}
 
-		auto chunk_pos_loc = shader->get_uniform_location("chunk_pos");
+		auto draw_offset_loc = shader->get_uniform_location("draw_offset");
 
 		drawcount = 0;
 
-		for (auto& alloc : allocs) {
-			auto& draw_list = alloc.draw_lists[type];
-			if (draw_list.count > 0) {
-
-				glBindVertexArray(alloc.vao);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buf);
 
-				for (int i=0; i<draw_list.count; ++i) {
-					auto& draw = draw_list.slices[i];
+		assert(draw_cmds.page_count <= (int)allocs.size());
+		for (int alloci=0; alloci<draw_cmds.page_count; ++alloci) {
+			auto& range = draw_cmds.range(alloci, type);
+			if (range.count == 0) continue;
 
-					float3 chunk_pos = (float3)(chunks.chunks[draw.chunk].pos * CHUNK_SIZE);
-					glUniform3fv(chunk_pos_loc, 1, &chunk_pos.x);
+			glBindVertexArray(type == ChunkDrawCommands::DT_FACES ? allocs[alloci].face_vao : allocs[alloci].vao);
 
-					glDrawArraysInstancedBaseInstance(GL_TRIANGLES,
-						0, BlockMeshes::MERGE_INSTANCE_FACTOR,
-						draw.vertex_count, draw.slice_idx * CHUNK_SLICE_LENGTH);
+			// gl_DrawID restarts at 0 for every multidraw
+			glUniform1ui(draw_offset_loc, range.offset);
 
-					draw_instances += draw.vertex_count;
-				}
+			glMultiDrawArraysIndirect(GL_TRIANGLES,
+				(void*)(range.offset * sizeof(ChunkDrawCommands::DrawCmd)),
+				(GLsizei)range.count, sizeof(ChunkDrawCommands::DrawCmd));
 
-				drawcount += draw_list.count;
-			}
+			drawcount += range.count;
 		}
 
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
 		ZoneValue(drawcount);
 	};
 
 	if (_draw_chunks) {
+		{
+			ZoneScopedN("chunk draw faces");
+			OGL_TRACE("chunk draw faces");
+			draw_slices(shad_faces, state_opaque, ChunkDrawCommands::DT_FACES, drawcount_faces);
+		}
 		{
 			ZoneScopedN("chunk draw opaque");
 			OGL_TRACE("chunk draw opaque");
-			draw_slices(shad_opaque, state_opaque, DT_OPAQUE, drawcount_opaque);
+			draw_slices(shad_opaque, state_opaque, ChunkDrawCommands::DT_OPAQUE, drawcount_opaque);
 		}
 		{
 			ZoneScopedN("chunk draw transparent");
 			OGL_TRACE("chunk draw transparent");
-			draw_slices(shad_transparent, state_transparant, DT_TRANSPARENT, drawcount_transparent);
+			draw_slices(shad_transparent, state_transparant, ChunkDrawCommands::DT_TRANSPARENT, drawcount_transparent);
 		}
 	}
 
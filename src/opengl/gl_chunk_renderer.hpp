@@ -4,6 +4,8 @@
 #include "opengl_shaders.hpp"
 #include "assets.hpp"
 #include "game.hpp"
+#include "chunk_draw_commands.hpp"
+#include "engine/ring_allocator.hpp"
 
 namespace gl {
 class OpenglRenderer;
@@ -12,13 +14,11 @@ class OpenglRenderer;
 struct ChunkRenderer {
 	SERIALIZE(ChunkRenderer, _draw_chunks)
 
-	static constexpr int SLICES_PER_ALLOC = 1024;
-	static constexpr size_t ALLOC_SIZE = SLICES_PER_ALLOC * CHUNK_SLICE_SIZE; // size of vram allocations
-
-	enum DrawType { DT_OPAQUE=0, DT_TRANSPARENT=1 };
+	static constexpr size_t ALLOC_SIZE = (size_t)MESH_PAGE_UNITS * MESH_UNIT; // size of vram allocations, one per Chunks::mesh_heap page
 
 	struct AllocBlock {
 		Vao vao;
+		Vao face_vao; // same vbo, face meshes contain FaceInstance
 		Vbo vbo;
 
 		AllocBlock () {
@@ -27,27 +27,32 @@ struct ChunkRenderer {
 
 			vbo = Vbo("ChunkRenderer.AllocBlock.vbo");
 			vao = setup_vao<BlockMeshInstance>("ChunkRenderer.vao", vbo);
+			face_vao = setup_vao<FaceInstance>("ChunkRenderer.face_vao", vbo);
 
-			//
+			// only written by copies out of the upload ring and between allocs, so can be immutable gpu only storage
 			glBindBuffer(GL_ARRAY_BUFFER, vbo);
-			glBufferData(GL_ARRAY_BUFFER, ALLOC_SIZE, nullptr, GL_STREAM_DRAW);
+			glBufferStorage(GL_ARRAY_BUFFER, ALLOC_SIZE, nullptr, 0);
 		}
-
-		struct DrawList {
-			struct DrawSlice {
-				uint16_t	vertex_count;
-				uint16_t	slice_idx; // in alloc (not global slice id)
-				chunk_id	chunk;
-			};
-			int				count;
-			DrawSlice		slices[SLICES_PER_ALLOC];
-		};
-
-		DrawList		draw_lists[2];
 	};
 
 	std::vector<AllocBlock>	allocs;
 
+	// rebuilt by the culling pass every frame, each alloc and draw type is drawn with one glMultiDrawArraysIndirect
+	ChunkDrawCommands	draw_cmds;
+	Vbo					indirect_buf; // draw_cmds.cmds
+	Ssbo				draws_ssbo; // draw_cmds.draws, read by the chunk shader at binding 4
+
+	// persistently mapped staging ring for the remeshed meshes, the fences are GLsync
+	static constexpr size_t UPLOAD_RING_SIZE = 32 * (1024ull * 1024);
+	Vbo					upload_buf;
+	char*				upload_ptr;
+	RingAllocator		upload_ring;
+
+	size_t				uploaded_bytes = 0; // last frame
+	size_t				moved_bytes = 0; // last frame, by the mesh_heap defrag
+	int					upload_stalls = 0; // total number of waits for the gpu to free up ring space
+
+	Shader* shad_faces;
 	Shader* shad_opaque;
 	Shader* shad_transparent;
 
@@ -55,6 +60,7 @@ struct ChunkRenderer {
 	PipelineState state_transparant;
 
 	ChunkRenderer (Shaders& shaders) {
+		shad_faces			= shaders.compile("chunks", {{"ALPHA_TEST", "1"}, {"FACE_INSTANCES", "1"}});
 		shad_opaque			= shaders.compile("chunks", {{"ALPHA_TEST", "1"}});
 		shad_transparent	= shaders.compile("chunks", {{"ALPHA_TEST", "0"}});
 
@@ -65,8 +71,26 @@ struct ChunkRenderer {
 		state_transparant.depth_test	= true;
 		state_transparant.depth_write	= true;
 		state_transparant.blend_enable	= true;
+
+		indirect_buf = Vbo("ChunkRenderer.indirect_buf");
+		draws_ssbo = Ssbo("ChunkRenderer.draws_ssbo");
+
+		upload_buf = Vbo("ChunkRenderer.upload_buf");
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBindBuffer(GL_COPY_READ_BUFFER, upload_buf);
+		glBufferStorage(GL_COPY_READ_BUFFER, UPLOAD_RING_SIZE, nullptr, flags);
+		upload_ptr = (char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, UPLOAD_RING_SIZE, flags);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+		upload_ring.init(UPLOAD_RING_SIZE);
+	}
+	~ChunkRenderer () {
+		for (auto& r : upload_ring.regions)
+			glDeleteSync((GLsync)(uintptr_t)r.fence);
+		// upload_buf gets unmapped when it is deleted
 	}
 
+	int drawcount_faces = 0;
 	int drawcount_opaque = 0;
 	int drawcount_transparent = 0;
 	size_t draw_instances = 0;
@@ -80,40 +104,47 @@ struct ChunkRenderer {
 	void imgui (Chunks& chunks) {
 
 		size_t vertices = 0;
-		size_t slices_total = 0;
+		size_t bytes = 0;
+		size_t meshes_total = 0;
+		size_t slices_total = 0; // what the old fixed size slice allocation would have needed
 
 		for (chunk_id cid=0; cid<chunks.end(); ++cid) {
-			if (chunks[cid].flags == 0) continue;
+			auto& chunk = chunks[cid];
+			if (chunk.flags == 0) continue;
 
-			vertices += chunks[cid].opaque_mesh_vertex_count;
-			vertices += chunks[cid].transp_mesh_vertex_count;
+			vertices += chunk.mesh_vertex_count();
+			bytes += chunk.mesh_bytes();
 
-			slices_total += _slices_count(chunks[cid].opaque_mesh_vertex_count);
-			slices_total += _slices_count(chunks[cid].transp_mesh_vertex_count);
+			meshes_total += (chunk.face_mesh_vertex_count > 0) + (chunk.opaque_mesh_vertex_count > 0) + (chunk.transp_mesh_vertex_count > 0);
+
+			slices_total += _slices_count(chunk.face_mesh_vertex_count, FACE_SLICE_LENGTH);
+			slices_total += _slices_count(chunk.opaque_mesh_vertex_count);
+			slices_total += _slices_count(chunk.transp_mesh_vertex_count);
 		}
 
 		size_t draw_vertices = draw_instances * BlockMeshes::MERGE_INSTANCE_FACTOR;
 
 		ImGui::Separator();
 
-		ImGui::Text("Drawcalls: opaque: %3d  transparent: %3d (%3d / %3d slices - %3.0f%%)",
-			drawcount_opaque, drawcount_transparent, drawcount_opaque + drawcount_transparent,
-			slices_total, (float)(drawcount_opaque + drawcount_transparent) / slices_total * 100);
+		int drawcount = drawcount_faces + drawcount_opaque + drawcount_transparent;
+		ImGui::Text("Draws: faces: %3d  opaque: %3d  transparent: %3d (%3d / %3d meshes - %3.0f%%)",
+			drawcount_faces, drawcount_opaque, drawcount_transparent, drawcount,
+			meshes_total, (float)drawcount / meshes_total * 100);
+		draw_cmds.imgui();
 
 		ImGui::Text("Vertex workload : drawn instances: %12s (vertices: %12s)",
 			format_thousands(draw_instances).c_str(), format_thousands(draw_vertices).c_str());
 
-		ImGui::Text("Mesh allocs: %2d  slices: %5d  vertices: %12s",
-			allocs.size(), slices_total, format_thousands(vertices).c_str());
-		ImGui::Text("Mesh VRAM: used: %7.3f MB  commited: %7.3f MB (%6.2f%% usage)",
-			(float)(vertices * sizeof(BlockMeshInstance)) / 1024 / 1024,
+		ImGui::Text("Mesh allocs: %2d  meshes: %5d  vertices: %12s",
+			allocs.size(), meshes_total, format_thousands(vertices).c_str());
+		ImGui::Text("Upload ring: %7.3f / %7.3f MB in use  uploaded: %7.3f MB  moved: %7.3f MB  stalls: %d",
+			(float)upload_ring.used() / 1024 / 1024, (float)UPLOAD_RING_SIZE / 1024 / 1024,
+			(float)uploaded_bytes / 1024 / 1024, (float)moved_bytes / 1024 / 1024, upload_stalls);
+		ImGui::Text("Mesh VRAM: used: %7.3f MB  commited: %7.3f MB (%6.2f%% usage)  fixed slices would need: %7.3f MB",
+			(float)bytes / 1024 / 1024,
 			(float)(allocs.size() * ALLOC_SIZE) / 1024 / 1024,
-			(float)(vertices * sizeof(BlockMeshInstance)) / (float)(allocs.size() * ALLOC_SIZE) * 100);
-
-		if (ImGui::TreeNode("slices alloc")) {
-			print_bitset_allocator(chunks.slices.slots, CHUNK_SLICE_SIZE, ALLOC_SIZE);
-			ImGui::TreePop();
-		}
+			(float)bytes / (float)(allocs.size() * ALLOC_SIZE) * 100,
+			(float)(slices_total * CHUNK_SLICE_SIZE) / 1024 / 1024);
 		
 		ImGui::DragFloat("detail_draw_dist", &detail_draw_dist);
 	}
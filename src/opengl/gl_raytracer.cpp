@@ -256,8 +256,11 @@ namespace gl {
 		
 		//g_debugdraw.wire_cube((float3)(voxtex_offset+GPU_WORLD_SIZE_CHUNKS/2)*CHUNK_SIZE, GPU_WORLD_SIZE_CHUNKS*CHUNK_SIZE, lrgba(.5f,.5f,.5f,1));
 
-		std::unordered_set<int3> reupload_chunks; // deduplicate due to 3 planar iterations and changed chunks
-		std::unordered_set<int3> clear_chunks;
+		if (brickmap_enable)
+			update_brickmap(game);
+		else if (brickmap.size_chunks != 0)
+			brickmap.clear();
+
 		std::vector<int3> reupload_chunk_flat;
 		
 		auto chunk_in_gpu_world = [&] (int3 chunk_pos) {
@@ -267,38 +270,26 @@ namespace gl {
 			       (unsigned)(rel_pos.z) < GPU_WORLD_SIZE_CHUNKS;
 		};
 
+		// one region per chunk position, which deduplicates the chunks that wrapped around, changed and were unloaded
+		voxel_upload.clear();
+		// the chunks around every region whose df reads the changed voxels
+		df_batch.clear(voxtex_offset, GPU_WORLD_SIZE_CHUNKS, g_assets.block_types.air_id);
+
+		auto upload_chunk = [&] (int3 pos, int3 lo, int3 hi) {
+			assert(chunk_in_gpu_world(pos));
+			df_batch.add(pos, lo, hi);
+
+			auto cid = game.chunks.query_chunk(pos);
+			if (cid == U16_NULL || game.chunks[cid].lod != 0) {
+				// no chunk loaded there or lod chunks, which are only used for raster rendering, need to clear data
+				voxel_upload.add_clear(pos);
+				return;
+			}
+			voxel_upload.add(cid, pos, lo, hi);
+		};
+
 		{ // Find gpu world chunks which have wrapped around if gpu world cube moves
-			auto reupload_chunk = [&] (int3 chunk_pos_rel) {
-				int3 world_pos = chunk_pos_rel + offset;
-				assert(chunk_in_gpu_world(world_pos));
-				reupload_chunks.emplace(world_pos);
-			};
-			
 			if (offset != old_offset) {
-				//int3 move = offset - old_offset;
-				//int3 lo = 0;
-				//int3 hi = GPU_WORLD_SIZE_CHUNKS;
-				//if (all(move < GPU_WORLD_SIZE_CHUNKS)) {
-				//	lo = select(move > 0, GPU_WORLD_SIZE_CHUNKS-move, 0);
-				//	hi = select(move > 0, GPU_WORLD_SIZE_CHUNKS, move);
-				//}
-				//
-				//for (int x=lo.x; x<hi.x; x++)
-				//for (int y=0; y<GPU_WORLD_SIZE_CHUNKS; y++)
-				//for (int z=0; z<GPU_WORLD_SIZE_CHUNKS; z++) {
-				//	reupload_chunk(int3(x,y,z));
-				//}
-				//for (int y=lo.y; y<hi.y; y++)
-				//for (int x=0; x<GPU_WORLD_SIZE_CHUNKS; x++)
-				//for (int z=0; z<GPU_WORLD_SIZE_CHUNKS; z++) {
-				//	reupload_chunk(int3(x,y,z));
-				//}
-				//for (int z=lo.z; z<hi.z; z++)
-				//for (int x=0; x<GPU_WORLD_SIZE_CHUNKS; x++)
-				//for (int y=0; z<GPU_WORLD_SIZE_CHUNKS; z++) {
-				//	reupload_chunk(int3(x,y,z));
-				//}
-			
 				for (int z=0; z<GPU_WORLD_SIZE_CHUNKS; z++)
 				for (int y=0; y<GPU_WORLD_SIZE_CHUNKS; y++)
 				for (int x=0; x<GPU_WORLD_SIZE_CHUNKS; x++) {
@@ -309,8 +300,27 @@ namespace gl {
 						(unsigned)(old_pos_rel.x) < GPU_WORLD_SIZE_CHUNKS &&
 						(unsigned)(old_pos_rel.y) < GPU_WORLD_SIZE_CHUNKS &&
 						(unsigned)(old_pos_rel.z) < GPU_WORLD_SIZE_CHUNKS;
-					if (!was_inside)
-						reupload_chunk(int3(x,y,z));
+					if (!was_inside) {
+						upload_chunk(world_pos, 0, CHUNK_SIZE);
+						continue;
+					}
+
+					// chunks on the border of the window whose df read voxels of neighbours that are now outside of it (and count as air)
+					bool on_border = x == 0 || y == 0 || z == 0 ||
+						x == GPU_WORLD_SIZE_CHUNKS-1 || y == GPU_WORLD_SIZE_CHUNKS-1 || z == GPU_WORLD_SIZE_CHUNKS-1;
+					if (on_border) {
+						bool lost_neighbour = false;
+						for (int nz=-1; nz<=1; ++nz)
+						for (int ny=-1; ny<=1; ++ny)
+						for (int nx=-1; nx<=1; ++nx) {
+							int3 rel = old_pos_rel + int3(nx,ny,nz);
+							bool was_in_old = (unsigned)rel.x < GPU_WORLD_SIZE_CHUNKS && (unsigned)rel.y < GPU_WORLD_SIZE_CHUNKS && (unsigned)rel.z < GPU_WORLD_SIZE_CHUNKS;
+							if (was_in_old && !chunk_in_gpu_world(world_pos + int3(nx,ny,nz)))
+								lost_neighbour = true;
+						}
+						if (lost_neighbour)
+							df_batch.add_chunk(world_pos);
+					}
 				}
 			}
 		}
@@ -318,192 +328,277 @@ namespace gl {
 		//// Reupload any chunks with changes
 		// take all chunks that have had voxels updated AND are inside the sliding window of gpu voxel memory
 		//  -> ie chunk coords [voxtex_offset, voxtex_offset + GPU_WORLD_SIZE_CHUNKS)
-		for (auto cid : game.chunks.upload_voxels) {
-			auto& chunk = game.chunks.chunks[cid];
+		// only their dirty rect rounded out to subchunks is uploaded
+		for (auto& up : game.chunks.upload_voxels) {
+			auto& chunk = game.chunks.chunks[up.cid];
 			if (chunk_in_gpu_world(chunk.pos)) {
-				reupload_chunks.emplace(chunk.pos);
+				upload_chunk(chunk.pos, up.dirty_rect_min, up.dirty_rect_max);
 			}
 		}
-		// Unload chunks to unload
+		// Unload chunks by replacing them with null voxels, unless a new chunk is uploaded there
 		for (auto cpos : game.chunks.unload_chunks) {
 			if (chunk_in_gpu_world(cpos)) {
-				clear_chunks.emplace(int3(cpos));
+				voxel_upload.add_clear(cpos);
+				df_batch.add(cpos, 0, CHUNK_SIZE);
 			}
 		}
-		
-		// temp buffer to 'decompress' my sparse subchunks and enable uploading them in a single glTextureSubImage3D per chunk
-		//block_id buffer[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE]; // WARNING: having two of these (even in separate scopes) apparently overflows the stack!
-		auto* buffer = (DenseChunkVoxels*)malloc(sizeof(DenseChunkVoxels)*2);
-		
 
 		//// Execute reupload
-		// and "decompress" them ie. de-sparsify them, then upload them to dense voxel region on gpu
-		// but upload them using world positions wrapped by GPU_WORLD_SIZE_CHUNKS instead, so that sliding the window by 1 chunk does not require moving all the contents
-		if (!reupload_chunks.empty()) {
+		// "decompress" them ie. de-sparsify them on the worker threads directly into the mapped pbo, then upload all of them out of the pbo
+		// using world positions wrapped by GPU_WORLD_SIZE_CHUNKS, so that sliding the window by 1 chunk does not require moving all the contents
+		if (!voxel_upload.regions.empty()) {
 			OGL_TRACE("raytracer upload changes");
 
-			for (auto pos : reupload_chunks) {
-				auto it = game.chunks.chunks_map.find(pos);
-				if (it == game.chunks.chunks_map.end()) {
-					// Chunk should be reuploaded due to gpu world movement, but we have no chunk loaded there, need to clear data
-					clear_chunks.emplace(int3(pos));
-					continue;
-				}
+			size_t voxels = voxel_upload.prepare(game.chunks.chunk_voxels.arr);
+			if (voxels > 0) {
+				ZoneScopedN("desparsify");
 
-				clear_chunks.erase(int3(pos)); // don't clear chunks we overwrite anyway
+				size_t bytes = voxels * sizeof(block_id);
+				glNamedBufferData(upload_pbo, bytes, nullptr, GL_STREAM_DRAW); // orphan the pbo of the last upload
+				auto* ptr = (block_id*)glMapNamedBufferRange(upload_pbo, 0, bytes, GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT);
 
-				auto cid = it->second;
-				auto& chunk = game.chunks.chunks[cid];
-				auto& vox = game.chunks.chunk_voxels[cid];
+				voxel_upload.desparsify(game.chunks.chunk_voxels.arr, game.chunks.subchunks.arr, ptr, upload_threaded);
 
-				assert(chunk_in_gpu_world(chunk.pos));
-				int3 wrap_pos = chunk.pos & (GPU_WORLD_SIZE_CHUNKS-1);
-				
-				//OGL_TRACE("upload chunk data");
-
-				{
-					ZoneScopedN("decompress");
-
-					for (int sz=0; sz<SUBCHUNK_COUNT; ++sz)
-					for (int sy=0; sy<SUBCHUNK_COUNT; ++sy)
-					for (int sx=0; sx<SUBCHUNK_COUNT; ++sx) {
-
-						auto subc = vox.subchunks[IDX3D(sx,sy,sz, SUBCHUNK_SIZE)];
-						if (subc & SUBC_SPARSE_BIT) {
-							block_id val = (block_id)(subc & ~SUBC_SPARSE_BIT);
-							
-							block_id val_packed[SUBCHUNK_SIZE];
-							for (int i=0; i<SUBCHUNK_SIZE; ++i)
-								val_packed[i] = val;
-							
-							for (int z=0; z<SUBCHUNK_SIZE; ++z)
-							for (int y=0; y<SUBCHUNK_SIZE; ++y) {
-								auto* dst = &buffer->voxels[sz*SUBCHUNK_SIZE + z][sy*SUBCHUNK_SIZE + y][sx*SUBCHUNK_SIZE + 0];
-								memcpy(dst, val_packed, sizeof(block_id)*SUBCHUNK_SIZE);
-							}
-							
-						} else {
-							auto* data = game.chunks.subchunks[subc].voxels;
-							
-							for (int z=0; z<SUBCHUNK_SIZE; ++z)
-							for (int y=0; y<SUBCHUNK_SIZE; ++y) {
-								auto* dst = &buffer->voxels[sz*SUBCHUNK_SIZE + z][sy*SUBCHUNK_SIZE + y][sx*SUBCHUNK_SIZE + 0];
-								auto* src = &data[IDX3D(0,y,z, SUBCHUNK_SIZE)];
-								memcpy(dst, src, sizeof(block_id)*SUBCHUNK_SIZE);
-							}
-						}
+				glUnmapNamedBuffer(upload_pbo);
+			}
+
+			{
+				ZoneScopedN("glTextureSubImage3D");
+
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_pbo);
+
+				for (auto& reg : voxel_upload.regions) {
+					int3 wrap_pos = reg.chunk_pos & (GPU_WORLD_SIZE_CHUNKS-1);
+					int3 tex_pos = wrap_pos * CHUNK_SIZE + reg.lo;
+
+					if (reg.uniform) {
+						// unloaded chunks and chunks of a single block (sky) don't need any data
+						glClearTexSubImage(voxel_tex.tex, 0,
+							tex_pos.x, tex_pos.y, tex_pos.z, reg.size.x, reg.size.y, reg.size.z,
+							GL_RED_INTEGER, GL_UNSIGNED_SHORT, &reg.value);
+					} else {
+						glTextureSubImage3D(voxel_tex.tex, 0,
+							tex_pos.x, tex_pos.y, tex_pos.z, reg.size.x, reg.size.y, reg.size.z,
+							GL_RED_INTEGER, GL_UNSIGNED_SHORT, (void*)(reg.offset * sizeof(block_id)));
 					}
-				}
 
-				{
-					ZoneScopedN("glTextureSubImage3D");
+					//g_debugdraw.wire_cube_stay((float3)reg.chunk_pos*CHUNK_SIZE+CHUNK_SIZE/2, CHUNK_SIZE, lrgba(0,1,0,1), 2);
 
-					glTextureSubImage3D(voxel_tex.tex, 0,
-						wrap_pos.x*CHUNK_SIZE, wrap_pos.y*CHUNK_SIZE, wrap_pos.z*CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE,
-						GL_RED_INTEGER, GL_UNSIGNED_SHORT, &buffer->voxels);
+					// vct mips are still recomputed for the whole chunk
+					reupload_chunk_flat.push_back(wrap_pos);
 				}
 
-				//g_debugdraw.wire_cube_stay((float3)pos*CHUNK_SIZE+CHUNK_SIZE/2, CHUNK_SIZE, lrgba(0,1,0,1), 2);
-
-				reupload_chunk_flat.push_back(wrap_pos);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 			}
 			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT|GL_TEXTURE_FETCH_BARRIER_BIT);
 		}
-		
-		// Unload chunks by replacing them with null voxels
-		// Do this before DF gen to be correct
-		if (!clear_chunks.empty()) {
-			memset(&buffer->voxels, 0, sizeof(buffer->voxels));
 
-			for (auto cpos : clear_chunks) {
-				assert(chunk_in_gpu_world(cpos));
+		compute_df(r, game);
 
-				int3 wrap_pos = cpos & (GPU_WORLD_SIZE_CHUNKS-1);
+		vct_data.recompute_mips(r, game, reupload_chunk_flat);
 
-				// Actually unloaded and not replaced, reupload empty chunk
-				glTextureSubImage3D(voxel_tex.tex, 0,
-					wrap_pos.x*CHUNK_SIZE, wrap_pos.y*CHUNK_SIZE, wrap_pos.z*CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE,
-					GL_RED_INTEGER, GL_UNSIGNED_SHORT, &buffer->voxels);
-					
-				reupload_chunk_flat.push_back(wrap_pos);
+		if (df_compare_requested) {
+			compare_df(game);
+			df_compare_requested = false;
+		}
+	}
+
+	void Raytracer::compute_df (OpenglRenderer& r, Game& game) {
+		ZoneScoped;
+
+		if (df_batch.entries.empty())
+			return;
+
+		int count = (int)df_batch.entries.size();
+
+		if (df_cpu) {
+			// fallback to the gpu passes: compute on the worker threads directly into the mapped pbo, then upload out of it
+			ZoneScopedN("df cpu");
+			OGL_TRACE("df cpu");
+			OGL_TIMER_ZONE(timer_df_init.timer);
+
+			auto& chunks = game.chunks;
+			df_batch.prepare([&] (int3 pos) {
+				auto cid = chunks.query_chunk(pos);
+				return cid != U16_NULL && chunks[cid].lod == 0 ? cid : U16_NULL; // lod chunks are not in voxel_tex
+			});
+
+			size_t bytes = (size_t)count * CHUNK_VOXEL_COUNT;
+			glNamedBufferData(df_upload_pbo, bytes, nullptr, GL_STREAM_DRAW); // orphan the pbo of the last upload
+			auto* ptr = (int8_t*)glMapNamedBufferRange(df_upload_pbo, 0, bytes, GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT);
 
-				//g_debugdraw.wire_cube_stay((float3)(wrap_pos + voxtex_offset)*CHUNK_SIZE+CHUNK_SIZE/2, CHUNK_SIZE, lrgba(1,.5f,0,1), 2);
+			df_batch.compute(chunks.chunk_voxels.arr, chunks.subchunks.arr, ptr, upload_threaded);
+
+			glUnmapNamedBuffer(df_upload_pbo);
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, df_upload_pbo);
+
+			for (int i=0; i<count; ++i) {
+				auto& e = df_batch.entries[i];
+				int3 tex_pos = (e.chunk_pos & (GPU_WORLD_SIZE_CHUNKS-1)) * CHUNK_SIZE;
+
+				if (e.uniform) {
+					glClearTexSubImage(df_tex.tex, 0,
+						tex_pos.x, tex_pos.y, tex_pos.z, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE,
+						GL_RED_INTEGER, GL_BYTE, &e.value);
+				} else {
+					glTextureSubImage3D(df_tex.tex, 0,
+						tex_pos.x, tex_pos.y, tex_pos.z, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE,
+						GL_RED_INTEGER, GL_BYTE, (void*)((size_t)i * CHUNK_VOXEL_COUNT));
+				}
 			}
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT|GL_TEXTURE_FETCH_BARRIER_BIT);
+			return;
 		}
 
-		// Use uploaded dense voxel gpu data to compute VCT data in compute shader
+		// Use uploaded dense voxel gpu data to compute the DF in compute shaders
 		// (batched into multiple chunks per compute invoke)
 		{
-			//chunks.clear(); // for profiling df gen
-			//for (int y=0; y<4; ++y)
-			//for (int x=0; x<4; ++x) {
-			//	chunks.push_back({x,y,7});
-			//}
+			ZoneScopedN("rt_df_gen");
+			OGL_TRACE("rt_df_gen");
+			OGL_TIMER_ZONE(timer_df_init.timer);
 
-			if (!reupload_chunk_flat.empty()) {
-				ZoneScopedN("rt_df_gen");
-				OGL_TRACE("rt_df_gen");
-				OGL_TIMER_ZONE(timer_df_init.timer);
+			glBindImageTexture(4, df_tex.tex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R8I);
 
-				int count = (int)reupload_chunk_flat.size();
+			static constexpr int BATCHSIZE = 32;
 
-				glBindImageTexture(4, df_tex.tex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R8I);
+			{
+				glUseProgram(df_tex.shad_init->prog);
 
-				{
-					glUseProgram(df_tex.shad_init->prog);
-
-					r.state.bind_textures(df_tex.shad_init, {
-						{"voxel_tex", voxel_tex.tex},
-					});
+				r.state.bind_textures(df_tex.shad_init, {
+					{"voxel_tex", voxel_tex.tex},
+				});
 
-					static constexpr int BATCHSIZE = 32;
-					for (int i=0; i<count; i+=BATCHSIZE) {
-						int subcount = min(count - i, BATCHSIZE);
+				// the init reads 1 voxel into the neighbouring chunks, so it works on world positions to know which of them are outside of voxel_tex
+				int3 window_min = voxtex_offset * CHUNK_SIZE;
+				df_tex.shad_init->set_uniform("window_min", window_min);
+				df_tex.shad_init->set_uniform("window_max", window_min + GPU_WORLD_SIZE);
 
-						int3 offsets[BATCHSIZE] = {};
-						for (int j=0; j<subcount; ++j)
-							offsets[j] = reupload_chunk_flat[i+j] * CHUNK_SIZE;
+				for (int i=0; i<count; i+=BATCHSIZE) {
+					int subcount = min(count - i, BATCHSIZE);
 
-						df_tex.shad_init->set_uniform_array("offsets[0]", offsets, BATCHSIZE);
+					int3 offsets[BATCHSIZE] = {};
+					for (int j=0; j<subcount; ++j)
+						offsets[j] = df_batch.entries[i+j].chunk_pos * CHUNK_SIZE;
 
-						constexpr int REGION = 8;
-						constexpr int CORE = REGION -2;
-						constexpr int CHUNK_WGROUPS = (CHUNK_SIZE + CORE-1) / CORE; // round up
+					df_tex.shad_init->set_uniform_array("offsets[0]", offsets, BATCHSIZE);
 
-						glDispatchCompute(CHUNK_WGROUPS, CHUNK_WGROUPS, CHUNK_WGROUPS * subcount);
-					}
+					constexpr int REGION = 8;
+					constexpr int CORE = REGION -2;
+					constexpr int CHUNK_WGROUPS = (CHUNK_SIZE + CORE-1) / CORE; // round up
 
-					glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT|GL_TEXTURE_FETCH_BARRIER_BIT);
+					glDispatchCompute(CHUNK_WGROUPS, CHUNK_WGROUPS, CHUNK_WGROUPS * subcount);
 				}
-				for (int pass=0; pass<3; ++pass) {
-					Shader* shad = df_tex.shad_pass[pass];
+
+				glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT|GL_TEXTURE_FETCH_BARRIER_BIT);
+			}
+			for (int pass=0; pass<3; ++pass) {
+				Shader* shad = df_tex.shad_pass[pass];
 				
-					glUseProgram(shad->prog);
-					r.state.bind_textures(shad, {});
+				glUseProgram(shad->prog);
+				r.state.bind_textures(shad, {});
 				
-					static constexpr int BATCHSIZE = 32;
-					for (int i=0; i<count; i+=BATCHSIZE) {
-						int subcount = min(count - i, BATCHSIZE);
+				for (int i=0; i<count; i+=BATCHSIZE) {
+					int subcount = min(count - i, BATCHSIZE);
 				
-						int3 offsets[BATCHSIZE] = {};
-						for (int j=0; j<subcount; ++j)
-							offsets[j] = reupload_chunk_flat[i+j] * CHUNK_SIZE;
+					int3 offsets[BATCHSIZE] = {};
+					for (int j=0; j<subcount; ++j)
+						offsets[j] = (df_batch.entries[i+j].chunk_pos & (GPU_WORLD_SIZE_CHUNKS-1)) * CHUNK_SIZE;
 				
-						shad->set_uniform_array("offsets[0]", offsets, BATCHSIZE);
+					shad->set_uniform_array("offsets[0]", offsets, BATCHSIZE);
 				
-						int dispatch_size = (CHUNK_SIZE + DFTexture::COMPUTE_GROUPSZ -1) / DFTexture::COMPUTE_GROUPSZ;
-						glDispatchCompute(dispatch_size, dispatch_size, subcount);
-					}
-				
-					glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT|GL_TEXTURE_FETCH_BARRIER_BIT);
+					int dispatch_size = (CHUNK_SIZE + DFTexture::COMPUTE_GROUPSZ -1) / DFTexture::COMPUTE_GROUPSZ;
+					glDispatchCompute(dispatch_size, dispatch_size, subcount);
 				}
+				
+				glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT|GL_TEXTURE_FETCH_BARRIER_BIT);
 			}
 
 			glBindImageTexture(4, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8); // unbind
 		}
-		vct_data.recompute_mips(r, game, reupload_chunk_flat);
+	}
+
+	void Raytracer::compare_df (Game& game) {
+		ZoneScoped;
+		OGL_TRACE("compare df");
+
+		uint64_t t0 = get_timestamp();
+
+		auto& chunks = game.chunks;
+		auto query = [&] (int3 pos) {
+			auto cid = chunks.query_chunk(pos);
+			return cid != U16_NULL && chunks[cid].lod == 0 ? cid : U16_NULL;
+		};
+
+		df_compare = {};
+		df_compare.chunks = 0;
+
+		// one layer of chunks at a time to keep the memory down
+		DistanceFieldBatch batch;
+		std::vector<int8_t> cpu_df;
+		std::vector<int8_t> gpu_df (CHUNK_VOXEL_COUNT);
+
+		for (int z=0; z<GPU_WORLD_SIZE_CHUNKS; ++z) {
+			batch.clear(voxtex_offset, GPU_WORLD_SIZE_CHUNKS, g_assets.block_types.air_id);
+			for (int y=0; y<GPU_WORLD_SIZE_CHUNKS; ++y)
+			for (int x=0; x<GPU_WORLD_SIZE_CHUNKS; ++x)
+				batch.add_chunk(voxtex_offset + int3(x,y,z));
+			batch.prepare(query);
+
+			cpu_df.resize(batch.entries.size() * CHUNK_VOXEL_COUNT);
+			batch.compute(chunks.chunk_voxels.arr, chunks.subchunks.arr, cpu_df.data(), true);
+
+			for (size_t i=0; i<batch.entries.size(); ++i) {
+				int3 tex_pos = (batch.entries[i].chunk_pos & (GPU_WORLD_SIZE_CHUNKS-1)) * CHUNK_SIZE;
+				glGetTextureSubImage(df_tex.tex, 0, tex_pos.x, tex_pos.y, tex_pos.z, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE,
+					GL_RED_INTEGER, GL_BYTE, CHUNK_VOXEL_COUNT, gpu_df.data());
+
+				int8_t const* cpu = cpu_df.data() + i * CHUNK_VOXEL_COUNT;
+				int failed = 0;
+				for (int j=0; j<CHUNK_VOXEL_COUNT; ++j)
+					failed += cpu[j] != gpu_df[j] ? 1 : 0;
+
+				df_compare.chunks++;
+				df_compare.failed_chunks += failed > 0 ? 1 : 0;
+				df_compare.failed_voxels += failed;
+			}
+		}
+
+		df_compare.ms = (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq;
+	}
+
+	void Raytracer::update_brickmap (Game& game) {
+		ZoneScoped;
+
+		auto& chunks = game.chunks;
+
+		int size = 1 << brickmap_size_log2;
+		if (brickmap.size_chunks != size)
+			brickmap.init(size);
+
+		auto set_chunk = [&] (int3 pos, int3 lo, int3 hi) {
+			auto cid = chunks.query_chunk(pos);
+			if (cid != U16_NULL && chunks[cid].lod != 0)
+				cid = U16_NULL; // lod chunks are only used for raster rendering
+			brickmap.set_chunk(pos, cid, lo, hi, chunks.chunk_voxels.arr, chunks.subchunks.arr);
+		};
+
+		// unloads first, chunks loaded again at the same position are in upload_voxels
+		for (auto cpos : chunks.unload_chunks)
+			brickmap.set_chunk(cpos, U16_NULL, 0, CHUNK_SIZE, nullptr, nullptr);
+
+		std::vector<int3> entered;
+		brickmap.move(roundi(game.lod_center()) / CHUNK_SIZE - size/2, entered);
+		for (auto pos : entered)
+			set_chunk(pos, 0, CHUNK_SIZE);
+
+		for (auto& up : chunks.upload_voxels)
+			set_chunk(chunks[up.cid].pos, up.dirty_rect_min, up.dirty_rect_max);
 
-		free(buffer);
+		// nothing on the gpu consumes the changes yet
+		brickmap.clear_dirty();
 	}
 
 	void Raytracer::set_uniforms (OpenglRenderer& r, Game& game, Shader* shad) {
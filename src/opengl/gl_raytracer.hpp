@@ -4,6 +4,9 @@
 #include "opengl_shaders.hpp"
 #include "assets.hpp"
 #include "game.hpp"
+#include "voxel_upload.hpp"
+#include "brickmap.hpp"
+#include "distance_field.hpp"
 
 #include "engine/window.hpp" // frame_counter
 
@@ -446,6 +449,31 @@ namespace gl {
 		}
 		
 		int3 voxtex_offset = 0;
+
+		// changed voxel regions of this frame, desparsified into upload_pbo and uploaded from there
+		VoxelUploadBatch voxel_upload;
+		Vbo upload_pbo = {"RT.voxel_upload_pbo"};
+		bool upload_threaded = true;
+
+		// sparse brickmap of a larger window than voxel_tex, kept up to date from the same changes, not used for rendering yet
+		Brickmap brickmap;
+		bool brickmap_enable = false;
+		int brickmap_size_log2 = 4; // 16^3 chunks
+
+		// chunks whose df needs to be recomputed this frame, computed on the gpu or on the cpu and uploaded out of df_upload_pbo
+		DistanceFieldBatch df_batch;
+		Vbo df_upload_pbo = {"RT.df_upload_pbo"};
+		bool df_cpu = false;
+
+		// compare df_tex of every chunk against the cpu df, runs at the end of the next upload_changes
+		struct DFCompare {
+			int chunks = -1; // -1 if not run yet
+			int failed_chunks = 0;
+			int failed_voxels = 0;
+			float ms = 0;
+		};
+		DFCompare df_compare;
+		bool df_compare_requested = false;
 		
 		bool enable = true;
 
@@ -557,6 +585,23 @@ namespace gl {
 
 			lighting.imgui(macro_change);
 
+			ImGui::Checkbox("voxel upload threaded", &upload_threaded);
+			voxel_upload.imgui();
+
+			ImGui::Checkbox("brickmap", &brickmap_enable);
+			ImGui::SameLine();
+			ImGui::SliderInt("brickmap_size_log2", &brickmap_size_log2, 1, 6);
+			brickmap.imgui();
+
+			ImGui::Checkbox("df on cpu", &df_cpu);
+			df_batch.imgui();
+			if (ImGui::Button("Compare df with cpu"))
+				df_compare_requested = true;
+			if (df_compare.chunks >= 0) {
+				ImGui::SameLine();
+				ImGui::Text("%d of %d chunks differ (%d voxels)  %7.2f ms", df_compare.failed_chunks, df_compare.chunks, df_compare.failed_voxels, df_compare.ms);
+			}
+
 			//ImGui::Separator();
 			//test_renderer.imgui();
 			
@@ -567,6 +612,9 @@ namespace gl {
 		}
 
 		void upload_changes (OpenglRenderer& r, Game& game);
+		void update_brickmap (Game& game);
+		void compute_df (OpenglRenderer& r, Game& game);
+		void compare_df (Game& game);
 
 		// update things and upload changes to gpu
 		void update (OpenglRenderer& r, Game& game, Input& I);
@@ -0,0 +1,116 @@
+#include "common.hpp"
+#include "selftest.hpp"
+#include "chunk_culling.hpp"
+#include "chunk_visibility.hpp"
+#include "occlusion_culling.hpp"
+#include "chunk_draw_commands.hpp"
+#include "mesh_allocator.hpp"
+#include "engine/ring_allocator.hpp"
+#include "voxel_upload.hpp"
+#include "distance_field.hpp"
+#include "brickmap.hpp"
+
+void Selftest::run () {
+	ZoneScoped;
+
+	uint64_t t0 = get_timestamp();
+	results.clear();
+
+	{
+		auto b = ChunkCuller::check_synthetic();
+		results.push_back({ "frustrum culling", b.failures,
+			prints("%d chunks  %d visible  cull%s: %7.3f ms  scalar: %7.3f ms",
+				b.chunks, b.visible, ChunkCuller::has_avx2 ? "" : " (no avx2)", b.cull_ms, b.scalar_ms) });
+	}
+	{
+		int failures = ChunkVisibility::check_synthetic_layouts();
+		results.push_back({ "cave culling layouts", failures, "" });
+	}
+	{
+		auto b = OcclusionCuller::check_synthetic_scenes();
+		results.push_back({ "occlusion scenes", b.failures,
+			prints("hills: %5d quads  raster: %6.3f ms  threaded: %6.3f ms  test %d boxes (%d hidden): %6.3f ms",
+				b.quads, b.raster_ms, b.raster_threaded_ms, b.boxes, b.hidden, b.test_ms) });
+	}
+	{
+		auto b = ChunkDrawCommands::check_synthetic();
+		results.push_back({ "draw commands", b.failures,
+			prints("%d draws  build: %7.3f ms", b.draws, b.build_ms) });
+	}
+	{
+		auto b = RingAllocator::check_synthetic();
+		results.push_back({ "upload ring", b.failures,
+			prints("%d allocs  %d stalls  max usage: %5.1f%%", b.allocs, b.stalls, b.max_usage * 100) });
+	}
+	{
+		auto b = MeshAllocator::check_synthetic();
+		results.push_back({ "mesh heap", b.failures,
+			prints("%d allocs  %d moves  alloc+free: %5.0f ns\n"
+			       "churn: slices: %7.1f MB  used: %7.1f MB  committed: %7.1f MB (defrag: %7.1f MB)  fragmentation: %5.1f%% (defrag: %5.1f%%)",
+				b.allocs, b.moves, b.alloc_ns,
+				b.slices_mb, b.used_mb, b.committed_mb, b.committed_defrag_mb, b.fragmentation * 100, b.fragmentation_defrag * 100) });
+	}
+	{
+		auto b = VoxelUploadBatch::check_synthetic();
+		results.push_back({ "voxel upload", b.failures,
+			prints("%d regions  block edits: %7.1f KB (whole chunks %7.1f KB)\n"
+			       "slide: %6.2f MB  %6.3f ms  threaded: %6.3f ms  whole chunks: %6.3f ms",
+				b.regions, b.edit_kb, b.edit_whole_kb,
+				b.slide_mb, b.slide_ms, b.slide_threaded_ms, b.whole_chunk_ms) });
+	}
+	{
+		auto b = DistanceFieldBatch::check_synthetic();
+		results.push_back({ "distance field", b.failures,
+			prints("full: %7.2f ms  threaded: %7.2f ms\n"
+			       "%d edits: %6.3f ms  %4.2f chunks (%5.2f%% of the window)  %8.0f voxels changed (%5.2f%% of recomputed)  radius %d",
+				b.full_ms, b.full_threaded_ms,
+				b.edits, b.edit_ms, b.chunks, b.recomputed_pct, b.changed_voxels, b.changed_pct, b.max_radius) });
+	}
+	{
+		auto b = Brickmap::check_synthetic();
+		results.push_back({ "brickmap", b.failures,
+			prints("build: %6.2f ms  %4d edits: %6.2f us  %8.2f MB (dense: %8.2f MB)\n"
+			       "%d rays (%d hits): %7.1f steps %7.0f ns  voxel by voxel: %7.1f steps %7.0f ns",
+				b.build_ms, b.edits, b.edit_us, b.memory_mb, b.dense_mb,
+				b.rays, b.hits, b.steps, b.ray_ns, b.naive_steps, b.naive_ray_ns) });
+	}
+
+	total_ms = (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq;
+}
+
+int Selftest::failures () const {
+	int count = 0;
+	for (auto& r : results)
+		count += r.failures;
+	return count;
+}
+
+void Selftest::print () const {
+	for (auto& r : results) {
+		printf("%-22s %s\n", r.name, r.failures == 0 ? "passed" : prints("%d failed", r.failures).c_str());
+		if (!r.details.empty())
+			printf("  %s\n", r.details.c_str());
+	}
+	if (failures() == 0) printf("all passed  %7.1f ms\n", total_ms);
+	else                 printf("%d failed  %7.1f ms\n", failures(), total_ms);
+}
+
+void Selftest::imgui () {
+	if (ImGui::Button("Run selftests"))
+		run();
+	if (results.empty())
+		return;
+
+	ImGui::SameLine();
+	if (failures() == 0) ImGui::Text("all passed  %7.1f ms", total_ms);
+	else                 ImGui::Text("%d failed  %7.1f ms", failures(), total_ms);
+
+	if (ImGui::TreeNode("selftest results")) {
+		for (auto& r : results) {
+			ImGui::Text("%-22s %s", r.name, r.failures == 0 ? "passed" : prints("%d failed", r.failures).c_str());
+			if (!r.details.empty())
+				ImGui::TextUnformatted(r.details.c_str());
+		}
+		ImGui::TreePop();
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "common.hpp"
+
+// Synthetic checks of the cpu side of the chunk pipeline (frustrum, cave and occlusion culling, draw commands, mesh heap, upload ring, voxel upload, distance field, brickmap)
+// every check builds its own data, so they run without a gpu or loaded world, and they all share this one entry point
+// Pure CPU code
+struct Selftest {
+	struct Result {
+		char const*	name;
+		int			failures;
+		std::string	details; // sizes and timings of the check
+	};
+	std::vector<Result> results; // empty if not run yet
+	float total_ms = 0;
+
+	void run ();
+	int failures () const;
+
+	// for the --selftest command line switch, which runs the checks without opening a window
+	void print () const;
+
+	void imgui ();
+};
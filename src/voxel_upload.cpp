@@ -0,0 +1,387 @@
+#include "common.hpp"
+#include "voxel_upload.hpp"
+
+void VoxelUploadBatch::clear () {
+	regions.clear();
+	layers.clear();
+	region_map.clear();
+	total_voxels = 0;
+	uniform_regions = 0;
+}
+
+void VoxelUploadBatch::add (chunk_id cid, int3 chunk_pos, int3 lo, int3 hi) {
+	assert(cid != U16_NULL);
+
+	lo.x = max(lo.x, 0);
+	lo.y = max(lo.y, 0);
+	lo.z = max(lo.z, 0);
+	hi.x = min(hi.x, CHUNK_SIZE);
+	hi.y = min(hi.y, CHUNK_SIZE);
+	hi.z = min(hi.z, CHUNK_SIZE);
+	if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) {
+		lo = 0;
+		hi = CHUNK_SIZE;
+	}
+
+	// round out to subchunks
+	lo = lo & ~SUBCHUNK_MASK;
+	hi = (hi + SUBCHUNK_MASK) & ~SUBCHUNK_MASK;
+
+	auto it = region_map.find(chunk_pos);
+	if (it == region_map.end()) {
+		region_map.emplace(chunk_pos, (uint32_t)regions.size());
+		regions.push_back({ chunk_pos, cid, lo, hi - lo });
+		return;
+	}
+
+	auto& r = regions[it->second];
+	if (r.cid == U16_NULL) {
+		// unloaded and a new chunk loaded at the same position, overwrite all of it
+		r.cid = cid;
+		r.lo = 0;
+		r.size = CHUNK_SIZE;
+		return;
+	}
+	assert(r.cid == cid);
+
+	int3 r_hi = r.lo + r.size;
+	r.lo.x = min(r.lo.x, lo.x);
+	r.lo.y = min(r.lo.y, lo.y);
+	r.lo.z = min(r.lo.z, lo.z);
+	r_hi.x = max(r_hi.x, hi.x);
+	r_hi.y = max(r_hi.y, hi.y);
+	r_hi.z = max(r_hi.z, hi.z);
+	r.size = r_hi - r.lo;
+}
+
+void VoxelUploadBatch::add_clear (int3 chunk_pos) {
+	if (region_map.find(chunk_pos) != region_map.end())
+		return;
+
+	region_map.emplace(chunk_pos, (uint32_t)regions.size());
+	regions.push_back({ chunk_pos, U16_NULL, 0, CHUNK_SIZE });
+}
+
+size_t VoxelUploadBatch::prepare (ChunkVoxels const* chunk_voxels) {
+	ZoneScoped;
+
+	layers.clear();
+	total_voxels = 0;
+	uniform_regions = 0;
+
+	for (uint32_t i=0; i<(uint32_t)regions.size(); ++i) {
+		auto& r = regions[i];
+		r.uniform = true;
+		r.value = B_NULL;
+
+		if (r.cid != U16_NULL) {
+			auto& vox = chunk_voxels[r.cid];
+			uint32_t first = vox.subchunks[SUBCHUNK_IDX(r.lo.x, r.lo.y, r.lo.z)];
+
+			for (int sz=r.lo.z; sz<r.lo.z + r.size.z && r.uniform; sz+=SUBCHUNK_SIZE)
+			for (int sy=r.lo.y; sy<r.lo.y + r.size.y && r.uniform; sy+=SUBCHUNK_SIZE)
+			for (int sx=r.lo.x; sx<r.lo.x + r.size.x && r.uniform; sx+=SUBCHUNK_SIZE) {
+				uint32_t subc = vox.subchunks[SUBCHUNK_IDX(sx,sy,sz)];
+				if ((subc & SUBC_SPARSE_BIT) == 0 || subc != first)
+					r.uniform = false;
+			}
+			if (r.uniform)
+				r.value = (block_id)(first & ~SUBC_SPARSE_BIT);
+		}
+
+		if (r.uniform) {
+			r.offset = 0;
+			uniform_regions++;
+			continue;
+		}
+
+		r.offset = total_voxels;
+		total_voxels += (size_t)r.size.x * r.size.y * r.size.z;
+
+		for (int z=r.lo.z; z<r.lo.z + r.size.z; z+=SUBCHUNK_SIZE)
+			layers.push_back({ i, z });
+	}
+
+	return total_voxels;
+}
+
+void VoxelUploadBatch::desparsify (ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, block_id* dst, bool threaded) {
+	ZoneScoped;
+
+	// not worth waking the threads for a few edits
+	static constexpr size_t THREADED_MIN_VOXELS = CHUNK_VOXEL_COUNT / 2;
+
+	uint64_t t0 = get_timestamp();
+
+	uint32_t count = (uint32_t)layers.size();
+	int parts = threaded && total_voxels >= THREADED_MIN_VOXELS ? parallelism_threads + 1 : 1;
+
+	// layers of different regions differ in size, so split by voxels, range i is [bounds[i], bounds[i+1])
+	std::vector<uint32_t> bounds = { 0 };
+
+	size_t per_part = (total_voxels + parts-1) / parts;
+	size_t voxels = 0;
+	for (uint32_t i=0; i<count; ++i) {
+		auto& r = regions[layers[i].region];
+		voxels += (size_t)r.size.x * r.size.y * SUBCHUNK_SIZE;
+
+		if (voxels >= per_part * bounds.size() || i+1 == count)
+			bounds.push_back(i+1);
+	}
+
+	parallel_for_ranges(bounds.data(), (uint32_t)bounds.size()-1, [&] (uint32_t first, uint32_t end) {
+		desparsify_layers(chunk_voxels, subchunks, dst, first, end);
+	});
+
+	desparsify_ms = (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq;
+}
+
+void VoxelUploadBatch::desparsify_layers (ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, block_id* dst, uint32_t first, uint32_t end) const {
+	ZoneScoped;
+
+	for (uint32_t i=first; i<end; ++i) {
+		auto& l = layers[i];
+		auto& r = regions[l.region];
+
+		size_t layer_voxels = (size_t)r.size.x * r.size.y * SUBCHUNK_SIZE;
+		block_id* layer_dst = dst + r.offset + (size_t)((l.z - r.lo.z) / SUBCHUNK_SIZE) * layer_voxels;
+
+		desparsify_region(chunk_voxels[r.cid], subchunks, int3(r.lo.x, r.lo.y, l.z), int3(r.size.x, r.size.y, SUBCHUNK_SIZE), layer_dst);
+	}
+}
+
+void VoxelUploadBatch::desparsify_region (ChunkVoxels const& vox, SubchunkVoxels const* subchunks, int3 lo, int3 size, block_id* dst) {
+	assert(((lo.x | lo.y | lo.z | size.x | size.y | size.z) & SUBCHUNK_MASK) == 0);
+
+	for (int sz=lo.z; sz<lo.z + size.z; sz+=SUBCHUNK_SIZE)
+	for (int sy=lo.y; sy<lo.y + size.y; sy+=SUBCHUNK_SIZE)
+	for (int sx=lo.x; sx<lo.x + size.x; sx+=SUBCHUNK_SIZE) {
+		uint32_t subc = vox.subchunks[SUBCHUNK_IDX(sx,sy,sz)];
+		block_id* out = dst + ((size_t)(sz - lo.z) * size.y + (sy - lo.y)) * size.x + (sx - lo.x);
+
+		if (subc & SUBC_SPARSE_BIT) {
+			block_id val = (block_id)(subc & ~SUBC_SPARSE_BIT);
+
+			for (int z=0; z<SUBCHUNK_SIZE; ++z)
+			for (int y=0; y<SUBCHUNK_SIZE; ++y) {
+				std::fill_n(out + ((size_t)z * size.y + y) * size.x, SUBCHUNK_SIZE, val);
+			}
+		} else {
+			auto* data = subchunks[subc].voxels;
+
+			for (int z=0; z<SUBCHUNK_SIZE; ++z)
+			for (int y=0; y<SUBCHUNK_SIZE; ++y) {
+				memcpy(out + ((size_t)z * size.y + y) * size.x, &data[BLOCK_IDX(0,y,z)], sizeof(block_id)*SUBCHUNK_SIZE);
+			}
+		}
+	}
+}
+
+VoxelUploadBatch::Bench VoxelUploadBatch::check_synthetic () {
+	ZoneScoped;
+
+	Bench b;
+	b.failures = 0;
+
+	uint32_t rng = 0x2545f491u;
+	auto next = [&] (uint32_t n) {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng % n;
+	};
+
+	// a slab of the gpu window worth of chunks: sky, mostly dense terrain and a mix of both
+	constexpr int CHUNKS = 64;
+	std::vector<ChunkVoxels> chunk_voxels (CHUNKS);
+	std::vector<SubchunkVoxels> subchunks;
+	subchunks.reserve(CHUNKS * CHUNK_SUBCHUNK_COUNT);
+
+	for (int c=0; c<CHUNKS; ++c) {
+		int kind = c % 3;
+		for (int i=0; i<CHUNK_SUBCHUNK_COUNT; ++i) {
+			uint32_t& subc = chunk_voxels[c].subchunks[i];
+			if (kind == 0) {
+				subc = SUBC_SPARSE_BIT | 1;
+			} else if (next(kind == 1 ? 8 : 2) == 0) {
+				subc = SUBC_SPARSE_BIT | next(8);
+			} else {
+				subc = (uint32_t)subchunks.size();
+				subchunks.emplace_back();
+				for (auto& v : subchunks.back().voxels)
+					v = (block_id)next(16);
+			}
+		}
+	}
+
+	auto reference = [&] (int c, int x, int y, int z) {
+		uint32_t subc = chunk_voxels[c].subchunks[SUBCHUNK_IDX(x,y,z)];
+		if (subc & SUBC_SPARSE_BIT)
+			return (block_id)(subc & ~SUBC_SPARSE_BIT);
+		return subchunks[subc].voxels[BLOCK_IDX(x,y,z)];
+	};
+
+	VoxelUploadBatch batch;
+	std::vector<block_id> dst;
+
+	auto check_batch = [&] () {
+		size_t non_uniform = 0;
+
+		for (auto& r : batch.regions) {
+			if (((r.lo.x | r.lo.y | r.lo.z | r.size.x | r.size.y | r.size.z) & SUBCHUNK_MASK) != 0 ||
+					r.size.x <= 0 || r.size.y <= 0 || r.size.z <= 0 ||
+					r.lo.x < 0 || r.lo.y < 0 || r.lo.z < 0 ||
+					r.lo.x + r.size.x > CHUNK_SIZE || r.lo.y + r.size.y > CHUNK_SIZE || r.lo.z + r.size.z > CHUNK_SIZE) {
+				b.failures++;
+				continue;
+			}
+			if (!r.uniform) {
+				if (r.offset != non_uniform)
+					b.failures++;
+				non_uniform += (size_t)r.size.x * r.size.y * r.size.z;
+			}
+
+			int c = r.chunk_pos.x;
+			bool ok = true;
+			for (int z=0; z<r.size.z && ok; ++z)
+			for (int y=0; y<r.size.y && ok; ++y)
+			for (int x=0; x<r.size.x && ok; ++x) {
+				block_id expect = r.cid == U16_NULL ? B_NULL : reference(c, r.lo.x + x, r.lo.y + y, r.lo.z + z);
+				block_id val = r.uniform ? r.value : dst[r.offset + ((size_t)z * r.size.y + y) * r.size.x + x];
+				if (val != expect)
+					ok = false;
+			}
+			if (!ok)
+				b.failures++;
+		}
+
+		if (non_uniform != batch.total_voxels)
+			b.failures++;
+	};
+
+	for (int iter=0; iter<64; ++iter) {
+		batch.clear();
+
+		struct Rect {
+			int		c;
+			int3	lo, hi;
+		};
+		std::vector<Rect> rects;
+		std::vector<int> state (CHUNKS, 0); // 0: untouched  1: cleared first  2: uploaded
+
+		int count = 1 + (int)next(8);
+		for (int i=0; i<count; ++i) {
+			int c = (int)next(CHUNKS);
+			int3 pos = int3(c,0,0);
+
+			if (next(4) == 0) {
+				batch.add_clear(pos);
+				if (state[c] == 0) state[c] = 1;
+				continue;
+			}
+
+			int3 lo, hi;
+			int kind = (int)next(8);
+			if (kind == 0) { // no dirty rect set
+				lo = INT_MAX;
+				hi = INT_MIN;
+			} else if (kind == 1) {
+				lo = 0;
+				hi = CHUNK_SIZE;
+			} else {
+				lo = int3((int)next(CHUNK_SIZE), (int)next(CHUNK_SIZE), (int)next(CHUNK_SIZE));
+				hi.x = lo.x + 1 + (int)next(kind == 2 ? CHUNK_SIZE - lo.x : 2);
+				hi.y = lo.y + 1 + (int)next(kind == 2 ? CHUNK_SIZE - lo.y : 2);
+				hi.z = lo.z + 1 + (int)next(kind == 2 ? CHUNK_SIZE - lo.z : 2);
+				hi.x = min(hi.x, CHUNK_SIZE);
+				hi.y = min(hi.y, CHUNK_SIZE);
+				hi.z = min(hi.z, CHUNK_SIZE);
+			}
+
+			batch.add((chunk_id)c, pos, lo, hi);
+			if (kind == 0 || state[c] == 1) {
+				lo = 0;
+				hi = CHUNK_SIZE;
+			}
+			rects.push_back({ c, lo, hi });
+			state[c] = 2;
+		}
+
+		dst.assign(batch.prepare(chunk_voxels.data()), (block_id)0xffff);
+		batch.desparsify(chunk_voxels.data(), subchunks.data(), dst.data(), (iter & 1) != 0);
+
+		// one region per touched chunk, covering all of its rects
+		int touched = 0;
+		for (int s : state)
+			touched += s != 0 ? 1 : 0;
+		if ((int)batch.regions.size() != touched)
+			b.failures++;
+
+		for (auto& rect : rects) {
+			auto it = batch.region_map.find(int3(rect.c,0,0));
+			if (it == batch.region_map.end()) {
+				b.failures++;
+				continue;
+			}
+			auto& r = batch.regions[it->second];
+			if (r.cid != (chunk_id)rect.c ||
+					rect.lo.x < r.lo.x || rect.lo.y < r.lo.y || rect.lo.z < r.lo.z ||
+					rect.hi.x > r.lo.x + r.size.x || rect.hi.y > r.lo.y + r.size.y || rect.hi.z > r.lo.z + r.size.z)
+				b.failures++;
+		}
+
+		check_batch();
+		b.regions += (int)batch.regions.size();
+	}
+
+	{ // single block edits in every chunk
+		batch.clear();
+		for (int c=0; c<CHUNKS; ++c) {
+			int3 lo = int3((int)next(CHUNK_SIZE), (int)next(CHUNK_SIZE), (int)next(CHUNK_SIZE));
+			batch.add((chunk_id)c, int3(c,0,0), lo, lo + 1);
+		}
+		dst.assign(batch.prepare(chunk_voxels.data()), (block_id)0xffff);
+		batch.desparsify(chunk_voxels.data(), subchunks.data(), dst.data(), false);
+		check_batch();
+
+		b.edit_kb = (float)(batch.total_voxels * sizeof(block_id)) / 1024;
+		b.edit_whole_kb = (float)((size_t)CHUNKS * CHUNK_VOXEL_COUNT * sizeof(block_id)) / 1024;
+	}
+
+	{ // window slide: whole chunks
+		batch.clear();
+		for (int c=0; c<CHUNKS; ++c)
+			batch.add((chunk_id)c, int3(c,0,0), 0, CHUNK_SIZE);
+		dst.assign(batch.prepare(chunk_voxels.data()), (block_id)0xffff);
+
+		b.slide_mb = (float)(batch.total_voxels * sizeof(block_id)) / (1024*1024);
+
+		auto time_ms = [&] (auto func) {
+			float best = INF;
+			for (int i=0; i<8; ++i) {
+				uint64_t t0 = get_timestamp();
+				func();
+				best = min(best, (float)(get_timestamp() - t0) * 1000 / (float)timestamp_freq);
+			}
+			return best;
+		};
+
+		b.slide_ms          = time_ms([&] () { batch.desparsify(chunk_voxels.data(), subchunks.data(), dst.data(), false); });
+		b.slide_threaded_ms = time_ms([&] () { batch.desparsify(chunk_voxels.data(), subchunks.data(), dst.data(), true); });
+		check_batch();
+
+		// every chunk desparsified as a whole on one thread, as the raytracer used to
+		std::unique_ptr<DenseChunkVoxels> whole (new DenseChunkVoxels);
+		b.whole_chunk_ms = time_ms([&] () {
+			for (int c=0; c<CHUNKS; ++c)
+				desparsify_region(chunk_voxels[c], subchunks.data(), 0, CHUNK_SIZE, &whole->voxels[0][0][0]);
+		});
+	}
+
+	return b;
+}
+
+void VoxelUploadBatch::imgui () {
+	ImGui::Text("voxel upload: %4d regions (%4d uniform)  %7.3f MB  desparsify: %6.3f ms",
+		(int)regions.size(), uniform_regions, (float)(total_voxels * sizeof(block_id)) / (1024*1024), desparsify_ms);
+}
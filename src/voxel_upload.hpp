@@ -0,0 +1,75 @@
+#pragma once
+#include "common.hpp"
+#include "chunks.hpp"
+
+// Voxel uploads of one frame into the dense voxel texture of the raytracer
+// every chunk that changed, entered or left the gpu window gets one region: the union of its dirty rects rounded out to subchunks
+// (whole chunks for chunks entering or leaving the window), regions that are a single block id (sky, unloaded chunks) are cleared instead of uploaded
+// the other regions are desparsified into one packed staging buffer, split by subchunk layers across parallel_for_threadpool,
+// so that the renderer can upload all of them out of a single buffer
+// Pure CPU code, the renderer only provides the staging memory
+struct VoxelUploadBatch {
+	struct Region {
+		int3		chunk_pos;
+		chunk_id	cid; // U16_NULL to clear the region to B_NULL
+		int3		lo; // voxel region relative to the chunk, subchunk aligned
+		int3		size;
+
+		bool		uniform; // all voxels are value, nothing in the staging buffer
+		block_id	value;
+		size_t		offset; // in block_ids into the staging buffer, voxels are packed x fastest
+	};
+	std::vector<Region>	regions;
+
+	// subchunk layer of a region, the unit of work of the desparsify jobs
+	struct Layer {
+		uint32_t	region;
+		int			z; // relative to the chunk
+	};
+	std::vector<Layer>	layers;
+
+	size_t				total_voxels = 0; // size of the staging buffer in block_ids
+
+	// stats of the last batch
+	int		uniform_regions = 0;
+	float	desparsify_ms = 0;
+
+	void clear ();
+
+	// add the dirty rect [lo,hi) of the chunk, rounded out to subchunks, merged with the region already added for it
+	// an empty rect counts as the whole chunk (chunks that were loaded without setting one)
+	void add (chunk_id cid, int3 chunk_pos, int3 lo, int3 hi);
+	// clear the chunk to B_NULL, ignored if the chunk gets uploaded anyway, and overridden by later uploads
+	void add_clear (int3 chunk_pos);
+
+	// find uniform regions, assign the staging offsets and split the rest into layers, returns total_voxels
+	size_t prepare (ChunkVoxels const* chunk_voxels);
+
+	// write all non-uniform regions into dst (total_voxels block_ids), split across parallel_for_threadpool if threaded
+	void desparsify (ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, block_id* dst, bool threaded);
+	void desparsify_layers (ChunkVoxels const* chunk_voxels, SubchunkVoxels const* subchunks, block_id* dst, uint32_t first, uint32_t end) const;
+
+	// copy the subchunk aligned box lo,size of one chunk into dst, packed x fastest
+	static void desparsify_region (ChunkVoxels const& vox, SubchunkVoxels const* subchunks, int3 lo, int3 size, block_id* dst);
+
+	struct Bench {
+		int		failures = -1; // -1 if not run yet
+		int		regions = 0;
+		// single block edits: uploaded data of the regions vs. whole chunks
+		float	edit_kb = 0;
+		float	edit_whole_kb = 0;
+		// window slide of a slab of chunks
+		float	slide_mb = 0;
+		float	slide_ms = 0;
+		float	slide_threaded_ms = 0;
+		float	whole_chunk_ms = 0; // the old per chunk desparsify of every voxel
+	};
+
+	// compare regions and desparsified voxels of random rects against a per voxel reference on synthetic chunks, runs without a gpu or loaded world
+	static Bench check_synthetic ();
+
+	void imgui ();
+
+private:
+	std::unordered_map<int3, uint32_t> region_map; // chunk_pos -> region
+};
@@ -3,6 +3,9 @@
 #include "vk_chunk_renderer.hpp"
 #include "vulkan_renderer.hpp"
 #include "chunk_mesher.hpp"
+#include "chunk_culling.hpp"
+#include "chunk_visibility.hpp"
+#include "occlusion_culling.hpp"
 
 namespace vk {
 
@@ -11,37 +14,64 @@ void ChunkRenderer::upload_remeshed (VulkanRenderer& r, Chunks& chunks, VkComman
 
 	auto& frame = frames[cur_frame];
 
-	for (auto& slice : chunks.upload_slices) {
-		uint32_t alloci = slice.sliceid / (uint32_t)SLICES_PER_ALLOC;
-		uint32_t slicei = slice.sliceid % (uint32_t)SLICES_PER_ALLOC;
+	{ // uploads and moves can still reference a page that the defrag released at the end of this frame
+		int pages = chunks.mesh_heap.page_count();
+		for (auto& slice : chunks.upload_slices)
+			pages = max(pages, (int)(slice.offset / ALLOC_SIZE) + 1);
+		for (auto& m : chunks.mesh_moves)
+			pages = max(pages, (int)(m.src / MESH_PAGE_UNITS) + 1);
 
-		while (alloci >= (uint32_t)allocs.size()) {
+		while ((int)allocs.size() < pages) {
 			new_alloc(r.ctx);
 		}
+		frame.pages_end = pages;
+	}
 
-		size_t unpadded_size = CHUNK_SLICE_LENGTH * sizeof(BlockMeshInstance); // size of slice data without padding
+	for (auto& slice : chunks.upload_slices) {
+		uint32_t alloci = (uint32_t)(slice.offset / ALLOC_SIZE);
 
 		r.staging.staged_copy(r.ctx, cmds, cur_frame,
-			slice.data->verts, unpadded_size,
-			allocs[alloci].mesh_data.buf, slicei * unpadded_size); // important to use unpadded_size here, can't use vertex-sized offsets when rendering
+			slice.data, slice.size,
+			allocs[alloci].mesh_data.buf, slice.offset % ALLOC_SIZE);
 
 		ChunkMeshData::free_slice(slice.data);
 	}
 
-	{ // free allocation blocks if they are no longer needed by any of the frames in flight
-		frame.slices_end = chunks.slices.slots.alloc_end;
+	if (chunks.mesh_moves.size() > 0) {
+		// defrag moves after the uploads, since they can move meshes that were uploaded this frame
+		if (chunks.upload_slices.size() > 0) {
+			VkMemoryBarrier mem = {};
+			mem.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			mem.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			mem.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(cmds,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 1, &mem, 0, nullptr, 0, nullptr);
+		}
 
-		int slices_end = 0;
+		// sources and destinations of one defrag never overlap, so the copies need no barriers between them
+		for (auto& m : chunks.mesh_moves) {
+			VkBufferCopy copy_region = {};
+			copy_region.srcOffset = (VkDeviceSize)(m.src % MESH_PAGE_UNITS) * MESH_UNIT;
+			copy_region.dstOffset = (VkDeviceSize)(m.dst % MESH_PAGE_UNITS) * MESH_UNIT;
+			copy_region.size = (VkDeviceSize)m.size * MESH_UNIT;
+			vkCmdCopyBuffer(cmds, allocs[m.src / MESH_PAGE_UNITS].mesh_data.buf, allocs[m.dst / MESH_PAGE_UNITS].mesh_data.buf, 1, &copy_region);
+		}
+	}
+
+	{ // free allocation blocks if they are no longer needed by any of the frames in flight
+		int pages_end = chunks.mesh_heap.page_count();
 		for (auto& f : frames)
-			slices_end = max(slices_end, f.slices_end);
+			pages_end = max(pages_end, f.pages_end);
 
-		while (slices_end < ((int)allocs.size()-1) * (int)SLICES_PER_ALLOC) {
+		while (pages_end < (int)allocs.size()) {
 			free_alloc(r.ctx.dev, allocs.back());
 			allocs.pop_back();
 		}
 	}
 
-	if (chunks.upload_slices.size() > 0) {
+	if (chunks.upload_slices.size() > 0 || chunks.mesh_moves.size() > 0) {
 		VkMemoryBarrier mem = {};
 		mem.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
 		mem.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
@@ -53,6 +83,55 @@ void ChunkRenderer::upload_remeshed (VulkanRenderer& r, Chunks& chunks, VkComman
 	}
 }
 
+void ChunkRenderer::reserve_draws (VulkanWindowContext& ctx, FrameData& frame, uint32_t count) {
+	if (count <= frame.draws_capacity) return;
+	ZoneScopedC(tracy::Color::Crimson);
+
+	free_draws(ctx.dev, frame);
+
+	frame.draws_capacity = max(count, frame.draws_capacity * 2);
+
+	VkDeviceSize cmds_size  = frame.draws_capacity * sizeof(ChunkDrawCommands::DrawCmd);
+	VkDeviceSize draws_size = frame.draws_capacity * sizeof(ChunkDrawCommands::DrawData);
+
+	frame.cmds_buf = allocate_buffer(ctx.dev, ctx.pdev, cmds_size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	frame.draws_buf = allocate_buffer(ctx.dev, ctx.pdev, draws_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	GPU_DBG_NAME(ctx, frame.cmds_buf.buf, "ChunkRenderer.frame.cmds_buf");
+	GPU_DBG_NAME(ctx, frame.draws_buf.buf, "ChunkRenderer.frame.draws_buf");
+
+	vkMapMemory(ctx.dev, frame.cmds_buf.mem, 0, cmds_size, 0, &frame.cmds_ptr);
+	vkMapMemory(ctx.dev, frame.draws_buf.mem, 0, draws_size, 0, &frame.draws_ptr);
+
+	VkDescriptorBufferInfo buf_info = {};
+	buf_info.buffer = frame.draws_buf.buf;
+	buf_info.offset = 0;
+	buf_info.range = draws_size;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = frame.draws_descriptor_set;
+	write.dstBinding = 0;
+	write.dstArrayElement = 0;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.descriptorCount = 1;
+	write.pBufferInfo = &buf_info;
+
+	vkUpdateDescriptorSets(ctx.dev, 1, &write, 0, nullptr);
+}
+void ChunkRenderer::free_draws (VkDevice dev, FrameData& frame) {
+	if (frame.draws_capacity == 0) return;
+
+	vkUnmapMemory(dev, frame.cmds_buf.mem);
+	vkUnmapMemory(dev, frame.draws_buf.mem);
+	frame.cmds_buf.free(dev);
+	frame.draws_buf.free(dev);
+
+	frame.cmds_ptr = nullptr;
+	frame.draws_ptr = nullptr;
+}
+
 void ChunkRenderer::draw_chunks (VulkanWindowContext& ctx, VkCommandBuffer cmds, Game& game, int cur_frame) {
 	ZoneScoped;
 
@@ -64,27 +143,7 @@ void ChunkRenderer::draw_chunks (VulkanWindowContext& ctx, VkCommandBuffer cmds,
 	{
 		ZoneScopedN("chunk culling pass");
 
-		for (auto& a : allocs) {
-			a.draw_lists[0].count = 0;
-			a.draw_lists[1].count = 0;
-		}
-
-		auto push_draw_slices = [&] (chunk_id cid, uint32_t vertex_count, slice_id slices, DrawType type) {
-			uint32_t remain_count = vertex_count;
-			slice_id sliceid = slices;
-			while (remain_count > 0) {
-				uint16_t alloci = sliceid / (uint32_t)SLICES_PER_ALLOC;
-				uint16_t slicei = sliceid % (uint32_t)SLICES_PER_ALLOC;
-
-				auto& draw_list = allocs[alloci].draw_lists[type];
-
-				auto draw_vertex_count = (uint16_t)std::min(remain_count, (uint32_t)CHUNK_SLICE_LENGTH);
-				draw_list.slices[draw_list.count++] = { draw_vertex_count, slicei, cid };
-
-				remain_count -= draw_vertex_count;
-				sliceid = chunks.slices[sliceid].next;
-			}
-		};
+		float3 cam_pos = cull_view.cam_to_world * float3(0);
 
 		lrgba cols[] = {
 			srgba(0, 0, 255, 255),
@@ -95,64 +154,88 @@ void ChunkRenderer::draw_chunks (VulkanWindowContext& ctx, VkCommandBuffer cmds,
 		if (chunks.debug_frustrum_culling)
 			g_debugdraw.wire_frustrum(cull_view, srgba(141,41,234));
 
-		for (chunk_id cid=0; cid<chunks.end(); ++cid) {
-			auto& chunk = chunks[cid];
-			if (chunk.flags == 0) continue;
+		chunks.culler->cull(cull_view.frustrum);
 
-			bool empty = chunk.opaque_mesh_vertex_count == 0 && chunk.transp_mesh_vertex_count == 0;
+		auto* visible_chunks = &chunks.culler->visible;
+		if (chunks.cave_culling) {
+			chunks.visibility->update(chunks, chunks.culler->visible, cam_pos);
+			visible_chunks = &chunks.visibility->visible;
+		}
+		if (chunks.occlusion_culling) {
+			chunks.occlusion->update(chunks, cull_view, *visible_chunks);
+			visible_chunks = &chunks.occlusion->visible;
+		}
 
-			float3 lo = (float3)(chunk.pos * CHUNK_SIZE);
-			float3 hi = (float3)((chunk.pos + 1) * CHUNK_SIZE);
+		if (chunks.debug_frustrum_culling || chunks.visualize_chunks) {
+			std::vector<bool> visible(chunks.end(), false);
+			for (chunk_id cid : *visible_chunks)
+				visible[cid] = true;
 
-			bool culled = empty || frustrum_cull_aabb(cull_view.frustrum, lo.x, lo.y, lo.z, hi.x, hi.y, hi.z);
-			
-			chunks.visualize_chunk(cid, chunk, empty, culled);
+			for (chunk_id cid=0; cid < chunks.end(); ++cid) {
+				auto& chunk = chunks[cid];
+				if (chunk.flags == 0) continue;
 
-			if (!culled) {
-				push_draw_slices(cid, chunk.opaque_mesh_vertex_count, chunk.opaque_mesh_slices, DT_OPAQUE);
-				push_draw_slices(cid, chunk.transp_mesh_vertex_count, chunk.transp_mesh_slices, DT_TRANSPARENT);
+				bool empty = chunk.mesh_vertex_count() == 0;
+				chunks.visualize_chunk(cid, chunk, empty, empty || !visible[cid]);
 			}
 		}
+
+		draw_cmds.build(chunks, *visible_chunks, cam_pos);
 	}
 
-	auto draw_slices = [&] (VkPipeline pipeline, DrawType type, int& drawcount) {
+	{
+		ZoneScopedN("upload draw commands");
+
+		// the buffers of this frame are no longer read by the gpu at this point
+		uint32_t count = (uint32_t)draw_cmds.cmds.size();
+		reserve_draws(ctx, frame, count);
+
+		memcpy(frame.cmds_ptr, draw_cmds.cmds.data(), count * sizeof(ChunkDrawCommands::DrawCmd));
+		memcpy(frame.draws_ptr, draw_cmds.draws.data(), count * sizeof(ChunkDrawCommands::DrawData));
+
+		vkCmdBindDescriptorSets(cmds, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1,
+			&frame.draws_descriptor_set, 0, nullptr);
+	}
+
+	auto draw_slices = [&] (VkPipeline pipeline, ChunkDrawCommands::DrawType type, int& drawcount) {
 		vkCmdBindPipeline(cmds, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
 		drawcount = 0;
 
-		for (auto& alloc : allocs) {
-			auto& draw_list = alloc.draw_lists[type];
-			if (draw_list.count > 0) {
-
-				VkBuffer vertex_bufs[] = { alloc.mesh_data.buf };
-				VkDeviceSize offsets[] = { 0 };
-				vkCmdBindVertexBuffers(cmds, 0, 1, vertex_bufs, offsets);
+		for (int alloci=0; alloci<draw_cmds.page_count; ++alloci) {
+			auto& range = draw_cmds.range(alloci, type);
+			if (range.count == 0) continue;
 
-				for (int i=0; i<draw_list.count; ++i) {
-					auto& draw = draw_list.slices[i];
+			VkBuffer vertex_bufs[] = { allocs[alloci].mesh_data.buf };
+			VkDeviceSize offsets[] = { 0 };
+			vkCmdBindVertexBuffers(cmds, 0, 1, vertex_bufs, offsets);
 
-					float3 chunk_pos = (float3)(chunks.chunks[draw.chunk].pos * CHUNK_SIZE);
-					vkCmdPushConstants(cmds, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(float3), &chunk_pos);
+			// gl_DrawIndex restarts at 0 for every vkCmdDrawIndirect
+			vkCmdPushConstants(cmds, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &range.offset);
 
-					vkCmdDraw(cmds, BlockMeshes::MERGE_INSTANCE_FACTOR, draw.vertex_count, 0, draw.slice_idx * CHUNK_SLICE_LENGTH);
-				}
+			vkCmdDrawIndirect(cmds, frame.cmds_buf.buf, range.offset * sizeof(ChunkDrawCommands::DrawCmd),
+				range.count, sizeof(ChunkDrawCommands::DrawCmd));
 
-				drawcount += draw_list.count;
-			}
+			drawcount += range.count;
 		}
 
 		ZoneValue(drawcount);
 	};
 
+	{
+		ZoneScopedN("chunk draw faces");
+		VK_TRACE(ctx, cmds, "chunk draw faces");
+		draw_slices(faces_pipeline->pipeline, ChunkDrawCommands::DT_FACES, drawcount_faces);
+	}
 	{
 		ZoneScopedN("chunk draw opaque");
 		VK_TRACE(ctx, cmds, "chunk draw opaque");
-		draw_slices(opaque_pipeline->pipeline, DT_OPAQUE, drawcount_opaque);
+		draw_slices(opaque_pipeline->pipeline, ChunkDrawCommands::DT_OPAQUE, drawcount_opaque);
 	}
 	{
 		ZoneScopedN("chunk draw transparent");
 		VK_TRACE(ctx, cmds, "chunk draw transparent");
-		draw_slices(transparent_pipeline->pipeline, DT_TRANSPARENT, drawcount_transparent);
+		draw_slices(transparent_pipeline->pipeline, ChunkDrawCommands::DT_TRANSPARENT, drawcount_transparent);
 	}
 }
 
@@ -5,78 +5,87 @@
 #include "vulkan_shaders.hpp"
 #include "assets.hpp"
 #include "game.hpp"
+#include "chunk_draw_commands.hpp"
 
 namespace vk {
 
 class VulkanRenderer;
 
 struct ChunkRenderer {
-	static constexpr uint64_t ALLOC_SIZE = 64 * (1024ull * 1024); // size of vram allocations
-	static constexpr int SLICES_PER_ALLOC = (int)(ALLOC_SIZE / CHUNK_SLICE_BYTESIZE);
+	static constexpr uint64_t ALLOC_SIZE = (uint64_t)MESH_PAGE_UNITS * MESH_UNIT; // size of vram allocations, one per Chunks::mesh_heap page
 
-	enum DrawType { DT_OPAQUE=0, DT_TRANSPARENT=1 };
-	
 	struct AllocBlock {
 		Allocation		mesh_data;
-
-		struct DrawList {
-			struct DrawSlice {
-				uint16_t	vertex_count;
-				uint16_t	slice_idx; // in alloc (not global slice id)
-				chunk_id	chunk;
-			};
-			int				count;
-			DrawSlice		slices[SLICES_PER_ALLOC];
-		};
-
-		DrawList		draw_lists[2];
 	};
 
 	struct FrameData {
-		int slices_end;
+		int pages_end = 0; // allocs referenced by this frame
+
+		// ChunkDrawCommands of this frame, host visible and persistently mapped, grown on demand
+		Allocation		cmds_buf;
+		Allocation		draws_buf;
+		void*			cmds_ptr = nullptr;
+		void*			draws_ptr = nullptr;
+		uint32_t		draws_capacity = 0;
+
+		// set 1: draws_buf as storage buffer of ChunkDrawCommands::DrawData { vec3 chunk_pos; float voxel_scale; } (same layout as the gl Draw struct)
+		// indexed with the push constant draw offset + gl_DrawIndex, voxel_scale scales the coarse voxel positions of lod meshes like in the gl shader
+		VkDescriptorSet	draws_descriptor_set;
 	};
 
 	std_vector<AllocBlock>	allocs;
 	std_vector<FrameData>	frames;
 
+	// rebuilt by the culling pass every frame, each alloc and draw type is drawn with one vkCmdDrawIndirect
+	ChunkDrawCommands		draw_cmds;
+
+	VkDescriptorSetLayout	draws_descriptor_layout;
+	VkDescriptorPool		descriptor_pool;
+
 	VkPipelineLayout		pipeline_layout;
+	Pipeline*				faces_pipeline;
 	Pipeline*				opaque_pipeline;
 	Pipeline*				transparent_pipeline;
 
+	int						drawcount_faces = 0;
 	int						drawcount_opaque = 0;
 	int						drawcount_transparent = 0;
 
 	void imgui (Chunks& chunks) {
 		
 		size_t vertices = 0;
-		size_t slices_total = 0;
+		size_t bytes = 0;
+		size_t meshes_total = 0;
+		size_t slices_total = 0; // what the old fixed size slice allocation would have needed
 		for (chunk_id cid=0; cid<chunks.end(); ++cid) {
-			if (chunks[cid].flags == 0) continue;
+			auto& chunk = chunks[cid];
+			if (chunk.flags == 0) continue;
 			
-			vertices += chunks[cid].opaque_mesh_vertex_count;
-			vertices += chunks[cid].transp_mesh_vertex_count;
+			vertices += chunk.mesh_vertex_count();
+			bytes += chunk.mesh_bytes();
 
-			slices_total += _slices_count(chunks[cid].opaque_mesh_vertex_count);
-			slices_total += _slices_count(chunks[cid].transp_mesh_vertex_count);
+			meshes_total += (chunk.face_mesh_vertex_count > 0) + (chunk.opaque_mesh_vertex_count > 0) + (chunk.transp_mesh_vertex_count > 0);
+
+			slices_total += _slices_count(chunk.face_mesh_vertex_count, FACE_SLICE_LENGTH);
+			slices_total += _slices_count(chunk.opaque_mesh_vertex_count);
+			slices_total += _slices_count(chunk.transp_mesh_vertex_count);
 		}
 		
 		ImGui::Separator();
 
-		ImGui::Text("Drawcalls: opaque: %3d  transparent: %3d (%3d / %3d slices - %3.0f%%)",
-			drawcount_opaque, drawcount_transparent, drawcount_opaque + drawcount_transparent,
-			slices_total, (float)(drawcount_opaque + drawcount_transparent) / slices_total * 100);
+		int drawcount = drawcount_faces + drawcount_opaque + drawcount_transparent;
+		ImGui::Text("Draws: faces: %3d  opaque: %3d  transparent: %3d (%3d / %3d meshes - %3.0f%%)",
+			drawcount_faces, drawcount_opaque, drawcount_transparent, drawcount,
+			meshes_total, (float)drawcount / meshes_total * 100);
+		draw_cmds.imgui();
 		
-		ImGui::Text("Mesh allocs: %2d  slices: %5d  vertices: %12s",
-			allocs.size(), slices_total, format_thousands(vertices).c_str());
-		ImGui::Text("Mesh VRAM: used: %7.3f MB  commited: %7.3f MB (%6.2f%% usage)",
-			(float)(vertices * sizeof(BlockMeshInstance)) / 1024 / 1024,
+		ImGui::Text("Mesh allocs: %2d  meshes: %5d  vertices: %12s",
+			allocs.size(), meshes_total, format_thousands(vertices).c_str());
+		ImGui::Text("Mesh VRAM: used: %7.3f MB  commited: %7.3f MB (%6.2f%% usage)  fixed slices would need: %7.3f MB",
+			(float)bytes / 1024 / 1024,
 			(float)(allocs.size() * ALLOC_SIZE) / 1024 / 1024,
-			(float)(vertices * sizeof(BlockMeshInstance)) / (float)(allocs.size() * ALLOC_SIZE) * 100);
-		
-		if (ImGui::TreeNode("slices alloc")) {
-			print_bitset_allocator(chunks.slices.slots, CHUNK_SLICE_BYTESIZE, ALLOC_SIZE);
-			ImGui::TreePop();
-		}
+			(float)bytes / (float)(allocs.size() * ALLOC_SIZE) * 100,
+			(float)(slices_total * CHUNK_SLICE_SIZE) / 1024 / 1024);
 		
 	}
 
@@ -86,10 +95,10 @@ struct ChunkRenderer {
 		AllocBlock alloc;
 
 		alloc.mesh_data = allocate_buffer(ctx.dev, ctx.pdev, ALLOC_SIZE,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		GPU_DBG_NAMEf(ctx, alloc.mesh_data.buf, "slices.allocs[%d].mesh_data", allocs.size());
-		GPU_DBG_NAMEf(ctx, alloc.mesh_data.mem, "slices.allocs[%d].mesh_mem", allocs.size());
+		GPU_DBG_NAMEf(ctx, alloc.mesh_data.buf, "ChunkRenderer.allocs[%d].mesh_data", allocs.size());
+		GPU_DBG_NAMEf(ctx, alloc.mesh_data.mem, "ChunkRenderer.allocs[%d].mesh_mem", allocs.size());
 
 		allocs.push_back(alloc);
 	}
@@ -98,10 +107,60 @@ struct ChunkRenderer {
 		alloc.mesh_data.free(dev);
 	}
 
+	void create_draws_descriptors (VulkanWindowContext& ctx) {
+		{
+			VkDescriptorSetLayoutBinding binding = {};
+			binding.binding = 0;
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			binding.descriptorCount = 1;
+			binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+			VkDescriptorSetLayoutCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			info.bindingCount = 1;
+			info.pBindings = &binding;
+
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(ctx.dev, &info, nullptr, &draws_descriptor_layout));
+			GPU_DBG_NAME(ctx, draws_descriptor_layout, "ChunkRenderer.draws_descriptor_layout");
+		}
+		{
+			VkDescriptorPoolSize size = {};
+			size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			size.descriptorCount = (uint32_t)frames.size();
+
+			VkDescriptorPoolCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			info.poolSizeCount = 1;
+			info.pPoolSizes = &size;
+			info.maxSets = (uint32_t)frames.size();
+
+			VK_CHECK_RESULT(vkCreateDescriptorPool(ctx.dev, &info, nullptr, &descriptor_pool));
+			GPU_DBG_NAME(ctx, descriptor_pool, "ChunkRenderer.descriptor_pool");
+		}
+		for (auto& f : frames) {
+			VkDescriptorSetAllocateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			info.descriptorPool = descriptor_pool;
+			info.descriptorSetCount = 1;
+			info.pSetLayouts = &draws_descriptor_layout;
+
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(ctx.dev, &info, &f.draws_descriptor_set));
+
+			reserve_draws(ctx, f, 4096);
+		}
+	}
+
+	// (re)allocate the draw buffers of a frame to fit count draws, only called once the frame is no longer in flight
+	void reserve_draws (VulkanWindowContext& ctx, FrameData& frame, uint32_t count);
+	void free_draws (VkDevice dev, FrameData& frame);
+
 	void create (VulkanWindowContext& ctx, PipelineManager& pipelines, VkRenderPass main_renderpass, VkDescriptorSetLayout common, int frames_in_flight) {
 		frames.resize(frames_in_flight);
 
-		pipeline_layout = create_pipeline_layout(ctx.dev, { common }, {{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(float3) }});
+		create_draws_descriptors(ctx);
+
+		// set 1 holds the per draw data, the push constant is the first draw of the current vkCmdDrawIndirect (gl_DrawIndex restarts at 0 for each)
+		pipeline_layout = create_pipeline_layout(ctx.dev, { common, draws_descriptor_layout }, {{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t) }});
 		GPU_DBG_NAME(ctx, pipeline_layout, "ChunkRenderer.pipeline_layout");
 
 		auto attribs = make_attribs<BlockMeshInstance>();
@@ -110,6 +169,11 @@ struct ChunkRenderer {
 		opt.alpha_blend = false;
 		opt.depth_test = true;
 		opt.color_attachments = 2;
+		{
+			auto face_attribs = make_attribs<FaceInstance>();
+			auto cfg = PipelineConfig("vk/chunks", pipeline_layout, main_renderpass, 0, opt, face_attribs, {{"ALPHA_TEST", "1"}, {"FACE_INSTANCES", "1"}});
+			faces_pipeline = pipelines.create_pipeline(ctx, "ChunkRenderer.faces_pipeline", cfg);
+		}
 		{
 			auto cfg = PipelineConfig("vk/chunks", pipeline_layout, main_renderpass, 0, opt, attribs, {{"ALPHA_TEST", "1"}});
 			opaque_pipeline = pipelines.create_pipeline(ctx, "ChunkRenderer.opaque_pipeline", cfg);
@@ -124,8 +188,12 @@ struct ChunkRenderer {
 	void destroy (VkDevice dev) {
 		for (auto& a : allocs)
 			free_alloc(dev, a);
+		for (auto& f : frames)
+			free_draws(dev, f);
 
 		vkDestroyPipelineLayout(dev, pipeline_layout, nullptr);
+		vkDestroyDescriptorPool(dev, descriptor_pool, nullptr);
+		vkDestroyDescriptorSetLayout(dev, draws_descriptor_layout, nullptr);
 	}
 
 	void upload_remeshed (VulkanRenderer& r, Chunks& chunks, VkCommandBuffer cmds, int cur_frame);
@@ -23,6 +23,8 @@ void VulkanRenderer::frame_begin (GLFWwindow* window, Input& I, kiss::ChangedFil
 	vkWaitForFences(ctx.dev, 1, &frame.fence, VK_TRUE, UINT64_MAX);
 	vkResetFences(ctx.dev, 1, &frame.fence);
 
+	staging.begin_frame(ctx.dev, cur_frame);
+
 	vkResetCommandPool(ctx.dev, frame.command_pool, 0);
 
 	ctx.aquire_image(frame.image_available_semaphore);
@@ -2,11 +2,11 @@
 #include "common.hpp"
 #include "vulkan_helper.hpp"
 #include "vulkan_window.hpp"
+#include "engine/ring_allocator.hpp"
 
 namespace vk {
 
-static constexpr VkDeviceSize STAGING_BUF_SIZE = 1 * (1024ull * 1024);
-static constexpr int MIN_STAGING_BUFS = 1; // keep n staging bufs alive to reduce number of allocations every frame
+static constexpr VkDeviceSize STAGING_RING_SIZE = 64 * (1024ull * 1024);
 
 struct MappedAllocation {
 	VkBuffer		buf;
@@ -22,7 +22,7 @@ struct MappedAllocation {
 		GPU_DBG_NAME(ctx, buf.mem, name);
 
 		void* ptr;
-		vkMapMemory(ctx.dev, buf.mem, 0, STAGING_BUF_SIZE, 0, &ptr);
+		vkMapMemory(ctx.dev, buf.mem, 0, size, 0, &ptr);
 
 		return { buf.buf, buf.mem, ptr };
 	}
@@ -35,89 +35,99 @@ struct MappedAllocation {
 	}
 };
 
+// Persistently mapped staging ring buffer, the RingAllocator fences are frame numbers
+// a frame is done reading its region once the fence of its frame slot was waited on, which happens in begin_frame
 struct StagingBuffers {
 	
 	struct FrameData {
-		std_vector<MappedAllocation> staging_bufs;
+		uint64_t frame_number = 0; // last frame recorded in this slot
+
+		// for the rare frame that uploads more than fits into the ring, freed once the slot comes around again
+		std_vector<MappedAllocation> overflow_bufs;
 	};
 
+	MappedAllocation		ring_buf;
+	RingAllocator			ring;
+
 	std_vector<FrameData>	frames;
+	uint64_t				frame_number = 0;
+
+	int						overflows = 0; // total number of overflow buffers allocated
 
 	void imgui () {
-		ImGui::Text("Staging bufs [frames]:");
-		for (auto& f : frames) {
-			ImGui::SameLine();
-			ImGui::Text(" %d", f.staging_bufs.size());
-		}
+		ImGui::Text("Staging ring: %7.3f / %7.3f MB in use  overflow bufs: %d",
+			(float)ring.used() / 1024 / 1024, (float)STAGING_RING_SIZE / 1024 / 1024, overflows);
 	}
 
 	void create (VulkanWindowContext& ctx, int frames_in_flight) {
 		frames.resize(frames_in_flight);
+
+		ring_buf = MappedAllocation::alloc("staging_ring", ctx, STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		ring.init(STAGING_RING_SIZE);
 	}
 	void destroy (VkDevice dev) {
+		ring_buf.free(dev);
 		for (auto& f : frames) {
-			for (auto& buf : f.staging_bufs)
+			for (auto& buf : f.overflow_bufs)
 				buf.free(dev);
 		}
 	}
 
-	void new_staging_buffer (VulkanWindowContext& ctx, int cur_frame) {
-		frames[cur_frame].staging_bufs.emplace_back(
-			MappedAllocation::alloc(
-				prints("staging_buf[%d][%d]", cur_frame, (int)frames[cur_frame].staging_bufs.size()).c_str(),
-				ctx, STAGING_BUF_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
-		);
-	}
-
-	VkDeviceSize avail_size = 0; // remaining size in current staging buffer
-	int used_bufs = 0; // number of staging buffers used this frame (there can be more allocated if I want to keep them alive to reduce allocs)
-
-	void staged_copy (VulkanWindowContext& ctx, VkCommandBuffer cmds, int cur_frame,
-			void* data, VkDeviceSize size, VkBuffer dst_buf, VkDeviceSize dst_offs) {
+	// must call after the fence of cur_frame was waited on
+	void begin_frame (VkDevice dev, int cur_frame) {
 		auto& frame = frames[cur_frame];
 
-		VkDeviceSize read_ptr = 0;
-		while (read_ptr < size) {
-			if (avail_size == 0) {
-				if (used_bufs == frame.staging_bufs.size())
-					new_staging_buffer(ctx, cur_frame);
+		// frames finish in order, so everything up to the last frame in this slot is done
+		uint64_t done = frame.frame_number;
+		ring.retire([&] (uint64_t fence) { return fence <= done; });
 
-				used_bufs++;
-				avail_size = STAGING_BUF_SIZE;
-			}
+		for (auto& buf : frame.overflow_bufs)
+			buf.free(dev);
+		frame.overflow_bufs.clear();
 
-			VkDeviceSize copy_size = std::min(avail_size, size - read_ptr);
+		frame.frame_number = ++frame_number;
+	}
 
-			auto& buf = frame.staging_bufs[used_bufs-1];
+	void staged_copy (VulkanWindowContext& ctx, VkCommandBuffer cmds, int cur_frame,
+			void* data, VkDeviceSize size, VkBuffer dst_buf, VkDeviceSize dst_offs) {
+		if (size == 0) return;
+		auto& frame = frames[cur_frame];
 
-			VkDeviceSize buf_offs = STAGING_BUF_SIZE - avail_size;
-			memcpy((char*)buf.mapped_ptr + buf_offs, (char*)data + read_ptr, copy_size);
-			
-			VkBufferCopy copy_region = {};
-			copy_region.srcOffset = buf_offs;
-			copy_region.dstOffset = dst_offs + read_ptr;
-			copy_region.size = copy_size;
-			vkCmdCopyBuffer(cmds, buf.buf, dst_buf, 1, &copy_region);
+		VkBuffer src_buf;
+		VkDeviceSize src_offs;
 
-			read_ptr += copy_size;
-			avail_size -= copy_size;
+		uint64_t offs = size <= STAGING_RING_SIZE ? ring.alloc(size) : RingAllocator::FAILED;
+		if (offs != RingAllocator::FAILED) {
+			memcpy((char*)ring_buf.mapped_ptr + offs, data, size);
+			src_buf = ring_buf.buf;
+			src_offs = offs;
+		}
+		else {
+			// can't wait for the gpu in the middle of recording a frame
+			overflows++;
+			frame.overflow_bufs.emplace_back(
+				MappedAllocation::alloc(
+					prints("staging_overflow[%d][%d]", cur_frame, (int)frame.overflow_bufs.size()).c_str(),
+					ctx, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+			);
+			auto& buf = frame.overflow_bufs.back();
+			memcpy(buf.mapped_ptr, data, size);
+			src_buf = buf.buf;
+			src_offs = 0;
 		}
+
+		VkBufferCopy copy_region = {};
+		copy_region.srcOffset = src_offs;
+		copy_region.dstOffset = dst_offs;
+		copy_region.size = size;
+		vkCmdCopyBuffer(cmds, src_buf, dst_buf, 1, &copy_region);
 	}
 
 	// must call after all staged_copy calls every frame
 	void update_buffer_alloc (VulkanWindowContext& ctx, int cur_frame) {
-		ZoneScopedC(tracy::Color::Crimson);
-		
-		auto& frame = frames[cur_frame];
-
-		while ((int)frame.staging_bufs.size() > max(used_bufs, MIN_STAGING_BUFS)) {
-			frame.staging_bufs.back().free(ctx.dev);
-			frame.staging_bufs.pop_back();
-		}
-
-		avail_size = 0;
-		used_bufs = 0;
+		ring.submit(frames[cur_frame].frame_number);
 	}
 };
 
@@ -209,7 +209,7 @@ VkInstance create_instance (char const* app_name, PFN_vkDebugUtilsMessengerCallb
 	app_info.applicationVersion = VK_MAKE_VERSION(1,0,0);
 	app_info.pEngineName = "No Engine";
 	app_info.engineVersion = VK_MAKE_VERSION(1,0,0);
-	app_info.apiVersion = VK_API_VERSION_1_0;
+	app_info.apiVersion = VK_API_VERSION_1_1; // for VkPhysicalDeviceShaderDrawParametersFeatures
 
 	VkInstanceCreateInfo info = {};
 	info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -392,9 +392,15 @@ VkDevice create_logical_device (VkPhysicalDevice pdev, std_vector<char const*> c
 	features.multiDrawIndirect = VK_TRUE; // 99.5% support  https://vulkan.gpuinfo.org/listdevicescoverage.php?feature=multiDrawIndirect&platform=windows&option=not
 
 	features.fillModeNonSolid = VK_TRUE;  // 100% support   https://vulkan.gpuinfo.org/listdevicescoverage.php?feature=fillModeNonSolid&platform=windows
+
+	// gl_DrawIndex in the chunk shaders, which index the per draw data of the multidraws with it
+	VkPhysicalDeviceShaderDrawParametersFeatures draw_params = {};
+	draw_params.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_DRAW_PARAMETERS_FEATURES;
+	draw_params.shaderDrawParameters = VK_TRUE;
 	
 	VkDeviceCreateInfo info = {};
 	info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	info.pNext = &draw_params;
 	info.queueCreateInfoCount = (uint32_t)count;
 	info.pQueueCreateInfos = q_infos;
 	info.pEnabledFeatures = &features;
@@ -14,7 +14,8 @@ __m128 lerp (__m128 a, __m128 b, float t) {
 
 namespace worldgen {
 
-	float NoisePass::calc_large_noise (float3 const& pos) {
+	template <typename LARGE>
+	float TerrainNoise::calc_large_noise (float3 const& pos) {
 		float depth = wg->base_depth;
 		
 		//float sphere = (length(pos) - 180) * 1.0f; // for VCT dev
@@ -25,7 +26,7 @@ namespace worldgen {
 		p.z *= wg->large_noise_flatten;
 
 		float seed = 0;
-		apply_noise_layers(depth, seed, p, wg->large_noise);
+		apply_noise_layers(LARGE(), depth, seed, p, wg->large_noise);
 		
 		// smaller ridges in wall
 		float cut = noise(pos / float3(4,4,1), 15, seed++);
@@ -34,7 +35,8 @@ namespace worldgen {
 		return depth;
 	}
 
-	BlockID NoisePass::cave_noise (float3 const& pos, float large_noise, float3 const& normal) {
+	template <typename SMALL>
+	BlockID TerrainNoise::cave_noise (float3 const& pos, float large_noise, float3 const& normal) {
 		float depth = large_noise;
 		
 		// small scale
@@ -42,10 +44,42 @@ namespace worldgen {
 		
 		float3 p = pos; // Only sue for noise layers
 		p.z *= wg->small_noise_flatten;
-		apply_noise_layers(depth, seed, p, wg->small_noise);
+		apply_noise_layers(SMALL(), depth, seed, p, wg->small_noise);
 
 		float modifer = noise01(pos / float3(1,1,3), 14, seed++);
+
+		return cave_block(pos, depth, modifer, normal, seed);
+	}
+
+	template <int... LAYERS>
+	void TerrainNoise::cave_noise8 (NoiseLayerPreset<LAYERS...>, int3 const& pos, float const* large_noise, float3 const* normals, BlockID* bids) {
+		__m256 x = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(pos.x), _mm256_setr_epi32(0,1,2,3,4,5,6,7)));
+		__m256 y = _mm256_set1_ps((float)pos.y);
+		__m256 z = _mm256_set1_ps((float)pos.z);
+
+		__m256 depth = _mm256_loadu_ps(large_noise);
 		
+		// small scale
+		float seed = (float)wg->large_noise.size();
+		
+		__m256 pz = _mm256_mul_ps(z, _mm256_set1_ps(wg->small_noise_flatten));
+		apply_noise_layers8(NoiseLayerPreset<LAYERS...>(), depth, seed, x, y, pz, wg->small_noise);
+
+		__m256 modifer = noise01_8(x, y, _mm256_div_ps(z, _mm256_set1_ps(3)), 14, seed++);
+
+		float depths[8], modifers[8];
+		_mm256_storeu_ps(depths, depth);
+		_mm256_storeu_ps(modifers, modifer);
+
+		for (int i=0; i<8; ++i) {
+			if (large_noise[i] < wg->max_depth)
+				bids[i] = cave_block(float3((float)(pos.x + i), (float)pos.y, (float)pos.z), depths[i], modifers[i], normals[i], seed);
+			else
+				bids[i] = B_UNBREAKIUM;
+		}
+	}
+
+	BlockID TerrainNoise::cave_block (float3 const& pos, float depth, float modifer, float3 const& normal, float seed) {
 		//float ground = wall;
 		//float ground = clamp(0.3f - abs(normal.z));
 
@@ -117,37 +151,62 @@ namespace worldgen {
 		return *(float3*)&res.m128_f32[1];
 	}
 
+	static const bool noise_avx2 = cpu_has_avx2();
+
 	void NoisePass::generate () {
-		ZoneScoped;
+		specialized = LargeNoisePreset::matches(wg->large_noise) && SmallNoisePreset::matches(wg->small_noise);
 
-		int3 chunkpos = chunk_pos * CHUNK_SIZE;
+		if (lod > 0) {
+			if (specialized)
+				generate_lod<LargeNoisePreset, SmallNoisePreset>();
+			else
+				generate_lod<DynamicNoiseLayers, DynamicNoiseLayers>();
+		} else {
+			if (specialized && noise_avx2)
+				generate8<LargeNoisePreset, SmallNoisePreset>();
+			else if (specialized)
+				generate<LargeNoisePreset, SmallNoisePreset>();
+			else
+				generate<DynamicNoiseLayers, DynamicNoiseLayers>();
+		}
+	}
 
-		{ // large noise generate
-			ZoneScopedN("large noise generate");
+	template <typename LARGE>
+	void NoisePass::generate_large_noise () {
+		ZoneScoped;
 
-			float3 pos_world;
+		int3 chunkpos = chunk_pos * CHUNK_SIZE;
+		float3 pos_world;
 
-			for (int z=0; z<LARGE_NOISE_COUNT; ++z) {
-				pos_world.z = (float)(z * LARGE_NOISE_SIZE + chunkpos.z);
+		for (int z=0; z<LARGE_NOISE_COUNT; ++z) {
+			pos_world.z = (float)(z * LARGE_NOISE_SIZE + chunkpos.z);
 
-				for (int y=0; y<LARGE_NOISE_COUNT; ++y) {
-					pos_world.y = (float)(y * LARGE_NOISE_SIZE + chunkpos.y);
+			for (int y=0; y<LARGE_NOISE_COUNT; ++y) {
+				pos_world.y = (float)(y * LARGE_NOISE_SIZE + chunkpos.y);
 
-					for (int x=0; x<LARGE_NOISE_COUNT; ++x) {
-						pos_world.x = (float)(x * LARGE_NOISE_SIZE + chunkpos.x);
+				for (int x=0; x<LARGE_NOISE_COUNT; ++x) {
+					pos_world.x = (float)(x * LARGE_NOISE_SIZE + chunkpos.x);
 
-						float val = calc_large_noise(pos_world);
-						
-						// calculate negative numerical derivative, with 1 block offsets
-						float dx = val - calc_large_noise(pos_world + float3(1,0,0));
-						float dy = val - calc_large_noise(pos_world + float3(0,1,0));
-						float dz = val - calc_large_noise(pos_world + float3(0,0,1));
+					float val = calc_large_noise<LARGE>(pos_world);
+					
+					// calculate negative numerical derivative, with 1 block offsets
+					float dx = val - calc_large_noise<LARGE>(pos_world + float3(1,0,0));
+					float dy = val - calc_large_noise<LARGE>(pos_world + float3(0,1,0));
+					float dz = val - calc_large_noise<LARGE>(pos_world + float3(0,0,1));
 
-						_mm_store_ps(large_noise[z][y][x], _mm_set_ps(dz,dy,dx, val));
-					}
+					_mm_store_ps(large_noise[z][y][x], _mm_set_ps(dz,dy,dx, val));
 				}
 			}
 		}
+	}
+
+	template <typename LARGE, typename SMALL>
+	void NoisePass::generate () {
+		ZoneScoped;
+
+		int3 chunkpos = chunk_pos * CHUNK_SIZE;
+
+		generate_large_noise<LARGE>();
 
 		{ // 3d noise generate
 			ZoneScopedN("3d noise generate");
@@ -202,7 +261,7 @@ namespace worldgen {
 							if (large_noise < wg->max_depth) {
 								float3 normal = large_noise_normalize_derivative(ln);
 
-								bid = cave_noise(pos_world, large_noise, normal);
+								bid = cave_noise<SMALL>(pos_world, large_noise, normal);
 							}
 							voxels[cz][cy][cx] = wg->bids[bid];
 						}
@@ -213,6 +272,187 @@ namespace worldgen {
 
 	}
 
+	template <typename LARGE, typename SMALL>
+	void NoisePass::generate8 () {
+		ZoneScoped;
+
+		int3 chunkpos = chunk_pos * CHUNK_SIZE;
+
+		generate_large_noise<LARGE>();
+
+		{ // 3d noise generate, rows along x in groups of 8 voxels
+			ZoneScopedN("3d noise generate avx2");
+
+			float	row_large_noise[CHUNK_SIZE];
+			float3	row_normals[CHUNK_SIZE];
+
+			for (int cz=0; cz<CHUNK_SIZE; cz++) {
+				int lz = cz / LARGE_NOISE_SIZE;
+				float tz = (float)(cz % LARGE_NOISE_SIZE) / LARGE_NOISE_SIZE;
+
+				for (int cy=0; cy<CHUNK_SIZE; cy++) {
+					int ly = cy / LARGE_NOISE_SIZE;
+					float ty = (float)(cy % LARGE_NOISE_SIZE) / LARGE_NOISE_SIZE;
+
+					// interpolate low-res large noise in the same order as generate
+					for (int lx=0; lx<LARGE_NOISE_CHUNK_SIZE; ++lx) {
+						auto ln00 = lerp(_mm_load_ps(large_noise[lz  ][ly  ][lx  ]), _mm_load_ps(large_noise[lz+1][ly  ][lx  ]), tz);
+						auto ln01 = lerp(_mm_load_ps(large_noise[lz  ][ly  ][lx+1]), _mm_load_ps(large_noise[lz+1][ly  ][lx+1]), tz);
+						auto ln10 = lerp(_mm_load_ps(large_noise[lz  ][ly+1][lx  ]), _mm_load_ps(large_noise[lz+1][ly+1][lx  ]), tz);
+						auto ln11 = lerp(_mm_load_ps(large_noise[lz  ][ly+1][lx+1]), _mm_load_ps(large_noise[lz+1][ly+1][lx+1]), tz);
+						auto ln0  = lerp(ln00, ln10, ty);
+						auto ln1  = lerp(ln01, ln11, ty);
+
+						for (int x=0; x<LARGE_NOISE_SIZE; x++) {
+							float tx = (float)x / LARGE_NOISE_SIZE;
+							auto ln    = lerp(ln0, ln1, tx);
+
+							int cx = lx * LARGE_NOISE_SIZE + x;
+							row_large_noise[cx] = large_noise_get_val(ln);
+							row_normals[cx] = large_noise_normalize_derivative(ln);
+						}
+					}
+
+					for (int cx=0; cx<CHUNK_SIZE; cx += 8) {
+						BlockID bids[8];
+						cave_noise8(SMALL(), chunkpos + int3(cx, cy, cz), &row_large_noise[cx], &row_normals[cx], bids);
+
+						for (int i=0; i<8; ++i)
+							voxels[cz][cy][cx + i] = wg->bids[bids[i]];
+					}
+				}
+			}
+		}
+	}
+
+	template <typename LARGE, typename SMALL>
+	void NoisePass::generate_lod () {
+		ZoneScoped;
+
+		int3 chunkpos = chunk_pos * CHUNK_SIZE;
+
+		// large noise is already coarse, so is computed like for full chunks
+		generate_large_noise<LARGE>();
+
+		{ // 3d noise generate at lod voxel centers
+			ZoneScopedN("3d noise generate lod");
+
+			int scale = 1 << lod;
+			int n = CHUNK_SIZE >> lod;
+
+			// coarse voxels are packed into the start of voxels as n^3
+			block_id* out = &voxels[0][0][0];
+
+			float3 pos_world;
+
+			for (int z=0; z<n; ++z) {
+				float bz = (float)(z * scale) + scale * 0.5f;
+				int lz = min((int)bz / LARGE_NOISE_SIZE, LARGE_NOISE_CHUNK_SIZE-1);
+				float tz = (bz - (float)(lz * LARGE_NOISE_SIZE)) / LARGE_NOISE_SIZE;
+				pos_world.z = bz + chunkpos.z;
+
+				for (int y=0; y<n; ++y) {
+					float by = (float)(y * scale) + scale * 0.5f;
+					int ly = min((int)by / LARGE_NOISE_SIZE, LARGE_NOISE_CHUNK_SIZE-1);
+					float ty = (by - (float)(ly * LARGE_NOISE_SIZE)) / LARGE_NOISE_SIZE;
+					pos_world.y = by + chunkpos.y;
+
+					for (int x=0; x<n; ++x) {
+						float bx = (float)(x * scale) + scale * 0.5f;
+						int lx = min((int)bx / LARGE_NOISE_SIZE, LARGE_NOISE_CHUNK_SIZE-1);
+						float tx = (bx - (float)(lx * LARGE_NOISE_SIZE)) / LARGE_NOISE_SIZE;
+						pos_world.x = bx + chunkpos.x;
+
+						auto ln00 = lerp(_mm_load_ps(large_noise[lz  ][ly  ][lx  ]), _mm_load_ps(large_noise[lz+1][ly  ][lx  ]), tz);
+						auto ln01 = lerp(_mm_load_ps(large_noise[lz  ][ly  ][lx+1]), _mm_load_ps(large_noise[lz+1][ly  ][lx+1]), tz);
+						auto ln10 = lerp(_mm_load_ps(large_noise[lz  ][ly+1][lx  ]), _mm_load_ps(large_noise[lz+1][ly+1][lx  ]), tz);
+						auto ln11 = lerp(_mm_load_ps(large_noise[lz  ][ly+1][lx+1]), _mm_load_ps(large_noise[lz+1][ly+1][lx+1]), tz);
+						auto ln = lerp(lerp(ln00, ln10, ty), lerp(ln01, ln11, ty), tx);
+
+						auto large_noise = large_noise_get_val(ln);
+
+						BlockID bid = B_UNBREAKIUM;
+						if (large_noise < wg->max_depth) {
+							float3 normal = large_noise_normalize_derivative(ln);
+
+							bid = cave_noise<SMALL>(pos_world, large_noise, normal);
+						}
+						out[IDX3D(x,y,z, n)] = wg->bids[bid];
+					}
+				}
+			}
+		}
+	}
+
+	TerrainSampler::TerrainSampler (WorldGenerator const* wg): TerrainNoise{wg} {
+		specialized = LargeNoisePreset::matches(wg->large_noise) && SmallNoisePreset::matches(wg->small_noise);
+	}
+
+	template <typename LARGE>
+	TerrainSampler::LargeNoise const& TerrainSampler::get_large_noise (int3 const& grid) {
+		auto it = large_noise.find(grid);
+		if (it != large_noise.end())
+			return it->second;
+
+		// same as NoisePass::generate_large_noise, chunks are aligned to the grid, so every chunk gets the same values at a grid point
+		float3 pos_world = (float3)(grid * LARGE_NOISE_SIZE);
+
+		float val = calc_large_noise<LARGE>(pos_world);
+		float dx = val - calc_large_noise<LARGE>(pos_world + float3(1,0,0));
+		float dy = val - calc_large_noise<LARGE>(pos_world + float3(0,1,0));
+		float dz = val - calc_large_noise<LARGE>(pos_world + float3(0,0,1));
+
+		return large_noise.emplace(grid, LargeNoise{{ val, dx, dy, dz }}).first->second;
+	}
+
+	template <typename LARGE, typename SMALL>
+	BlockID TerrainSampler::sample (int3 const& pos_world) {
+		static_assert(LARGE_NOISE_SIZE == 4, "");
+		int3 grid = int3(pos_world.x >> 2, pos_world.y >> 2, pos_world.z >> 2); // floor division
+		int3 offs = pos_world - grid * LARGE_NOISE_SIZE;
+
+		auto load = [&] (int x, int y, int z) {
+			return _mm_loadu_ps(get_large_noise<LARGE>(grid + int3(x,y,z)).val);
+		};
+
+		// interpolate in the same order as NoisePass::generate
+		float tz = (float)offs.z / LARGE_NOISE_SIZE;
+		float ty = (float)offs.y / LARGE_NOISE_SIZE;
+		float tx = (float)offs.x / LARGE_NOISE_SIZE;
+		auto ln00 = lerp(load(0,0,0), load(0,0,1), tz);
+		auto ln01 = lerp(load(1,0,0), load(1,0,1), tz);
+		auto ln10 = lerp(load(0,1,0), load(0,1,1), tz);
+		auto ln11 = lerp(load(1,1,0), load(1,1,1), tz);
+		auto ln0  = lerp(ln00, ln10, ty);
+		auto ln1  = lerp(ln01, ln11, ty);
+		auto ln   = lerp(ln0, ln1, tx);
+
+		float val = large_noise_get_val(ln);
+		if (val >= wg->max_depth)
+			return B_UNBREAKIUM;
+
+		float3 normal = large_noise_normalize_derivative(ln);
+
+		if constexpr (!std::is_same_v<SMALL, DynamicNoiseLayers>) {
+			if (noise_avx2) {
+				// NoisePass::generate8 is used for these chunks, only the first of the 8 voxels is wanted
+				float vals[8] = { val, wg->max_depth, wg->max_depth, wg->max_depth, wg->max_depth, wg->max_depth, wg->max_depth, wg->max_depth };
+				float3 normals[8] = { normal };
+				BlockID bids[8];
+				cave_noise8(SMALL(), pos_world, vals, normals, bids);
+				return bids[0];
+			}
+		}
+		return cave_noise<SMALL>((float3)pos_world, val, normal);
+	}
+
+	block_id TerrainSampler::get (int3 const& pos_world) {
+		BlockID bid = specialized ?
+			sample<LargeNoisePreset, SmallNoisePreset>(pos_world) :
+			sample<DynamicNoiseLayers, DynamicNoiseLayers>(pos_world);
+		return wg->bids[bid];
+	}
+
 #if 0
 #define SCZ (SUBCHUNK_COUNT*SUBCHUNK_COUNT)
 
@@ -321,6 +561,55 @@ namespace worldgen {
 		return smoothstep( smoothstep(val + valb) );
 	}
 	
+	void ColumnFields::compute (int3 const& chunk_pos, WorldGenerator const& wg) {
+		ZoneScoped;
+
+		int2 base = int2(chunk_pos.x, chunk_pos.y) * CHUNK_SIZE;
+
+		for (int y=0; y<CHUNK_SIZE; ++y)
+		for (int x=0; x<CHUNK_SIZE; ++x) {
+			float2 pos_world = float2((float)(x + base.x), (float)(y + base.y));
+
+			tree_density [y][x] = noise_tree_density (wg, wg.noise2, pos_world);
+			grass_density[y][x] = noise_grass_density(wg, wg.noise2, pos_world);
+		}
+	}
+
+	ColumnFields const& ColumnFieldCache::get (int3 const& chunk_pos, WorldGenerator const& wg) {
+		int3 key = int3(chunk_pos.x, chunk_pos.y, 0);
+
+		auto it = map.find(key);
+		if (it != map.end()) {
+			hits++;
+			auto& e = *entries[it->second];
+			e.last_used = ++counter;
+			return e.fields;
+		}
+		misses++;
+
+		uint32_t idx;
+		if (entries.size() < capacity) {
+			idx = (uint32_t)entries.size();
+			entries.emplace_back(std::make_unique<Entry>());
+		} else {
+			// evict least recently used, linear scan is fine since this only happens once per new column
+			idx = 0;
+			for (uint32_t i=1; i<(uint32_t)entries.size(); ++i) {
+				if (entries[i]->last_used < entries[idx]->last_used)
+					idx = i;
+			}
+			map.erase(entries[idx]->pos);
+		}
+
+		auto& e = *entries[idx];
+		e.pos = key;
+		e.last_used = ++counter;
+		map.emplace(key, idx);
+
+		e.fields.compute(chunk_pos, wg);
+		return e.fields;
+	}
+
 	auto chance (double& rand, double prob) {
 		double probd = prob;
 
@@ -333,38 +622,68 @@ namespace worldgen {
 		return happened;
 	}
 
-	void object_pass (Chunks& chunks, chunk_id cid, Neighbours& neighbours, WorldGenerator const* wg) {
+	void object_pass (Chunks& chunks, chunk_id cid, Neighbours& neighbours, WorldGenerator const* wg, ColumnFieldCache& column_cache) {
 		ZoneScoped;
 		
-		OSN::Noise<2> noise (wg->seed);
-		OSN::Noise<3> noise3 (wg->seed);
+		auto& noise3 = wg->noise3;
 
-		int3 chunkpos = chunks.chunks[cid].pos * CHUNK_SIZE;
+		int3 cpos = chunks.chunks[cid].pos;
+		int3 chunkpos = cpos * CHUNK_SIZE;
 
-		// write block with coord relative to this chunk, writes outside of this chunk are ignored
-		auto write_block = [&] (int x, int y, int z, BlockID bid) -> void {
-			int bx, by, bz;
-			int cx, cy, cz;
-			CHUNK_BLOCK_POS(x,y,z, cx,cy,cz, bx,by,bz);
+		// 2D fields are only needed for the surface, so chunks without any grass-able voxels (air, underground) don't compute them
+		ColumnFields const* column = nullptr;
+		column_cache.set_capacity(chunks.load_radius);
 
-			if (abs(cz) <= 1 || abs(cy) <= 1 || abs(cx) <= 1)
-				chunks.write_block(bx,by,bz, neighbours.neighbours[cz+1][cy+1][cx+1], wg->bids[bid]);
-		};
-		auto read_block = [&] (int x, int y, int z) -> block_id {
+		// chunks that got writes deferred into chunks.pending_writes by this pass
+		std::vector<int3> write_targets;
+
+		// write block with coord relative to this chunk, writes into other chunks always go through chunks.pending_writes,
+		// which get applied right away after the pass if the target is loaded
+		auto write_block_ = [&] (int x, int y, int z, BlockID val, bool replace) -> void {
 			int bx, by, bz;
 			int cx, cy, cz;
 			CHUNK_BLOCK_POS(x,y,z, cx,cy,cz, bx,by,bz);
 
-			if (abs(cz) > 1 || abs(cy) > 1 || abs(cx) > 1)
-				return B_NULL;
-			return chunks.read_block(bx,by,bz, neighbours.neighbours[cz+1][cy+1][cx+1]);
+			block_id bid = wg->bids[val];
+
+			if (cx != 0 || cy != 0 || cz != 0) {
+				int3 target = cpos + int3(cx,cy,cz);
+				chunks.pending_writes[target].push_back({ (uint8_t)bx, (uint8_t)by, (uint8_t)bz, replace, bid });
+				if (std::find(write_targets.begin(), write_targets.end(), target) == write_targets.end())
+					write_targets.push_back(target);
+				return;
+			}
+
+			if (!replace || can_replace(chunks.read_block(bx,by,bz, cid), bid, wg))
+				chunks.write_block(bx,by,bz, cid, bid);
+		};
+		auto write_block = [&] (int x, int y, int z, BlockID val) {
+			write_block_(x,y,z, val, false);
 		};
 		auto replace_block = [&] (int x, int y, int z, BlockID val) { // for tree placing
-			auto bid = read_block(x,y,z);
+			write_block_(x,y,z, val, true);
+		};
+		// for the surface checks across the z border, the chunks above and below are always loaded
+		auto read_block = [&] (int x, int y, int z) -> block_id {
+			return neighbours.read_block(chunks, x,y,z);
+		};
 
-			if (bid == wg->bids[B_AIR] || (val == B_TREE_LOG && bid == wg->bids[B_LEAVES])) { // replace air and water with tree log, replace leaves with tree log
-				write_block(x,y,z, val);
+		// placement checks only look at the generated terrain, so that the result does not depend on which neighbours are loaded
+		// or already ran their object pass, blocks outside of this chunk are evaluated from the noise
+		TerrainSampler terrain{ wg };
+		auto read_generated = [&] (int x, int y, int z) -> block_id {
+			if ((unsigned)x < CHUNK_SIZE && (unsigned)y < CHUNK_SIZE && (unsigned)z < CHUNK_SIZE)
+				return chunks.read_block(x,y,z, cid);
+			return terrain.get(chunkpos + int3(x,y,z));
+		};
+		// features only ever get placed into air (except grass, which stays solid), so air and feature blocks are the blocks that were generated as air
+		auto is_free = [&] (block_id bid) {
+			static constexpr BlockID FREE[] = { B_AIR, B_TREE_LOG, B_LEAVES, B_TALLGRASS, B_TORCH, B_GLOWSHROOM,
+				B_CRYSTAL, B_CRYSTAL2, B_CRYSTAL3, B_CRYSTAL4, B_CRYSTAL5, B_CRYSTAL6 };
+			for (auto b : FREE) {
+				if (bid == wg->bids[b]) return true;
 			}
+			return false;
 		};
 
 		auto place_block_ellipsoid = [&] (float3 const& center, float3 const& radius, BlockID bid) {
@@ -395,8 +714,7 @@ namespace worldgen {
 
 			{
 				for (int i=0; i<trunk_h; ++i) {
-					block_id bid = read_block(x,y, z + i);
-					if (bid != wg->bids[B_AIR] && bid != wg->bids[B_LEAVES])
+					if (!is_free(read_generated(x,y, z + i)))
 						return;
 				}
 
@@ -408,8 +726,7 @@ namespace worldgen {
 				for (int cy=start.y; cy<end.y; ++cy)
 				for (int cx=start.x; cx<end.x; ++cx) {
 					if (length_sqr(((float3)int3(cx,cy,cz) + 0.5f - leaf_center) / leaf_radius) <= 1) {
-						block_id bid = read_block(cx,cy,cz);
-						if (!(bid == wg->bids[B_AIR] || bid == wg->bids[B_LEAVES]))
+						if (!is_free(read_generated(cx,cy,cz)))
 							count++;
 					}
 				}
@@ -477,8 +794,11 @@ namespace worldgen {
 					float rand1 = (float)(h & 0xffffffff) * (1.0f / (float)(uint32_t)-1); // uniform in [0, 1]
 					float rand2 = (float)(h >> 32)        * (1.0f / (float)(uint32_t)-1); // uniform in [0, 1]
 
-					float tree_density = noise_tree_density(*wg, noise, float2((float)wx, (float)wy));
-					float grass_density = noise_grass_density(*wg, noise, float2((float)wx, (float)wy));
+					if (!column)
+						column = &column_cache.get(cpos, *wg);
+
+					float tree_density  = column->tree_density [y][x];
+					float grass_density = column->grass_density[y][x];
 
 					if (chunks.blue_noise_tex.sample(wx,wy,wz) < tree_density) {
 						place_tree(x,y,z, rand1, rand2);
@@ -509,10 +829,36 @@ namespace worldgen {
 				}
 			}
 		}
+
+		for (auto& target : write_targets) {
+			chunk_id nid = chunks.query_chunk(target);
+			if (nid != U16_NULL && chunks.chunks[nid].lod == 0) // lod chunks keep the writes queued for the full chunk
+				apply_pending_writes(chunks, nid, wg);
+		}
+	}
+
+	void apply_pending_writes (Chunks& chunks, chunk_id cid, WorldGenerator const* wg) {
+		auto it = chunks.pending_writes.find(chunks[cid].pos);
+		if (it == chunks.pending_writes.end())
+			return;
+
+		ZoneScoped;
+
+		// apply in order of recording, so that tree logs still replace leaves written before them
+		for (auto& w : it->second) {
+			if (!w.replace || can_replace(chunks.read_block(w.x,w.y,w.z, cid), w.bid, wg))
+				chunks.write_block(w.x,w.y,w.z, cid, w.bid);
+		}
+
+		chunks.pending_writes.erase(it);
 	}
 }
 
 void WorldgenJob::execute () {
+	uint64_t t0 = get_timestamp();
+
 	noise_pass.generate();
+
+	time_sec = (float)(get_timestamp() - t0) / (float)timestamp_freq;
 }
 
@@ -3,6 +3,10 @@
 #include "blocks.hpp"
 #include "chunks.hpp"
 
+// TODO: get rid of open_simplex_noise and replace it with a better library that is not object oriented and supports a seed per call
+// ideally also is written with simd usage in mind
+#include "open_simplex_noise/open_simplex_noise.hpp"
+
 inline uint64_t get_seed (std::string_view str) {
 	str = kiss::trim(str);
 
@@ -136,6 +140,28 @@ namespace worldgen {
 	};
 }
 
+// Timings of the noise pass of finished WorldgenJobs, split by which noise layer path was used
+struct WorldgenPerfStats {
+	float	total_sec[2] = {}; // [0] dynamic  [1] specialized preset
+	int		count[2] = {};
+
+	void push (bool specialized, float sec) {
+		total_sec[specialized] += sec;
+		count[specialized]++;
+	}
+
+	void imgui () {
+		static constexpr char const* NAMES[2] = { "dynamic", "preset" };
+		for (int i=0; i<2; ++i) {
+			float ms = count[i] > 0 ? total_sec[i] / (float)count[i] * 1000 : 0;
+			float chunks_per_sec = total_sec[i] > 0 ? (float)count[i] / total_sec[i] : 0;
+			ImGui::Text("noise pass %-8s: %6d chunks  %7.3f ms/chunk  %6.1f chunks/s per thread", NAMES[i], count[i], ms, chunks_per_sec);
+		}
+		if (ImGui::Button("reset perf stats"))
+			*this = {};
+	}
+};
+
 struct WorldGenerator {
 	SERIALIZE(WorldGenerator, seed_str, savefile, water_level, base_depth,
 		large_noise_flatten, small_noise_flatten,
@@ -148,6 +174,10 @@ struct WorldGenerator {
 	std::string seed_str = "test2";
 	uint64_t seed; // only calculated on WorldGenerator copy into _threads_world_gen
 
+	// permutation tables for seed, built once in init_seed() and then only read (concurrently) by worldgen jobs and object_pass
+	OSN::Noise<2> noise2;
+	OSN::Noise<3> noise3;
+
 	std::string savefile = "../saves/test";
 
 	struct NoiseParam {
@@ -212,11 +242,21 @@ struct WorldGenerator {
 	float grass_density_amp = .5f;
 
 	worldgen::BlockIDs	bids;
+
+	WorldgenPerfStats	perf; // accumulated on main thread (on world_gen, not _threads_world_gen)
 	
 	WorldGenerator () {
 		bids.load();
 	}
 
+	// only call on _threads_world_gen while no worldgen jobs are running
+	void init_seed () {
+		ZoneScoped;
+		seed = get_seed(seed_str);
+		noise2 = OSN::Noise<2>((int64_t)seed);
+		noise3 = OSN::Noise<3>((int64_t)seed);
+	}
+
 	static void imgui_noise_layers (char const* name, std::vector<NoiseParam>& layers) {
 		if (!imgui_push(name)) return;
 
@@ -265,36 +305,55 @@ struct WorldGenerator {
 
 		ImGui::Checkbox("disable_grass", &disable_grass);
 
+		ImGui::Spacing();
+		perf.imgui();
+
 		ImGui::PopItemWidth();
 		imgui_pop();
 	}
 };
 
-// TODO: get rid of open_simplex_noise and replace it with a better library that is not object oriented and supports a seed per call
-// ideally also is written with simd usage in mind
-#include "open_simplex_noise/open_simplex_noise.hpp"
-
 namespace worldgen {
-	struct NoisePass {
-		int3					chunk_pos;
-		WorldGenerator const*	wg;
-		OSN::Noise<3>			noise3;
-
-		// output
-	#define LARGE_NOISE_SIZE 4
-	#define LARGE_NOISE_CHUNK_SIZE (CHUNK_SIZE / LARGE_NOISE_SIZE)
-	#define LARGE_NOISE_COUNT (LARGE_NOISE_CHUNK_SIZE +1)
+	// Noise layers with the layer count, modes and cutoffs known at compile time
+	// Each layer is an int of NoiseLayerFlags
+	// periods, strengths and cutoff values are still read from the NoiseParams, so tweaking those in imgui keeps using the specialized path
+	enum NoiseLayerFlags : int {
+		NL_ADD		= 0,
+		NL_ERODE	= 1,
+		NL_CUTOFF	= 2,
+	};
+	inline int noise_layer_flags (WorldGenerator::NoiseParam const& n) {
+		return (n.mode == 1 ? NL_ERODE : NL_ADD) | (n.cutoff ? NL_CUTOFF : 0);
+	}
 
-		// NOTE: deriv is opposite of real derivative -> vector pointing to negative values, ie. air, because I prefer it this way around
+	template <int... LAYERS>
+	struct NoiseLayerPreset {
+		static constexpr int COUNT = (int)sizeof...(LAYERS);
 		
-		// float value; float3 deriv;
-		float large_noise[LARGE_NOISE_COUNT][LARGE_NOISE_COUNT][LARGE_NOISE_COUNT][4];
-		block_id voxels[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE];
-
-		NoisePass (int3 chunk_pos, WorldGenerator const* wg):
-			chunk_pos{chunk_pos}, wg{wg}, noise3{(int64_t)wg->seed} {
+		static bool matches (std::vector<WorldGenerator::NoiseParam> const& layers) {
+			static constexpr int flags[] = { LAYERS... };
 
+			if (layers.size() != COUNT) return false;
+			for (int i=0; i<COUNT; ++i) {
+				if ((layers[i].mode != 0 && layers[i].mode != 1) || noise_layer_flags(layers[i]) != flags[i])
+					return false;
+			}
+			return true;
 		}
+	};
+	// Runtime loop over NoiseParams, used when the config does not match a preset (ie. while layers are being edited in imgui)
+	struct DynamicNoiseLayers {};
+
+	// built-in presets, match the default large_noise and small_noise layers
+	typedef NoiseLayerPreset<NL_ADD, NL_ADD>			LargeNoisePreset;
+	typedef NoiseLayerPreset<NL_ADD, NL_ADD|NL_CUTOFF>	SmallNoisePreset;
+
+	// noise functions of the terrain, shared by NoisePass and TerrainSampler
+	struct TerrainNoise {
+		WorldGenerator const*	wg;
+		OSN::Noise<3> const&	noise3; // shared per seed in wg
+
+		TerrainNoise (WorldGenerator const* wg): wg{wg}, noise3{wg->noise3} {}
 
 		float noise01 (float3 const& pos, float period, float seed) {
 			float3 p = pos / period; // period is inverse frequency
@@ -309,7 +368,58 @@ namespace worldgen {
 			return noise3.eval<float>(p.x, p.y, p.z) * period * 0.25f;
 		}
 
-		void apply_noise_layers (float& depth, float& seed, float3 const& pos, std::vector<WorldGenerator::NoiseParam> const& layers) {
+		// noise01 and noise for 8 positions at once, only call if cpu_has_avx2()
+		__m256 noise01_8 (__m256 x, __m256 y, __m256 z, float period, float seed) {
+			__m256 p = _mm256_set1_ps(period);
+			__m256 val = noise3.eval8(_mm256_div_ps(x, p), _mm256_div_ps(y, p), _mm256_div_ps(z, p));
+
+			return _mm256_add_ps(_mm256_mul_ps(val, _mm256_set1_ps(0.5f)), _mm256_set1_ps(0.5f));
+		}
+		__m256 noise8 (__m256 x, __m256 y, __m256 z, float period, float seed) {
+			__m256 p = _mm256_set1_ps(period);
+			__m256 val = noise3.eval8(_mm256_div_ps(x, p), _mm256_div_ps(y, p), _mm256_div_ps(z, p));
+
+			return _mm256_mul_ps(_mm256_mul_ps(val, p), _mm256_set1_ps(0.25f));
+		}
+
+		template <int FLAGS>
+		void apply_noise_layer (float& depth, float& seed, float3 const& pos, WorldGenerator::NoiseParam const& n) {
+			float val = noise(pos, n.period, seed++) * n.strength;
+			if constexpr (FLAGS & NL_CUTOFF) val = max(val, n.cutoff_val);
+
+			if constexpr (FLAGS & NL_ERODE) {
+				if (depth > 0)
+					depth -= val;
+			} else {
+				depth += val;
+			}
+		}
+		// fully unrolled, no branching on mode or cutoff
+		template <int... LAYERS>
+		void apply_noise_layers (NoiseLayerPreset<LAYERS...>, float& depth, float& seed, float3 const& pos, std::vector<WorldGenerator::NoiseParam> const& layers) {
+			WorldGenerator::NoiseParam const* n = layers.data();
+			(apply_noise_layer<LAYERS>(depth, seed, pos, *n++), ...);
+		}
+		// same for 8 positions at once, only the presets are vectorized
+		template <int FLAGS>
+		void apply_noise_layer8 (__m256& depth, float& seed, __m256 x, __m256 y, __m256 z, WorldGenerator::NoiseParam const& n) {
+			__m256 val = _mm256_mul_ps(noise8(x, y, z, n.period, seed++), _mm256_set1_ps(n.strength));
+			if constexpr (FLAGS & NL_CUTOFF) val = _mm256_max_ps(val, _mm256_set1_ps(n.cutoff_val));
+
+			if constexpr (FLAGS & NL_ERODE) {
+				__m256 eroded = _mm256_sub_ps(depth, val);
+				depth = _mm256_blendv_ps(depth, eroded, _mm256_cmp_ps(depth, _mm256_setzero_ps(), _CMP_GT_OQ));
+			} else {
+				depth = _mm256_add_ps(depth, val);
+			}
+		}
+		template <int... LAYERS>
+		void apply_noise_layers8 (NoiseLayerPreset<LAYERS...>, __m256& depth, float& seed, __m256 x, __m256 y, __m256 z, std::vector<WorldGenerator::NoiseParam> const& layers) {
+			WorldGenerator::NoiseParam const* n = layers.data();
+			(apply_noise_layer8<LAYERS>(depth, seed, x, y, z, *n++), ...);
+		}
+
+		void apply_noise_layers (DynamicNoiseLayers, float& depth, float& seed, float3 const& pos, std::vector<WorldGenerator::NoiseParam> const& layers) {
 			for (auto& n : layers) {
 				float val = noise(pos, n.period, seed++) * n.strength;
 				if (n.cutoff) val = max(val, n.cutoff_val);
@@ -326,18 +436,84 @@ namespace worldgen {
 			}
 		}
 
+		template <typename LARGE>
 		float calc_large_noise (float3 const& pos);
+		template <typename SMALL>
 		BlockID cave_noise (float3 const& pos, float large_noise, float3 const& normal);
 
+		// cave_noise for the 8 voxels pos + (0..7,0,0), the small noise layers and the modifier are evaluated for all 8 at once
+		// voxels with large_noise >= max_depth are B_UNBREAKIUM, like NoisePass::generate does it, only call if cpu_has_avx2()
+		template <int... LAYERS>
+		void cave_noise8 (NoiseLayerPreset<LAYERS...>, int3 const& pos, float const* large_noise, float3 const* normals, BlockID* bids);
+
+		// rest of cave_noise after the small noise layers and the modifier
+		BlockID cave_block (float3 const& pos, float depth, float modifer, float3 const& normal, float seed);
+	};
+
+	#define LARGE_NOISE_SIZE 4
+	#define LARGE_NOISE_CHUNK_SIZE (CHUNK_SIZE / LARGE_NOISE_SIZE)
+	#define LARGE_NOISE_COUNT (LARGE_NOISE_CHUNK_SIZE +1)
+
+	struct NoisePass : TerrainNoise {
+		int3					chunk_pos;
+		int						lod; // 0: full chunk, >0: (CHUNK_SIZE >> lod)^3 voxels packed into voxels
+
+		bool					specialized; // used LargeNoisePreset and SmallNoisePreset
+
+		// output
+
+		// NOTE: deriv is opposite of real derivative -> vector pointing to negative values, ie. air, because I prefer it this way around
+		
+		// float value; float3 deriv;
+		float large_noise[LARGE_NOISE_COUNT][LARGE_NOISE_COUNT][LARGE_NOISE_COUNT][4];
+		block_id voxels[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE];
+
+		NoisePass (int3 chunk_pos, int lod, WorldGenerator const* wg):
+			TerrainNoise{wg}, chunk_pos{chunk_pos}, lod{lod} {
+
+		}
+
+		template <typename LARGE>
+		void generate_large_noise ();
+
+		template <typename LARGE, typename SMALL>
+		void generate ();
+		// generate with cave_noise8, for presets if cpu_has_avx2()
+		template <typename LARGE, typename SMALL>
+		void generate8 ();
+		template <typename LARGE, typename SMALL>
+		void generate_lod ();
+
 		void generate ();
 	};
+
+	// generated terrain block (before the object pass) at single world positions, bit for bit what NoisePass generates there
+	// for checks that reach into chunks that may not be loaded, the large noise grid points are cached
+	struct TerrainSampler : TerrainNoise {
+		struct LargeNoise {
+			float	val[4]; // float value; float3 deriv; like NoisePass::large_noise
+		};
+		chunk_pos_map<LargeNoise> large_noise; // keyed by grid point (world pos / LARGE_NOISE_SIZE)
+
+		bool specialized; // use LargeNoisePreset and SmallNoisePreset like NoisePass::generate
+
+		TerrainSampler (WorldGenerator const* wg);
+
+		block_id get (int3 const& pos_world);
+
+	private:
+		template <typename LARGE>
+		LargeNoise const& get_large_noise (int3 const& grid);
+		template <typename LARGE, typename SMALL>
+		BlockID sample (int3 const& pos_world);
+	};
 }
 
 struct WorldgenJob {
 	worldgen::NoisePass		noise_pass;
+	float					time_sec; // time noise_pass took, for WorldgenPerfStats
 
-	// unfortunately need ctor because OSN::Noise<3> does work in it's ctor, which it shouldn't
-	WorldgenJob (int3 chunk_pos, WorldGenerator const* wg): noise_pass{chunk_pos, wg} {}
+	WorldgenJob (int3 chunk_pos, int lod, WorldGenerator const* wg): noise_pass{chunk_pos, lod, wg} {}
 
 	void execute ();
 };
@@ -353,8 +529,8 @@ namespace worldgen {
 			return neighbours[z+1][y+1][x+1];
 		}
 
-		// read block with coord relative to center chunk
-		chunk_id read_block (Chunks& chunks, int x, int y, int z) const {
+		// read block with coord relative to center chunk, returns B_NULL for missing neighbours
+		block_id read_block (Chunks& chunks, int x, int y, int z) const {
 			assert(x >= -CHUNK_SIZE && x < CHUNK_SIZE*2 &&
 			       y >= -CHUNK_SIZE && y < CHUNK_SIZE*2 &&
 			       z >= -CHUNK_SIZE && z < CHUNK_SIZE*2);
@@ -363,9 +539,72 @@ namespace worldgen {
 			CHUNK_BLOCK_POS(x,y,z, cx,cy,cz, bx,by,bz);
 
 			chunk_id chunk = neighbours[cz+1][cy+1][cx+1];
+			if (chunk == U16_NULL)
+				return B_NULL;
 			return chunks.read_block(bx,by,bz, chunk);
 		}
 	};
 
-	void object_pass (Chunks& chunks, chunk_id cid, Neighbours& neighbours, WorldGenerator const* wg);
+	// 2D worldgen fields that only depend on x,y (tree and grass density, later biome maps)
+	// computed once per chunk column and shared by all vertically stacked chunks
+	struct ColumnFields {
+		float tree_density [CHUNK_SIZE][CHUNK_SIZE];
+		float grass_density[CHUNK_SIZE][CHUNK_SIZE];
+
+		void compute (int3 const& chunk_pos, WorldGenerator const& wg);
+	};
+
+	// LRU cache of ColumnFields keyed by chunk column, only used by object_pass on the main thread
+	// needs to be cleared when _threads_world_gen changes
+	struct ColumnFieldCache {
+		uint32_t capacity = 0; // 32KB per column, enough for all columns inside the load radius (see set_capacity)
+
+		struct Entry {
+			int3			pos; // (column x, column y, 0)
+			uint64_t		last_used;
+			ColumnFields	fields;
+		};
+		std::vector<std::unique_ptr<Entry>>	entries;
+		chunk_pos_map<uint32_t>				map; // column -> index into entries
+
+		uint64_t	counter = 0;
+		uint32_t	hits = 0, misses = 0;
+
+		ColumnFields const& get (int3 const& chunk_pos, WorldGenerator const& wg);
+
+		// fit every column touched by the circle of load_radius, so that columns only get evicted once they are unloaded
+		void set_capacity (float load_radius) {
+			float r = load_radius / CHUNK_SIZE + 1;
+			uint32_t cap = (uint32_t)ceili(PI * r*r);
+			if (cap < entries.size())
+				clear(); // rare, only when load_radius shrinks
+			capacity = cap;
+		}
+
+		void clear () {
+			entries.clear();
+			entries.shrink_to_fit();
+			map.clear();
+			counter = 0;
+			hits = 0;
+			misses = 0;
+		}
+
+		void imgui () {
+			ImGui::Text("column field cache: %3d / %3d columns  %6d hits %6d misses (%5.1f %% hits)",
+				(int)entries.size(), capacity, hits, misses, (float)hits / (float)max((int)(hits + misses), 1) * 100);
+		}
+	};
+
+	// replace air, and replace leaves with tree log
+	inline bool can_replace (block_id cur, block_id val, WorldGenerator const* wg) {
+		return cur == wg->bids[B_AIR] || (val == wg->bids[B_TREE_LOG] && cur == wg->bids[B_LEAVES]);
+	}
+
+	// Neighbours can contain nulls (except for the chunks directly above and below),
+	// writes into other chunks go through chunks.pending_writes and are applied right away if the target is loaded
+	void object_pass (Chunks& chunks, chunk_id cid, Neighbours& neighbours, WorldGenerator const* wg, ColumnFieldCache& column_cache);
+
+	// apply writes deferred by object_pass of neighbouring chunks, once the chunk arrives or right after the pass if it is loaded
+	void apply_pending_writes (Chunks& chunks, chunk_id cid, WorldGenerator const* wg);
 }